@@ -10,7 +10,12 @@ LOCAL_MODULE := bigcache
 LOCAL_SRC_FILES := \
     src/bigcache_index.c \
     src/bigcache_packer.c \
+    src/bigcache_layout.c \
+    src/bigcache_writer.c \
     src/uffd_handler.c \
+    src/bigcache_broker.c \
+    src/fault_daemon.c \
+    src/bigcache_residency.c \
     src/preloader.c \
     src/main.c
 
@@ -38,7 +43,11 @@ include $(BUILD_EXECUTABLE)
 # BigCache Generator - runs on device to extract real file data
 include $(CLEAR_VARS)
 LOCAL_MODULE := genbigcache
-LOCAL_SRC_FILES := src/generate_bigcache.c
+LOCAL_SRC_FILES := \
+    src/generate_bigcache.c \
+    src/bigcache_writer.c
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/include
 LOCAL_CFLAGS := -Wall -Wextra -O2 -D_GNU_SOURCE
 LOCAL_LDLIBS := -llog
 include $(BUILD_EXECUTABLE)
@@ -49,6 +58,9 @@ LOCAL_MODULE := preloader
 LOCAL_SRC_FILES := \
     src/bigcache_index.c \
     src/uffd_handler.c \
+    src/bigcache_broker.c \
+    src/fault_daemon.c \
+    src/bigcache_residency.c \
     src/preloader.c
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/include
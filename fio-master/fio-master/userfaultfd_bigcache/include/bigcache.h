@@ -50,7 +50,8 @@ typedef struct __attribute__((packed)) {
     uint64_t total_size;         /* BigCache 文件总大小 */
     uint32_t checksum;           /* CRC32 校验和 */
     uint32_t flags;              /* 标志位 */
-    uint8_t  reserved[32];       /* 保留字段 */
+    uint64_t file_stat_offset;   /* 文件状态表起始偏移，0 表示未记录（旧文件）*/
+    uint8_t  reserved[24];       /* 保留字段 */
 } BigCacheHeader;
 
 /*
@@ -82,6 +83,15 @@ typedef struct __attribute__((packed)) {
     char     path[MAX_PATH_LEN]; /* 文件路径 */
 } BigCacheFileEntry;
 
+/*
+ * 文件状态表项（与文件名表一一对应）
+ * 打包时源文件的 mtime 和 inode，运行时不一致说明文件已被替换或原地改写
+ */
+typedef struct __attribute__((packed)) {
+    uint64_t mtime_ns;           /* 修改时间（纳秒），0 表示未记录 */
+    uint64_t ino;                /* inode 号 */
+} BigCacheFileStat;
+
 /*
  * 运行时索引结构
  * 用于快速查找：(file_path, offset) -> bigcache_offset
@@ -127,10 +137,23 @@ typedef struct {
     /* 索引表 */
     BigCachePageIndex *page_index;   /* 页面索引数组 */
     BigCacheFileEntry *file_table;   /* 文件名表数组 */
+    BigCacheFileStat *file_stats;    /* 文件状态表，旧文件为 NULL */
     
     /* 运行时查找表 */
     PageLookupTable *lookup_table;
     
+    /* 每个文件的页面存在位图（bit i = 源文件第 i 页在 BigCache 中）*/
+    uint8_t **page_bitmaps;
+    uint32_t *bitmap_pages;      /* 每个位图覆盖的页数 */
+    uint32_t **page_slots;       /* 源文件页 -> 数据区序号 + 1（0 为不在 BigCache 中），与位图同长 */
+    
+    /*
+     * 已服务位图：数据区第 i 页已拷贝给应用（缺页安装、read hook、shadow 填充），
+     * 本进程不再需要它常驻，驻留管理器据此释放
+     */
+    uint8_t *served_bitmap;
+    uint32_t served_pages;
+    
     /* 统计信息 */
     uint64_t hit_count;          /* 命中次数 */
     uint64_t miss_count;         /* 未命中次数 */
@@ -151,6 +174,8 @@ void bigcache_destroy(BigCacheContext *ctx);
 
 /* 加载 BigCache 文件 */
 int bigcache_load(BigCacheContext *ctx, const char *path);
+/* 从已打开的 fd 加载，成功或失败后 fd 都归上下文所有 */
+int bigcache_load_fd(BigCacheContext *ctx, int fd);
 int bigcache_unload(BigCacheContext *ctx);
 
 /* 页面查找 */
@@ -163,11 +188,42 @@ int bigcache_lookup_offset(BigCacheContext *ctx,
                            uint64_t offset,
                            uint64_t *out_bigcache_offset);
 
+/* 查找但不计入命中统计（用于预取探测）*/
+void* bigcache_peek(BigCacheContext *ctx,
+                    const char *file_path,
+                    uint64_t offset);
+
+/* 按路径查找文件表条目，返回 file_id，不存在返回 -1 */
+int bigcache_find_file(BigCacheContext *ctx, const char *file_path);
+
+/* 源文件 [offset, offset + length) 内在 BigCache 中的页数 */
+size_t bigcache_count_cached(BigCacheContext *ctx, int file_id,
+                             uint64_t offset, uint64_t length);
+
+/*
+ * 源文件 [offset, offset + length) 内缓存页在数据区中的最大序号 + 1，没有缓存页返回 0。
+ * 后台预热按数据区顺序推进，预热到该序号时区间内的缓存页全部就绪
+ */
+uint32_t bigcache_range_end_slot(BigCacheContext *ctx, int file_id,
+                                 uint64_t offset, uint64_t length);
+
+/* 源文件 offset 所在页是否在 BigCache 中 */
+int bigcache_page_cached(BigCacheContext *ctx, int file_id, uint64_t offset);
+
+/* 源文件 offset 所在页在 BigCache 映射中的数据，不在 BigCache 中返回 NULL（计为已服务）*/
+const void* bigcache_file_page(BigCacheContext *ctx, int file_id, uint64_t offset);
+
+/* 数据区 [slot, slot + count) 已拷贝给应用 */
+void bigcache_mark_served(BigCacheContext *ctx, uint32_t slot, uint32_t count);
+int bigcache_slot_served(BigCacheContext *ctx, uint32_t slot);
+
 /* 预热相关 */
 int bigcache_preheat(BigCacheContext *ctx);
 int bigcache_preheat_range(BigCacheContext *ctx, 
                            uint32_t start_order, 
                            uint32_t end_order);
+/* 分段预热全部页面后调用：切换随机访问提示并 mlock */
+int bigcache_preheat_finish(BigCacheContext *ctx);
 
 /* 统计信息 */
 void bigcache_print_stats(BigCacheContext *ctx);
@@ -175,6 +231,7 @@ void bigcache_reset_stats(BigCacheContext *ctx);
 
 /* 工具函数 */
 uint32_t bigcache_crc32(const void *data, size_t len);
+uint32_t bigcache_crc32_update(uint32_t crc, const void *data, size_t len);
 int bigcache_verify(BigCacheContext *ctx);
 
 /*
@@ -185,6 +242,7 @@ typedef struct {
     uint64_t offset;
     uint32_t size;
     uint32_t access_order;
+    float    probability;        /* 冷启动中被访问的概率（多 trace 统计，默认 1.0）*/
 } PackerPageEntry;
 
 typedef struct {
@@ -207,7 +265,57 @@ int packer_add_page(BigCachePacker *packer,
                     const char *file_path,
                     uint64_t offset,
                     uint32_t access_order);
+int packer_add_page_prob(BigCachePacker *packer,
+                         const char *file_path,
+                         uint64_t offset,
+                         uint32_t access_order,
+                         float probability);
 int packer_build(BigCachePacker *packer, const char *output_path);
 int packer_load_from_csv(BigCachePacker *packer, const char *csv_path);
 
+/*
+ * 存储设备代价模型（与 tools/simulate_performance.py 的 StorageParams 一致）
+ */
+typedef struct {
+    const char *name;            /* 设备名 */
+    double sequential_read_mbps; /* 顺序读速度 MB/s */
+    double random_read_iops;     /* 随机读 IOPS */
+    double seek_time_ms;         /* 寻道时间 ms */
+    double page_read_us;         /* 随机读取单个 4K 页的时间 us */
+} StorageCostModel;
+
+/* 按名称获取内置代价模型（hdd/ssd/nvme/emmc/ufs），未知返回 NULL */
+const StorageCostModel* packer_get_cost_model(const char *name);
+
+/*
+ * 预算选择报告
+ */
+typedef struct {
+    size_t candidate_pages;      /* 候选页数 */
+    size_t selected_pages;       /* 入选页数 */
+    size_t readahead_pages;      /* 回退时可被内核预读覆盖的候选页数 */
+    size_t dropped_files;        /* 页全部落选、从文件表中去掉的文件数 */
+    double expected_accesses;    /* 候选页期望访问次数（概率之和）*/
+    double covered_accesses;     /* 入选页期望访问次数 */
+    double max_saving_ms;        /* 全部候选页都入选时的预测节省 */
+    double predicted_saving_ms;  /* 入选页的预测节省 */
+    double bigcache_read_ms;     /* 顺序读取入选页的时间 */
+} BudgetReport;
+
+/*
+ * 在预算内选择页面（原地裁剪打包器，保持原有布局顺序）
+ *
+ * 每页预测节省 = 访问概率 × 关键路径权重 × (回退读取代价 - 顺序读取代价)
+ *   关键路径权重 = 1 + critical_weight × (1 - 名次 / 页数)，越早访问越关键
+ *   回退读取代价：同文件前一页紧邻在前访问时按顺序读计（内核预读），否则按随机 4K 读计
+ * 按预测节省从大到小贪心选择 budget_pages 个页面
+ */
+int packer_select_budget(BigCachePacker *packer,
+                         size_t budget_pages,
+                         const StorageCostModel *model,
+                         double critical_weight,
+                         BudgetReport *report);
+void packer_print_budget_report(const BudgetReport *report,
+                                const StorageCostModel *model);
+
 #endif /* BIGCACHE_H */
@@ -0,0 +1,65 @@
+/*
+ * BigCache 代理进程（broker）
+ *
+ * 常驻进程把 BigCache.bin 读入一个密封的 memfd 并锁定在内存中，
+ * 预加载器连上 Unix 套接字后经 SCM_RIGHTS 收到该 memfd，直接映射使用：
+ * - 各进程映射同一组物理页，不再各自读文件、预热和 mlock
+ * - memfd 已加 F_SEAL_WRITE/SHRINK/GROW，接收方映射后内容和大小都不会再变
+ *
+ * 套接字路径以 '@' 开头时使用抽象命名空间（Android 上无需可写目录）
+ */
+
+#ifndef BIGCACHE_BROKER_H
+#define BIGCACHE_BROKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BROKER_MAGIC    0x52424342  /* "BCBR" */
+#define BROKER_VERSION  1
+
+/* 连接建立后代理发送的消息，memfd 随消息以 SCM_RIGHTS 附带 */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;               /* memfd 中 BigCache 的字节数 */
+} BrokerHello;
+
+typedef struct {
+    int memfd;                   /* 密封的 BigCache 副本 */
+    size_t size;
+    void *mapped;                /* 只读映射，用于 mlock 保持常驻 */
+    int locked;                  /* mlock 是否成功 */
+    double load_ms;              /* 读入 memfd 的耗时 */
+    uint64_t clients_served;
+    uint64_t clients_refused;    /* 凭据不可信被拒绝的连接 */
+} BigCacheBroker;
+
+/* 把 BigCache 文件读入密封 memfd 并锁定，成功返回 0，失败返回 -errno */
+int broker_load(BigCacheBroker *broker, const char *bigcache_path);
+void broker_unload(BigCacheBroker *broker);
+
+/* 在 socket_path 上监听并把 memfd 分发给 broker_peer_trusted 的对端，直到 *stop 非零 */
+int broker_serve(BigCacheBroker *broker, const char *socket_path,
+                 volatile sig_atomic_t *stop);
+
+/*
+ * 预加载器侧：从代理取得 memfd，校验代理进程凭据、密封和大小。
+ * 成功返回 fd（O_CLOEXEC），代理不可信返回 -EPERM，其他失败返回 -errno；
+ * timeout_ms 限制连接与接收的等待
+ */
+int broker_fetch(const char *socket_path, int timeout_ms, uint64_t *out_size);
+
+/* 填充 sockaddr_un，'@' 开头为抽象命名空间，返回地址长度，路径过长返回 0 */
+socklen_t broker_socket_addr(const char *socket_path, struct sockaddr_un *addr);
+
+/*
+ * 按 SO_PEERCRED 检查对端：与本进程同 uid，或为 root / system（Android AID_SYSTEM）时返回 1。
+ * pid 非 NULL 时写入内核给出的对端 pid，取不到凭据时返回 0
+ */
+int broker_peer_trusted(int sock, pid_t *pid);
+
+#endif /* BIGCACHE_BROKER_H */
@@ -0,0 +1,105 @@
+/*
+ * BigCache 布局优化器
+ *
+ * 位于打包器之前：对 BigCachePacker 中的页面重新排序，
+ * 决定每个页面在 BigCache.bin 中的位置，并给出布局质量评分。
+ */
+
+#ifndef BIGCACHE_LAYOUT_H
+#define BIGCACHE_LAYOUT_H
+
+#include <stdint.h>
+#include "bigcache.h"
+
+/*
+ * 布局策略
+ */
+typedef enum {
+    LAYOUT_FIRST_ACCESS = 0,     /* 按首次访问顺序（原始行为）*/
+    LAYOUT_CO_ACCESS,            /* 共访问窗口聚类：窗口内同文件页面聚在一起 */
+    LAYOUT_FILE_WINDOW,          /* 时间窗口内按 (文件, 偏移) 排序，利于内核预读 */
+    LAYOUT_PHASE_CHUNK,          /* 按启动阶段切块，阶段内按文件聚类 */
+    LAYOUT_NUM_STRATEGIES
+} LayoutStrategy;
+
+/*
+ * 布局参数
+ */
+typedef struct {
+    uint32_t window_pages;       /* 共访问/文件排序窗口大小（页）*/
+    uint32_t phase_gap;          /* access_order 间隔超过该值视为新阶段 */
+    uint32_t max_phase_pages;    /* 单个阶段最大页数 */
+    uint32_t read_pages;         /* 评分模型中一次顺序读取的页数（预读窗口）*/
+} LayoutOptions;
+
+/*
+ * 布局质量评分
+ * 按首次访问顺序回放所有页面，模拟对 BigCache.bin 的读取。
+ * 只衡量布局与本次 trace 的吻合程度，first-access 按构造总是最优；
+ * 其余策略针对的回退读预读和跨启动波动不在模型内，不能据此自动选策略
+ */
+typedef struct {
+    uint64_t num_pages;          /* 页面数 */
+    uint64_t expected_reads;     /* 预期读 IO 次数（越少越好）*/
+    double   avg_ooo_distance;   /* 平均乱序距离：|布局位置 - 访问名次|（页）*/
+    uint64_t max_ooo_distance;   /* 最大乱序距离（页）*/
+    uint64_t backward_jumps;     /* 回放时向后跳转的次数 */
+    uint64_t file_switches;      /* 布局中相邻页面属于不同文件的次数 */
+    uint32_t num_phases;         /* 识别出的启动阶段数 */
+} LayoutScore;
+
+/*
+ * 多 trace 共识统计
+ * 留一法（leave-one-out）：用其余 trace 构建布局，评估在未参与构建的 trace 上的命中率
+ */
+#define CONSENSUS_MAX_TRACES 64
+
+typedef struct {
+    uint32_t num_traces;         /* trace 数量 */
+    uint32_t min_runs;           /* 入选所需的最少出现次数 */
+    uint64_t union_pages;        /* 所有 trace 的页面并集 */
+    uint64_t selected_pages;     /* 入选页面数 */
+    double   avg_pages_per_trace;/* 每个 trace 的平均页面数 */
+    double   loo_hit_rate;       /* 共识布局在留出 trace 上的平均命中率 */
+    double   loo_avg_pages;      /* 留一法构建的平均布局页数 */
+    double   single_hit_rate;    /* 对照：单 trace 布局在其它 trace 上的平均命中率 */
+    double   single_avg_pages;   /* 对照：单 trace 布局的平均页数 */
+} ConsensusReport;
+
+/* 默认参数 */
+void layout_default_options(LayoutOptions *opts);
+
+/* 策略名称 <-> 枚举 */
+const char* layout_strategy_name(LayoutStrategy strategy);
+int layout_strategy_from_name(const char *name);
+
+/* 按指定策略重排打包器中的页面 */
+int layout_optimize(BigCachePacker *packer,
+                    LayoutStrategy strategy,
+                    const LayoutOptions *opts);
+
+/* 计算当前页面顺序的布局评分 */
+int layout_score(const BigCachePacker *packer,
+                 const LayoutOptions *opts,
+                 LayoutScore *score);
+
+/*
+ * 从 N 个 read_sequence.csv 构建共识布局
+ * 计算每页的出现概率和首次访问名次中位数，出现比例 >= min_ratio 的页面
+ * 按稳健名次排序后加入打包器（probability 字段为出现概率）
+ */
+int layout_consensus(BigCachePacker *packer,
+                     const char *const *trace_paths,
+                     int num_traces,
+                     double min_ratio,
+                     ConsensusReport *report);
+
+void layout_print_consensus_report(const ConsensusReport *report);
+
+/* 打印评分 */
+void layout_print_score(const char *label, const LayoutScore *score);
+
+/* 以 bigcache_layout.csv 格式输出当前页面顺序 */
+int layout_write_csv(const BigCachePacker *packer, const char *csv_path);
+
+#endif /* BIGCACHE_LAYOUT_H */
@@ -0,0 +1,94 @@
+/*
+ * BigCache 驻留管理
+ *
+ * 预热后整个 BigCache 被 mlock，启动结束后这些页仍然钉在内存中。
+ * 驻留管理线程按启动阶段和 /proc/pressure/memory（PSI）逐级放手：
+ *
+ *   STARTUP   启动阶段，保持全部锁定
+ *   SETTLED   启动完成：已服务页 munlock + MADV_COLD（留在页缓存，优先回收）
+ *   PRESSURE  some avg10 >= some_threshold：已服务页 MADV_PAGEOUT 立即回收
+ *   CRITICAL  full avg10 >= full_threshold：未服务页也 MADV_PAGEOUT
+ *
+ * 已服务页的内容已拷贝进应用的映射，释放后再次需要时从 BigCache 文件重新读入，
+ * 只是变慢，不影响正确性。级别只升不降，释放过的页不再重新锁定。
+ * psi_path 可指向格式相同的普通文件，用于测试时模拟压力
+ */
+
+#ifndef BIGCACHE_RESIDENCY_H
+#define BIGCACHE_RESIDENCY_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "bigcache.h"
+
+#define RESIDENCY_DEFAULT_PSI_PATH  "/proc/pressure/memory"
+
+typedef enum {
+    RESIDENCY_STARTUP = 0,
+    RESIDENCY_SETTLED,
+    RESIDENCY_PRESSURE,
+    RESIDENCY_CRITICAL
+} ResidencyLevel;
+
+typedef struct {
+    char psi_path[256];
+    int poll_ms;                 /* PSI 采样间隔 */
+    int startup_ms;              /* 预热完成后多久视为启动结束，0 只由 residency_startup_done 结束 */
+    double some_threshold;       /* some avg10（%）*/
+    double full_threshold;       /* full avg10（%）*/
+} ResidencyConfig;
+
+typedef struct {
+    uint64_t ticks;
+    uint64_t psi_errors;         /* PSI 读取失败（内核未开启 PSI 时按无压力处理）*/
+    uint64_t unlocked_pages;
+    uint64_t cold_pages;
+    uint64_t pageout_pages;
+    uint64_t madvise_calls;
+    uint64_t madvise_errors;     /* 内核不支持 MADV_COLD/PAGEOUT 时只有 munlock 生效 */
+    double last_some;
+    double last_full;
+    int level;
+    int max_level;
+    double settled_ms;           /* 从管理器启动到离开 STARTUP 的时间，-1 未离开 */
+    double release_ms;           /* munlock 与 madvise 的累计耗时 */
+} ResidencyStats;
+
+typedef struct {
+    BigCacheContext *bigcache;
+    ResidencyConfig config;
+
+    uint8_t *state;              /* 每个数据区页：0 锁定，1 COLD，2 PAGEOUT */
+    int all_unlocked;            /* 启动结束时已整体 munlock */
+    pthread_t thread;
+    int running;
+    int stop;
+    int startup_done;
+    double start_ms;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;         /* 停止或启动完成时立即处理 */
+    ResidencyStats stats;
+} ResidencyManager;
+
+void residency_default_config(ResidencyConfig *config);
+
+ResidencyManager* residency_create(BigCacheContext *bigcache, const ResidencyConfig *config);
+void residency_destroy(ResidencyManager *rm);
+
+int residency_start(ResidencyManager *rm);
+void residency_stop(ResidencyManager *rm);
+
+/* 应用通知启动完成，不必等 startup_ms */
+void residency_startup_done(ResidencyManager *rm);
+
+/* 采样一次并按当前级别释放，返回级别 */
+int residency_tick(ResidencyManager *rm);
+
+/* 解析 PSI 文件的 some/full avg10，成功返回 0，失败返回 -errno */
+int residency_read_psi(const char *path, double *some_avg10, double *full_avg10);
+
+const char* residency_level_name(int level);
+void residency_print_stats(ResidencyManager *rm);
+
+#endif /* BIGCACHE_RESIDENCY_H */
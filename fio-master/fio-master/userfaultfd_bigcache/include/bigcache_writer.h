@@ -0,0 +1,84 @@
+/*
+ * BigCache 流式输出写入器
+ *
+ * 供打包器和设备端生成工具共用：
+ * - fallocate 预分配连续 extent
+ * - O_DIRECT + 对齐大缓冲区，双缓冲，由后台线程写盘
+ * - 结束时只 fsync 输出文件（不做全局 sync）
+ * - 不支持 O_DIRECT 的文件系统（如 tmpfs）退回普通写 + 回写后丢弃页缓存
+ *
+ * 本头文件不依赖 bigcache.h，便于独立工具直接使用
+ */
+
+#ifndef BIGCACHE_WRITER_H
+#define BIGCACHE_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define BCW_ALIGN            4096                /* O_DIRECT 对齐粒度 */
+#define BCW_DEFAULT_BUF_SIZE (4 * 1024 * 1024)   /* 默认单个缓冲区大小 */
+
+typedef struct {
+    int fd;
+    int direct;                  /* 是否以 O_DIRECT 打开 */
+    uint64_t expected_size;      /* 预期文件大小（用于 fallocate）*/
+
+    /* 双缓冲 */
+    uint8_t *bufs[2];
+    size_t buf_size;
+    int cur;                     /* 当前填充的缓冲区 */
+    size_t fill;                 /* 当前缓冲区已填充字节 */
+    uint64_t offset;             /* 当前缓冲区对应的文件偏移 */
+
+    /* 首个对齐块副本，用于结束时回填头部（如校验和）*/
+    uint8_t *head_block;
+
+    /* 后台写线程 */
+    pthread_t io_thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;                 /* 有缓冲区等待写出 */
+    int pending_buf;
+    size_t pending_len;
+    uint64_t pending_offset;
+    int stop;
+    int io_error;                /* 首个写错误（-errno）*/
+
+    /* 统计 */
+    uint64_t bytes_written;      /* 逻辑写入字节数 */
+    uint64_t write_calls;        /* pwrite 调用次数 */
+    double io_wait_ms;           /* 生产者等待写线程的时间 */
+} BigCacheWriter;
+
+/* 创建输出文件并启动写线程，buf_size 为 0 时使用默认值 */
+BigCacheWriter* bigcache_writer_open(const char *path,
+                                     uint64_t expected_size,
+                                     size_t buf_size);
+
+/* 顺序追加数据 */
+int bigcache_writer_write(BigCacheWriter *w, const void *data, size_t len);
+
+/* 顺序追加 len 字节 0（用于对齐填充）*/
+int bigcache_writer_pad(BigCacheWriter *w, size_t len);
+
+/* 回填首个对齐块内的数据（offset + len 不能超过 BCW_ALIGN）*/
+int bigcache_writer_patch_head(BigCacheWriter *w, size_t offset,
+                               const void *data, size_t len);
+
+/* 关闭后的最终统计，包含最后一块的写出与 fsync */
+typedef struct {
+    uint64_t bytes_written;
+    uint64_t write_calls;
+    double io_wait_ms;
+    int direct;
+} BigCacheWriterStats;
+
+/*
+ * 刷出剩余数据、截断到实际大小、fsync 并关闭；返回 0 或 -errno。
+ * stats 非 NULL 时填入最终统计（w 关闭后已释放，不能再读其中的计数）
+ */
+int bigcache_writer_close(BigCacheWriter *w, BigCacheWriterStats *stats);
+
+#endif /* BIGCACHE_WRITER_H */
@@ -0,0 +1,203 @@
+/*
+ * 缺页服务进程（fault daemon）
+ *
+ * 每个应用进程各自运行 UFFD 处理线程会增加线程数、内存和启动工作。
+ * 服务进程常驻并持有唯一一份 BigCache，预加载器启动时创建 userfaultfd，
+ * 经 Unix 套接字（SCM_RIGHTS）交给服务进程，之后该进程的缺页由服务进程的
+ * 共享处理线程池以 UFFDIO_COPY 安装到应用的地址空间：
+ *
+ *   预加载器                         服务进程
+ *   HELLO + uffd  ─────────────────▶ 分配客户端槽位，ACK / NAK(-EBUSY)
+ *   mmap 匿名 + UFFDIO_REGISTER
+ *   REGISTER(addr, len, file, off) ─▶ 记录区域，ACK / NAK（超出字节配额）
+ *   UNREGISTER(addr, len)  ────────▶ 裁剪区域（munmap、MAP_FIXED 覆盖前）
+ *   关闭连接  ─────────────────────▶ 打印该客户端统计，释放槽位
+ *
+ * 背压：客户端数上限（超出时预加载器退回进程内处理器）、每客户端注册字节上限
+ * （超出时映射保持文件页）、每次轮到某客户端最多处理 batch_quota 条缺页消息，
+ * 之后重新排队，单个缺页风暴不会饿死其他进程
+ *
+ * 双方都按 SO_PEERCRED 检查对端（同 uid 或 root/system），不可信的对端以 -EPERM 拒绝
+ */
+
+#ifndef FAULT_DAEMON_H
+#define FAULT_DAEMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <signal.h>
+#include <pthread.h>
+#include "bigcache.h"
+#include "uffd_handler.h"
+
+#define FAULT_DAEMON_MAGIC        0x44464342  /* "BCFD" */
+#define FAULT_DAEMON_MAX_CLIENTS  64
+#define FAULT_DAEMON_MAX_WORKERS  32
+
+/* 消息类型 */
+#define FAULT_DAEMON_HELLO        1  /* 附带 uffd；arg = pid（仅供日志，服务进程以 SO_PEERCRED 为准）*/
+#define FAULT_DAEMON_REGISTER     2  /* arg = file_id */
+#define FAULT_DAEMON_UNREGISTER   3
+#define FAULT_DAEMON_ACK          4
+#define FAULT_DAEMON_NAK          5  /* arg = -errno */
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t type;
+    int32_t  arg;
+    uint32_t reserved;
+    uint64_t addr;
+    uint64_t len;
+    uint64_t file_offset;
+    uint64_t cache_id;           /* HELLO：双方 BigCache 的标识，不一致时拒绝 */
+} FaultDaemonMsg;
+
+typedef struct {
+    int num_workers;             /* 共享处理线程数 */
+    int max_clients;             /* 同时服务的客户端上限（<= FAULT_DAEMON_MAX_CLIENTS）*/
+    size_t max_client_bytes;     /* 每个客户端可注册的映射字节数，0 不限制 */
+    int batch_quota;             /* 每次轮到某客户端最多处理的缺页消息数 */
+    size_t fault_around;         /* 缺页时向后顺带安装的缓存页数 */
+} FaultDaemonConfig;
+
+/* 每个客户端的统计 */
+typedef struct {
+    uint64_t faults;             /* 缺页消息数 */
+    uint64_t cache_pages;        /* 从 BigCache 安装的页 */
+    uint64_t file_pages;         /* 从原文件读取安装的页 */
+    uint64_t zero_pages;         /* 零页填充（无区域或读取失败）*/
+    uint64_t around_pages;       /* fault-around 顺带安装的页 */
+    uint64_t coalesced;          /* 页已安装，只需唤醒 */
+    uint64_t errors;             /* 安装失败 */
+    uint64_t throttled;          /* 用完 batch_quota 后让出的次数 */
+    uint64_t regions;            /* 接受的注册 */
+    uint64_t refused;            /* 因字节配额拒绝的注册 */
+    uint64_t max_registered;     /* 同时注册字节数峰值 */
+    double total_us;             /* 缺页服务总耗时 */
+    double max_us;               /* 单次缺页服务最大耗时 */
+} FaultDaemonStats;
+
+/* 区域：应用地址范围 -> 源文件偏移 */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t file_offset;
+    int file_id;
+    int prot;                    /* 预加载器侧恢复文件映射时使用 */
+} FaultDaemonRegion;
+
+/* 按 start 升序、互不重叠的区域表，服务进程和预加载器两侧共用 */
+typedef struct {
+    FaultDaemonRegion *entries;
+    int count;
+    int cap;
+    size_t bytes;                /* 区域总字节数 */
+} FaultDaemonRegionList;
+
+/*
+ * 客户端槽位
+ * 槽位数组不释放，epoll 事件携带 (槽位, 代数)，关闭时代数加一，
+ * 处理线程在 serve_lock 下核对代数后才使用槽位中的 uffd
+ */
+typedef struct {
+    pthread_mutex_t serve_lock;  /* 同一时刻只有一个处理线程服务该客户端 */
+    pthread_rwlock_t regions_lock;
+    int active;
+    uint32_t gen;
+    int pid;
+    int sock;
+    int uffd;
+    FaultDaemonRegionList regions;
+    FaultDaemonStats stats;
+} FaultDaemonSlot;
+
+struct FaultDaemon;
+
+typedef struct {
+    struct FaultDaemon *daemon;
+    int index;
+    pthread_t thread;
+    uint8_t *bounce;             /* 原文件回退读取缓冲 */
+} FaultDaemonWorker;
+
+typedef struct FaultDaemon {
+    BigCacheContext *bigcache;
+    FaultDaemonConfig config;
+    uint64_t cache_id;
+
+    int listen_sock;
+    int ctl_epoll;               /* 监听套接字与客户端控制连接 */
+    int fault_epoll;             /* 各客户端的 uffd（EPOLLONESHOT）*/
+    volatile int running;
+
+    FaultDaemonWorker workers[FAULT_DAEMON_MAX_WORKERS];
+    int num_workers;
+
+    FaultDaemonSlot clients[FAULT_DAEMON_MAX_CLIENTS];
+    int num_clients;
+    uint64_t clients_served;
+    uint64_t clients_refused;
+    FaultDaemonStats totals;     /* 已断开客户端的累计 */
+
+    /* 原文件回退：按 file_id 惰性打开 */
+    int *file_fds;
+    pthread_mutex_t file_lock;
+} FaultDaemon;
+
+/* 服务进程侧 */
+FaultDaemon* fault_daemon_create(BigCacheContext *bigcache, const FaultDaemonConfig *config);
+void fault_daemon_destroy(FaultDaemon *daemon);
+/* 启动处理线程并在调用线程中运行控制循环，直到 *stop 非零 */
+int fault_daemon_run(FaultDaemon *daemon, const char *socket_path,
+                     volatile sig_atomic_t *stop);
+void fault_daemon_print_stats(FaultDaemon *daemon);
+
+/* BigCache 标识：CRC 与页数，客户端与服务进程加载的必须是同一个文件 */
+uint64_t fault_daemon_cache_id(const BigCacheContext *bigcache);
+
+/*
+ * 预加载器侧
+ *
+ * 本地也记录已注册的区域。看门狗线程等待连接断开，服务进程意外退出时
+ * 由它读取自己持有的 uffd、按本地区域表继续服务缺页，应用不会挂起或读到零页
+ */
+typedef struct {
+    int sock;
+    int uffd;
+    BigCacheContext *bigcache;
+    pthread_mutex_t lock;        /* 请求-应答与区域表串行化 */
+    FaultDaemonRegionList regions;
+    int refused;
+    int lost;                    /* 连接出错或服务进程已退出，不再注册新区域 */
+    volatile int closing;
+    pthread_t watchdog;
+    int watchdog_running;
+
+    /* 接管后本地服务缺页使用 */
+    int *file_fds;
+    pthread_mutex_t file_lock;
+    FaultDaemonStats takeover;
+} FaultDaemonClient;
+
+/* 连接服务进程并交出 uffd，成功返回 0；被拒绝返回 -EBUSY 等 */
+int fault_daemon_connect(FaultDaemonClient *client, const char *socket_path,
+                         BigCacheContext *bigcache, int timeout_ms);
+void fault_daemon_disconnect(FaultDaemonClient *client);
+
+/*
+ * 创建由服务进程提供数据的匿名映射，fixed 非 NULL 时以 MAP_FIXED 覆盖该范围。
+ * 失败返回 MAP_FAILED，覆盖失败时该范围按原文件重新映射
+ */
+void* fault_daemon_map(FaultDaemonClient *client, void *fixed, size_t size,
+                       const char *file_path, int file_id, uint64_t file_offset, int prot);
+
+/* munmap 或 MAP_FIXED 覆盖前调用：本地注销并通知服务进程 */
+void fault_daemon_unmap_range(FaultDaemonClient *client, void *addr, size_t len);
+
+/*
+ * 把本地区域表中的映射换回原文件（见 uffd_handback_range），
+ * 换回的范围通知服务进程注销，返回换回的区域数
+ */
+int fault_daemon_handback(FaultDaemonClient *client, UffdHandbackStats *stats);
+
+#endif /* FAULT_DAEMON_H */
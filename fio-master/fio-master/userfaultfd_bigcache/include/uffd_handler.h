@@ -33,6 +33,20 @@ typedef struct MemoryRegion {
     char *file_path;             /* 对应的文件路径 */
     uint64_t file_offset_base;   /* 文件偏移基址 */
     int prot;                    /* 保护标志 (PROT_READ | PROT_WRITE 等) */
+    uint8_t *populated;          /* 已安装页位图（每页 1 bit），供 fault-around 判断缺失 */
+    int file_id;                 /* BigCache 文件表中的 ID，不在 BigCache 中为 -1 */
+    int minor;                   /* 由 shadow memfd 提供，命中时用 UFFDIO_CONTINUE 解决 */
+    size_t fault_size;           /* 缺页安装粒度：PAGE_SIZE，hugetlb shadow 为大页大小 */
+    
+    /* 未命中回退 */
+    int source_fd;               /* 原文件 fd，未命中时从这里读取；-1 表示不可用 */
+    uint64_t ra_next;            /* 预期的下一个顺序未命中地址 */
+    size_t ra_pages;             /* 当前回退读取窗口（页）*/
+    uint64_t miss_faults;        /* 从原文件回退服务的缺页数 */
+    uint64_t miss_pages;         /* 从原文件读入的页数 */
+    
+    int event_file;              /* 缺页事件文件表中的序号，未记录事件时为 -1 */
+    
     struct MemoryRegion *next;   /* 链表指针 */
 } MemoryRegion;
 
@@ -42,9 +56,25 @@ typedef struct MemoryRegion {
 typedef struct {
     uint64_t total_faults;       /* 总缺页次数 */
     uint64_t cache_hits;         /* BigCache 命中次数 */
-    uint64_t cache_misses;       /* BigCache 未命中次数 */
+    uint64_t cache_misses;       /* 无法回退、zero-fill 关闭时按错误安装零页的次数 */
     uint64_t zero_fills;         /* 零页填充次数 */
     uint64_t copy_errors;        /* 拷贝错误次数 */
+    uint64_t coalesced_faults;   /* 同一页已由其他处理线程填充而合并的缺页 */
+    uint64_t poll_calls;         /* poll 唤醒次数（不含超时）*/
+    uint64_t read_calls;         /* read(uffd) 次数 */
+    uint64_t copy_ioctls;        /* UFFDIO_COPY 次数 */
+    uint64_t max_batch;          /* 单次 read 读出的最大缺页数 */
+    uint64_t prefetched_pages;   /* fault-around 额外安装的页数 */
+    uint64_t populated_pages;    /* 后台填充器提前安装的页数（即避免的缺页上限）*/
+    uint64_t populate_copies;    /* 后台填充器的 UFFDIO_COPY 次数 */
+    uint64_t populate_races;     /* 后台填充时页已被缺页处理安装 */
+    uint64_t populate_yields;    /* 后台填充器为缺页处理让路的次数 */
+    uint64_t minor_faults;       /* 以 UFFDIO_CONTINUE 解决的缺页（无拷贝）*/
+    uint64_t wake_ioctls;        /* UFFDIO_WAKE 调用次数 */
+    uint64_t fallback_faults;    /* 未命中、从原文件读取服务的缺页 */
+    uint64_t fallback_pages;     /* 从原文件读入并安装的页数 */
+    uint64_t fallback_reads;     /* 回退 pread 次数 */
+    uint64_t fallback_errors;    /* 回退读取失败（退回零页或报错）*/
     double total_handle_time_us; /* 总处理时间（微秒）*/
     double avg_handle_time_us;   /* 平均处理时间（微秒）*/
     double max_handle_time_us;   /* 最大处理时间（微秒）*/
@@ -54,27 +84,191 @@ typedef struct {
  * UFFD 处理器配置
  */
 typedef struct {
-    int enable_zero_fill;        /* 未命中时是否填充零页 */
+    int enable_zero_fill;        /* 未命中时是否填充零页（关闭时仍安装零页，但记为错误）*/
     int enable_stats;            /* 是否收集统计信息 */
     int enable_logging;          /* 是否启用日志 */
-    int handler_priority;        /* 处理器线程优先级 */
-    size_t prefetch_ahead;       /* 预取页数 */
+    int handler_priority;        /* 处理线程 nice 值（负值需要 CAP_SYS_NICE 或 RLIMIT_NICE）*/
+    int handler_sched_policy;    /* SCHED_OTHER / SCHED_FIFO / SCHED_RR，实时策略无权限时退回 nice */
+    int handler_rt_priority;     /* 实时策略的优先级（1-99）*/
+    uint64_t handler_cpu_mask;   /* 处理线程可运行的 CPU（bit i = CPU i），0 不限制 */
+    size_t prefetch_ahead;       /* 缺页时向后顺带安装的最大页数（fault-around）*/
+    size_t prefetch_behind;      /* 缺页时向前顺带安装的最大页数 */
+    int num_handler_threads;     /* 处理线程数（共享同一 userfaultfd），<= 1 为单线程 */
+    int msg_batch_size;          /* 每次 read 最多读取的消息数，1 为逐条处理 */
+    int enable_populator;        /* 按 access_order 在后台主动填充已注册区域 */
+    size_t populate_chunk_pages; /* 后台填充单次 UFFDIO_COPY 最大页数 */
+    int serve_mode;              /* UFFD_SERVE_COPY / UFFD_SERVE_MINOR */
+    int shadow_hugetlb;          /* MINOR 模式下 shadow memfd 尝试使用 hugetlb */
+    int batch_wake;              /* 批量安装时以 DONTWAKE 拷贝，整批完成后只唤醒一次 */
+    int enable_file_fallback;    /* 未命中时从原文件读取，优先于零页填充 */
+    size_t fallback_readahead;   /* 顺序未命中时回退读取窗口的上限（页），<= 1 不预读 */
+    size_t event_ring_size;      /* 每个处理线程的缺页事件环容量（向上取 2 的幂），0 不记录 */
+    const char *event_log_path;  /* 停止时把缺页事件写入该文件，NULL 不写 */
 } UffdConfig;
 
+/* 回退读取窗口上限 */
+#define UFFD_MAX_FALLBACK_PAGES 64
+
+/* 按文件汇总的未命中统计（已注销区域的累计值）*/
+typedef struct {
+    char *file_path;
+    uint64_t faults;
+    uint64_t pages;
+} UffdFileMiss;
+
 /*
- * UFFD 处理器上下文
+ * 缺页服务模式
+ * COPY：匿名映射 + UFFDIO_COPY，每次缺页拷贝一页
+ * MINOR：BigCache 数据预先装入每个文件的 shadow memfd，区域映射该 memfd
+ *        并以 MISSING|MINOR 注册，命中页用 UFFDIO_CONTINUE 直接映射页缓存，
+ *        无逐页拷贝，物理页在同一文件的所有映射间共享
  */
+#define UFFD_SERVE_COPY   0
+#define UFFD_SERVE_MINOR  1
+
+/* hugetlb shadow 的大页大小 */
+#define UFFD_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* 每个 BigCache 文件的 shadow memfd */
 typedef struct {
+    int fd;                      /* memfd，-1 表示尚未创建 */
+    uint64_t size;               /* 文件大小 */
+    size_t page_size;            /* PAGE_SIZE 或 UFFD_HUGE_PAGE_SIZE */
+} UffdShadow;
+
+/*
+ * 缺页事件记录
+ *
+ * 每个处理线程一个单写者环形缓冲区，写满后覆盖最旧的事件，热路径无锁。
+ * 停止时（或调用 uffd_handler_dump_events）合并各线程事件并按时间排序写出：
+ * ┌──────────────────────────────────────────┐
+ * │ UffdEventLogHeader                       │
+ * ├──────────────────────────────────────────┤
+ * │ 文件表：num_files 项                      │
+ * │   int32 bigcache_file_id, uint32 path_len│
+ * │   char path[path_len]（无结尾 0）         │
+ * ├──────────────────────────────────────────┤
+ * │ UffdFaultEvent[num_events]               │
+ * └──────────────────────────────────────────┘
+ * tools/uffd_events.py 可转换为 CSV 或 visit_io 的 read_sequence.csv 格式
+ */
+#define UFFD_EVENT_MAGIC     0x56454655  /* "UFEV" */
+#define UFFD_EVENT_VERSION   1
+#define UFFD_DEFAULT_EVENT_RING 65536
+
+/* 缺页的服务方式 */
+#define UFFD_FAULT_HIT        0  /* 从 BigCache 拷贝 */
+#define UFFD_FAULT_MINOR      1  /* 从 shadow memfd CONTINUE */
+#define UFFD_FAULT_FALLBACK   2  /* 从原文件读取 */
+#define UFFD_FAULT_ZERO       3  /* 零页填充 */
+#define UFFD_FAULT_COALESCED  4  /* 同一页已在处理中，合并 */
+#define UFFD_FAULT_ERROR      5  /* 无区域或安装失败 */
+
+typedef struct __attribute__((packed)) {
+    uint64_t timestamp_ns;       /* 读到缺页消息的时间（CLOCK_MONOTONIC）*/
+    uint64_t address;            /* 缺页地址（页对齐）*/
+    uint64_t file_offset;        /* 缺页页在源文件中的偏移 */
+    uint32_t service_ns;         /* 从读到消息到页面安装完成的时间 */
+    int32_t  file;               /* 文件表序号，-1 表示未知 */
+    uint32_t tid;                /* 缺页的应用线程 ID，内核不支持时为 0 */
+    uint16_t pages;              /* 本次安装的页数，随同一段安装而满足的缺页为 0 */
+    uint8_t  kind;               /* UFFD_FAULT_* */
+    uint8_t  worker;             /* 处理线程序号 */
+} UffdFaultEvent;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;              /* UFFD_EVENT_MAGIC */
+    uint16_t version;            /* UFFD_EVENT_VERSION */
+    uint16_t record_size;        /* sizeof(UffdFaultEvent) */
+    uint32_t num_files;          /* 文件表项数 */
+    uint32_t num_threads;        /* 处理线程数 */
+    uint64_t num_events;         /* 事件数 */
+    uint64_t dropped_events;     /* 环写满后被覆盖的事件数 */
+    uint64_t monotonic_ns;       /* 写出时的 CLOCK_MONOTONIC */
+    uint64_t realtime_ns;        /* 写出时的 CLOCK_REALTIME，用于换算墙上时间 */
+} UffdEventLogHeader;
+
+/* 事件文件表项 */
+typedef struct {
+    char *file_path;
+    int file_id;                 /* BigCache 文件 ID，-1 表示不在 BigCache 中 */
+} UffdEventFile;
+
+/* 批量读取消息上限及默认值 */
+#define UFFD_MAX_MSG_BATCH     64
+#define UFFD_DEFAULT_MSG_BATCH 32
+
+/* 处理线程上限 */
+#define UFFD_MAX_HANDLER_THREADS 32
+
+/* 在途缺页表槽位数（2 的幂）*/
+#define UFFD_INFLIGHT_SLOTS 1024
+
+struct UffdHandler;
+
+/*
+ * 处理线程
+ * 每个线程有私有统计，热路径上无需加锁
+ */
+typedef struct UffdWorker {
+    struct UffdHandler *handler; /* 所属处理器 */
+    int index;                   /* 线程序号 */
+    pthread_t thread;            /* 线程句柄 */
+    UffdStats stats;             /* 线程私有统计 */
+    uint8_t *bounce;             /* 回退读取的中转缓冲区 */
+    uint64_t read_seq;           /* 区域表读侧序号，奇数表示正在使用区域 */
+    UffdFaultEvent *events;      /* 缺页事件环，NULL 表示不记录 */
+    uint64_t event_head;         /* 已写入的事件总数 */
+    uint64_t event_mask;         /* 环容量 - 1 */
+} UffdWorker;
+
+/*
+ * 区域表快照
+ * entries 按基址升序排列，缺页路径无锁二分查找；by_file 是同一组区域按
+ * (file_id, file_offset_base) 升序排列的副本，填充器按文件偏移二分查找。
+ * 注册/注销在 regions_lock 下复制出新表并原子发布，
+ * 等所有处理线程离开读侧临界区后再释放旧表和被注销的区域
+ */
+typedef struct {
+    int count;
+    MemoryRegion **by_file;      /* 指向 entries 之后的同尺寸数组 */
+    MemoryRegion *entries[];
+} RegionTable;
+
+/*
+ * UFFD 处理器上下文
+ */
+typedef struct UffdHandler {
     /* Userfaultfd 相关 */
     int uffd;                    /* userfaultfd 文件描述符 */
-    pthread_t handler_thread;    /* 处理器线程 */
+    UffdWorker *workers;         /* 处理线程池 */
+    int num_workers;             /* 处理线程数 */
     volatile int running;        /* 运行标志 */
     
+    /* 在途缺页：正在被某个处理线程填充的页地址（0 表示空闲槽）*/
+    uint64_t inflight[UFFD_INFLIGHT_SLOTS];
+    int demand_active;           /* 正在处理缺页的线程数，后台填充器据此让路 */
+    
+    /* 后台填充器 */
+    pthread_t populator_thread;  /* 填充线程 */
+    volatile int populator_running;
+    uint64_t populator_read_seq; /* 填充线程的区域表读侧序号，语义同 UffdWorker.read_seq */
+    uint32_t *file_region_count; /* 每个 BigCache 文件当前注册的区域数 */
+    uint32_t region_gen;         /* 区域注册代数，有新区域时填充器重扫 */
+    pthread_mutex_t populator_lock;
+    pthread_cond_t populator_cond;/* region_gen 增加或停止时唤醒填充器 */
+    
+    /* MINOR 模式 */
+    uint64_t uffd_features;      /* UFFDIO_API 协商得到的特性 */
+    UffdShadow *shadows;         /* 按 file_id 索引 */
+    pthread_mutex_t shadow_lock; /* shadow 创建锁 */
+    
     /* BigCache 引用 */
     BigCacheContext *bigcache;   /* BigCache 上下文 */
     
     /* 注册的内存区域 */
-    MemoryRegion *regions;       /* 区域链表 */
+    MemoryRegion *regions;       /* 区域链表（写侧，受 regions_lock 保护）*/
+    RegionTable *region_table;   /* 读侧快照 */
     pthread_mutex_t regions_lock;/* 区域锁 */
     int num_regions;             /* 区域数量 */
     
@@ -88,6 +282,14 @@ typedef struct {
     /* 零页缓冲（用于填充未命中的页）*/
     void *zero_page;             /* 预分配的零页 */
     
+    /* 已注销区域的未命中统计（受 regions_lock 保护）*/
+    UffdFileMiss *file_misses;
+    int num_file_misses;
+    
+    /* 缺页事件引用的文件（受 regions_lock 保护，只增不减）*/
+    UffdEventFile *event_files;
+    int num_event_files;
+    
     /* 事件管道（用于优雅关闭）*/
     int shutdown_pipe[2];        /* 关闭通知管道 */
 } UffdHandler;
@@ -117,6 +319,12 @@ int uffd_handler_register_region(UffdHandler *handler,
                                   uint64_t file_offset_base);
 int uffd_handler_unregister_region(UffdHandler *handler, void *addr);
 
+/*
+ * 取消注册与 [addr, addr + len) 重叠的区域：完全落在范围内的整体取消，
+ * 部分重叠的裁掉重叠部分。在 munmap 或 MAP_FIXED 覆盖前调用，返回处理的区域数
+ */
+int uffd_handler_unregister_range(UffdHandler *handler, void *addr, size_t len);
+
 /*
  * 创建受 UFFD 保护的内存映射
  * 这是核心函数：创建匿名映射并注册到 UFFD
@@ -128,11 +336,80 @@ void* uffd_handler_create_mapping(UffdHandler *handler,
                                    int prot);
 int uffd_handler_destroy_mapping(UffdHandler *handler, void *addr, size_t size);
 
+/*
+ * 以 MAP_FIXED 把已有文件映射中的 [addr, addr + size) 替换为 UFFD 映射
+ * 失败时该范围按原文件重新映射（MAP_PRIVATE），返回 MAP_FAILED
+ */
+void* uffd_handler_overlay_mapping(UffdHandler *handler,
+                                    void *addr,
+                                    size_t size,
+                                    const char *file_path,
+                                    uint64_t file_offset_base,
+                                    int prot);
+
+/*
+ * Handback：启动结束后把 UFFD 匿名映射换回原文件的私有映射
+ * 匿名副本不与其他进程共享、回收代价高，且与页缓存重复。
+ * 换回前比对已安装的页与原文件，不一致（被写过）、区域可写或权限被改过的保留
+ */
+typedef struct {
+    uint64_t regions;            /* 换回的区域数 */
+    uint64_t pages;              /* 换回的页数 */
+    uint64_t anon_pages;         /* 随之释放的已安装匿名页 */
+    uint64_t kept;               /* 可写、权限变化、内容不一致或 MINOR/hugetlb 而保留的区域 */
+    uint64_t failed;             /* 映射原文件失败，原映射不变 */
+    double ms;
+} UffdHandbackStats;
+
+/* /proc/self/maps 快照，按 start 升序；一轮换回只读取一次 */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    int prot;
+    int anon;                    /* inode 为 0 */
+} UffdVma;
+
+typedef struct {
+    UffdVma *entries;
+    int count;
+} UffdVmaSnapshot;
+
+int uffd_vma_snapshot(UffdVmaSnapshot *snap);
+void uffd_vma_snapshot_free(UffdVmaSnapshot *snap);
+
+/*
+ * 把 [start, end) 的 UFFD 匿名映射换成原文件 [file_offset, ...) 的私有映射（prot）：
+ * 按 vmas 确认该范围仍是未改过权限的匿名映射，另行映射原文件、比对已驻留的页后
+ * 以 mremap(MREMAP_FIXED) 原子替换，再 UFFDIO_WAKE 唤醒阻塞在旧映射上的缺页
+ * （重试时落到文件映射上）。成功返回 0，保留返回 -EBUSY，其他 -errno 时原映射不变
+ */
+int uffd_handback_range(int uffd, uint64_t start, uint64_t end, const char *file_path,
+                        uint64_t file_offset, int prot, const UffdVmaSnapshot *vmas,
+                        UffdHandbackStats *stats);
+
+/* 换回全部可换回的区域并从处理器中移除，返回换回的区域数 */
+int uffd_handler_handback(UffdHandler *handler, UffdHandbackStats *stats);
+
 /* 统计信息 */
 void uffd_handler_get_stats(UffdHandler *handler, UffdStats *stats);
 void uffd_handler_reset_stats(UffdHandler *handler);
 void uffd_handler_print_stats(UffdHandler *handler);
 
+/*
+ * CPU 掩码
+ * uffd_big_core_mask 按 cpu_capacity（没有时按 cpuinfo_max_freq）取最低一档以外的全部核心，
+ * 同构或无法判断时返回 0。
+ * uffd_parse_cpu_mask 解析 "big"、"all"、"0xf0" 或 "4-7,2" 形式，成功返回 0
+ */
+uint64_t uffd_big_core_mask(void);
+int uffd_parse_cpu_mask(const char *spec, uint64_t *mask);
+
+/* 按文件打印未命中回退统计，未命中最多的 limit 个文件 */
+void uffd_handler_print_file_misses(UffdHandler *handler, int limit);
+
+/* 把各处理线程环中的缺页事件写入 path，返回写出的事件数 */
+long uffd_handler_dump_events(UffdHandler *handler, const char *path);
+
 /*
  * 高级 API：文件 mmap 替代
  * 
@@ -190,7 +467,7 @@ int _uffd_handle_pagefault(UffdHandler *handler,
                            uint64_t fault_addr,
                            uint64_t fault_flags);
 
-/* 查找地址对应的区域 */
+/* 查找地址对应的区域（处理线程内或持有 regions_lock 时调用）*/
 MemoryRegion* _uffd_find_region(UffdHandler *handler, void *addr);
 
 /* 计算页对齐地址 */
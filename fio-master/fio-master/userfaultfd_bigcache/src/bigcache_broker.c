@@ -0,0 +1,345 @@
+/*
+ * BigCache 代理进程实现
+ *
+ * 代理端：memfd_create + 读入 + 密封 + mlock，accept 后对每个连接发送
+ * BrokerHello 并以 SCM_RIGHTS 附带 memfd，随即关闭连接。
+ * 预加载器端：connect + recvmsg 取得 fd，校验消息和密封后交给 bigcache_load_fd
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bigcache.h"
+#include "bigcache_broker.h"
+
+/* 接收方要求的密封：内容与大小不可再变，映射后不会 SIGBUS 或读到被改写的页 */
+#define BROKER_REQUIRED_SEALS (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW)
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+socklen_t broker_socket_addr(const char *socket_path, struct sockaddr_un *addr) {
+    size_t len = strlen(socket_path);
+    if (len == 0 || len >= sizeof(addr->sun_path)) return 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, socket_path, len);
+    if (socket_path[0] == '@') addr->sun_path[0] = '\0';
+
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+}
+
+#define BROKER_SYSTEM_UID 1000   /* Android AID_SYSTEM */
+
+int broker_peer_trusted(int sock, pid_t *pid) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0 ||
+        cred_len != sizeof(cred)) {
+        return 0;
+    }
+    if (pid) *pid = cred.pid;
+
+    return cred.uid == getuid() || cred.uid == 0 || cred.uid == BROKER_SYSTEM_UID;
+}
+
+int broker_load(BigCacheBroker *broker, const char *bigcache_path) {
+    if (!broker || !bigcache_path) return -EINVAL;
+
+    memset(broker, 0, sizeof(*broker));
+    broker->memfd = -1;
+    broker->mapped = MAP_FAILED;
+    double start = now_ms();
+
+    int fd = open(bigcache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("broker_load: open");
+        return -errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(BigCacheHeader)) {
+        fprintf(stderr, "broker_load: %s is not a BigCache file\n", bigcache_path);
+        close(fd);
+        return -EINVAL;
+    }
+    broker->size = st.st_size;
+
+    broker->memfd = memfd_create("bigcache", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (broker->memfd < 0) {
+        perror("broker_load: memfd_create");
+        close(fd);
+        return -errno;
+    }
+
+    int ret = 0;
+    uint8_t *dst = MAP_FAILED;
+    if (ftruncate(broker->memfd, broker->size) < 0) {
+        perror("broker_load: ftruncate");
+        ret = -errno;
+        goto out;
+    }
+
+    /* 直接读入 memfd 的共享映射，不经中间缓冲 */
+    dst = mmap(NULL, broker->size, PROT_READ | PROT_WRITE, MAP_SHARED, broker->memfd, 0);
+    if (dst == MAP_FAILED) {
+        perror("broker_load: mmap");
+        ret = -errno;
+        goto out;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (size_t done = 0; done < broker->size; ) {
+        ssize_t n = read(fd, dst + done, broker->size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "broker_load: short read at %zu\n", done);
+            ret = n < 0 ? -errno : -EIO;
+            goto out;
+        }
+        done += n;
+    }
+
+    const BigCacheHeader *hdr = (const BigCacheHeader*)dst;
+    if (hdr->magic != BIGCACHE_MAGIC || hdr->version != BIGCACHE_VERSION) {
+        fprintf(stderr, "broker_load: invalid BigCache header\n");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    /* F_SEAL_WRITE 要求没有可写的共享映射 */
+    munmap(dst, broker->size);
+    dst = MAP_FAILED;
+    if (fcntl(broker->memfd, F_ADD_SEALS, BROKER_REQUIRED_SEALS | F_SEAL_SEAL) < 0) {
+        perror("broker_load: F_ADD_SEALS");
+        ret = -errno;
+        goto out;
+    }
+
+    broker->mapped = mmap(NULL, broker->size, PROT_READ, MAP_SHARED, broker->memfd, 0);
+    if (broker->mapped == MAP_FAILED) {
+        perror("broker_load: mmap");
+        ret = -errno;
+        goto out;
+    }
+
+    /* 锁定失败不是致命错误，页仍在 shmem 中，只是可能被换出 */
+    if (mlock(broker->mapped, broker->size) == 0) {
+        broker->locked = 1;
+    } else {
+        perror("broker_load: mlock (optional)");
+    }
+
+    broker->load_ms = now_ms() - start;
+
+out:
+    if (dst != MAP_FAILED) munmap(dst, broker->size);
+    /* 内容已在 memfd 中，丢弃源文件的页缓存，避免同一份数据常驻两次 */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    if (ret < 0) broker_unload(broker);
+    return ret;
+}
+
+void broker_unload(BigCacheBroker *broker) {
+    if (!broker) return;
+
+    if (broker->mapped != MAP_FAILED && broker->mapped) {
+        munmap(broker->mapped, broker->size);
+    }
+    broker->mapped = MAP_FAILED;
+
+    if (broker->memfd >= 0) {
+        close(broker->memfd);
+        broker->memfd = -1;
+    }
+}
+
+/* 发送 BrokerHello 并附带 memfd */
+static int send_memfd(int sock, const BigCacheBroker *broker) {
+    BrokerHello hello = {
+        .magic = BROKER_MAGIC,
+        .version = BROKER_VERSION,
+        .size = broker->size
+    };
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf)
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &broker->memfd, sizeof(int));
+
+    ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    if (n < 0) return -errno;
+    return n == sizeof(hello) ? 0 : -EIO;
+}
+
+int broker_serve(BigCacheBroker *broker, const char *socket_path,
+                 volatile sig_atomic_t *stop) {
+    if (!broker || broker->memfd < 0 || !socket_path) return -EINVAL;
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = broker_socket_addr(socket_path, &addr);
+    if (!addr_len) return -ENAMETOOLONG;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("broker_serve: socket");
+        return -errno;
+    }
+
+    /* 文件系统套接字可能是上次运行遗留的 */
+    if (socket_path[0] != '@') unlink(socket_path);
+
+    if (bind(sock, (struct sockaddr*)&addr, addr_len) < 0 || listen(sock, 64) < 0) {
+        int err = errno;
+        perror("broker_serve: bind/listen");
+        close(sock);
+        return -err;
+    }
+
+    printf("[Broker] Serving %.2f MB on %s (%s)\n",
+           (double)broker->size / (1024 * 1024), socket_path,
+           broker->locked ? "locked" : "not locked");
+
+    /* poll 超时用于检查停止标志 */
+    while (!*stop) {
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        int ready = poll(&pfd, 1, 200);
+        if (ready < 0 && errno != EINTR) {
+            perror("broker_serve: poll");
+            break;
+        }
+        if (ready <= 0) continue;
+
+        int client = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) continue;
+
+        /* memfd 含全部缓存页，其中可能有对端无权打开的文件，只发给可信进程 */
+        pid_t pid = -1;
+        if (!broker_peer_trusted(client, &pid)) {
+            broker->clients_refused++;
+            fprintf(stderr, "[Broker] Refused untrusted client pid %d\n", pid);
+            close(client);
+            continue;
+        }
+
+        int ret = send_memfd(client, broker);
+        if (ret == 0) {
+            broker->clients_served++;
+        } else {
+            fprintf(stderr, "[Broker] Failed to send memfd to pid %d: %d\n", pid, ret);
+        }
+        close(client);
+    }
+
+    close(sock);
+    if (socket_path[0] != '@') unlink(socket_path);
+
+    printf("[Broker] Stopped, %llu clients served, %llu refused\n",
+           (unsigned long long)broker->clients_served,
+           (unsigned long long)broker->clients_refused);
+    return 0;
+}
+
+int broker_fetch(const char *socket_path, int timeout_ms, uint64_t *out_size) {
+    if (!socket_path) return -EINVAL;
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = broker_socket_addr(socket_path, &addr);
+    if (!addr_len) return -ENAMETOOLONG;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -errno;
+
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (connect(sock, (struct sockaddr*)&addr, addr_len) < 0) {
+        int err = errno;
+        close(sock);
+        return -err;
+    }
+
+    /* 抽象命名空间谁都能抢先绑定，不是可信进程发来的 BigCache 不能使用 */
+    if (!broker_peer_trusted(sock, NULL)) {
+        close(sock);
+        return -EPERM;
+    }
+
+    BrokerHello hello;
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf)
+    };
+
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    int err = n < 0 ? errno : 0;
+    close(sock);
+    if (n < 0) return -err;
+
+    int fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (fd < 0) return -EPROTO;
+
+    if (n != sizeof(hello) || (msg.msg_flags & MSG_CTRUNC) ||
+        hello.magic != BROKER_MAGIC || hello.version != BROKER_VERSION) {
+        close(fd);
+        return -EPROTO;
+    }
+
+    /* 未密封的 fd 可能被发送方截断或改写，不能直接映射使用 */
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & BROKER_REQUIRED_SEALS) != BROKER_REQUIRED_SEALS ||
+        fstat(fd, &st) < 0 || (uint64_t)st.st_size != hello.size) {
+        close(fd);
+        return -EPERM;
+    }
+
+    if (out_size) *out_size = hello.size;
+    return fd;
+}
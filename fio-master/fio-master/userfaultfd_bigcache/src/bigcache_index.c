@@ -53,10 +53,15 @@ static void init_crc32_table(void) {
 }
 
 uint32_t bigcache_crc32(const void *data, size_t len) {
+    return bigcache_crc32_update(0, data, len);
+}
+
+/* 增量计算：crc 传入上一次的返回值（首次为 0）*/
+uint32_t bigcache_crc32_update(uint32_t crc, const void *data, size_t len) {
     init_crc32_table();
     
     const uint8_t *buf = (const uint8_t*)data;
-    uint32_t crc = 0xFFFFFFFF;
+    crc ^= 0xFFFFFFFF;
     
     for (size_t i = 0; i < len; i++) {
         crc = crc32_table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
@@ -194,12 +199,21 @@ int bigcache_load(BigCacheContext *ctx, const char *path) {
     if (!ctx || !path) return -EINVAL;
     
     /* 打开文件 */
-    ctx->fd = open(path, O_RDONLY);
-    if (ctx->fd < 0) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         perror("bigcache_load: open");
         return -errno;
     }
     
+    return bigcache_load_fd(ctx, fd);
+}
+
+/* 从已打开的 fd 加载（BigCache.bin 或代理进程传来的 memfd），fd 归上下文所有 */
+int bigcache_load_fd(BigCacheContext *ctx, int fd) {
+    if (!ctx || fd < 0) return -EINVAL;
+    
+    ctx->fd = fd;
+    
     /* 获取文件大小 */
     struct stat st;
     if (fstat(ctx->fd, &st) < 0) {
@@ -244,6 +258,13 @@ int bigcache_load(BigCacheContext *ctx, const char *path) {
         ((uint8_t*)ctx->mapped_data + ctx->header.index_offset);
     ctx->file_table = (BigCacheFileEntry*)
         ((uint8_t*)ctx->mapped_data + ctx->header.file_table_offset);
+    ctx->file_stats = NULL;
+    if (ctx->header.file_stat_offset != 0 &&
+        ctx->header.file_stat_offset + (uint64_t)ctx->header.num_files * sizeof(BigCacheFileStat)
+            <= ctx->mapped_size) {
+        ctx->file_stats = (BigCacheFileStat*)
+            ((uint8_t*)ctx->mapped_data + ctx->header.file_stat_offset);
+    }
     
     /* 构建运行时查找表 */
     ctx->lookup_table = create_lookup_table(ctx->header.num_pages);
@@ -271,6 +292,42 @@ int bigcache_load(BigCacheContext *ctx, const char *path) {
         }
     }
     
+    /* 页面存在位图：先求每个文件的最大页号，再置位 */
+    uint32_t num_files = ctx->header.num_files;
+    ctx->page_bitmaps = calloc(num_files, sizeof(uint8_t*));
+    ctx->bitmap_pages = calloc(num_files, sizeof(uint32_t));
+    ctx->page_slots = calloc(num_files, sizeof(uint32_t*));
+    ctx->served_bitmap = calloc((ctx->header.num_pages + 7) / 8 + 1, 1);
+    if (!ctx->page_bitmaps || !ctx->bitmap_pages || !ctx->page_slots || !ctx->served_bitmap) {
+        bigcache_unload(ctx);
+        return -ENOMEM;
+    }
+    
+    for (uint32_t i = 0; i < ctx->header.num_pages; i++) {
+        BigCachePageIndex *pi = &ctx->page_index[i];
+        uint32_t page = (uint32_t)(pi->source_offset / PAGE_SIZE);
+        if (pi->file_id < num_files && page + 1 > ctx->bitmap_pages[pi->file_id]) {
+            ctx->bitmap_pages[pi->file_id] = page + 1;
+        }
+    }
+    
+    for (uint32_t f = 0; f < num_files; f++) {
+        ctx->page_bitmaps[f] = calloc((ctx->bitmap_pages[f] + 7) / 8 + 1, 1);
+        ctx->page_slots[f] = calloc(ctx->bitmap_pages[f] + 1, sizeof(uint32_t));
+        if (!ctx->page_bitmaps[f] || !ctx->page_slots[f]) {
+            bigcache_unload(ctx);
+            return -ENOMEM;
+        }
+    }
+    
+    for (uint32_t i = 0; i < ctx->header.num_pages; i++) {
+        BigCachePageIndex *pi = &ctx->page_index[i];
+        if (pi->file_id >= num_files) continue;
+        uint32_t page = (uint32_t)(pi->source_offset / PAGE_SIZE);
+        ctx->page_bitmaps[pi->file_id][page / 8] |= 1 << (page % 8);
+        ctx->page_slots[pi->file_id][page] = i + 1;
+    }
+    
     ctx->is_loaded = 1;
     
     printf("BigCache loaded: %u pages, %u files, %.2f MB\n",
@@ -295,6 +352,27 @@ int bigcache_unload(BigCacheContext *ctx) {
         ctx->fd = -1;
     }
     
+    if (ctx->page_bitmaps) {
+        for (uint32_t f = 0; f < ctx->header.num_files; f++) {
+            free(ctx->page_bitmaps[f]);
+        }
+        free(ctx->page_bitmaps);
+        ctx->page_bitmaps = NULL;
+    }
+    free(ctx->bitmap_pages);
+    ctx->bitmap_pages = NULL;
+    free(ctx->served_bitmap);
+    ctx->served_bitmap = NULL;
+    ctx->served_pages = 0;
+    
+    if (ctx->page_slots) {
+        for (uint32_t f = 0; f < ctx->header.num_files; f++) {
+            free(ctx->page_slots[f]);
+        }
+        free(ctx->page_slots);
+        ctx->page_slots = NULL;
+    }
+    
     ctx->is_loaded = 0;
     ctx->is_preheated = 0;
     
@@ -313,17 +391,142 @@ void* bigcache_lookup(BigCacheContext *ctx,
     RuntimePageEntry *entry = lookup_table_find(ctx->lookup_table,
                                                 file_path,
                                                 page_offset);
+    /* 多个缺页处理线程并发查找，计数使用原子操作 */
     if (!entry) {
-        ctx->miss_count++;
+        __atomic_fetch_add(&ctx->miss_count, 1, __ATOMIC_RELAXED);
         return NULL;
     }
     
-    ctx->hit_count++;
-    ctx->total_bytes_served += PAGE_SIZE;
+    __atomic_fetch_add(&ctx->hit_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctx->total_bytes_served, PAGE_SIZE, __ATOMIC_RELAXED);
+    bigcache_mark_served(ctx, (uint32_t)((entry->bigcache_offset - ctx->header.data_offset) /
+                                         PAGE_SIZE), 1);
+    
+    return (uint8_t*)ctx->mapped_data + entry->bigcache_offset;
+}
+
+/* 查找但不计入统计 */
+void* bigcache_peek(BigCacheContext *ctx,
+                    const char *file_path,
+                    uint64_t offset) {
+    if (!ctx || !ctx->is_loaded || !file_path) return NULL;
+    
+    RuntimePageEntry *entry = lookup_table_find(ctx->lookup_table,
+                                                file_path,
+                                                offset & ~(PAGE_SIZE - 1));
+    if (!entry) return NULL;
     
     return (uint8_t*)ctx->mapped_data + entry->bigcache_offset;
 }
 
+/* 按路径查找文件 ID（注册区域时调用，不在热路径上）*/
+int bigcache_find_file(BigCacheContext *ctx, const char *file_path) {
+    if (!ctx || !ctx->is_loaded || !file_path) return -1;
+    
+    for (uint32_t i = 0; i < ctx->header.num_files; i++) {
+        if (strcmp(ctx->file_table[i].path, file_path) == 0) {
+            return (int)i;
+        }
+    }
+    
+    return -1;
+}
+
+/* 统计区间内已缓存的页数：按字节 popcount，首尾不完整的字节逐位处理 */
+size_t bigcache_count_cached(BigCacheContext *ctx, int file_id,
+                             uint64_t offset, uint64_t length) {
+    if (!ctx || !ctx->is_loaded || file_id < 0 ||
+        (uint32_t)file_id >= ctx->header.num_files || length == 0) {
+        return 0;
+    }
+    
+    const uint8_t *bitmap = ctx->page_bitmaps[file_id];
+    uint64_t first = offset / PAGE_SIZE;
+    uint64_t last = (offset + length + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (last > ctx->bitmap_pages[file_id]) last = ctx->bitmap_pages[file_id];
+    
+    size_t count = 0;
+    uint64_t page = first;
+    while (page < last && page % 8 != 0) {
+        count += (bitmap[page / 8] >> (page % 8)) & 1;
+        page++;
+    }
+    while (page + 8 <= last) {
+        count += __builtin_popcount(bitmap[page / 8]);
+        page += 8;
+    }
+    while (page < last) {
+        count += (bitmap[page / 8] >> (page % 8)) & 1;
+        page++;
+    }
+    
+    return count;
+}
+
+uint32_t bigcache_range_end_slot(BigCacheContext *ctx, int file_id,
+                                 uint64_t offset, uint64_t length) {
+    if (!ctx || !ctx->is_loaded || file_id < 0 ||
+        (uint32_t)file_id >= ctx->header.num_files || length == 0) {
+        return 0;
+    }
+    
+    const uint32_t *slots = ctx->page_slots[file_id];
+    uint64_t first = offset / PAGE_SIZE;
+    uint64_t last = (offset + length + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (last > ctx->bitmap_pages[file_id]) last = ctx->bitmap_pages[file_id];
+    
+    uint32_t end = 0;
+    for (uint64_t page = first; page < last; page++) {
+        if (slots[page] > end) end = slots[page];
+    }
+    return end;
+}
+
+int bigcache_page_cached(BigCacheContext *ctx, int file_id, uint64_t offset) {
+    if (!ctx || !ctx->is_loaded || file_id < 0 ||
+        (uint32_t)file_id >= ctx->header.num_files) {
+        return 0;
+    }
+    
+    uint64_t page = offset / PAGE_SIZE;
+    if (page >= ctx->bitmap_pages[file_id]) return 0;
+    return (ctx->page_bitmaps[file_id][page / 8] >> (page % 8)) & 1;
+}
+
+const void* bigcache_file_page(BigCacheContext *ctx, int file_id, uint64_t offset) {
+    if (!ctx || !ctx->is_loaded || file_id < 0 ||
+        (uint32_t)file_id >= ctx->header.num_files) {
+        return NULL;
+    }
+    
+    uint64_t page = offset / PAGE_SIZE;
+    if (page >= ctx->bitmap_pages[file_id]) return NULL;
+    
+    uint32_t slot = ctx->page_slots[file_id][page];
+    if (slot == 0) return NULL;
+    bigcache_mark_served(ctx, slot - 1, 1);
+    return (const uint8_t*)ctx->mapped_data + ctx->header.data_offset +
+           (uint64_t)(slot - 1) * PAGE_SIZE;
+}
+
+/* 缺页处理线程并发置位，已置位时只读不写，避免热页反复写同一缓存行 */
+void bigcache_mark_served(BigCacheContext *ctx, uint32_t slot, uint32_t count) {
+    if (!ctx || !ctx->served_bitmap) return;
+    
+    for (uint32_t i = slot; i < slot + count && i < ctx->header.num_pages; i++) {
+        uint8_t bit = 1 << (i % 8);
+        if (__atomic_load_n(&ctx->served_bitmap[i / 8], __ATOMIC_RELAXED) & bit) continue;
+        if (!(__atomic_fetch_or(&ctx->served_bitmap[i / 8], bit, __ATOMIC_RELAXED) & bit)) {
+            __atomic_fetch_add(&ctx->served_pages, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int bigcache_slot_served(BigCacheContext *ctx, uint32_t slot) {
+    if (!ctx || !ctx->served_bitmap || slot >= ctx->header.num_pages) return 0;
+    return (__atomic_load_n(&ctx->served_bitmap[slot / 8], __ATOMIC_RELAXED) >> (slot % 8)) & 1;
+}
+
 /* 查找偏移（不返回数据）*/
 int bigcache_lookup_offset(BigCacheContext *ctx,
                            const char *file_path,
@@ -339,12 +542,12 @@ int bigcache_lookup_offset(BigCacheContext *ctx,
                                                 file_path,
                                                 page_offset);
     if (!entry) {
-        ctx->miss_count++;
+        __atomic_fetch_add(&ctx->miss_count, 1, __ATOMIC_RELAXED);
         return -ENOENT;
     }
     
     *out_bigcache_offset = entry->bigcache_offset;
-    ctx->hit_count++;
+    __atomic_fetch_add(&ctx->hit_count, 1, __ATOMIC_RELAXED);
     
     return 0;
 }
@@ -369,6 +572,14 @@ int bigcache_preheat(BigCacheContext *ctx) {
         sum += data[i];  /* 触发缺页，加载到内存 */
     }
     
+    (void)sum;  /* 防止编译器优化掉 */
+    return bigcache_preheat_finish(ctx);
+}
+
+/* 预热完成：切换访问提示并锁定 */
+int bigcache_preheat_finish(BigCacheContext *ctx) {
+    if (!ctx || !ctx->is_loaded) return -EINVAL;
+    
     /* 设置随机访问提示（预热后访问模式是随机的）*/
     if (madvise(ctx->mapped_data, ctx->mapped_size, MADV_RANDOM) < 0) {
         perror("bigcache_preheat: madvise RANDOM");
@@ -383,7 +594,6 @@ int bigcache_preheat(BigCacheContext *ctx) {
     ctx->is_preheated = 1;
     printf("BigCache preheated successfully\n");
     
-    (void)sum;  /* 防止编译器优化掉 */
     return 0;
 }
 
@@ -0,0 +1,877 @@
+/*
+ * BigCache 布局优化器实现
+ *
+ * 输入：打包器中的页面（来自 bigcache_layout.csv，带首次访问序号）
+ * 输出：重排后的页面顺序 + 布局评分
+ *
+ * 评分模型：按首次访问顺序回放页面，对 BigCache.bin 的每次读取
+ * 覆盖 read_pages 个连续页面（模拟预读窗口），落在窗口内的访问不产生 IO。
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "bigcache.h"
+#include "bigcache_layout.h"
+
+/* 排序/重排时使用的轻量条目，避免反复拷贝 PackerPageEntry */
+typedef struct {
+    uint32_t idx;                /* 在打包器中的原始下标 */
+    uint32_t rank;               /* 访问名次（按 access_order 排序后的位置）*/
+    uint32_t file_id;            /* 文件 ID（打包器文件表下标）*/
+    uint32_t order;              /* 首次访问序号 */
+    uint64_t offset;             /* 源文件偏移 */
+    uint64_t key;                /* 段内排序主键 */
+    uint64_t key2;               /* 段内排序次键 */
+} LayoutItem;
+
+static const char *g_strategy_names[LAYOUT_NUM_STRATEGIES] = {
+    "first-access",
+    "co-access",
+    "file-window",
+    "phase-chunk"
+};
+
+void layout_default_options(LayoutOptions *opts) {
+    if (!opts) return;
+    opts->window_pages = 256;        /* 1MB */
+    opts->phase_gap = 1000;
+    opts->max_phase_pages = 4096;    /* 16MB */
+    opts->read_pages = 32;           /* 128KB 预读窗口 */
+}
+
+const char* layout_strategy_name(LayoutStrategy strategy) {
+    if ((int)strategy < 0 || strategy >= LAYOUT_NUM_STRATEGIES) return "unknown";
+    return g_strategy_names[strategy];
+}
+
+int layout_strategy_from_name(const char *name) {
+    if (!name) return -EINVAL;
+    for (int i = 0; i < LAYOUT_NUM_STRATEGIES; i++) {
+        if (strcmp(name, g_strategy_names[i]) == 0) return i;
+    }
+    return -EINVAL;
+}
+
+/* FNV-1a 字符串哈希 */
+static uint64_t hash_path(const char *str) {
+    uint64_t hash = 14695981039346656037ULL;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* 为每个页面解析文件 ID（打包器文件表下标），开放寻址哈希 */
+static int resolve_file_ids(const BigCachePacker *packer, uint32_t *ids) {
+    size_t num_slots = 16;
+    while (num_slots < packer->num_files * 2) num_slots <<= 1;
+
+    int32_t *slots = malloc(num_slots * sizeof(int32_t));
+    if (!slots) return -ENOMEM;
+    memset(slots, 0xff, num_slots * sizeof(int32_t));
+
+    for (size_t i = 0; i < packer->num_files; i++) {
+        size_t s = hash_path(packer->file_paths[i]) & (num_slots - 1);
+        while (slots[s] >= 0) s = (s + 1) & (num_slots - 1);
+        slots[s] = (int32_t)i;
+    }
+
+    for (size_t i = 0; i < packer->num_entries; i++) {
+        const char *path = packer->entries[i].file_path;
+        size_t s = hash_path(path) & (num_slots - 1);
+        ids[i] = 0;
+        while (slots[s] >= 0) {
+            if (strcmp(packer->file_paths[slots[s]], path) == 0) {
+                ids[i] = (uint32_t)slots[s];
+                break;
+            }
+            s = (s + 1) & (num_slots - 1);
+        }
+    }
+
+    free(slots);
+    return 0;
+}
+
+static int cmp_by_order(const void *a, const void *b) {
+    const LayoutItem *x = a, *y = b;
+    if (x->order != y->order) return x->order < y->order ? -1 : 1;
+    return x->idx < y->idx ? -1 : (x->idx > y->idx);
+}
+
+static int cmp_by_key(const void *a, const void *b) {
+    const LayoutItem *x = a, *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->key2 != y->key2) return x->key2 < y->key2 ? -1 : 1;
+    return x->rank < y->rank ? -1 : (x->rank > y->rank);
+}
+
+/* 构建按访问名次排序的条目数组 */
+static LayoutItem* build_ranked_items(const BigCachePacker *packer) {
+    size_t n = packer->num_entries;
+    LayoutItem *items = calloc(n, sizeof(LayoutItem));
+    uint32_t *ids = calloc(n, sizeof(uint32_t));
+    if (!items || !ids || resolve_file_ids(packer, ids) < 0) {
+        free(items);
+        free(ids);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        items[i].idx = (uint32_t)i;
+        items[i].file_id = ids[i];
+        items[i].order = packer->entries[i].access_order;
+        items[i].offset = packer->entries[i].offset;
+    }
+    free(ids);
+
+    qsort(items, n, sizeof(LayoutItem), cmp_by_order);
+    for (size_t i = 0; i < n; i++) {
+        items[i].rank = (uint32_t)i;
+    }
+    return items;
+}
+
+/* 判断名次 r 处是否开始新阶段 */
+static int is_phase_start(const LayoutItem *items, size_t r, size_t phase_len,
+                          const LayoutOptions *opts) {
+    if (r == 0) return 1;
+    if (opts->max_phase_pages && phase_len >= opts->max_phase_pages) return 1;
+    return items[r].order - items[r - 1].order > opts->phase_gap;
+}
+
+/*
+ * 段内按文件聚类：文件按其在段内首次出现的名次排序，
+ * 文件内按偏移（by_offset）或访问名次排序
+ */
+static void cluster_segment(LayoutItem *items, size_t start, size_t end,
+                            uint32_t *file_first, int by_offset) {
+    for (size_t r = start; r < end; r++) {
+        file_first[items[r].file_id] = UINT32_MAX;
+    }
+    for (size_t r = start; r < end; r++) {
+        uint32_t f = items[r].file_id;
+        if (file_first[f] == UINT32_MAX) file_first[f] = items[r].rank;
+    }
+    for (size_t r = start; r < end; r++) {
+        items[r].key = file_first[items[r].file_id];
+        items[r].key2 = by_offset ? items[r].offset : items[r].rank;
+    }
+    qsort(items + start, end - start, sizeof(LayoutItem), cmp_by_key);
+}
+
+/* 共访问窗口聚类：领头页之后 window 个名次内的同文件页面紧随其后 */
+static int order_co_access(const BigCachePacker *packer, LayoutItem *items,
+                           uint32_t *out, const LayoutOptions *opts) {
+    size_t n = packer->num_entries;
+    size_t nf = packer->num_files;
+    uint32_t *start = calloc(nf + 1, sizeof(uint32_t));
+    uint32_t *cursor = calloc(nf + 1, sizeof(uint32_t));
+    uint32_t *list = malloc(n * sizeof(uint32_t));
+    uint8_t *placed = calloc(n, 1);
+    if (!start || !cursor || !list || !placed) {
+        free(start); free(cursor); free(list); free(placed);
+        return -ENOMEM;
+    }
+
+    /* 每个文件的页面按名次排列（计数排序）*/
+    for (size_t r = 0; r < n; r++) start[items[r].file_id + 1]++;
+    for (size_t f = 0; f < nf; f++) start[f + 1] += start[f];
+    memcpy(cursor, start, (nf + 1) * sizeof(uint32_t));
+    for (size_t r = 0; r < n; r++) list[cursor[items[r].file_id]++] = (uint32_t)r;
+    memcpy(cursor, start, nf * sizeof(uint32_t));
+
+    size_t k = 0;
+    for (size_t r = 0; r < n; r++) {
+        if (placed[r]) continue;
+
+        uint32_t f = items[r].file_id;
+        uint64_t limit = (uint64_t)r + opts->window_pages;
+        while (cursor[f] < start[f + 1] && list[cursor[f]] < limit) {
+            uint32_t q = list[cursor[f]++];
+            placed[q] = 1;
+            out[k++] = items[q].idx;
+        }
+    }
+
+    free(start); free(cursor); free(list); free(placed);
+    return 0;
+}
+
+/* 固定窗口 / 阶段切块 */
+static int order_segmented(const BigCachePacker *packer, LayoutItem *items,
+                           uint32_t *out, const LayoutOptions *opts,
+                           int by_phase) {
+    size_t n = packer->num_entries;
+    uint32_t *file_first = malloc((packer->num_files + 1) * sizeof(uint32_t));
+    if (!file_first) return -ENOMEM;
+
+    size_t seg_start = 0;
+    for (size_t r = 1; r <= n; r++) {
+        int boundary;
+        if (r == n) {
+            boundary = 1;
+        } else if (by_phase) {
+            boundary = is_phase_start(items, r, r - seg_start, opts);
+        } else {
+            boundary = opts->window_pages && r - seg_start >= opts->window_pages;
+        }
+        if (!boundary) continue;
+
+        cluster_segment(items, seg_start, r, file_first, !by_phase);
+        seg_start = r;
+    }
+
+    for (size_t r = 0; r < n; r++) out[r] = items[r].idx;
+    free(file_first);
+    return 0;
+}
+
+/* 按新顺序重排打包器条目 */
+static int apply_order(BigCachePacker *packer, const uint32_t *order) {
+    PackerPageEntry *entries = malloc(packer->capacity * sizeof(PackerPageEntry));
+    if (!entries) return -ENOMEM;
+
+    for (size_t i = 0; i < packer->num_entries; i++) {
+        entries[i] = packer->entries[order[i]];
+    }
+
+    free(packer->entries);
+    packer->entries = entries;
+    return 0;
+}
+
+int layout_optimize(BigCachePacker *packer,
+                    LayoutStrategy strategy,
+                    const LayoutOptions *opts) {
+    if (!packer || (int)strategy < 0 || strategy >= LAYOUT_NUM_STRATEGIES) {
+        return -EINVAL;
+    }
+    if (packer->num_entries == 0) return 0;
+
+    LayoutOptions defaults;
+    if (!opts) {
+        layout_default_options(&defaults);
+        opts = &defaults;
+    }
+
+    LayoutItem *items = build_ranked_items(packer);
+    uint32_t *order = malloc(packer->num_entries * sizeof(uint32_t));
+    if (!items || !order) {
+        free(items);
+        free(order);
+        return -ENOMEM;
+    }
+
+    int ret = 0;
+    switch (strategy) {
+        case LAYOUT_FIRST_ACCESS:
+            for (size_t r = 0; r < packer->num_entries; r++) order[r] = items[r].idx;
+            break;
+        case LAYOUT_CO_ACCESS:
+            ret = order_co_access(packer, items, order, opts);
+            break;
+        case LAYOUT_FILE_WINDOW:
+            ret = order_segmented(packer, items, order, opts, 0);
+            break;
+        case LAYOUT_PHASE_CHUNK:
+            ret = order_segmented(packer, items, order, opts, 1);
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+    }
+
+    if (ret == 0) {
+        ret = apply_order(packer, order);
+    }
+
+    free(items);
+    free(order);
+    return ret;
+}
+
+int layout_score(const BigCachePacker *packer,
+                 const LayoutOptions *opts,
+                 LayoutScore *score) {
+    if (!packer || !score) return -EINVAL;
+
+    LayoutOptions defaults;
+    if (!opts) {
+        layout_default_options(&defaults);
+        opts = &defaults;
+    }
+
+    memset(score, 0, sizeof(LayoutScore));
+    size_t n = packer->num_entries;
+    score->num_pages = n;
+    if (n == 0) return 0;
+
+    LayoutItem *items = build_ranked_items(packer);
+    if (!items) return -ENOMEM;
+
+    uint32_t read_pages = opts->read_pages ? opts->read_pages : 1;
+    uint64_t ra_start = 0, ra_end = 0;
+    uint64_t prev_pos = 0;
+    double total_ooo = 0;
+    size_t phase_len = 0;
+
+    /* 按访问名次回放：items[r].idx 即页面在布局中的位置 */
+    for (size_t r = 0; r < n; r++) {
+        uint64_t pos = items[r].idx;
+
+        if (!(pos >= ra_start && pos < ra_end)) {
+            score->expected_reads++;
+            ra_start = pos;
+            ra_end = pos + read_pages;
+        }
+
+        if (r > 0 && pos < prev_pos) score->backward_jumps++;
+        prev_pos = pos;
+
+        uint64_t dist = pos > r ? pos - r : r - pos;
+        total_ooo += dist;
+        if (dist > score->max_ooo_distance) score->max_ooo_distance = dist;
+
+        if (is_phase_start(items, r, phase_len, opts)) {
+            score->num_phases++;
+            phase_len = 0;
+        }
+        phase_len++;
+    }
+    score->avg_ooo_distance = total_ooo / n;
+
+    /* 布局相邻页的文件切换次数（按布局位置索引文件 ID）*/
+    uint32_t *file_at = malloc(n * sizeof(uint32_t));
+    if (file_at) {
+        for (size_t r = 0; r < n; r++) file_at[items[r].idx] = items[r].file_id;
+        for (size_t i = 1; i < n; i++) {
+            if (file_at[i] != file_at[i - 1]) score->file_switches++;
+        }
+        free(file_at);
+    }
+
+    free(items);
+    return 0;
+}
+
+void layout_print_score(const char *label, const LayoutScore *score) {
+    if (!score) return;
+
+    printf("%-14s pages=%lu reads=%lu ooo_avg=%.1f ooo_max=%lu "
+           "back_jumps=%lu file_switches=%lu phases=%u\n",
+           label ? label : "",
+           (unsigned long)score->num_pages,
+           (unsigned long)score->expected_reads,
+           score->avg_ooo_distance,
+           (unsigned long)score->max_ooo_distance,
+           (unsigned long)score->backward_jumps,
+           (unsigned long)score->file_switches,
+           score->num_phases);
+}
+
+int layout_write_csv(const BigCachePacker *packer, const char *csv_path) {
+    if (!packer || !csv_path) return -EINVAL;
+
+    FILE *fp = fopen(csv_path, "w");
+    if (!fp) {
+        perror("layout_write_csv: fopen");
+        return -errno;
+    }
+
+    fprintf(fp, "bigcache_offset,source_file,source_offset,size,"
+                "first_access_order,probability\n");
+    for (size_t i = 0; i < packer->num_entries; i++) {
+        const PackerPageEntry *pe = &packer->entries[i];
+        fprintf(fp, "%lu,%s,%lu,%u,%u,%.4f\n",
+                (unsigned long)(i * PAGE_SIZE),
+                pe->file_path,
+                (unsigned long)pe->offset,
+                pe->size,
+                pe->access_order,
+                pe->probability);
+    }
+
+    fclose(fp);
+    printf("Layout written: %s (%zu pages)\n", csv_path, packer->num_entries);
+    return 0;
+}
+
+/*
+ * ==================== 多 trace 共识布局 ====================
+ */
+
+typedef struct {
+    uint32_t path_id;            /* 路径驻留 ID */
+    uint64_t page;               /* 页号（offset / PAGE_SIZE）*/
+    uint64_t seen_mask;          /* 出现过的 trace 位图 */
+    float    median_rank;        /* 归一化首次访问名次的中位数 */
+} ConsensusPage;
+
+typedef struct {
+    uint64_t order;              /* trace 中的 Order 列 */
+    uint32_t seq;                /* 文件内行号（Order 相同时保持稳定）*/
+    uint32_t page_id;            /* 页面表下标 */
+} TraceEvent;
+
+typedef struct {
+    /* 路径驻留表 */
+    char **paths;
+    size_t num_paths;
+    size_t cap_paths;
+    int32_t *path_slots;
+    size_t num_path_slots;
+
+    /* 页面表 */
+    ConsensusPage *pages;
+    size_t num_pages;
+    size_t cap_pages;
+    int32_t *page_slots;
+    size_t num_page_slots;
+
+    /* 每页每个 trace 的归一化名次，未出现为 -1 */
+    float *ranks;
+    uint32_t num_traces;
+} ConsensusState;
+
+static uint64_t hash_page(uint32_t path_id, uint64_t page) {
+    uint64_t h = (page * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)path_id * 0xC2B2AE3D27D4EB4FULL);
+    return h ^ (h >> 29);
+}
+
+static void consensus_free(ConsensusState *st) {
+    for (size_t i = 0; i < st->num_paths; i++) free(st->paths[i]);
+    free(st->paths);
+    free(st->path_slots);
+    free(st->pages);
+    free(st->page_slots);
+    free(st->ranks);
+}
+
+/* 路径驻留：返回 ID，失败返回 -1 */
+static int32_t consensus_intern_path(ConsensusState *st, const char *path) {
+    if (st->num_paths * 2 >= st->num_path_slots) {
+        size_t n = st->num_path_slots ? st->num_path_slots * 2 : 1024;
+        int32_t *slots = malloc(n * sizeof(int32_t));
+        if (!slots) return -1;
+        memset(slots, 0xff, n * sizeof(int32_t));
+        for (size_t i = 0; i < st->num_paths; i++) {
+            size_t s = hash_path(st->paths[i]) & (n - 1);
+            while (slots[s] >= 0) s = (s + 1) & (n - 1);
+            slots[s] = (int32_t)i;
+        }
+        free(st->path_slots);
+        st->path_slots = slots;
+        st->num_path_slots = n;
+    }
+
+    size_t s = hash_path(path) & (st->num_path_slots - 1);
+    while (st->path_slots[s] >= 0) {
+        if (strcmp(st->paths[st->path_slots[s]], path) == 0) {
+            return st->path_slots[s];
+        }
+        s = (s + 1) & (st->num_path_slots - 1);
+    }
+
+    if (st->num_paths >= st->cap_paths) {
+        size_t cap = st->cap_paths ? st->cap_paths * 2 : 256;
+        char **paths = realloc(st->paths, cap * sizeof(char*));
+        if (!paths) return -1;
+        st->paths = paths;
+        st->cap_paths = cap;
+    }
+
+    st->paths[st->num_paths] = strdup(path);
+    if (!st->paths[st->num_paths]) return -1;
+    st->path_slots[s] = (int32_t)st->num_paths;
+    return (int32_t)st->num_paths++;
+}
+
+/* 查找或添加页面：返回页面表下标，失败返回 -1 */
+static int64_t consensus_find_page(ConsensusState *st, uint32_t path_id, uint64_t page) {
+    if (st->num_pages * 2 >= st->num_page_slots) {
+        size_t n = st->num_page_slots ? st->num_page_slots * 2 : 65536;
+        int32_t *slots = malloc(n * sizeof(int32_t));
+        if (!slots) return -1;
+        memset(slots, 0xff, n * sizeof(int32_t));
+        for (size_t i = 0; i < st->num_pages; i++) {
+            size_t s = hash_page(st->pages[i].path_id, st->pages[i].page) & (n - 1);
+            while (slots[s] >= 0) s = (s + 1) & (n - 1);
+            slots[s] = (int32_t)i;
+        }
+        free(st->page_slots);
+        st->page_slots = slots;
+        st->num_page_slots = n;
+    }
+
+    size_t s = hash_page(path_id, page) & (st->num_page_slots - 1);
+    while (st->page_slots[s] >= 0) {
+        ConsensusPage *cp = &st->pages[st->page_slots[s]];
+        if (cp->path_id == path_id && cp->page == page) {
+            return st->page_slots[s];
+        }
+        s = (s + 1) & (st->num_page_slots - 1);
+    }
+
+    if (st->num_pages >= st->cap_pages) {
+        size_t cap = st->cap_pages ? st->cap_pages * 2 : 16384;
+        ConsensusPage *pages = realloc(st->pages, cap * sizeof(ConsensusPage));
+        float *ranks = realloc(st->ranks, cap * st->num_traces * sizeof(float));
+        if (pages) st->pages = pages;
+        if (ranks) st->ranks = ranks;
+        if (!pages || !ranks) return -1;
+        st->cap_pages = cap;
+    }
+
+    ConsensusPage *cp = &st->pages[st->num_pages];
+    memset(cp, 0, sizeof(ConsensusPage));
+    cp->path_id = path_id;
+    cp->page = page;
+    for (uint32_t t = 0; t < st->num_traces; t++) {
+        st->ranks[st->num_pages * st->num_traces + t] = -1.0f;
+    }
+
+    st->page_slots[s] = (int32_t)st->num_pages;
+    return (int64_t)st->num_pages++;
+}
+
+/* 切分一行 CSV（PowerShell Export-Csv 会给每个字段加引号）*/
+static int split_csv_fields(char *line, char **fields, int max_fields) {
+    int n = 0;
+    char *p = line;
+
+    while (n < max_fields) {
+        while (*p == ' ') p++;
+        if (*p == '"') {
+            p++;
+            fields[n++] = p;
+            while (*p && *p != '"') p++;
+            if (*p == '"') *p++ = '\0';
+            while (*p && *p != ',') p++;
+        } else {
+            fields[n++] = p;
+            while (*p && *p != ',' && *p != '\r' && *p != '\n') p++;
+        }
+
+        if (*p != ',') {
+            *p = '\0';
+            break;
+        }
+        *p++ = '\0';
+    }
+    return n;
+}
+
+static int cmp_trace_event(const void *a, const void *b) {
+    const TraceEvent *x = a, *y = b;
+    if (x->order != y->order) return x->order < y->order ? -1 : 1;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+/*
+ * 加载一个 read_sequence.csv
+ * 列：Order,Type,Filename,,Offset,Size,Timestamp,Process（按表头名定位）
+ */
+static int consensus_load_trace(ConsensusState *st, const char *csv_path,
+                                uint32_t trace_idx, uint64_t *out_pages) {
+    FILE *fp = fopen(csv_path, "r");
+    if (!fp) {
+        fprintf(stderr, "layout_consensus: cannot open %s: %s\n",
+                csv_path, strerror(errno));
+        return -errno;
+    }
+
+    char line[2048];
+    char *fields[16];
+    int col_order = 0, col_file = 2, col_offset = 4, col_size = 5;
+
+    if (!fgets(line, sizeof(line), fp)) {
+        fclose(fp);
+        return -EIO;
+    }
+
+    int nf = split_csv_fields(line, fields, 16);
+    for (int i = 0; i < nf; i++) {
+        const char *name = fields[i];
+        if (strncmp(name, "\xEF\xBB\xBF", 3) == 0) name += 3;  /* UTF-8 BOM */
+        if (strcmp(name, "Order") == 0) col_order = i;
+        else if (strcmp(name, "Filename") == 0) col_file = i;
+        else if (strcmp(name, "Offset") == 0) col_offset = i;
+        else if (strcmp(name, "Size") == 0) col_size = i;
+    }
+    int min_fields = col_order;
+    if (col_file > min_fields) min_fields = col_file;
+    if (col_offset > min_fields) min_fields = col_offset;
+    if (col_size > min_fields) min_fields = col_size;
+
+    TraceEvent *events = NULL;
+    size_t num_events = 0, cap_events = 0;
+    uint32_t seq = 0;
+    int ret = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        nf = split_csv_fields(line, fields, 16);
+        if (nf <= min_fields || !fields[col_file][0]) continue;
+
+        uint64_t order = strtoull(fields[col_order], NULL, 10);
+        uint64_t offset = strtoull(fields[col_offset], NULL, 10);
+        uint64_t size = strtoull(fields[col_size], NULL, 10);
+        if (size == 0) size = 1;
+
+        int32_t path_id = consensus_intern_path(st, fields[col_file]);
+        if (path_id < 0) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        /* 一次读取可能跨多个页面 */
+        uint64_t first = offset / PAGE_SIZE;
+        uint64_t last = (offset + size - 1) / PAGE_SIZE;
+        for (uint64_t page = first; page <= last && ret == 0; page++) {
+            int64_t pid = consensus_find_page(st, (uint32_t)path_id, page);
+            if (pid < 0) {
+                ret = -ENOMEM;
+                break;
+            }
+
+            if (num_events >= cap_events) {
+                size_t cap = cap_events ? cap_events * 2 : 65536;
+                TraceEvent *ev = realloc(events, cap * sizeof(TraceEvent));
+                if (!ev) {
+                    ret = -ENOMEM;
+                    break;
+                }
+                events = ev;
+                cap_events = cap;
+            }
+            events[num_events].order = order;
+            events[num_events].seq = seq++;
+            events[num_events].page_id = (uint32_t)pid;
+            num_events++;
+        }
+        if (ret < 0) break;
+    }
+    fclose(fp);
+
+    if (ret < 0) {
+        free(events);
+        return ret;
+    }
+
+    /* 按 Order 排序后给首次访问的页面分配名次 */
+    qsort(events, num_events, sizeof(TraceEvent), cmp_trace_event);
+
+    uint32_t N = st->num_traces;
+    uint64_t unique = 0;
+    for (size_t i = 0; i < num_events; i++) {
+        uint32_t pid = events[i].page_id;
+        if (st->ranks[(size_t)pid * N + trace_idx] >= 0) continue;
+        st->ranks[(size_t)pid * N + trace_idx] = (float)unique++;
+        st->pages[pid].seen_mask |= 1ULL << trace_idx;
+    }
+
+    /* 归一化到 [0, 1)，消除不同 trace 长度差异 */
+    if (unique > 0) {
+        for (size_t pid = 0; pid < st->num_pages; pid++) {
+            float *r = &st->ranks[pid * N + trace_idx];
+            if (*r >= 0) *r /= (float)unique;
+        }
+    }
+
+    free(events);
+    *out_pages = unique;
+    printf("  Trace %u: %s (%lu unique pages)\n",
+           trace_idx, csv_path, (unsigned long)unique);
+    return 0;
+}
+
+static int cmp_float(const void *a, const void *b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return x < y ? -1 : (x > y);
+}
+
+static int cmp_consensus_page(const void *a, const void *b) {
+    const ConsensusPage *x = a, *y = b;
+    if (x->median_rank != y->median_rank) return x->median_rank < y->median_rank ? -1 : 1;
+
+    int px = __builtin_popcountll(x->seen_mask);
+    int py = __builtin_popcountll(y->seen_mask);
+    if (px != py) return px > py ? -1 : 1;
+
+    if (x->path_id != y->path_id) return x->path_id < y->path_id ? -1 : 1;
+    return x->page < y->page ? -1 : (x->page > y->page);
+}
+
+/* 留一法与单 trace 对照评估 */
+static void consensus_evaluate(const ConsensusState *st, double min_ratio,
+                               const uint64_t *trace_pages, ConsensusReport *report) {
+    uint32_t N = st->num_traces;
+    if (N < 2) return;
+
+    /* 用 N-1 个 trace 构建时的入选阈值 */
+    uint32_t loo_min = (uint32_t)(min_ratio * (N - 1) + 0.999999);
+    if (loo_min < 1) loo_min = 1;
+
+    double hit_sum = 0, size_sum = 0;
+    double single_hit_sum = 0;
+    uint64_t pair_count = 0;
+
+    for (uint32_t t = 0; t < N; t++) {
+        uint64_t bit = 1ULL << t;
+        uint64_t hits = 0, size = 0;
+        uint64_t *pair_hits = calloc(N, sizeof(uint64_t));
+
+        for (size_t i = 0; i < st->num_pages; i++) {
+            uint64_t mask = st->pages[i].seen_mask;
+            int others = __builtin_popcountll(mask & ~bit);
+            if ((uint32_t)others >= loo_min) {
+                size++;
+                if (mask & bit) hits++;
+            }
+            if (pair_hits && (mask & bit)) {
+                uint64_t rest = mask & ~bit;
+                while (rest) {
+                    pair_hits[__builtin_ctzll(rest)]++;
+                    rest &= rest - 1;
+                }
+            }
+        }
+
+        if (trace_pages[t] > 0) {
+            hit_sum += (double)hits / trace_pages[t];
+            if (pair_hits) {
+                for (uint32_t s = 0; s < N; s++) {
+                    if (s == t) continue;
+                    single_hit_sum += (double)pair_hits[s] / trace_pages[t];
+                    pair_count++;
+                }
+            }
+        }
+        size_sum += size;
+        free(pair_hits);
+    }
+
+    report->loo_hit_rate = hit_sum / N;
+    report->loo_avg_pages = size_sum / N;
+    report->single_hit_rate = pair_count ? single_hit_sum / pair_count : 0;
+    report->single_avg_pages = report->avg_pages_per_trace;
+}
+
+int layout_consensus(BigCachePacker *packer,
+                     const char *const *trace_paths,
+                     int num_traces,
+                     double min_ratio,
+                     ConsensusReport *report) {
+    if (!packer || !trace_paths || num_traces <= 0 ||
+        num_traces > CONSENSUS_MAX_TRACES || min_ratio < 0 || min_ratio > 1) {
+        return -EINVAL;
+    }
+
+    ConsensusState st;
+    memset(&st, 0, sizeof(st));
+    st.num_traces = (uint32_t)num_traces;
+
+    ConsensusReport local;
+    if (!report) report = &local;
+    memset(report, 0, sizeof(ConsensusReport));
+    report->num_traces = st.num_traces;
+
+    uint64_t trace_pages[CONSENSUS_MAX_TRACES] = {0};
+    uint64_t total_pages = 0;
+
+    printf("Building consensus layout from %d traces...\n", num_traces);
+    for (int t = 0; t < num_traces; t++) {
+        int ret = consensus_load_trace(&st, trace_paths[t], (uint32_t)t, &trace_pages[t]);
+        if (ret < 0) {
+            consensus_free(&st);
+            return ret;
+        }
+        total_pages += trace_pages[t];
+    }
+
+    uint32_t N = st.num_traces;
+    uint32_t min_runs = (uint32_t)(min_ratio * N + 0.999999);
+    if (min_runs < 1) min_runs = 1;
+
+    report->min_runs = min_runs;
+    report->union_pages = st.num_pages;
+    report->avg_pages_per_trace = (double)total_pages / N;
+
+    /* 入选页面：计算名次中位数 */
+    ConsensusPage *selected = malloc((st.num_pages + 1) * sizeof(ConsensusPage));
+    float *tmp = malloc(N * sizeof(float));
+    if (!selected || !tmp) {
+        free(selected);
+        free(tmp);
+        consensus_free(&st);
+        return -ENOMEM;
+    }
+
+    size_t num_selected = 0;
+    for (size_t i = 0; i < st.num_pages; i++) {
+        ConsensusPage *cp = &st.pages[i];
+        uint32_t seen = (uint32_t)__builtin_popcountll(cp->seen_mask);
+        if (seen < min_runs) continue;
+
+        uint32_t k = 0;
+        for (uint32_t t = 0; t < N; t++) {
+            float r = st.ranks[i * N + t];
+            if (r >= 0) tmp[k++] = r;
+        }
+        qsort(tmp, k, sizeof(float), cmp_float);
+        cp->median_rank = (k % 2) ? tmp[k / 2] : (tmp[k / 2 - 1] + tmp[k / 2]) / 2;
+
+        selected[num_selected++] = *cp;
+    }
+    free(tmp);
+
+    qsort(selected, num_selected, sizeof(ConsensusPage), cmp_consensus_page);
+
+    int ret = 0;
+    for (size_t i = 0; i < num_selected; i++) {
+        ConsensusPage *cp = &selected[i];
+        float prob = (float)__builtin_popcountll(cp->seen_mask) / N;
+        ret = packer_add_page_prob(packer, st.paths[cp->path_id],
+                                   cp->page * PAGE_SIZE, (uint32_t)(i + 1), prob);
+        if (ret < 0) {
+            fprintf(stderr, "layout_consensus: failed to add page: %d\n", ret);
+            break;
+        }
+    }
+    report->selected_pages = packer->num_entries;
+
+    if (ret == 0) {
+        consensus_evaluate(&st, min_ratio, trace_pages, report);
+    }
+
+    free(selected);
+    consensus_free(&st);
+    return ret;
+}
+
+void layout_print_consensus_report(const ConsensusReport *report) {
+    if (!report) return;
+
+    printf("\n=== Consensus Layout ===\n");
+    printf("Traces: %u (page kept if seen in >= %u runs)\n",
+           report->num_traces, report->min_runs);
+    printf("Union pages: %lu\n", (unsigned long)report->union_pages);
+    printf("Avg pages per trace: %.0f\n", report->avg_pages_per_trace);
+    printf("Selected pages: %lu (%.2f MB)\n",
+           (unsigned long)report->selected_pages,
+           (double)report->selected_pages * PAGE_SIZE / (1024 * 1024));
+
+    if (report->num_traces >= 2) {
+        printf("Leave-one-out hit rate: %.2f%% (avg %.0f pages)\n",
+               report->loo_hit_rate * 100, report->loo_avg_pages);
+        printf("Single-trace hit rate:  %.2f%% (avg %.0f pages)\n",
+               report->single_hit_rate * 100, report->single_avg_pages);
+    }
+    printf("========================\n\n");
+}
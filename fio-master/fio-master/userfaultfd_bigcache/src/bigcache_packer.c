@@ -9,11 +9,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include "bigcache.h"
+#include "bigcache_writer.h"
 
 #define INITIAL_CAPACITY 10000
 
@@ -95,6 +97,15 @@ int packer_add_page(BigCachePacker *packer,
                     const char *file_path,
                     uint64_t offset,
                     uint32_t access_order) {
+    return packer_add_page_prob(packer, file_path, offset, access_order, 1.0f);
+}
+
+/* 添加页面（带访问概率）*/
+int packer_add_page_prob(BigCachePacker *packer,
+                         const char *file_path,
+                         uint64_t offset,
+                         uint32_t access_order,
+                         float probability) {
     if (!packer || !file_path) return -EINVAL;
     
     /* 页对齐 */
@@ -123,6 +134,7 @@ int packer_add_page(BigCachePacker *packer,
     entry->offset = page_offset;
     entry->size = PAGE_SIZE;
     entry->access_order = access_order;
+    entry->probability = probability;
     
     packer->num_entries++;
     
@@ -155,7 +167,7 @@ int packer_load_from_csv(BigCachePacker *packer, const char *csv_path) {
     }
     
     /* 读取数据行 */
-    /* 格式: bigcache_offset,source_file,source_offset,size,first_access_order */
+    /* 格式: bigcache_offset,source_file,source_offset,size,first_access_order[,probability] */
     while (fgets(line, sizeof(line), fp)) {
         line_num++;
         
@@ -170,6 +182,7 @@ int packer_load_from_csv(BigCachePacker *packer, const char *csv_path) {
         char *source_offset_str = strtok(NULL, ",");
         char *size_str = strtok(NULL, ",");
         char *access_order_str = strtok(NULL, ",");
+        char *probability_str = strtok(NULL, ",");
         
         if (!bigcache_offset_str || !source_file || 
             !source_offset_str || !access_order_str) {
@@ -179,8 +192,10 @@ int packer_load_from_csv(BigCachePacker *packer, const char *csv_path) {
         
         uint64_t source_offset = strtoull(source_offset_str, NULL, 10);
         uint32_t access_order = strtoul(access_order_str, NULL, 10);
+        float probability = probability_str ? strtof(probability_str, NULL) : 1.0f;
         
-        int ret = packer_add_page(packer, source_file, source_offset, access_order);
+        int ret = packer_add_page_prob(packer, source_file, source_offset,
+                                       access_order, probability);
         if (ret < 0) {
             fprintf(stderr, "Error adding page at line %d: %d\n", line_num, ret);
         } else {
@@ -194,6 +209,202 @@ int packer_load_from_csv(BigCachePacker *packer, const char *csv_path) {
     return loaded;
 }
 
+/* 内置存储代价模型 */
+static const StorageCostModel g_cost_models[] = {
+    { "hdd",  150,  100,    8.0,  10000 },
+    { "ssd",  500,  50000,  0.1,  80 },
+    { "nvme", 3000, 500000, 0.02, 20 },
+    { "emmc", 300,  10000,  0.3,  200 },
+    { "ufs",  2000, 70000,  0.1,  50 },
+};
+
+const StorageCostModel* packer_get_cost_model(const char *name) {
+    if (!name) return NULL;
+    
+    for (size_t i = 0; i < sizeof(g_cost_models) / sizeof(g_cost_models[0]); i++) {
+        if (strcmp(g_cost_models[i].name, name) == 0) {
+            return &g_cost_models[i];
+        }
+    }
+    return NULL;
+}
+
+/* 预算选择时的排序条目 */
+typedef struct {
+    size_t idx;                  /* 打包器条目下标 */
+    double saving_us;            /* 预测节省（微秒）*/
+} BudgetItem;
+
+/* 排序键：条目指针随下标一起排序，比较函数不依赖全局状态 */
+typedef struct {
+    size_t idx;
+    const PackerPageEntry *entry;
+} EntryKey;
+
+/* 按 (文件, 偏移) 排序 */
+static int cmp_entry_by_file(const void *a, const void *b) {
+    const PackerPageEntry *x = ((const EntryKey*)a)->entry;
+    const PackerPageEntry *y = ((const EntryKey*)b)->entry;
+    int c = strcmp(x->file_path, y->file_path);
+    if (c != 0) return c;
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+/* 按访问序号排序 */
+static int cmp_entry_by_order(const void *a, const void *b) {
+    const EntryKey *x = a, *y = b;
+    if (x->entry->access_order != y->entry->access_order) {
+        return x->entry->access_order < y->entry->access_order ? -1 : 1;
+    }
+    return x->idx < y->idx ? -1 : (x->idx > y->idx);
+}
+
+static int cmp_budget_item(const void *a, const void *b) {
+    const BudgetItem *x = a, *y = b;
+    if (x->saving_us != y->saving_us) return x->saving_us > y->saving_us ? -1 : 1;
+    return x->idx < y->idx ? -1 : (x->idx > y->idx);
+}
+
+/* 按预算选择页面 */
+int packer_select_budget(BigCachePacker *packer,
+                         size_t budget_pages,
+                         const StorageCostModel *model,
+                         double critical_weight,
+                         BudgetReport *report) {
+    if (!packer || !model) return -EINVAL;
+    
+    BudgetReport local;
+    if (!report) report = &local;
+    memset(report, 0, sizeof(BudgetReport));
+    
+    size_t n = packer->num_entries;
+    report->candidate_pages = n;
+    if (n == 0) return 0;
+    
+    EntryKey *sorted = malloc(n * sizeof(EntryKey));
+    size_t *rank = malloc(n * sizeof(size_t));
+    uint8_t *sequential = calloc(n, 1);
+    BudgetItem *items = malloc(n * sizeof(BudgetItem));
+    if (!sorted || !rank || !sequential || !items) {
+        free(sorted); free(rank); free(sequential); free(items);
+        return -ENOMEM;
+    }
+    
+    /* 访问名次 */
+    for (size_t i = 0; i < n; i++) {
+        sorted[i].idx = i;
+        sorted[i].entry = &packer->entries[i];
+    }
+    qsort(sorted, n, sizeof(EntryKey), cmp_entry_by_order);
+    for (size_t r = 0; r < n; r++) rank[sorted[r].idx] = r;
+    
+    /* 回退时是否能被预读覆盖：同文件前一页在它之前被访问 */
+    qsort(sorted, n, sizeof(EntryKey), cmp_entry_by_file);
+    for (size_t k = 1; k < n; k++) {
+        const PackerPageEntry *prev = sorted[k - 1].entry;
+        const PackerPageEntry *cur = sorted[k].entry;
+        if (prev->offset + PAGE_SIZE == cur->offset &&
+            prev->access_order <= cur->access_order &&
+            strcmp(prev->file_path, cur->file_path) == 0) {
+            sequential[sorted[k].idx] = 1;
+            report->readahead_pages++;
+        }
+    }
+    
+    /* 每页预测节省 */
+    double seq_page_us = PAGE_SIZE / (model->sequential_read_mbps * 1024 * 1024) * 1e6;
+    
+    for (size_t i = 0; i < n; i++) {
+        const PackerPageEntry *pe = &packer->entries[i];
+        double fallback_us = sequential[i] ? seq_page_us : model->page_read_us;
+        double weight = 1.0 + critical_weight * (1.0 - (double)rank[i] / n);
+        
+        items[i].idx = i;
+        items[i].saving_us = pe->probability * weight * (fallback_us - seq_page_us);
+        if (items[i].saving_us < 0) items[i].saving_us = 0;
+        
+        report->expected_accesses += pe->probability;
+        report->max_saving_ms += items[i].saving_us / 1000;
+    }
+    
+    /* 贪心选择 */
+    size_t keep = (budget_pages == 0 || budget_pages > n) ? n : budget_pages;
+    qsort(items, n, sizeof(BudgetItem), cmp_budget_item);
+    
+    uint8_t *selected = sequential;  /* 复用缓冲区 */
+    memset(selected, 0, n);
+    for (size_t k = 0; k < keep; k++) {
+        selected[items[k].idx] = 1;
+        report->predicted_saving_ms += items[k].saving_us / 1000;
+        report->covered_accesses += packer->entries[items[k].idx].probability;
+    }
+    
+    /* 原地压缩，保持布局顺序 */
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!selected[i]) continue;
+        if (out != i) packer->entries[out] = packer->entries[i];
+        out++;
+    }
+    packer->num_entries = out;
+    
+    /* 页全部落选的文件从文件表中去掉，保持其余文件的顺序 */
+    uint8_t *used = calloc(packer->num_files ? packer->num_files : 1, 1);
+    if (used) {
+        for (size_t i = 0; i < out; i++) {
+            for (size_t f = 0; f < packer->num_files; f++) {
+                if (!used[f] && strcmp(packer->file_paths[f], packer->entries[i].file_path) == 0) {
+                    used[f] = 1;
+                    break;
+                }
+            }
+        }
+        size_t files_out = 0;
+        for (size_t f = 0; f < packer->num_files; f++) {
+            if (!used[f]) {
+                free(packer->file_paths[f]);
+                report->dropped_files++;
+                continue;
+            }
+            packer->file_paths[files_out++] = packer->file_paths[f];
+        }
+        packer->num_files = files_out;
+        free(used);
+    }
+    
+    report->selected_pages = out;
+    report->bigcache_read_ms = out * seq_page_us / 1000;
+    
+    free(sorted); free(rank); free(sequential); free(items);
+    return 0;
+}
+
+void packer_print_budget_report(const BudgetReport *report,
+                                const StorageCostModel *model) {
+    if (!report) return;
+    
+    printf("\n=== Budget Selection (%s) ===\n", model ? model->name : "?");
+    printf("Candidate pages: %zu (%.2f MB)\n", report->candidate_pages,
+           (double)report->candidate_pages * PAGE_SIZE / (1024 * 1024));
+    printf("Selected pages: %zu (%.2f MB)\n", report->selected_pages,
+           (double)report->selected_pages * PAGE_SIZE / (1024 * 1024));
+    printf("Readahead-friendly candidates: %zu\n", report->readahead_pages);
+    if (report->dropped_files > 0) {
+        printf("Files with no selected pages (dropped): %zu\n", report->dropped_files);
+    }
+    if (report->expected_accesses > 0) {
+        printf("Expected accesses covered: %.1f / %.1f (%.2f%%)\n",
+               report->covered_accesses, report->expected_accesses,
+               report->covered_accesses * 100 / report->expected_accesses);
+    }
+    printf("Predicted saving: %.2f ms (max %.2f ms, %.2f%%)\n",
+           report->predicted_saving_ms, report->max_saving_ms,
+           report->max_saving_ms > 0 ?
+               report->predicted_saving_ms * 100 / report->max_saving_ms : 0.0);
+    printf("BigCache sequential read: %.2f ms\n", report->bigcache_read_ms);
+    printf("==============================\n\n");
+}
+
 /* 构建 BigCache 文件 */
 int packer_build(BigCachePacker *packer, const char *output_path) {
     if (!packer || !output_path || packer->num_entries == 0) {
@@ -212,7 +423,9 @@ int packer_build(BigCachePacker *packer, const char *output_path) {
     /* 对齐 */
     size_t index_offset = header_size;
     size_t file_table_offset = index_offset + index_size;
-    size_t data_offset = (file_table_offset + file_table_size + PAGE_SIZE - 1) 
+    size_t file_stat_offset = file_table_offset + file_table_size;
+    size_t file_stat_size = packer->num_files * sizeof(BigCacheFileStat);
+    size_t data_offset = (file_stat_offset + file_stat_size + PAGE_SIZE - 1) 
                          & ~(PAGE_SIZE - 1);  /* 页对齐 */
     size_t total_size = data_offset + data_size;
     
@@ -222,44 +435,27 @@ int packer_build(BigCachePacker *packer, const char *output_path) {
     printf("  Data: %zu bytes (%.2f MB)\n", data_size, (double)data_size / (1024*1024));
     printf("  Total: %zu bytes (%.2f MB)\n", total_size, (double)total_size / (1024*1024));
     
-    /* 创建输出文件 */
-    int fd = open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) {
-        perror("packer_build: open output");
-        return -errno;
-    }
-    
-    /* 扩展文件大小 */
-    if (ftruncate(fd, total_size) < 0) {
-        perror("packer_build: ftruncate");
-        close(fd);
-        return -errno;
-    }
-    
-    /* mmap 输出文件 */
-    void *output = mmap(NULL, total_size, PROT_READ | PROT_WRITE, 
-                        MAP_SHARED, fd, 0);
-    if (output == MAP_FAILED) {
-        perror("packer_build: mmap output");
-        close(fd);
-        return -errno;
+    /* 元数据（头部 + 索引 + 文件表）先在内存中组装，再与页面数据一起流式写出 */
+    uint8_t *meta = calloc(1, data_offset);
+    if (!meta) {
+        return -ENOMEM;
     }
     
     /* 填充头部 */
-    BigCacheHeader *header = (BigCacheHeader*)output;
-    memset(header, 0, sizeof(BigCacheHeader));
+    BigCacheHeader *header = (BigCacheHeader*)meta;
     header->magic = BIGCACHE_MAGIC;
     header->version = BIGCACHE_VERSION;
     header->num_pages = packer->num_entries;
     header->num_files = packer->num_files;
     header->index_offset = index_offset;
     header->file_table_offset = file_table_offset;
+    header->file_stat_offset = file_stat_offset;
     header->data_offset = data_offset;
     header->total_size = total_size;
     
     /* 填充文件表 */
-    BigCacheFileEntry *file_table = (BigCacheFileEntry*)
-        ((uint8_t*)output + file_table_offset);
+    BigCacheFileEntry *file_table = (BigCacheFileEntry*)(meta + file_table_offset);
+    BigCacheFileStat *file_stats = (BigCacheFileStat*)(meta + file_stat_offset);
     
     for (size_t i = 0; i < packer->num_files; i++) {
         BigCacheFileEntry *fe = &file_table[i];
@@ -267,7 +463,15 @@ int packer_build(BigCachePacker *packer, const char *output_path) {
         strncpy(fe->path, packer->file_paths[i], MAX_PATH_LEN - 1);
         fe->path_len = strlen(fe->path);
         fe->total_pages = 0;
-        fe->original_size = 0;
+        
+        /* 运行时据此判断源文件是否已变化，取不到时为 0（不校验）*/
+        struct stat st;
+        if (stat(packer->file_paths[i], &st) == 0) {
+            fe->original_size = st.st_size;
+            file_stats[i].mtime_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ull +
+                                     (uint64_t)st.st_mtim.tv_nsec;
+            file_stats[i].ino = st.st_ino;
+        }
         
         /* 统计该文件的页数 */
         for (size_t j = 0; j < packer->num_entries; j++) {
@@ -277,19 +481,13 @@ int packer_build(BigCachePacker *packer, const char *output_path) {
         }
     }
     
-    /* 填充索引和数据 */
-    BigCachePageIndex *page_index = (BigCachePageIndex*)
-        ((uint8_t*)output + index_offset);
-    uint8_t *data_area = (uint8_t*)output + data_offset;
-    
-    int successful_pages = 0;
-    int failed_pages = 0;
+    /* 填充索引 */
+    BigCachePageIndex *page_index = (BigCachePageIndex*)(meta + index_offset);
     
     for (size_t i = 0; i < packer->num_entries; i++) {
         PackerPageEntry *pe = &packer->entries[i];
         BigCachePageIndex *pi = &page_index[i];
         
-        /* 填充索引 */
         pi->file_id = find_or_add_file(packer, pe->file_path);
         pi->source_offset = pe->offset;
         pi->access_order = pe->access_order;
@@ -301,13 +499,42 @@ int packer_build(BigCachePacker *packer, const char *output_path) {
             strstr(pe->file_path, ".oat")) {
             pi->flags |= PAGE_FLAG_EXECUTABLE;
         }
+    }
+    
+    /* 创建输出文件 */
+    BigCacheWriter *writer = bigcache_writer_open(output_path, total_size, 0);
+    if (!writer) {
+        free(meta);
+        return -EIO;
+    }
+    
+    /* 校验和覆盖 magic/version 之后的全部内容，写出时增量计算 */
+    uint32_t crc = bigcache_crc32_update(0, meta + sizeof(uint32_t) * 2,
+                                         data_offset - sizeof(uint32_t) * 2);
+    
+    int ret = bigcache_writer_write(writer, meta, data_offset);
+    free(meta);
+    
+    /* 写入页面数据 */
+    uint8_t page_data[PAGE_SIZE];
+    int successful_pages = 0;
+    int failed_pages = 0;
+    
+    /* 布局中同一文件的页面通常相邻，复用源文件描述符 */
+    const char *src_path = NULL;
+    int src_fd = -1;
+    
+    for (size_t i = 0; i < packer->num_entries && ret == 0; i++) {
+        PackerPageEntry *pe = &packer->entries[i];
         
-        /* 读取源文件数据 */
-        uint8_t *page_data = data_area + i * PAGE_SIZE;
+        if (!src_path || strcmp(src_path, pe->file_path) != 0) {
+            if (src_fd >= 0) close(src_fd);
+            src_fd = open(pe->file_path, O_RDONLY);
+            src_path = pe->file_path;
+        }
         
         /* 注意：这里需要实际的文件系统访问 */
         /* 在模拟环境中，我们填充测试数据 */
-        int src_fd = open(pe->file_path, O_RDONLY);
         if (src_fd >= 0) {
             /* 可以访问源文件 */
             if (pread(src_fd, page_data, PAGE_SIZE, pe->offset) == PAGE_SIZE) {
@@ -317,7 +544,6 @@ int packer_build(BigCachePacker *packer, const char *output_path) {
                 memset(page_data, 0, PAGE_SIZE);
                 failed_pages++;
             }
-            close(src_fd);
         } else {
             /* 无法访问源文件，填充模拟数据 */
             /* 用于测试目的 */
@@ -336,28 +562,41 @@ int packer_build(BigCachePacker *packer, const char *output_path) {
             failed_pages++;
         }
         
+        crc = bigcache_crc32_update(crc, page_data, PAGE_SIZE);
+        ret = bigcache_writer_write(writer, page_data, PAGE_SIZE);
+        
         if ((i + 1) % 10000 == 0) {
             printf("  Progress: %zu / %zu pages\n", i + 1, packer->num_entries);
         }
     }
     
-    /* 计算校验和 */
-    header->checksum = bigcache_crc32((uint8_t*)output + sizeof(uint32_t) * 2,
-                                      total_size - sizeof(uint32_t) * 2);
+    if (src_fd >= 0) close(src_fd);
     
-    /* 同步并取消映射 */
-    if (msync(output, total_size, MS_SYNC) < 0) {
-        perror("packer_build: msync");
+    /* 回填校验和 */
+    if (ret == 0) {
+        ret = bigcache_writer_patch_head(writer, offsetof(BigCacheHeader, checksum),
+                                         &crc, sizeof(crc));
     }
     
-    munmap(output, total_size);
-    close(fd);
+    /* 刷出并只同步输出文件；统计在关闭后读取，包含最后一块 */
+    BigCacheWriterStats wstats;
+    int close_ret = bigcache_writer_close(writer, &wstats);
+    if (ret == 0) ret = close_ret;
+    
+    if (ret < 0) {
+        fprintf(stderr, "packer_build: write output failed: %s\n", strerror(-ret));
+        unlink(output_path);
+        return ret;
+    }
     
     printf("\nBigCache built successfully:\n");
     printf("  Output: %s\n", output_path);
     printf("  Size: %.2f MB\n", (double)total_size / (1024*1024));
     printf("  Successful pages: %d\n", successful_pages);
     printf("  Simulated pages: %d\n", failed_pages);
+    printf("  Writer: %s, %lu writes, %.1f ms waiting on I/O\n",
+           wstats.direct ? "O_DIRECT" : "buffered", (unsigned long)wstats.write_calls,
+           wstats.io_wait_ms);
     
     return 0;
 }
@@ -0,0 +1,310 @@
+/*
+ * BigCache 驻留管理实现
+ *
+ * 每次采样计算当前级别，再按页决定目标状态：
+ *   已服务页：STARTUP 锁定，SETTLED COLD，PRESSURE/CRITICAL PAGEOUT
+ *   未服务页：CRITICAL 时 PAGEOUT，否则锁定
+ * 目标高于当前状态的页按连续段合并，每段一次 munlock（首次释放时）和一次 madvise。
+ * 启动阶段结束时整个数据区一次 munlock：此后不再需要钉住任何页，
+ * 也避免按段解锁把一个 VMA 拆成成千上万个；启动阶段内因压力释放时才按段解锁
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "bigcache_residency.h"
+
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+#define RES_LOCKED   0
+#define RES_COLD     1
+#define RES_PAGEOUT  2
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void residency_default_config(ResidencyConfig *config) {
+    memset(config, 0, sizeof(*config));
+    strcpy(config->psi_path, RESIDENCY_DEFAULT_PSI_PATH);
+    config->poll_ms = 500;
+    config->startup_ms = 10000;
+    config->some_threshold = 10.0;
+    config->full_threshold = 5.0;
+}
+
+const char* residency_level_name(int level) {
+    switch (level) {
+    case RESIDENCY_STARTUP:  return "startup";
+    case RESIDENCY_SETTLED:  return "settled";
+    case RESIDENCY_PRESSURE: return "pressure";
+    case RESIDENCY_CRITICAL: return "critical";
+    default:                 return "?";
+    }
+}
+
+/*
+ * 格式：
+ *   some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ *   full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ */
+int residency_read_psi(const char *path, double *some_avg10, double *full_avg10) {
+    FILE *fp = fopen(path, "re");
+    if (!fp) return -errno;
+
+    char line[256];
+    int found = 0;
+    *some_avg10 = 0;
+    *full_avg10 = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        double avg10;
+        if (sscanf(line, "some avg10=%lf", &avg10) == 1) {
+            *some_avg10 = avg10;
+            found++;
+        } else if (sscanf(line, "full avg10=%lf", &avg10) == 1) {
+            *full_avg10 = avg10;
+            found++;
+        }
+    }
+    fclose(fp);
+    return found ? 0 : -EINVAL;
+}
+
+ResidencyManager* residency_create(BigCacheContext *bigcache, const ResidencyConfig *config) {
+    if (!bigcache || !bigcache->is_loaded) return NULL;
+
+    ResidencyManager *rm = calloc(1, sizeof(ResidencyManager));
+    if (!rm) return NULL;
+
+    rm->state = calloc(bigcache->header.num_pages ? bigcache->header.num_pages : 1, 1);
+    if (!rm->state) {
+        free(rm);
+        return NULL;
+    }
+
+    rm->bigcache = bigcache;
+    if (config) {
+        rm->config = *config;
+    } else {
+        residency_default_config(&rm->config);
+    }
+    if (rm->config.poll_ms <= 0) rm->config.poll_ms = 500;
+
+    pthread_mutex_init(&rm->lock, NULL);
+    pthread_cond_init(&rm->wake, NULL);
+    rm->start_ms = now_ms();
+    rm->stats.settled_ms = -1;
+    return rm;
+}
+
+void residency_destroy(ResidencyManager *rm) {
+    if (!rm) return;
+    residency_stop(rm);
+    pthread_cond_destroy(&rm->wake);
+    pthread_mutex_destroy(&rm->lock);
+    free(rm->state);
+    free(rm);
+}
+
+/* 数据区 [first, end) 页从 from 升到 to */
+static void release_range(ResidencyManager *rm, uint32_t first, uint32_t end,
+                          int from, int to) {
+    BigCacheContext *bc = rm->bigcache;
+    uint8_t *addr = (uint8_t*)bc->mapped_data + bc->header.data_offset +
+                    (uint64_t)first * PAGE_SIZE;
+    size_t len = (size_t)(end - first) * PAGE_SIZE;
+    uint32_t pages = end - first;
+
+    /* 锁定的页 MADV_COLD/PAGEOUT 不生效，先解锁 */
+    if (from == RES_LOCKED && !rm->all_unlocked) {
+        if (munlock(addr, len) == 0) rm->stats.unlocked_pages += pages;
+    }
+
+    rm->stats.madvise_calls++;
+    if (madvise(addr, len, to == RES_COLD ? MADV_COLD : MADV_PAGEOUT) < 0) {
+        rm->stats.madvise_errors++;
+    } else if (to == RES_COLD) {
+        rm->stats.cold_pages += pages;
+    } else {
+        rm->stats.pageout_pages += pages;
+    }
+
+    memset(rm->state + first, to, pages);
+}
+
+int residency_tick(ResidencyManager *rm) {
+    pthread_mutex_lock(&rm->lock);
+    BigCacheContext *bc = rm->bigcache;
+    rm->stats.ticks++;
+
+    /* 预热完成前 mlock 尚未施加，此时释放会被随后的 mlock 覆盖 */
+    if (!bc->is_preheated) {
+        int level = rm->stats.level;
+        pthread_mutex_unlock(&rm->lock);
+        return level;
+    }
+
+    int level = RESIDENCY_STARTUP;
+    double elapsed = now_ms() - rm->start_ms;
+    if (rm->startup_done ||
+        (rm->config.startup_ms > 0 && elapsed >= rm->config.startup_ms)) {
+        level = RESIDENCY_SETTLED;
+    }
+
+    if (level == RESIDENCY_SETTLED && !rm->all_unlocked) {
+        double start = now_ms();
+        if (munlock((uint8_t*)bc->mapped_data + bc->header.data_offset,
+                    (size_t)bc->header.num_pages * PAGE_SIZE) == 0) {
+            for (uint32_t i = 0; i < bc->header.num_pages; i++) {
+                if (rm->state[i] == RES_LOCKED) rm->stats.unlocked_pages++;
+            }
+        }
+        rm->all_unlocked = 1;
+        rm->stats.release_ms += now_ms() - start;
+    }
+
+    double some, full;
+    if (residency_read_psi(rm->config.psi_path, &some, &full) == 0) {
+        rm->stats.last_some = some;
+        rm->stats.last_full = full;
+        if (some >= rm->config.some_threshold && level < RESIDENCY_PRESSURE) {
+            level = RESIDENCY_PRESSURE;
+        }
+        if (full >= rm->config.full_threshold) level = RESIDENCY_CRITICAL;
+    } else {
+        rm->stats.psi_errors++;
+    }
+
+    /* 只升不降：压力过后重新锁定会与回收相互抵消 */
+    if (level < rm->stats.max_level) level = rm->stats.max_level;
+    if (level > RESIDENCY_STARTUP && rm->stats.settled_ms < 0) {
+        rm->stats.settled_ms = elapsed;
+    }
+    rm->stats.level = level;
+    rm->stats.max_level = level;
+
+    if (level == RESIDENCY_STARTUP) {
+        pthread_mutex_unlock(&rm->lock);
+        return level;
+    }
+
+    int served_target = level >= RESIDENCY_PRESSURE ? RES_PAGEOUT : RES_COLD;
+    int cold_target = level >= RESIDENCY_CRITICAL ? RES_PAGEOUT : RES_LOCKED;
+
+    double start = now_ms();
+    uint32_t num_pages = bc->header.num_pages;
+    uint32_t run_start = 0;
+    int run_from = -1, run_to = -1;
+
+    for (uint32_t i = 0; i <= num_pages; i++) {
+        int from = -1, to = -1;
+        if (i < num_pages) {
+            int target = bigcache_slot_served(bc, i) ? served_target : cold_target;
+            if (target > rm->state[i]) {
+                from = rm->state[i];
+                to = target;
+            }
+        }
+
+        if (from == run_from && to == run_to) continue;
+        if (run_to >= 0) release_range(rm, run_start, i, run_from, run_to);
+        run_start = i;
+        run_from = from;
+        run_to = to;
+    }
+    rm->stats.release_ms += now_ms() - start;
+
+    pthread_mutex_unlock(&rm->lock);
+    return level;
+}
+
+static void* residency_thread(void *arg) {
+    ResidencyManager *rm = arg;
+
+    pthread_mutex_lock(&rm->lock);
+    while (!rm->stop) {
+        pthread_mutex_unlock(&rm->lock);
+        residency_tick(rm);
+        pthread_mutex_lock(&rm->lock);
+
+        if (rm->stop) break;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)(rm->config.poll_ms % 1000) * 1000000;
+        deadline.tv_sec += rm->config.poll_ms / 1000 + deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&rm->wake, &rm->lock, &deadline);
+    }
+    pthread_mutex_unlock(&rm->lock);
+    return NULL;
+}
+
+int residency_start(ResidencyManager *rm) {
+    if (!rm || rm->running) return -EINVAL;
+
+    rm->stop = 0;
+    int ret = pthread_create(&rm->thread, NULL, residency_thread, rm);
+    if (ret != 0) return -ret;
+    rm->running = 1;
+    return 0;
+}
+
+void residency_stop(ResidencyManager *rm) {
+    if (!rm || !rm->running) return;
+
+    pthread_mutex_lock(&rm->lock);
+    rm->stop = 1;
+    pthread_cond_signal(&rm->wake);
+    pthread_mutex_unlock(&rm->lock);
+
+    pthread_join(rm->thread, NULL);
+    rm->running = 0;
+}
+
+void residency_startup_done(ResidencyManager *rm) {
+    if (!rm) return;
+
+    pthread_mutex_lock(&rm->lock);
+    rm->startup_done = 1;
+    pthread_cond_signal(&rm->wake);
+    pthread_mutex_unlock(&rm->lock);
+}
+
+void residency_print_stats(ResidencyManager *rm) {
+    if (!rm) return;
+
+    pthread_mutex_lock(&rm->lock);
+    ResidencyStats *s = &rm->stats;
+    printf("Residency: level %s, %llu ticks, PSI some %.2f full %.2f%s\n",
+           residency_level_name(s->level), (unsigned long long)s->ticks,
+           s->last_some, s->last_full, s->psi_errors ? " (PSI unavailable)" : "");
+    if (s->settled_ms >= 0) {
+        printf("  left startup after %.0f ms\n", s->settled_ms);
+    }
+    printf("  served: %u/%u pages\n",
+           __atomic_load_n(&rm->bigcache->served_pages, __ATOMIC_RELAXED),
+           rm->bigcache->header.num_pages);
+    printf("  released: %llu pages unlocked (%.2f MB), %llu cold, %llu paged out in %.2f ms\n",
+           (unsigned long long)s->unlocked_pages,
+           (double)s->unlocked_pages * PAGE_SIZE / (1024 * 1024),
+           (unsigned long long)s->cold_pages, (unsigned long long)s->pageout_pages,
+           s->release_ms);
+    if (s->madvise_errors) {
+        printf("  madvise: %llu/%llu calls failed\n",
+               (unsigned long long)s->madvise_errors, (unsigned long long)s->madvise_calls);
+    }
+    pthread_mutex_unlock(&rm->lock);
+}
@@ -77,6 +77,12 @@ typedef struct {
     BigCachePageIndex *index;
     char **file_names;
     
+    /* 页查找表：page_slots[file_id][源文件页号] = 数据区序号 + 1（0 为不在 BigCache 中）*/
+    uint32_t **page_slots;
+    uint32_t *file_pages;        /* 每个文件查找表的长度（最大页号 + 1）*/
+    double index_build_ms;
+    size_t index_bytes;
+    
     /* fd 跟踪 */
     FdInfo fds[MAX_FDS];
     
@@ -85,6 +91,12 @@ typedef struct {
     uint64_t bypassed_reads;
     uint64_t bytes_served;
     double total_time_us;
+    
+    /* 每次 pread64 的查找开销（命中与未命中都计）*/
+    uint64_t lookups;
+    uint64_t lookup_hits;
+    double lookup_time_us;
+    double max_lookup_us;
 } TracerState;
 
 static TracerState g_state = {0};
@@ -166,21 +178,70 @@ static int load_bigcache(const char *path) {
     return 0;
 }
 
-/* 查找页面在 BigCache 中的位置 */
-static void *find_page_in_bigcache(uint32_t file_id, uint64_t offset) {
-    /* 简单线性搜索（可优化为哈希表）*/
-    uint64_t page_offset = (offset / PAGE_SIZE) * PAGE_SIZE;
+/*
+ * 建立页查找表：先求每个文件的最大页号，再填入数据区序号。
+ * 被跟踪进程在每次 pread64 处停住等待查找，逐条扫描索引的代价随页数线性增长
+ */
+static int build_page_index(void) {
+    double start = get_time_us();
+    uint32_t num_files = g_state.header->num_files;
+    
+    g_state.page_slots = calloc(num_files, sizeof(uint32_t *));
+    g_state.file_pages = calloc(num_files, sizeof(uint32_t));
+    if (!g_state.page_slots || !g_state.file_pages) return -1;
     
     for (uint32_t i = 0; i < g_state.header->num_pages; i++) {
-        if (g_state.index[i].file_id == file_id &&
-            g_state.index[i].source_offset == page_offset) {
-            /* 计算 bigcache_offset: data_offset + i * PAGE_SIZE */
-            uint64_t bigcache_offset = g_state.header->data_offset + (uint64_t)i * PAGE_SIZE;
-            return (char *)g_state.bigcache_data + bigcache_offset;
+        BigCachePageIndex *pi = &g_state.index[i];
+        uint32_t page = (uint32_t)(pi->source_offset / PAGE_SIZE);
+        if (pi->file_id < num_files && page + 1 > g_state.file_pages[pi->file_id]) {
+            g_state.file_pages[pi->file_id] = page + 1;
         }
     }
     
-    return NULL;
+    g_state.index_bytes = num_files * (sizeof(uint32_t *) + sizeof(uint32_t));
+    for (uint32_t f = 0; f < num_files; f++) {
+        g_state.page_slots[f] = calloc(g_state.file_pages[f] + 1, sizeof(uint32_t));
+        if (!g_state.page_slots[f]) return -1;
+        g_state.index_bytes += (g_state.file_pages[f] + 1) * sizeof(uint32_t);
+    }
+    
+    for (uint32_t i = 0; i < g_state.header->num_pages; i++) {
+        BigCachePageIndex *pi = &g_state.index[i];
+        if (pi->file_id >= num_files) continue;
+        g_state.page_slots[pi->file_id][pi->source_offset / PAGE_SIZE] = i + 1;
+    }
+    
+    g_state.index_build_ms = (get_time_us() - start) / 1000;
+    printf("Page index built: %.2f KB in %.2f ms\n",
+           (double)g_state.index_bytes / 1024, g_state.index_build_ms);
+    return 0;
+}
+
+static void free_page_index(void) {
+    if (g_state.page_slots) {
+        for (uint32_t f = 0; f < g_state.header->num_files; f++) {
+            free(g_state.page_slots[f]);
+        }
+        free(g_state.page_slots);
+        g_state.page_slots = NULL;
+    }
+    free(g_state.file_pages);
+    g_state.file_pages = NULL;
+}
+
+/* 查找页面在 BigCache 中的位置 */
+static void *find_page_in_bigcache(uint32_t file_id, uint64_t offset) {
+    uint64_t page = offset / PAGE_SIZE;
+    if (file_id >= g_state.header->num_files || page >= g_state.file_pages[file_id]) {
+        return NULL;
+    }
+    
+    uint32_t slot = g_state.page_slots[file_id][page];
+    if (slot == 0) return NULL;
+    
+    /* 计算 bigcache_offset: data_offset + 序号 * PAGE_SIZE */
+    uint64_t bigcache_offset = g_state.header->data_offset + (uint64_t)(slot - 1) * PAGE_SIZE;
+    return (char *)g_state.bigcache_data + bigcache_offset;
 }
 
 /* 检查文件是否需要跟踪 */
@@ -281,7 +342,14 @@ static void handle_pread64(pid_t pid, struct user_regs_struct *regs, int is_exit
         double start = get_time_us();
         
         void *cached_data = find_page_in_bigcache(g_state.fds[fd].file_id, offset);
+        double lookup_us = get_time_us() - start;
+        g_state.lookups++;
+        g_state.lookup_time_us += lookup_us;
+        if (lookup_us > g_state.max_lookup_us) g_state.max_lookup_us = lookup_us;
+        
         if (cached_data) {
+            g_state.lookup_hits++;
+            
             /* 计算页内偏移 */
             size_t page_offset = offset % PAGE_SIZE;
             size_t to_copy = PAGE_SIZE - page_offset;
@@ -385,6 +453,14 @@ static void print_stats(void) {
         printf("Avg intercept time: %.2f us\n", 
                g_state.total_time_us / g_state.intercepted_reads);
     }
+    printf("Page index: %.2f KB, built in %.2f ms\n",
+           (double)g_state.index_bytes / 1024, g_state.index_build_ms);
+    printf("Lookups: %lu (%lu hits), total %.2f ms\n",
+           g_state.lookups, g_state.lookup_hits, g_state.lookup_time_us / 1000);
+    if (g_state.lookups > 0) {
+        printf("Avg lookup time: %.3f us, max %.2f us\n",
+               g_state.lookup_time_us / g_state.lookups, g_state.max_lookup_us);
+    }
     printf("=========================\n");
 }
 
@@ -409,6 +485,10 @@ int main(int argc, char *argv[]) {
     if (load_bigcache(bigcache_path) < 0) {
         return 1;
     }
+    if (build_page_index() < 0) {
+        fprintf(stderr, "Out of memory building page index\n");
+        return 1;
+    }
     
     pid_t target_pid = 0;
     
@@ -451,6 +531,7 @@ int main(int argc, char *argv[]) {
     print_stats();
     
     /* 清理 */
+    free_page_index();
     if (g_state.bigcache_data) {
         munmap(g_state.bigcache_data, g_state.bigcache_size);
     }
@@ -0,0 +1,297 @@
+/*
+ * BigCache 流式输出写入器实现
+ *
+ * 生产者填充当前缓冲区，满后交给后台线程 pwrite，自己切换到另一个缓冲区
+ * 继续填充，读源文件与写 BigCache.bin 重叠进行。
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "bigcache_writer.h"
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* 完整写出一段数据 */
+static int write_full(BigCacheWriter *w, const uint8_t *buf, size_t len,
+                      uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(w->fd, buf, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        if (n == 0) return -EIO;
+        w->write_calls++;
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* 非 O_DIRECT 模式：写回已写区间后丢弃页缓存，避免挤占设备内存 */
+static void drop_written_range(BigCacheWriter *w, uint64_t offset, size_t len) {
+    if (w->direct) return;
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(w->fd, offset, len,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                    SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+    posix_fadvise(w->fd, offset, len, POSIX_FADV_DONTNEED);
+}
+
+/* 后台写线程 */
+static void* writer_thread_func(void *arg) {
+    BigCacheWriter *w = (BigCacheWriter*)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->pending && !w->stop) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (!w->pending && w->stop) break;
+
+        int idx = w->pending_buf;
+        size_t len = w->pending_len;
+        uint64_t offset = w->pending_offset;
+        pthread_mutex_unlock(&w->lock);
+
+        int ret = write_full(w, w->bufs[idx], len, offset);
+        if (ret == 0) drop_written_range(w, offset, len);
+
+        pthread_mutex_lock(&w->lock);
+        if (ret < 0 && w->io_error == 0) w->io_error = ret;
+        w->pending = 0;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/* 等待写线程空闲 */
+static int wait_idle(BigCacheWriter *w) {
+    double t0 = now_ms();
+    pthread_mutex_lock(&w->lock);
+    while (w->pending) {
+        pthread_cond_wait(&w->cond, &w->lock);
+    }
+    int err = w->io_error;
+    pthread_mutex_unlock(&w->lock);
+    w->io_wait_ms += now_ms() - t0;
+    return err;
+}
+
+/* 将当前缓冲区交给写线程（len 需已按 BCW_ALIGN 对齐）*/
+static int submit_current(BigCacheWriter *w, size_t len) {
+    int err = wait_idle(w);
+    if (err < 0) return err;
+
+    pthread_mutex_lock(&w->lock);
+    w->pending = 1;
+    w->pending_buf = w->cur;
+    w->pending_len = len;
+    w->pending_offset = w->offset;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    w->offset += len;
+    w->cur ^= 1;
+    w->fill = 0;
+    return 0;
+}
+
+BigCacheWriter* bigcache_writer_open(const char *path,
+                                     uint64_t expected_size,
+                                     size_t buf_size) {
+    if (!path) return NULL;
+
+    if (buf_size == 0) buf_size = BCW_DEFAULT_BUF_SIZE;
+    buf_size = (buf_size + BCW_ALIGN - 1) & ~((size_t)BCW_ALIGN - 1);
+
+    BigCacheWriter *w = calloc(1, sizeof(BigCacheWriter));
+    if (!w) return NULL;
+
+    w->expected_size = expected_size;
+    w->buf_size = buf_size;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (w->fd >= 0) {
+        w->direct = 1;
+    } else if (errno == EINVAL) {
+        /* 文件系统不支持 O_DIRECT */
+        w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (w->fd < 0) {
+        perror("bigcache_writer_open: open");
+        free(w);
+        return NULL;
+    }
+
+    /* 预分配连续空间；不支持时由最终的 ftruncate 设定大小 */
+    if (expected_size > 0 && fallocate(w->fd, 0, 0, expected_size) < 0 &&
+        errno != EOPNOTSUPP && errno != ENOSYS) {
+        perror("bigcache_writer_open: fallocate");
+    }
+
+    if (posix_memalign((void**)&w->bufs[0], BCW_ALIGN, buf_size) != 0 ||
+        posix_memalign((void**)&w->bufs[1], BCW_ALIGN, buf_size) != 0 ||
+        posix_memalign((void**)&w->head_block, BCW_ALIGN, BCW_ALIGN) != 0) {
+        fprintf(stderr, "bigcache_writer_open: cannot allocate buffers\n");
+        goto fail;
+    }
+    memset(w->head_block, 0, BCW_ALIGN);
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+
+    if (pthread_create(&w->io_thread, NULL, writer_thread_func, w) != 0) {
+        fprintf(stderr, "bigcache_writer_open: cannot create writer thread\n");
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        goto fail;
+    }
+
+    return w;
+
+fail:
+    free(w->bufs[0]);
+    free(w->bufs[1]);
+    free(w->head_block);
+    close(w->fd);
+    unlink(path);
+    free(w);
+    return NULL;
+}
+
+/* data 为 NULL 时追加 0 */
+static int append(BigCacheWriter *w, const void *data, size_t len) {
+    const uint8_t *src = (const uint8_t*)data;
+
+    /* 记录首个对齐块的内容，供 patch_head 使用 */
+    uint64_t logical = w->offset + w->fill;
+    if (logical < BCW_ALIGN) {
+        size_t n = BCW_ALIGN - logical;
+        if (n > len) n = len;
+        if (src) memcpy(w->head_block + logical, src, n);
+        else memset(w->head_block + logical, 0, n);
+    }
+
+    while (len > 0) {
+        size_t n = w->buf_size - w->fill;
+        if (n > len) n = len;
+
+        if (src) {
+            memcpy(w->bufs[w->cur] + w->fill, src, n);
+            src += n;
+        } else {
+            memset(w->bufs[w->cur] + w->fill, 0, n);
+        }
+        w->fill += n;
+        len -= n;
+        w->bytes_written += n;
+
+        if (w->fill == w->buf_size) {
+            int ret = submit_current(w, w->buf_size);
+            if (ret < 0) return ret;
+        }
+    }
+
+    return 0;
+}
+
+int bigcache_writer_write(BigCacheWriter *w, const void *data, size_t len) {
+    if (!w || (!data && len > 0)) return -EINVAL;
+    return append(w, data, len);
+}
+
+int bigcache_writer_pad(BigCacheWriter *w, size_t len) {
+    if (!w) return -EINVAL;
+    return append(w, NULL, len);
+}
+
+int bigcache_writer_patch_head(BigCacheWriter *w, size_t offset,
+                               const void *data, size_t len) {
+    if (!w || !data || offset + len > BCW_ALIGN) return -EINVAL;
+
+    memcpy(w->head_block + offset, data, len);
+
+    /* 首块仍在当前缓冲区中时直接修改，由正常写出路径带出 */
+    if (w->offset == 0) {
+        memcpy(w->bufs[w->cur] + offset, data, len);
+        return 0;
+    }
+
+    /* 已写出：等待写线程空闲后重写整个对齐块 */
+    int err = wait_idle(w);
+    if (err < 0) return err;
+    return write_full(w, w->head_block, BCW_ALIGN, 0);
+}
+
+int bigcache_writer_close(BigCacheWriter *w, BigCacheWriterStats *stats) {
+    if (!w) return -EINVAL;
+
+    uint64_t final_size = w->offset + w->fill;
+    int ret = 0;
+
+    /* 最后一个缓冲区补齐到对齐粒度后写出 */
+    if (w->fill > 0) {
+        size_t aligned = (w->fill + BCW_ALIGN - 1) & ~((size_t)BCW_ALIGN - 1);
+        memset(w->bufs[w->cur] + w->fill, 0, aligned - w->fill);
+        ret = submit_current(w, aligned);
+    }
+
+    int err = wait_idle(w);
+    if (ret == 0) ret = err;
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->io_thread, NULL);
+
+    /* 去掉对齐填充和 fallocate 的多余部分 */
+    if (ftruncate(w->fd, final_size) < 0 && ret == 0) {
+        ret = -errno;
+    }
+
+    double t0 = now_ms();
+    if (fsync(w->fd) < 0 && ret == 0) {
+        ret = -errno;
+    }
+    w->io_wait_ms += now_ms() - t0;
+
+    if (!w->direct) {
+        posix_fadvise(w->fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    close(w->fd);
+
+    if (stats) {
+        stats->bytes_written = w->bytes_written;
+        stats->write_calls = w->write_calls;
+        stats->io_wait_ms = w->io_wait_ms;
+        stats->direct = w->direct;
+    }
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w->bufs[0]);
+    free(w->bufs[1]);
+    free(w->head_block);
+    free(w);
+
+    return ret;
+}
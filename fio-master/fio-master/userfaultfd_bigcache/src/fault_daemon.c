@@ -0,0 +1,1022 @@
+/*
+ * 缺页服务进程实现
+ *
+ * 控制线程（调用 fault_daemon_run 的线程）处理 accept 和各客户端的控制消息，
+ * 处理线程共享一个 epoll，每个客户端的 uffd 以 EPOLLONESHOT 加入：
+ * 取到事件的线程独占该客户端，读出并处理至多 batch_quota 条缺页消息后重新挂上，
+ * 仍有积压时事件排到就绪队列末尾，轮到其他客户端之后再继续
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include "fault_daemon.h"
+#include "bigcache_broker.h"
+#include "uffd_handler.h"
+
+#define DAEMON_LISTEN_KEY  UINT64_MAX
+#define DAEMON_MSG_BATCH   32
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+uint64_t fault_daemon_cache_id(const BigCacheContext *bigcache) {
+    return ((uint64_t)bigcache->header.checksum << 32) | bigcache->header.num_pages;
+}
+
+static uint64_t slot_key(int slot, uint32_t gen) {
+    return ((uint64_t)gen << 32) | (uint32_t)slot;
+}
+
+/* 完整收发一条控制消息 */
+static int send_msg(int sock, const FaultDaemonMsg *msg) {
+    ssize_t n = send(sock, msg, sizeof(*msg), MSG_NOSIGNAL);
+    if (n < 0) return -errno;
+    return n == sizeof(*msg) ? 0 : -EIO;
+}
+
+static int recv_msg(int sock, FaultDaemonMsg *msg) {
+    ssize_t n = recv(sock, msg, sizeof(*msg), MSG_WAITALL);
+    if (n < 0) return -errno;
+    if (n == 0) return -ECONNRESET;
+    if (n != sizeof(*msg) || msg->magic != FAULT_DAEMON_MAGIC) return -EPROTO;
+    return 0;
+}
+
+static int send_reply(int sock, int ok, int arg) {
+    FaultDaemonMsg reply = {
+        .magic = FAULT_DAEMON_MAGIC,
+        .type = ok ? FAULT_DAEMON_ACK : FAULT_DAEMON_NAK,
+        .arg = arg
+    };
+    return send_msg(sock, &reply);
+}
+
+static void stats_add(FaultDaemonStats *dst, const FaultDaemonStats *src) {
+    dst->faults += src->faults;
+    dst->cache_pages += src->cache_pages;
+    dst->file_pages += src->file_pages;
+    dst->zero_pages += src->zero_pages;
+    dst->around_pages += src->around_pages;
+    dst->coalesced += src->coalesced;
+    dst->errors += src->errors;
+    dst->throttled += src->throttled;
+    dst->regions += src->regions;
+    dst->refused += src->refused;
+    if (src->max_registered > dst->max_registered) dst->max_registered = src->max_registered;
+    dst->total_us += src->total_us;
+    if (src->max_us > dst->max_us) dst->max_us = src->max_us;
+}
+
+static void print_client_stats(const char *who, const FaultDaemonStats *s) {
+    printf("%s: %lu faults, pages %lu cache / %lu file / %lu zero / "
+           "%lu around, %lu coalesced, %lu errors, %lu throttled, regions %lu (%lu refused, "
+           "peak %.2f MB), avg %.1f us, max %.1f us\n",
+           who, (unsigned long)s->faults, (unsigned long)s->cache_pages,
+           (unsigned long)s->file_pages, (unsigned long)s->zero_pages,
+           (unsigned long)s->around_pages, (unsigned long)s->coalesced,
+           (unsigned long)s->errors, (unsigned long)s->throttled,
+           (unsigned long)s->regions, (unsigned long)s->refused,
+           (double)s->max_registered / (1024 * 1024),
+           s->faults ? s->total_us / s->faults : 0.0, s->max_us);
+}
+
+/*
+ * 区域表（调用者持有对应的锁）
+ */
+
+/* 最后一个 start <= addr 的区域 */
+static FaultDaemonRegion* region_find(FaultDaemonRegionList *list, uint64_t addr) {
+    int lo = 0, hi = list->count - 1, found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (list->entries[mid].start <= addr) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (found < 0 || addr >= list->entries[found].end) return NULL;
+    return &list->entries[found];
+}
+
+/* [lo, hi) 是否与某个区域重叠：包含 lo 的区域，或 lo 之后的第一个区域起点 < hi */
+static int region_overlaps(FaultDaemonRegionList *list, uint64_t lo, uint64_t hi) {
+    int left = 0, right = list->count;
+    while (left < right) {
+        int mid = (left + right) / 2;
+        if (list->entries[mid].end <= lo) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left < list->count && list->entries[left].start < hi;
+}
+
+/* 去掉与 [lo, hi) 重叠的部分，两端露出的部分保留；中间切开时区域数加一 */
+static int region_remove_range(FaultDaemonRegionList *list, uint64_t lo, uint64_t hi) {
+    if (list->count + 1 > list->cap) {
+        int cap = list->cap ? list->cap * 2 : 64;
+        FaultDaemonRegion *grown = realloc(list->entries, cap * sizeof(FaultDaemonRegion));
+        if (!grown) return -ENOMEM;
+        list->entries = grown;
+        list->cap = cap;
+    }
+
+    /* 从后往前处理，切开时插入的尾段不会被再次访问 */
+    for (int i = list->count - 1; i >= 0; i--) {
+        FaultDaemonRegion *r = &list->entries[i];
+        if (r->end <= lo || r->start >= hi) continue;
+
+        FaultDaemonRegion head = *r, tail = *r;
+        int keep_head = r->start < lo, keep_tail = r->end > hi;
+        list->bytes -= r->end - r->start;
+
+        head.end = lo;
+        tail.file_offset += hi - r->start;
+        tail.start = hi;
+
+        if (keep_head && keep_tail) {
+            memmove(&list->entries[i + 2], &list->entries[i + 1],
+                    (list->count - i - 1) * sizeof(FaultDaemonRegion));
+            list->entries[i] = head;
+            list->entries[i + 1] = tail;
+            list->count++;
+        } else if (keep_head) {
+            list->entries[i] = head;
+        } else if (keep_tail) {
+            list->entries[i] = tail;
+        } else {
+            memmove(&list->entries[i], &list->entries[i + 1],
+                    (list->count - i - 1) * sizeof(FaultDaemonRegion));
+            list->count--;
+            continue;
+        }
+        if (keep_head) list->bytes += head.end - head.start;
+        if (keep_tail) list->bytes += tail.end - tail.start;
+    }
+    return 0;
+}
+
+static int region_insert(FaultDaemonRegionList *list, const FaultDaemonRegion *region) {
+    int ret = region_remove_range(list, region->start, region->end);
+    if (ret < 0) return ret;
+
+    int pos = list->count;
+    while (pos > 0 && list->entries[pos - 1].start > region->start) pos--;
+    memmove(&list->entries[pos + 1], &list->entries[pos],
+            (list->count - pos) * sizeof(FaultDaemonRegion));
+    list->entries[pos] = *region;
+    list->count++;
+    list->bytes += region->end - region->start;
+    return 0;
+}
+
+static void region_list_free(FaultDaemonRegionList *list) {
+    free(list->entries);
+    memset(list, 0, sizeof(*list));
+}
+
+/*
+ * 缺页服务
+ * 服务进程的处理线程和预加载器的接管线程共用，调用者持有区域表的锁
+ */
+
+/* 页来源：BigCache 与按 file_id 惰性打开的原文件（-2 表示尚未打开）*/
+typedef struct {
+    BigCacheContext *bigcache;
+    int *file_fds;
+    pthread_mutex_t *file_lock;
+    size_t fault_around;
+} PageSource;
+
+static int *alloc_file_fds(const BigCacheContext *bigcache) {
+    int *fds = malloc(bigcache->header.num_files * sizeof(int));
+    if (!fds) return NULL;
+    for (uint32_t i = 0; i < bigcache->header.num_files; i++) fds[i] = -2;
+    return fds;
+}
+
+static void close_file_fds(const BigCacheContext *bigcache, int *fds) {
+    if (!fds) return;
+    for (uint32_t i = 0; i < bigcache->header.num_files; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    free(fds);
+}
+
+static int source_fd(const PageSource *src, int file_id) {
+    if (file_id < 0 || (uint32_t)file_id >= src->bigcache->header.num_files) return -1;
+
+    int fd = __atomic_load_n(&src->file_fds[file_id], __ATOMIC_ACQUIRE);
+    if (fd != -2) return fd;
+
+    pthread_mutex_lock(src->file_lock);
+    fd = src->file_fds[file_id];
+    if (fd == -2) {
+        fd = open(src->bigcache->file_table[file_id].path, O_RDONLY | O_CLOEXEC);
+        __atomic_store_n(&src->file_fds[file_id], fd, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(src->file_lock);
+    return fd;
+}
+
+/* 安装一页，已存在时按需唤醒。返回 0、-EEXIST 或其他 -errno */
+static int install_page(int uffd, uint64_t dst, const void *src, int dontwake) {
+    struct uffdio_copy copy = {
+        .dst = dst,
+        .src = (uint64_t)src,
+        .len = PAGE_SIZE,
+        .mode = dontwake ? UFFDIO_COPY_MODE_DONTWAKE : 0
+    };
+    if (ioctl(uffd, UFFDIO_COPY, &copy) == 0) return 0;
+
+    int err = errno;
+    if (err == EEXIST && !dontwake) {
+        struct uffdio_range range = { .start = dst, .len = PAGE_SIZE };
+        ioctl(uffd, UFFDIO_WAKE, &range);
+    }
+    return -err;
+}
+
+static void serve_fault(const PageSource *ps, FaultDaemonRegionList *regions, int uffd,
+                        uint8_t *bounce, FaultDaemonStats *s, uint64_t fault_addr) {
+    double start = now_us();
+    uint64_t page = fault_addr & ~((uint64_t)PAGE_SIZE - 1);
+    s->faults++;
+
+    FaultDaemonRegion *r = region_find(regions, page);
+
+    if (!r) {
+        /* 控制消息与缺页不同步时可能出现，零页总比让应用线程永远挂起好 */
+        struct uffdio_zeropage zero = {
+            .range = { .start = page, .len = PAGE_SIZE }
+        };
+        if (ioctl(uffd, UFFDIO_ZEROPAGE, &zero) == 0) {
+            s->zero_pages++;
+        } else if (errno == EEXIST) {
+            struct uffdio_range range = { .start = page, .len = PAGE_SIZE };
+            ioctl(uffd, UFFDIO_WAKE, &range);
+            s->coalesced++;
+        } else {
+            s->errors++;
+        }
+        return;
+    }
+
+    uint64_t off = r->file_offset + (page - r->start);
+    const void *src = bigcache_file_page(ps->bigcache, r->file_id, off);
+    int ret;
+
+    if (src) {
+        ret = install_page(uffd, page, src, 0);
+        if (ret == 0) s->cache_pages++;
+    } else {
+        /* 未命中：从原文件读取，文件末尾之后补零 */
+        int fd = source_fd(ps, r->file_id);
+        ssize_t n = fd >= 0 ? pread(fd, bounce, PAGE_SIZE, off) : -1;
+        if (n >= 0) {
+            memset(bounce + n, 0, PAGE_SIZE - n);
+            ret = install_page(uffd, page, bounce, 0);
+            if (ret == 0) s->file_pages++;
+        } else {
+            memset(bounce, 0, PAGE_SIZE);
+            ret = install_page(uffd, page, bounce, 0);
+            if (ret == 0) s->zero_pages++;
+        }
+    }
+
+    if (ret == -EEXIST) {
+        s->coalesced++;
+    } else if (ret < 0) {
+        s->errors++;
+    }
+
+    /* fault-around：向后顺带安装区域内连续的缓存页，碰到未缓存或已安装的页停止 */
+    if (ret == 0) {
+        for (size_t i = 1; i <= ps->fault_around; i++) {
+            uint64_t next = page + i * PAGE_SIZE;
+            if (next >= r->end) break;
+            const void *next_src = bigcache_file_page(ps->bigcache, r->file_id,
+                                                      off + i * PAGE_SIZE);
+            if (!next_src || install_page(uffd, next, next_src, 1) < 0) break;
+            s->around_pages++;
+        }
+    }
+
+    double elapsed = now_us() - start;
+    s->total_us += elapsed;
+    if (elapsed > s->max_us) s->max_us = elapsed;
+}
+
+/* 处理至多 batch_quota 条消息 */
+static void serve_client(FaultDaemon *d, FaultDaemonWorker *w, FaultDaemonSlot *c) {
+    struct uffd_msg msgs[DAEMON_MSG_BATCH];
+    int handled = 0;
+
+    while (handled < d->config.batch_quota) {
+        int want = d->config.batch_quota - handled;
+        if (want > DAEMON_MSG_BATCH) want = DAEMON_MSG_BATCH;
+
+        ssize_t n = read(c->uffd, msgs, want * sizeof(struct uffd_msg));
+        if (n <= 0) return;  /* EAGAIN：已读空；其他错误由控制线程在断开时清理 */
+
+        PageSource ps = {
+            .bigcache = d->bigcache,
+            .file_fds = d->file_fds,
+            .file_lock = &d->file_lock,
+            .fault_around = d->config.fault_around
+        };
+        int count = n / sizeof(struct uffd_msg);
+        pthread_rwlock_rdlock(&c->regions_lock);
+        for (int i = 0; i < count; i++) {
+            if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+                serve_fault(&ps, &c->regions, c->uffd, w->bounce, &c->stats,
+                            msgs[i].arg.pagefault.address);
+            }
+        }
+        pthread_rwlock_unlock(&c->regions_lock);
+        handled += count;
+    }
+
+    c->stats.throttled++;
+}
+
+static void* worker_main(void *arg) {
+    FaultDaemonWorker *w = arg;
+    FaultDaemon *d = w->daemon;
+
+    while (d->running) {
+        struct epoll_event ev;
+        int n = epoll_wait(d->fault_epoll, &ev, 1, 200);
+        if (n <= 0) continue;
+
+        int slot = (int)(ev.data.u64 & 0xffffffff);
+        uint32_t gen = (uint32_t)(ev.data.u64 >> 32);
+        FaultDaemonSlot *c = &d->clients[slot];
+
+        pthread_mutex_lock(&c->serve_lock);
+        if (c->active && c->gen == gen) {
+            serve_client(d, w, c);
+
+            /* 重新挂上，仍有积压时排到就绪队列末尾 */
+            struct epoll_event rearm = {
+                .events = EPOLLIN | EPOLLONESHOT,
+                .data.u64 = ev.data.u64
+            };
+            epoll_ctl(d->fault_epoll, EPOLL_CTL_MOD, c->uffd, &rearm);
+        }
+        pthread_mutex_unlock(&c->serve_lock);
+    }
+    return NULL;
+}
+
+/*
+ * 控制线程
+ */
+
+static void close_client(FaultDaemon *d, int slot) {
+    FaultDaemonSlot *c = &d->clients[slot];
+
+    pthread_mutex_lock(&c->serve_lock);
+    epoll_ctl(d->fault_epoll, EPOLL_CTL_DEL, c->uffd, NULL);
+    epoll_ctl(d->ctl_epoll, EPOLL_CTL_DEL, c->sock, NULL);
+    close(c->uffd);
+    close(c->sock);
+
+    char who[48];
+    snprintf(who, sizeof(who), "[Daemon] client pid %d", c->pid);
+    print_client_stats(who, &c->stats);
+    stats_add(&d->totals, &c->stats);
+
+    pthread_rwlock_wrlock(&c->regions_lock);
+    region_list_free(&c->regions);
+    pthread_rwlock_unlock(&c->regions_lock);
+
+    c->active = 0;
+    c->gen++;
+    d->num_clients--;
+    pthread_mutex_unlock(&c->serve_lock);
+}
+
+/* 接收 HELLO 与 uffd，分配槽位 */
+static void accept_client(FaultDaemon *d) {
+    int sock = accept4(d->listen_sock, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0) return;
+
+    /* HELLO 随连接立即到达，不让一个卡住的客户端阻塞控制线程 */
+    struct timeval tv = { .tv_sec = 1 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    FaultDaemonMsg hello;
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf)
+    };
+
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    int uffd = -1;
+    struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+        memcpy(&uffd, CMSG_DATA(cmsg), sizeof(int));
+    }
+
+    /* pid 取内核给出的凭据，HELLO 中的 pid 由客户端自报，不可信 */
+    pid_t pid = -1;
+    int err = 0;
+    if (!broker_peer_trusted(sock, &pid)) {
+        err = -EPERM;
+    } else if (n != sizeof(hello) || uffd < 0 || hello.magic != FAULT_DAEMON_MAGIC ||
+        hello.type != FAULT_DAEMON_HELLO) {
+        err = -EPROTO;
+    } else if (hello.cache_id != d->cache_id) {
+        err = -ESTALE;
+    }
+
+    /* 客户端数上限：拒绝后预加载器退回进程内处理器 */
+    int slot = -1;
+    if (!err) {
+        for (int i = 0; i < d->config.max_clients && slot < 0; i++) {
+            if (!d->clients[i].active) slot = i;
+        }
+        if (slot < 0) err = -EBUSY;
+    }
+
+    if (err) {
+        if (err == -EBUSY) d->clients_refused++;
+        send_reply(sock, 0, err);
+        if (uffd >= 0) close(uffd);
+        close(sock);
+        return;
+    }
+
+    FaultDaemonSlot *c = &d->clients[slot];
+    pthread_mutex_lock(&c->serve_lock);
+    c->pid = pid;
+    c->sock = sock;
+    c->uffd = uffd;
+    memset(&c->stats, 0, sizeof(c->stats));
+    c->active = 1;
+    pthread_mutex_unlock(&c->serve_lock);
+
+    fcntl(uffd, F_SETFL, fcntl(uffd, F_GETFL) | O_NONBLOCK);
+
+    uint64_t key = slot_key(slot, c->gen);
+    struct epoll_event ctl_ev = { .events = EPOLLIN, .data.u64 = key };
+    struct epoll_event fault_ev = { .events = EPOLLIN | EPOLLONESHOT, .data.u64 = key };
+    d->num_clients++;
+    d->clients_served++;
+
+    if (epoll_ctl(d->ctl_epoll, EPOLL_CTL_ADD, sock, &ctl_ev) < 0 ||
+        epoll_ctl(d->fault_epoll, EPOLL_CTL_ADD, uffd, &fault_ev) < 0 ||
+        send_reply(sock, 1, slot) < 0) {
+        close_client(d, slot);
+    }
+}
+
+static void handle_control(FaultDaemon *d, int slot) {
+    FaultDaemonSlot *c = &d->clients[slot];
+    FaultDaemonMsg msg;
+
+    if (recv_msg(c->sock, &msg) < 0) {
+        close_client(d, slot);
+        return;
+    }
+
+    uint64_t start = msg.addr & ~((uint64_t)PAGE_SIZE - 1);
+    uint64_t end = (msg.addr + msg.len + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+
+    if (msg.type == FAULT_DAEMON_REGISTER) {
+        int err = 0;
+        pthread_rwlock_wrlock(&c->regions_lock);
+        if (msg.arg < 0 || (uint32_t)msg.arg >= d->bigcache->header.num_files || end <= start) {
+            err = -EINVAL;
+        } else if (d->config.max_client_bytes &&
+                   c->regions.bytes + (end - start) > d->config.max_client_bytes) {
+            /* 字节配额：拒绝后该映射保持文件页 */
+            err = -ENOSPC;
+            c->stats.refused++;
+        } else {
+            FaultDaemonRegion region = {
+                .start = start,
+                .end = end,
+                .file_offset = msg.file_offset,
+                .file_id = msg.arg
+            };
+            err = region_insert(&c->regions, &region);
+            if (!err) {
+                c->stats.regions++;
+                if (c->regions.bytes > c->stats.max_registered) {
+                    c->stats.max_registered = c->regions.bytes;
+                }
+            }
+        }
+        pthread_rwlock_unlock(&c->regions_lock);
+
+        if (send_reply(c->sock, err == 0, err) < 0) close_client(d, slot);
+    } else if (msg.type == FAULT_DAEMON_UNREGISTER) {
+        pthread_rwlock_wrlock(&c->regions_lock);
+        region_remove_range(&c->regions, start, end);
+        pthread_rwlock_unlock(&c->regions_lock);
+    } else {
+        close_client(d, slot);
+    }
+}
+
+FaultDaemon* fault_daemon_create(BigCacheContext *bigcache, const FaultDaemonConfig *config) {
+    if (!bigcache || !bigcache->is_loaded || !config) return NULL;
+
+    FaultDaemon *d = calloc(1, sizeof(FaultDaemon));
+    if (!d) return NULL;
+
+    d->bigcache = bigcache;
+    d->config = *config;
+    if (d->config.num_workers < 1) d->config.num_workers = 1;
+    if (d->config.num_workers > FAULT_DAEMON_MAX_WORKERS) {
+        d->config.num_workers = FAULT_DAEMON_MAX_WORKERS;
+    }
+    if (d->config.max_clients < 1 || d->config.max_clients > FAULT_DAEMON_MAX_CLIENTS) {
+        d->config.max_clients = FAULT_DAEMON_MAX_CLIENTS;
+    }
+    if (d->config.batch_quota < 1) d->config.batch_quota = DAEMON_MSG_BATCH;
+    d->cache_id = fault_daemon_cache_id(bigcache);
+    d->listen_sock = d->ctl_epoll = d->fault_epoll = -1;
+
+    for (int i = 0; i < FAULT_DAEMON_MAX_CLIENTS; i++) {
+        pthread_mutex_init(&d->clients[i].serve_lock, NULL);
+        pthread_rwlock_init(&d->clients[i].regions_lock, NULL);
+    }
+
+    d->file_fds = alloc_file_fds(bigcache);
+    if (!d->file_fds) {
+        free(d);
+        return NULL;
+    }
+    pthread_mutex_init(&d->file_lock, NULL);
+
+    return d;
+}
+
+void fault_daemon_destroy(FaultDaemon *d) {
+    if (!d) return;
+
+    for (int i = 0; i < FAULT_DAEMON_MAX_CLIENTS; i++) {
+        pthread_mutex_destroy(&d->clients[i].serve_lock);
+        pthread_rwlock_destroy(&d->clients[i].regions_lock);
+    }
+    close_file_fds(d->bigcache, d->file_fds);
+    pthread_mutex_destroy(&d->file_lock);
+    free(d);
+}
+
+int fault_daemon_run(FaultDaemon *d, const char *socket_path, volatile sig_atomic_t *stop) {
+    if (!d || !socket_path) return -EINVAL;
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = broker_socket_addr(socket_path, &addr);
+    if (!addr_len) return -ENAMETOOLONG;
+
+    d->listen_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    d->ctl_epoll = epoll_create1(EPOLL_CLOEXEC);
+    d->fault_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (d->listen_sock < 0 || d->ctl_epoll < 0 || d->fault_epoll < 0) {
+        perror("fault_daemon_run: socket/epoll");
+        return -errno;
+    }
+
+    if (socket_path[0] != '@') unlink(socket_path);
+    if (bind(d->listen_sock, (struct sockaddr*)&addr, addr_len) < 0 ||
+        listen(d->listen_sock, 64) < 0) {
+        int err = errno;
+        perror("fault_daemon_run: bind/listen");
+        return -err;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = DAEMON_LISTEN_KEY };
+    epoll_ctl(d->ctl_epoll, EPOLL_CTL_ADD, d->listen_sock, &ev);
+
+    d->running = 1;
+    for (int i = 0; i < d->config.num_workers; i++) {
+        FaultDaemonWorker *w = &d->workers[i];
+        w->daemon = d;
+        w->index = i;
+        w->bounce = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+        if (!w->bounce || pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            free(w->bounce);
+            break;
+        }
+        d->num_workers++;
+    }
+    if (d->num_workers == 0) {
+        d->running = 0;
+        return -ENOMEM;
+    }
+
+    printf("[Daemon] Serving %u pages on %s: %d workers, max %d clients, "
+           "%zu MB per client, quota %d\n",
+           d->bigcache->header.num_pages, socket_path, d->num_workers,
+           d->config.max_clients, d->config.max_client_bytes / (1024 * 1024),
+           d->config.batch_quota);
+
+    while (!*stop) {
+        struct epoll_event events[16];
+        int n = epoll_wait(d->ctl_epoll, events, 16, 200);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u64 == DAEMON_LISTEN_KEY) {
+                accept_client(d);
+                continue;
+            }
+            int slot = (int)(events[i].data.u64 & 0xffffffff);
+            uint32_t gen = (uint32_t)(events[i].data.u64 >> 32);
+            if (d->clients[slot].active && d->clients[slot].gen == gen) {
+                handle_control(d, slot);
+            }
+        }
+    }
+
+    for (int i = 0; i < FAULT_DAEMON_MAX_CLIENTS; i++) {
+        if (d->clients[i].active) close_client(d, i);
+    }
+
+    d->running = 0;
+    for (int i = 0; i < d->num_workers; i++) {
+        pthread_join(d->workers[i].thread, NULL);
+        free(d->workers[i].bounce);
+    }
+    d->num_workers = 0;
+
+    close(d->listen_sock);
+    close(d->ctl_epoll);
+    close(d->fault_epoll);
+    if (socket_path[0] != '@') unlink(socket_path);
+    return 0;
+}
+
+void fault_daemon_print_stats(FaultDaemon *d) {
+    printf("\n=== Fault Daemon Statistics ===\n");
+    printf("Clients: %lu served, %lu refused, %d connected\n",
+           (unsigned long)d->clients_served, (unsigned long)d->clients_refused,
+           d->num_clients);
+    print_client_stats("[Daemon] total", &d->totals);
+    printf("===============================\n");
+}
+
+
+/*
+ * 预加载器侧
+ */
+
+/* 服务进程退出后在本进程内继续服务已注册区域的缺页 */
+static void client_takeover(FaultDaemonClient *client) {
+    pthread_mutex_lock(&client->lock);
+    client->lost = 1;
+    int count = client->regions.count;
+    pthread_mutex_unlock(&client->lock);
+
+    fprintf(stderr, "[Preloader] Fault daemon disconnected, serving %d regions locally\n",
+            count);
+
+    uint8_t *bounce = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+    client->file_fds = alloc_file_fds(client->bigcache);
+    if (!bounce || !client->file_fds) {
+        free(bounce);
+        return;
+    }
+    PageSource ps = {
+        .bigcache = client->bigcache,
+        .file_fds = client->file_fds,
+        .file_lock = &client->file_lock
+    };
+
+    while (!client->closing) {
+        struct pollfd pfd = { .fd = client->uffd, .events = POLLIN };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+
+        struct uffd_msg msgs[DAEMON_MSG_BATCH];
+        ssize_t n = read(client->uffd, msgs, sizeof(msgs));
+        if (n <= 0) continue;
+
+        pthread_mutex_lock(&client->lock);
+        for (int i = 0; i < (int)(n / sizeof(struct uffd_msg)); i++) {
+            if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+                serve_fault(&ps, &client->regions, client->uffd, bounce,
+                            &client->takeover, msgs[i].arg.pagefault.address);
+            }
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+    free(bounce);
+}
+
+static void* client_watchdog(void *arg) {
+    FaultDaemonClient *client = arg;
+    struct pollfd pfd = { .fd = client->sock, .events = POLLRDHUP };
+
+    while (!client->closing) {
+        int n = poll(&pfd, 1, -1);
+        if (n > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) break;
+    }
+    if (!client->closing) client_takeover(client);
+    return NULL;
+}
+
+int fault_daemon_connect(FaultDaemonClient *client, const char *socket_path,
+                         BigCacheContext *bigcache, int timeout_ms) {
+    memset(client, 0, sizeof(*client));
+    client->sock = client->uffd = -1;
+    client->bigcache = bigcache;
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_mutex_init(&client->file_lock, NULL);
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = broker_socket_addr(socket_path, &addr);
+    if (!addr_len) return -ENAMETOOLONG;
+
+    /* 服务进程只用 MISSING 缺页与 UFFDIO_COPY，不需要额外特性 */
+    int uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (uffd < 0) return -errno;
+    struct uffdio_api api = { .api = UFFD_API, .features = 0 };
+    if (ioctl(uffd, UFFDIO_API, &api) < 0) {
+        int err = errno;
+        close(uffd);
+        return -err;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        int err = errno;
+        close(uffd);
+        return -err;
+    }
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    FaultDaemonMsg hello = {
+        .magic = FAULT_DAEMON_MAGIC,
+        .type = FAULT_DAEMON_HELLO,
+        .arg = getpid(),
+        .cache_id = fault_daemon_cache_id(bigcache)
+    };
+    struct iovec iov = { .iov_base = &hello, .iov_len = sizeof(hello) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf)
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &uffd, sizeof(int));
+
+    /* 交出 uffd 之前确认对端是可信的服务进程，否则它能读写本进程的缺页 */
+    int err = 0;
+    FaultDaemonMsg reply;
+    if (connect(sock, (struct sockaddr*)&addr, addr_len) < 0) {
+        err = -errno;
+    } else if (!broker_peer_trusted(sock, NULL)) {
+        err = -EPERM;
+    } else if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(hello)) {
+        err = -errno;
+    } else if ((err = recv_msg(sock, &reply)) == 0 && reply.type != FAULT_DAEMON_ACK) {
+        err = reply.arg < 0 ? reply.arg : -EPROTO;
+    }
+
+    if (err) {
+        close(sock);
+        close(uffd);
+        return err;
+    }
+
+    /*
+     * 连接建立后放宽应答超时：REGISTER 超时会让迟到的应答错位，
+     * 因此任何收发失败都把连接标记为 lost，不再注册新区域
+     */
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    client->sock = sock;
+    client->uffd = uffd;
+    /* 看门狗平时只阻塞在 poll 上，给小栈 */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+    if (pthread_create(&client->watchdog, &attr, client_watchdog, client) == 0) {
+        client->watchdog_running = 1;
+    }
+    pthread_attr_destroy(&attr);
+    return 0;
+}
+
+void fault_daemon_disconnect(FaultDaemonClient *client) {
+    client->closing = 1;
+    if (client->sock >= 0) shutdown(client->sock, SHUT_RDWR);
+    if (client->watchdog_running) {
+        pthread_join(client->watchdog, NULL);
+        client->watchdog_running = 0;
+    }
+
+    if (client->sock >= 0) close(client->sock);
+    if (client->uffd >= 0) close(client->uffd);
+    client->sock = client->uffd = -1;
+
+    if (client->takeover.faults) {
+        print_client_stats("[Preloader] local takeover", &client->takeover);
+    }
+    if (client->file_fds) close_file_fds(client->bigcache, client->file_fds);
+    client->file_fds = NULL;
+    region_list_free(&client->regions);
+    pthread_mutex_destroy(&client->lock);
+    pthread_mutex_destroy(&client->file_lock);
+}
+
+/*
+ * 直接用系统调用恢复：经 mmap hook 会再次尝试拦截该范围，
+ * 服务进程按字节配额拒绝时会反复注册、恢复
+ */
+static void restore_file_mapping(void *addr, size_t size, const char *file_path,
+                                 uint64_t file_offset, int prot) {
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        syscall(SYS_mmap, addr, size, prot, MAP_PRIVATE | MAP_FIXED, fd, file_offset);
+        close(fd);
+    }
+}
+
+void* fault_daemon_map(FaultDaemonClient *client, void *fixed, size_t size,
+                       const char *file_path, int file_id, uint64_t file_offset, int prot) {
+    if (client->uffd < 0 || client->lost || size == 0 || file_id < 0) return MAP_FAILED;
+    size = (size + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+
+    /* 服务进程以 UFFDIO_COPY 安装，映射需要可写 */
+    void *addr = mmap(fixed, size, prot | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | (fixed ? MAP_FIXED : 0), -1, 0);
+    if (addr == MAP_FAILED) {
+        if (fixed) restore_file_mapping(fixed, size, file_path, file_offset, prot);
+        return MAP_FAILED;
+    }
+
+    struct uffdio_register reg = {
+        .range = { .start = (uint64_t)addr, .len = size },
+        .mode = UFFDIO_REGISTER_MODE_MISSING
+    };
+    int ok = ioctl(client->uffd, UFFDIO_REGISTER, &reg) == 0;
+
+    /* 应答到达前不会有人访问该映射，服务进程收到缺页时区域已就位 */
+    if (ok) {
+        FaultDaemonMsg msg = {
+            .magic = FAULT_DAEMON_MAGIC,
+            .type = FAULT_DAEMON_REGISTER,
+            .arg = file_id,
+            .addr = (uint64_t)addr,
+            .len = size,
+            .file_offset = file_offset
+        };
+        FaultDaemonRegion region = {
+            .start = (uint64_t)addr,
+            .end = (uint64_t)addr + size,
+            .file_offset = file_offset,
+            .file_id = file_id,
+            .prot = prot
+        };
+        FaultDaemonMsg reply;
+
+        pthread_mutex_lock(&client->lock);
+        if (client->lost) {
+            ok = 0;
+        } else if (send_msg(client->sock, &msg) < 0 || recv_msg(client->sock, &reply) < 0) {
+            client->lost = 1;
+            ok = 0;
+        } else {
+            ok = reply.type == FAULT_DAEMON_ACK;
+        }
+        if (ok && region_insert(&client->regions, &region) < 0) {
+            /* 服务进程已记录该区域，本地只影响接管，仍可使用 */
+            client->lost = 1;
+        }
+        if (!ok) client->refused++;
+        pthread_mutex_unlock(&client->lock);
+
+        if (!ok) ioctl(client->uffd, UFFDIO_UNREGISTER, &reg.range);
+    }
+
+    if (!ok) {
+        if (fixed) {
+            restore_file_mapping(fixed, size, file_path, file_offset, prot);
+        } else {
+            munmap(addr, size);
+        }
+        return MAP_FAILED;
+    }
+    return addr;
+}
+
+void fault_daemon_unmap_range(FaultDaemonClient *client, void *addr, size_t len) {
+    if (client->uffd < 0 || len == 0) return;
+
+    uint64_t start = (uint64_t)addr & ~((uint64_t)PAGE_SIZE - 1);
+    uint64_t end = ((uint64_t)addr + len + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+
+    pthread_mutex_lock(&client->lock);
+    if (!region_overlaps(&client->regions, start, end)) {
+        pthread_mutex_unlock(&client->lock);
+        return;
+    }
+    region_remove_range(&client->regions, start, end);
+
+    struct uffdio_range range = { .start = start, .len = end - start };
+    ioctl(client->uffd, UFFDIO_UNREGISTER, &range);
+
+    /* 不等应答：同一连接上之后的 REGISTER 一定在它之后处理 */
+    FaultDaemonMsg msg = {
+        .magic = FAULT_DAEMON_MAGIC,
+        .type = FAULT_DAEMON_UNREGISTER,
+        .addr = start,
+        .len = end - start
+    };
+    send_msg(client->sock, &msg);
+    pthread_mutex_unlock(&client->lock);
+}
+
+int fault_daemon_handback(FaultDaemonClient *client, UffdHandbackStats *stats) {
+    if (client->uffd < 0) return -EINVAL;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int count = 0;
+
+    /* 持锁期间 munmap hook 的注销和接管后的本地服务都会等待，区域表不会变化 */
+    pthread_mutex_lock(&client->lock);
+    UffdVmaSnapshot vmas;
+    if (uffd_vma_snapshot(&vmas) < 0) {
+        pthread_mutex_unlock(&client->lock);
+        return -ENOMEM;
+    }
+    for (int i = client->regions.count - 1; i >= 0; i--) {
+        FaultDaemonRegion r = client->regions.entries[i];
+        if (uffd_handback_range(client->uffd, r.start, r.end,
+                                client->bigcache->file_table[r.file_id].path,
+                                r.file_offset, r.prot, &vmas, stats) < 0) {
+            continue;
+        }
+        region_remove_range(&client->regions, r.start, r.end);
+        count++;
+
+        /* 服务进程此后收到的该范围缺页只会安装失败，由 UFFDIO_WAKE 让应用重试 */
+        if (!client->lost) {
+            FaultDaemonMsg msg = {
+                .magic = FAULT_DAEMON_MAGIC,
+                .type = FAULT_DAEMON_UNREGISTER,
+                .addr = r.start,
+                .len = r.end - r.start
+            };
+            if (send_msg(client->sock, &msg) < 0) client->lost = 1;
+        }
+    }
+    pthread_mutex_unlock(&client->lock);
+    uffd_vma_snapshot_free(&vmas);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (stats) {
+        stats->ms += (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    }
+    return count;
+}
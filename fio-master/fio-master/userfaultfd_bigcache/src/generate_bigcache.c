@@ -15,6 +15,7 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <time.h>
+#include "bigcache_writer.h"
 
 /* 常量 */
 #define PAGE_SIZE 4096
@@ -324,18 +325,10 @@ static int generate_bigcache(const char *output_path) {
     printf("Data offset: %lu\n", (unsigned long)data_offset);
     printf("Total size: %.2f MB\n", total_size / 1024.0 / 1024.0);
     
-    /* 创建输出文件 */
-    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) {
-        fprintf(stderr, "Error: cannot create output file %s: %s\n",
-                output_path, strerror(errno));
-        return -1;
-    }
-    
-    /* 预分配空间 */
-    if (ftruncate(fd, total_size) < 0) {
-        fprintf(stderr, "Error: cannot allocate space: %s\n", strerror(errno));
-        close(fd);
+    /* 创建输出文件（预分配 + O_DIRECT 双缓冲流式写出）*/
+    BigCacheWriter *writer = bigcache_writer_open(output_path, total_size, 0);
+    if (!writer) {
+        fprintf(stderr, "Error: cannot create output file %s\n", output_path);
         return -1;
     }
     
@@ -353,15 +346,11 @@ static int generate_bigcache(const char *output_path) {
     };
     memset(header.reserved, 0, sizeof(header.reserved));
     
-    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
-        fprintf(stderr, "Error: failed to write header\n");
-        close(fd);
-        return -1;
-    }
+    int ret = bigcache_writer_write(writer, &header, sizeof(header));
     
     /* 写入索引表 */
-    lseek(fd, index_offset, SEEK_SET);
-    for (int i = 0; i < g_num_pages; i++) {
+    if (ret == 0) ret = bigcache_writer_pad(writer, index_offset - sizeof(header));
+    for (int i = 0; i < g_num_pages && ret == 0; i++) {
         g_pages[i].bigcache_offset = data_offset + (uint64_t)i * PAGE_SIZE;
         
         BigCachePageIndex idx = {
@@ -372,16 +361,15 @@ static int generate_bigcache(const char *output_path) {
             .reserved = 0
         };
         
-        if (write(fd, &idx, sizeof(idx)) != sizeof(idx)) {
-            fprintf(stderr, "Error: failed to write index entry %d\n", i);
-            close(fd);
-            return -1;
-        }
+        ret = bigcache_writer_write(writer, &idx, sizeof(idx));
     }
     
     /* 写入文件表 */
-    lseek(fd, file_table_offset, SEEK_SET);
-    for (int i = 0; i < g_num_files; i++) {
+    if (ret == 0) {
+        ret = bigcache_writer_pad(writer, file_table_offset -
+                                  (index_offset + (uint64_t)g_num_pages * sizeof(BigCachePageIndex)));
+    }
+    for (int i = 0; i < g_num_files && ret == 0; i++) {
         BigCacheFileEntry entry = {
             .file_id = g_files[i].file_id,
             .path_len = strlen(g_files[i].path),
@@ -391,11 +379,13 @@ static int generate_bigcache(const char *output_path) {
         memset(entry.path, 0, MAX_PATH_LEN);
         strncpy(entry.path, g_files[i].path, MAX_PATH_LEN - 1);
         
-        if (write(fd, &entry, sizeof(entry)) != sizeof(entry)) {
-            fprintf(stderr, "Error: failed to write file entry %d\n", i);
-            close(fd);
-            return -1;
-        }
+        ret = bigcache_writer_write(writer, &entry, sizeof(entry));
+    }
+    
+    if (ret < 0) {
+        fprintf(stderr, "Error: failed to write metadata: %s\n", strerror(-ret));
+        bigcache_writer_close(writer, NULL);
+        return -1;
     }
     
     /* 写入数据 - 从真实文件读取 */
@@ -404,17 +394,18 @@ static int generate_bigcache(const char *output_path) {
     uint8_t *page_buffer = malloc(PAGE_SIZE);
     if (!page_buffer) {
         fprintf(stderr, "Error: cannot allocate page buffer\n");
-        close(fd);
+        bigcache_writer_close(writer, NULL);
         return -1;
     }
     
-    lseek(fd, data_offset, SEEK_SET);
+    ret = bigcache_writer_pad(writer, data_offset -
+                              (file_table_offset + (uint64_t)g_num_files * sizeof(BigCacheFileEntry)));
     
     int read_errors = 0;
     struct timespec start, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
     
-    for (int i = 0; i < g_num_pages; i++) {
+    for (int i = 0; i < g_num_pages && ret == 0; i++) {
         /* 从源文件读取真实数据 */
         if (read_source_page(g_pages[i].file_path, 
                              g_pages[i].source_offset, 
@@ -423,11 +414,10 @@ static int generate_bigcache(const char *output_path) {
         }
         
         /* 写入 BigCache */
-        if (write(fd, page_buffer, PAGE_SIZE) != PAGE_SIZE) {
-            fprintf(stderr, "Error: failed to write page data %d\n", i);
-            free(page_buffer);
-            close(fd);
-            return -1;
+        ret = bigcache_writer_write(writer, page_buffer, PAGE_SIZE);
+        if (ret < 0) {
+            fprintf(stderr, "Error: failed to write page data %d: %s\n", i, strerror(-ret));
+            break;
         }
         
         /* 进度报告 */
@@ -437,25 +427,33 @@ static int generate_bigcache(const char *output_path) {
         }
     }
     
+    free(page_buffer);
+    
+    /* 刷出剩余数据，只同步输出文件 */
+    BigCacheWriterStats wstats;
+    int close_ret = bigcache_writer_close(writer, &wstats);
+    if (ret == 0) ret = close_ret;
+    
     clock_gettime(CLOCK_MONOTONIC, &end);
     double elapsed = (end.tv_sec - start.tv_sec) + 
                      (end.tv_nsec - start.tv_nsec) / 1e9;
     
-    free(page_buffer);
-    close(fd);
+    if (ret < 0) {
+        fprintf(stderr, "Error: failed to write %s: %s\n", output_path, strerror(-ret));
+        return -1;
+    }
     
     printf("\n=== BigCache Generated ===\n");
     printf("Output: %s\n", output_path);
     printf("Size: %.2f MB\n", total_size / 1024.0 / 1024.0);
-    printf("Time: %.2f seconds\n", elapsed);
+    printf("Time: %.2f seconds (%s, %lu writes, %.1f ms waiting on I/O)\n", elapsed,
+           wstats.direct ? "O_DIRECT" : "buffered", (unsigned long)wstats.write_calls,
+           wstats.io_wait_ms);
     printf("Speed: %.2f MB/s\n", (total_size / 1024.0 / 1024.0) / elapsed);
     if (read_errors > 0) {
         printf("Warning: %d pages could not be read (filled with zeros)\n", read_errors);
     }
     
-    /* 同步到磁盘 */
-    sync();
-    
     return 0;
 }
 
@@ -11,16 +11,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 #include <unistd.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <limits.h>
 #include "bigcache.h"
+#include "bigcache_layout.h"
 #include "uffd_handler.h"
+#include "bigcache_broker.h"
+#include "fault_daemon.h"
+#include "bigcache_residency.h"
 
 /* 外部声明 */
 extern int preloader_init(const char *bigcache_path);
 extern void preloader_cleanup(void);
+extern BigCacheContext* preloader_get_bigcache(void);
+extern void* preloader_mmap(void *addr, size_t length, int prot, int flags,
+                            int fd, off_t offset, const char *pathname);
+extern int preloader_handback(void);
+extern int preloader_not_ready_count(void);
+extern void preloader_get_stats(int *intercepted, int *bypassed,
+                                size_t *total_size, double *init_time);
 
 /* 获取时间（毫秒）*/
 static double get_time_ms(void) {
@@ -32,13 +53,59 @@ static double get_time_ms(void) {
 /* 命令：打包 */
 static int cmd_pack(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: bigcache pack <layout.csv> <output.bin>\n");
+        fprintf(stderr, "Usage: bigcache pack <layout.csv> <output.bin> "
+                        "[--budget-mb N | --budget-pages N] [--device NAME]\n"
+                        "                     [--critical-weight W] [--selected out.csv]\n");
+        fprintf(stderr, "\nDevices: hdd, ssd, nvme, emmc, ufs (default: ufs)\n");
         return 1;
     }
     
     const char *csv_path = argv[0];
     const char *output_path = argv[1];
     
+    size_t budget_pages = 0;
+    const char *device = "ufs";
+    const char *selected_path = NULL;
+    double critical_weight = 1.0;
+    
+    for (int i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Option %s requires a value\n", argv[i]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--budget-mb") == 0 || strcmp(argv[i], "--budget-pages") == 0) {
+            char *end;
+            double value = strtod(argv[i + 1], &end);
+            if (strcmp(argv[i], "--budget-mb") == 0) value = value * 1024 * 1024 / PAGE_SIZE;
+            if (end == argv[i + 1] || *end != '\0' || value < 1) {
+                fprintf(stderr, "Invalid %s value: %s\n", argv[i], argv[i + 1]);
+                return 1;
+            }
+            budget_pages = (size_t)value;
+        } else if (strcmp(argv[i], "--device") == 0) {
+            device = argv[i + 1];
+        } else if (strcmp(argv[i], "--critical-weight") == 0) {
+            critical_weight = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--selected") == 0) {
+            selected_path = argv[i + 1];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    /* --selected 输出的是预算选择结果，没有预算时无从写出 */
+    if (selected_path && budget_pages == 0) {
+        fprintf(stderr, "--selected requires --budget-mb or --budget-pages\n");
+        return 1;
+    }
+    
+    const StorageCostModel *model = packer_get_cost_model(device);
+    if (!model) {
+        fprintf(stderr, "Unknown device model: %s\n", device);
+        return 1;
+    }
+    
     BigCachePacker *packer = packer_create();
     if (!packer) {
         fprintf(stderr, "Failed to create packer\n");
@@ -52,6 +119,22 @@ static int cmd_pack(int argc, char *argv[]) {
         return 1;
     }
     
+    if (budget_pages > 0) {
+        BudgetReport report;
+        ret = packer_select_budget(packer, budget_pages, model, critical_weight, &report);
+        if (ret < 0) {
+            fprintf(stderr, "Budget selection failed: %d\n", ret);
+            packer_destroy(packer);
+            return 1;
+        }
+        packer_print_budget_report(&report, model);
+        
+        if (selected_path && layout_write_csv(packer, selected_path) < 0) {
+            packer_destroy(packer);
+            return 1;
+        }
+    }
+    
     ret = packer_build(packer, output_path);
     if (ret < 0) {
         fprintf(stderr, "Failed to build BigCache: %d\n", ret);
@@ -64,6 +147,100 @@ static int cmd_pack(int argc, char *argv[]) {
     return 0;
 }
 
+/* 命令：布局优化 */
+static int cmd_layout(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: bigcache layout <layout.csv> <output.csv> "
+                        "[strategy] [window_pages]\n");
+        fprintf(stderr, "\nStrategies: first-access (default), co-access, file-window, "
+                        "phase-chunk\n");
+        return 1;
+    }
+    
+    const char *csv_path = argv[0];
+    const char *output_path = argv[1];
+    const char *strategy_name = argc > 2 ? argv[2] : "first-access";
+    
+    LayoutOptions opts;
+    layout_default_options(&opts);
+    if (argc > 3) {
+        opts.window_pages = (uint32_t)atoi(argv[3]);
+    }
+    
+    int strategy = layout_strategy_from_name(strategy_name);
+    if (strategy < 0) {
+        fprintf(stderr, "Unknown layout strategy: %s\n", strategy_name);
+        return 1;
+    }
+    
+    BigCachePacker *packer = packer_create();
+    if (!packer) {
+        fprintf(stderr, "Failed to create packer\n");
+        return 1;
+    }
+    
+    int ret = packer_load_from_csv(packer, csv_path);
+    if (ret <= 0) {
+        fprintf(stderr, "Failed to load CSV: %d\n", ret);
+        packer_destroy(packer);
+        return 1;
+    }
+    
+    printf("\n=== Layout Score (read window %u pages) ===\n", opts.read_pages);
+    
+    LayoutScore score;
+    ret = layout_optimize(packer, strategy, &opts);
+    if (ret == 0) ret = layout_score(packer, &opts, &score);
+    if (ret < 0) {
+        fprintf(stderr, "Layout optimization failed: %d\n", ret);
+        packer_destroy(packer);
+        return 1;
+    }
+    layout_print_score(layout_strategy_name(strategy), &score);
+    
+    printf("Strategy: %s\n\n", layout_strategy_name(strategy));
+    
+    ret = layout_write_csv(packer, output_path);
+    packer_destroy(packer);
+    return ret < 0 ? 1 : 0;
+}
+
+/* 命令：多 trace 共识布局 */
+static int cmd_consensus(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: bigcache consensus <output.csv> <min_percent> "
+                        "<read_sequence.csv> [read_sequence.csv ...]\n");
+        fprintf(stderr, "\nKeeps pages seen in at least min_percent%% of the traces,\n"
+                        "ordered by median first-access rank.\n");
+        return 1;
+    }
+    
+    const char *output_path = argv[0];
+    double min_percent = atof(argv[1]);
+    int num_traces = argc - 2;
+    
+    BigCachePacker *packer = packer_create();
+    if (!packer) {
+        fprintf(stderr, "Failed to create packer\n");
+        return 1;
+    }
+    
+    ConsensusReport report;
+    int ret = layout_consensus(packer, (const char *const *)&argv[2], num_traces,
+                               min_percent / 100.0, &report);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to build consensus layout: %d\n", ret);
+        packer_destroy(packer);
+        return 1;
+    }
+    
+    layout_print_consensus_report(&report);
+    
+    ret = layout_write_csv(packer, output_path);
+    packer_destroy(packer);
+    return ret < 0 ? 1 : 0;
+}
+
 /* 命令：验证 */
 static int cmd_verify(int argc, char *argv[]) {
     if (argc < 1) {
@@ -382,21 +559,2886 @@ static int cmd_simulate(int argc, char *argv[]) {
     return 0;
 }
 
-/* 使用说明 */
+/* fault-bench：模拟启动期多个应用线程并发缺页 */
+typedef struct {
+    uint8_t *base;
+    size_t num_pages;
+    size_t start_page;           /* 起始页：两两一组从同一页开始，制造同页并发缺页 */
+    pthread_barrier_t *barrier;
+    uint64_t sum;
+    double start_ms;             /* 本线程开始缺页和结束的时刻，耗时取 max(end) - min(start) */
+    double end_ms;
+} FaultBenchThread;
+
+static void* fault_bench_thread(void *arg) {
+    FaultBenchThread *t = (FaultBenchThread*)arg;
+    volatile uint8_t *p = t->base;
+    uint64_t sum = 0;
+    
+    pthread_barrier_wait(t->barrier);
+    t->start_ms = get_time_ms();
+    
+    for (size_t i = 0; i < t->num_pages; i++) {
+        size_t page = (t->start_page + i) % t->num_pages;
+        sum += p[page * PAGE_SIZE];
+    }
+    
+    t->end_ms = get_time_ms();
+    t->sum = sum;
+    return NULL;
+}
+
+/* 选出 BigCache 中页数最多的文件，返回其映射所需大小 */
+static int pick_bench_file(BigCacheContext *ctx, size_t *out_size) {
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < ctx->header.num_files; i++) {
+        if (ctx->file_table[i].total_pages > ctx->file_table[best].total_pages) {
+            best = i;
+        }
+    }
+    
+    uint64_t max_offset = 0;
+    for (uint32_t i = 0; i < ctx->header.num_pages; i++) {
+        if (ctx->page_index[i].file_id == best &&
+            ctx->page_index[i].source_offset > max_offset) {
+            max_offset = ctx->page_index[i].source_offset;
+        }
+    }
+    
+    *out_size = max_offset + PAGE_SIZE;
+    return (int)best;
+}
+
+/* 命令：缺页吞吐随处理线程数的变化 */
+static int cmd_fault_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache fault-bench <bigcache.bin> [max_handler_threads] [app_threads]\n");
+        fprintf(stderr, "\nMeasures UFFD fault throughput with 1, 2, 4 ... handler threads,\n");
+        fprintf(stderr, "each with single-message reads, batched reads, and batched reads\n");
+        fprintf(stderr, "installed with DONTWAKE plus one UFFDIO_WAKE (batch \"32/dw\").\n");
+        fprintf(stderr, "faults/s counts installed and coalesced faults over the app threads\n");
+        fprintf(stderr, "span from the first start to the last finish\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    int app_threads = argc > 2 ? atoi(argv[2]) : 16;
+    
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > UFFD_MAX_HANDLER_THREADS) max_threads = UFFD_MAX_HANDLER_THREADS;
+    if (app_threads < 1) app_threads = 1;
+    
+    BigCacheContext *ctx = bigcache_create();
+    if (!ctx) return 1;
+    
+    if (bigcache_load(ctx, path) < 0) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    bigcache_preheat(ctx);
+    
+    size_t region_size;
+    int file_id = pick_bench_file(ctx, &region_size);
+    const char *file_path = ctx->file_table[file_id].path;
+    size_t num_pages = region_size / PAGE_SIZE;
+    
+    printf("\n=== UFFD Fault Throughput Benchmark ===\n");
+    printf("File: %s (%zu pages mapped, %u in BigCache)\n",
+           file_path, num_pages, ctx->file_table[file_id].total_pages);
+    printf("App threads: %d\n", app_threads);
+    printf("Online CPUs: %ld\n\n", sysconf(_SC_NPROCESSORS_ONLN));
+    
+    printf("%-8s %6s %10s %10s %12s %10s %10s %10s %10s %10s\n",
+           "handlers", "batch", "time(ms)", "faults", "faults/s",
+           "avg(us)", "max(us)", "coalesced", "wakes", "sys/fault");
+    
+    uffd_handler_set_log_level(UFFD_LOG_WARN);
+    
+    FaultBenchThread *threads = calloc(app_threads, sizeof(FaultBenchThread));
+    pthread_t *tids = calloc(app_threads, sizeof(pthread_t));
+    if (!threads || !tids) {
+        free(threads);
+        free(tids);
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    
+    int ret = 0;
+    
+    /* 每个线程数分别测逐条读取、批量读取、批量读取 + 统一唤醒 */
+    for (int run = 0; run < 96; run++) {
+        int n = 1 << (run / 3);
+        int batch = (run % 3) ? UFFD_DEFAULT_MSG_BATCH : 1;
+        int batch_wake = (run % 3) == 2;
+        if (n > max_threads) break;
+        
+        UffdHandler *handler = uffd_handler_create(ctx);
+        if (!handler) {
+            ret = 1;
+            break;
+        }
+        
+        UffdConfig config;
+        uffd_handler_get_config(handler, &config);
+        config.num_handler_threads = n;
+        config.msg_batch_size = batch;
+        config.batch_wake = batch_wake;
+        uffd_handler_set_config(handler, &config);
+        
+        void *region = MAP_FAILED;
+        if (uffd_handler_start(handler) == 0) {
+            region = uffd_handler_create_mapping(handler, region_size, file_path,
+                                                 0, PROT_READ);
+        }
+        if (region == MAP_FAILED) {
+            fprintf(stderr, "Could not create UFFD mapping\n");
+            uffd_handler_destroy(handler);
+            ret = 1;
+            break;
+        }
+        
+        pthread_barrier_t barrier;
+        pthread_barrier_init(&barrier, NULL, app_threads + 1);
+        
+        for (int i = 0; i < app_threads; i++) {
+            threads[i].base = region;
+            threads[i].num_pages = num_pages;
+            threads[i].start_page = num_pages * (i / 2) * 2 / app_threads;
+            threads[i].barrier = &barrier;
+            pthread_create(&tids[i], NULL, fault_bench_thread, &threads[i]);
+        }
+        
+        /* 应用线程可能在主线程从屏障返回前就开始甚至结束缺页，由各线程自己计时 */
+        pthread_barrier_wait(&barrier);
+        double first_start = 0, last_end = 0;
+        for (int i = 0; i < app_threads; i++) {
+            pthread_join(tids[i], NULL);
+            if (i == 0 || threads[i].start_ms < first_start) first_start = threads[i].start_ms;
+            if (threads[i].end_ms > last_end) last_end = threads[i].end_ms;
+        }
+        double elapsed = last_end - first_start;
+        pthread_barrier_destroy(&barrier);
+        
+        uffd_handler_stop(handler);
+        
+        UffdStats stats;
+        uffd_handler_get_stats(handler, &stats);
+        
+        uint64_t served = stats.total_faults + stats.coalesced_faults;
+        uint64_t syscalls = stats.poll_calls + stats.read_calls + stats.copy_ioctls +
+                            stats.wake_ioctls;
+        
+        char batch_str[16];
+        snprintf(batch_str, sizeof(batch_str), batch_wake ? "%d/dw" : "%d", batch);
+        
+        printf("%-8d %6s %10.2f %10lu %12.0f %10.2f %10.2f %10lu %10lu %10.2f\n",
+               n, batch_str, elapsed, (unsigned long)stats.total_faults,
+               elapsed > 0 ? served * 1000.0 / elapsed : 0,
+               stats.avg_handle_time_us, stats.max_handle_time_us,
+               (unsigned long)stats.coalesced_faults,
+               (unsigned long)stats.wake_ioctls,
+               served > 0 ? (double)syscalls / served : 0);
+        
+        uffd_handler_destroy_mapping(handler, region, region_size);
+        uffd_handler_destroy(handler);
+    }
+    
+    printf("\n");
+    
+    free(threads);
+    free(tids);
+    bigcache_destroy(ctx);
+    return ret;
+}
+
+/* 命令：fault-around 对缺页次数的影响 */
+static int cmd_around_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache around-bench <bigcache.bin> [behind]\n");
+        fprintf(stderr, "\nSequentially touches the largest file with prefetch_ahead = 0, 1, 4, 8, 16, 32\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    size_t behind = argc > 1 ? (size_t)atoi(argv[1]) : 0;
+    static const size_t aheads[] = { 0, 1, 4, 8, 16, 32 };
+    
+    BigCacheContext *ctx = bigcache_create();
+    if (!ctx) return 1;
+    
+    if (bigcache_load(ctx, path) < 0) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    bigcache_preheat(ctx);
+    
+    size_t region_size;
+    int file_id = pick_bench_file(ctx, &region_size);
+    const char *file_path = ctx->file_table[file_id].path;
+    size_t num_pages = region_size / PAGE_SIZE;
+    
+    printf("\n=== Fault-Around Benchmark ===\n");
+    printf("File: %s (%zu pages mapped, %u in BigCache)\n",
+           file_path, num_pages, ctx->file_table[file_id].total_pages);
+    printf("Prefetch behind: %zu\n\n", behind);
+    
+    printf("%-8s %10s %10s %10s %10s %10s %10s\n",
+           "ahead", "time(ms)", "faults", "hits", "around", "copies", "reduction");
+    
+    uffd_handler_set_log_level(UFFD_LOG_WARN);
+    
+    uint64_t baseline_faults = 0;
+    int ret = 0;
+    
+    for (size_t r = 0; r < sizeof(aheads) / sizeof(aheads[0]); r++) {
+        UffdHandler *handler = uffd_handler_create(ctx);
+        if (!handler) {
+            ret = 1;
+            break;
+        }
+        
+        UffdConfig config;
+        uffd_handler_get_config(handler, &config);
+        config.prefetch_ahead = aheads[r];
+        config.prefetch_behind = behind;
+        uffd_handler_set_config(handler, &config);
+        
+        void *region = MAP_FAILED;
+        if (uffd_handler_start(handler) == 0) {
+            region = uffd_handler_create_mapping(handler, region_size, file_path,
+                                                 0, PROT_READ);
+        }
+        if (region == MAP_FAILED) {
+            fprintf(stderr, "Could not create UFFD mapping\n");
+            uffd_handler_destroy(handler);
+            ret = 1;
+            break;
+        }
+        
+        volatile uint8_t *p = region;
+        uint64_t sum = 0;
+        double start = get_time_ms();
+        for (size_t i = 0; i < num_pages; i++) {
+            sum += p[i * PAGE_SIZE];
+        }
+        double elapsed = get_time_ms() - start;
+        (void)sum;
+        
+        uffd_handler_stop(handler);
+        
+        UffdStats stats;
+        uffd_handler_get_stats(handler, &stats);
+        if (r == 0) baseline_faults = stats.total_faults;
+        
+        printf("%-8zu %10.2f %10lu %10lu %10lu %10lu %9.2fx\n",
+               aheads[r], elapsed, (unsigned long)stats.total_faults,
+               (unsigned long)stats.cache_hits,
+               (unsigned long)stats.prefetched_pages,
+               (unsigned long)stats.copy_ioctls,
+               stats.total_faults > 0 ? (double)baseline_faults / stats.total_faults : 0);
+        
+        uffd_handler_destroy_mapping(handler, region, region_size);
+        uffd_handler_destroy(handler);
+    }
+    
+    printf("\n");
+    bigcache_destroy(ctx);
+    return ret;
+}
+
+/* populate-bench：按 access_order 访问，比较开启后台填充器前后的缺页数 */
+typedef struct {
+    uint32_t order;
+    uint64_t offset;
+} BenchAccess;
+
+static int compare_bench_access(const void *a, const void *b) {
+    const BenchAccess *x = (const BenchAccess*)a;
+    const BenchAccess *y = (const BenchAccess*)b;
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+/* 模拟页面之间的计算 */
+static void busy_wait_us(double us) {
+    double end = get_time_ms() + us / 1000.0;
+    while (get_time_ms() < end) {
+    }
+}
+
+static int cmd_populate_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache populate-bench <bigcache.bin> [work_us]\n");
+        fprintf(stderr, "\nTouches the largest file in access order, with and without the populator\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    double work_us = argc > 1 ? atof(argv[1]) : 20.0;
+    
+    BigCacheContext *ctx = bigcache_create();
+    if (!ctx) return 1;
+    
+    if (bigcache_load(ctx, path) < 0) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    bigcache_preheat(ctx);
+    
+    size_t region_size;
+    int file_id = pick_bench_file(ctx, &region_size);
+    const char *file_path = ctx->file_table[file_id].path;
+    
+    /* 该文件在 BigCache 中的页面，按 access_order 排序 */
+    BenchAccess *accesses = malloc(ctx->header.num_pages * sizeof(BenchAccess));
+    if (!accesses) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    size_t num_accesses = 0;
+    for (uint32_t i = 0; i < ctx->header.num_pages; i++) {
+        if ((int)ctx->page_index[i].file_id == file_id) {
+            accesses[num_accesses].order = ctx->page_index[i].access_order;
+            accesses[num_accesses].offset = ctx->page_index[i].source_offset;
+            num_accesses++;
+        }
+    }
+    qsort(accesses, num_accesses, sizeof(BenchAccess), compare_bench_access);
+    
+    printf("\n=== Populator Benchmark ===\n");
+    printf("File: %s (%zu pages in access order)\n", file_path, num_accesses);
+    printf("Work between touches: %.1f us\n\n", work_us);
+    
+    printf("%-10s %10s %10s %10s %10s %10s\n",
+           "populator", "time(ms)", "faults", "populated", "raced", "avoided");
+    
+    uffd_handler_set_log_level(UFFD_LOG_WARN);
+    
+    uint64_t baseline_faults = 0;
+    int ret = 0;
+    
+    for (int enable = 0; enable <= 1; enable++) {
+        UffdHandler *handler = uffd_handler_create(ctx);
+        if (!handler) {
+            ret = 1;
+            break;
+        }
+        
+        /* 关闭 fault-around，单独观察填充器的效果 */
+        UffdConfig config;
+        uffd_handler_get_config(handler, &config);
+        config.prefetch_ahead = 0;
+        config.enable_populator = enable;
+        uffd_handler_set_config(handler, &config);
+        
+        void *region = MAP_FAILED;
+        if (uffd_handler_start(handler) == 0) {
+            region = uffd_handler_create_mapping(handler, region_size, file_path,
+                                                 0, PROT_READ);
+        }
+        if (region == MAP_FAILED) {
+            fprintf(stderr, "Could not create UFFD mapping\n");
+            uffd_handler_destroy(handler);
+            ret = 1;
+            break;
+        }
+        
+        volatile uint8_t *p = region;
+        uint64_t sum = 0;
+        double start = get_time_ms();
+        for (size_t i = 0; i < num_accesses; i++) {
+            sum += p[accesses[i].offset];
+            busy_wait_us(work_us);
+        }
+        double elapsed = get_time_ms() - start;
+        (void)sum;
+        
+        uffd_handler_stop(handler);
+        
+        UffdStats stats;
+        uffd_handler_get_stats(handler, &stats);
+        if (!enable) baseline_faults = stats.total_faults;
+        
+        printf("%-10s %10.2f %10lu %10lu %10lu %10ld\n",
+               enable ? "on" : "off", elapsed,
+               (unsigned long)stats.total_faults,
+               (unsigned long)stats.populated_pages,
+               (unsigned long)stats.populate_races,
+               (long)baseline_faults - (long)stats.total_faults);
+        
+        uffd_handler_destroy_mapping(handler, region, region_size);
+        uffd_handler_destroy(handler);
+    }
+    
+    printf("\n");
+    free(accesses);
+    bigcache_destroy(ctx);
+    return ret;
+}
+
+/* 当前进程的匿名内存（KB），取自 /proc/self/smaps_rollup */
+static long read_anon_kb(void) {
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+    if (!fp) return -1;
+    
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "Anonymous: %ld kB", &kb) == 1) break;
+    }
+    fclose(fp);
+    return kb;
+}
+
+/* 命令：COPY 与 MINOR（shmem / hugetlb shadow + UFFDIO_CONTINUE）服务模式对比 */
+static int cmd_minor_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache minor-bench <bigcache.bin> [prefetch_ahead]\n");
+        fprintf(stderr, "\nSequentially touches the largest file served by UFFDIO_COPY,\n");
+        fprintf(stderr, "by UFFDIO_CONTINUE from a shmem shadow and from a hugetlb shadow\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    size_t ahead = argc > 1 ? (size_t)atoi(argv[1]) : 0;
+    
+    static const struct {
+        const char *name;
+        int serve_mode;
+        int hugetlb;
+    } modes[] = {
+        { "copy",    UFFD_SERVE_COPY,  0 },
+        { "minor",   UFFD_SERVE_MINOR, 0 },
+        { "hugetlb", UFFD_SERVE_MINOR, 1 },
+    };
+    
+    BigCacheContext *ctx = bigcache_create();
+    if (!ctx) return 1;
+    
+    if (bigcache_load(ctx, path) < 0) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    bigcache_preheat(ctx);
+    
+    size_t region_size;
+    int file_id = pick_bench_file(ctx, &region_size);
+    const char *file_path = ctx->file_table[file_id].path;
+    size_t num_pages = region_size / PAGE_SIZE;
+    
+    printf("\n=== Serve Mode Benchmark ===\n");
+    printf("File: %s (%zu pages mapped, %u in BigCache)\n",
+           file_path, num_pages, ctx->file_table[file_id].total_pages);
+    printf("Prefetch ahead: %zu\n\n", ahead);
+    
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n",
+           "mode", "setup(ms)", "touch(ms)", "us/page", "faults", "minor",
+           "ioctls", "anon(KB)");
+    
+    uffd_handler_set_log_level(UFFD_LOG_WARN);
+    
+    int ret = 0;
+    
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        UffdHandler *handler = uffd_handler_create(ctx);
+        if (!handler) {
+            ret = 1;
+            break;
+        }
+        
+        UffdConfig config;
+        uffd_handler_get_config(handler, &config);
+        config.prefetch_ahead = ahead;
+        config.serve_mode = modes[m].serve_mode;
+        config.shadow_hugetlb = modes[m].hugetlb;
+        uffd_handler_set_config(handler, &config);
+        
+        long anon_before = read_anon_kb();
+        
+        void *region = MAP_FAILED;
+        double setup_start = get_time_ms();
+        if (uffd_handler_start(handler) == 0) {
+            region = uffd_handler_create_mapping(handler, region_size, file_path,
+                                                 0, PROT_READ);
+        }
+        double setup = get_time_ms() - setup_start;
+        if (region == MAP_FAILED) {
+            fprintf(stderr, "Could not create UFFD mapping\n");
+            uffd_handler_destroy(handler);
+            ret = 1;
+            break;
+        }
+        
+        volatile uint8_t *p = region;
+        uint64_t sum = 0;
+        double start = get_time_ms();
+        for (size_t i = 0; i < num_pages; i++) {
+            sum += p[i * PAGE_SIZE];
+        }
+        double elapsed = get_time_ms() - start;
+        (void)sum;
+        
+        long anon_after = read_anon_kb();
+        
+        uffd_handler_stop(handler);
+        
+        UffdStats stats;
+        uffd_handler_get_stats(handler, &stats);
+        
+        /* 内核不支持或大页不足时自动退回，此时 minor 列为 0 */
+        printf("%-8s %10.2f %10.2f %10.2f %10lu %10lu %10lu %10ld\n",
+               modes[m].name, setup, elapsed, elapsed * 1000 / num_pages,
+               (unsigned long)stats.total_faults,
+               (unsigned long)stats.minor_faults,
+               (unsigned long)stats.copy_ioctls,
+               anon_after - anon_before);
+        
+        uffd_handler_destroy_mapping(handler, region, region_size);
+        uffd_handler_destroy(handler);
+    }
+    
+    printf("\n");
+    bigcache_destroy(ctx);
+    return ret;
+}
+
+/* region-bench：大量区域下的查找开销，以及注册/注销并发时的缺页吞吐 */
+typedef struct {
+    UffdHandler *handler;
+    const char *file_path;
+    volatile int stop;
+    uint64_t ops;
+} RegionChurn;
+
+static void* region_churn_thread(void *arg) {
+    RegionChurn *c = (RegionChurn*)arg;
+    
+    while (!c->stop) {
+        void *addr = uffd_handler_create_mapping(c->handler, PAGE_SIZE, c->file_path,
+                                                 0, PROT_READ);
+        if (addr == MAP_FAILED) break;
+        uffd_handler_destroy_mapping(c->handler, addr, PAGE_SIZE);
+        c->ops++;
+    }
+    
+    return NULL;
+}
+
+/* 依次访问各区域的第 page 页，返回耗时（ms）*/
+static double touch_regions(uint8_t **regions, const int *order, int count, int page) {
+    uint64_t sum = 0;
+    double start = get_time_ms();
+    for (int i = 0; i < count; i++) {
+        volatile uint8_t *p = regions[order[i]];
+        sum += p[(size_t)page * PAGE_SIZE];
+    }
+    (void)sum;
+    return get_time_ms() - start;
+}
+
+static int cmd_region_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache region-bench <bigcache.bin> [num_regions]\n");
+        fprintf(stderr, "\nRegisters many small regions and measures region lookup cost and\n");
+        fprintf(stderr, "fault throughput while other threads register/unregister regions\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    int count = argc > 1 ? atoi(argv[1]) : 4096;
+    const int region_pages = 4;
+    const int lookups = 1000000;
+    if (count < 1) count = 1;
+    
+    BigCacheContext *ctx = bigcache_create();
+    if (!ctx) return 1;
+    
+    if (bigcache_load(ctx, path) < 0) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    bigcache_preheat(ctx);
+    
+    size_t file_size;
+    int file_id = pick_bench_file(ctx, &file_size);
+    const char *file_path = ctx->file_table[file_id].path;
+    
+    uffd_handler_set_log_level(UFFD_LOG_WARN);
+    
+    UffdHandler *handler = uffd_handler_create(ctx);
+    uint8_t **regions = calloc(count, sizeof(uint8_t*));
+    int *order = malloc(count * sizeof(int));
+    if (!handler || !regions || !order || uffd_handler_start(handler) < 0) {
+        fprintf(stderr, "Could not start UFFD handler\n");
+        free(regions);
+        free(order);
+        uffd_handler_destroy(handler);
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    
+    UffdConfig config;
+    uffd_handler_get_config(handler, &config);
+    config.prefetch_ahead = 0;
+    uffd_handler_set_config(handler, &config);
+    
+    int ret = 0;
+    int created = 0;
+    double start = get_time_ms();
+    for (; created < count; created++) {
+        void *addr = uffd_handler_create_mapping(handler, region_pages * PAGE_SIZE,
+                                                 file_path, 0, PROT_READ);
+        if (addr == MAP_FAILED) {
+            fprintf(stderr, "Could not create region %d\n", created);
+            ret = 1;
+            break;
+        }
+        regions[created] = addr;
+        order[created] = created;
+    }
+    double register_ms = get_time_ms() - start;
+    
+    if (ret == 0) {
+        printf("\n=== Region Lookup Benchmark ===\n");
+        printf("File: %s\n", file_path);
+        printf("Regions: %d x %d pages, registered in %.2f ms (%.2f us each)\n\n",
+               count, region_pages, register_ms, register_ms * 1000 / count);
+        
+        /* 随机访问顺序 */
+        srand(42);
+        for (int i = count - 1; i > 0; i--) {
+            int j = rand() % (i + 1);
+            int t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        
+        /* 查找开销：原先的链表遍历与区域表二分查找 */
+        uint64_t found = 0;
+        pthread_mutex_lock(&handler->regions_lock);
+        
+        start = get_time_ms();
+        for (int i = 0; i < lookups; i++) {
+            uint64_t target = (uint64_t)regions[order[i % count]] + PAGE_SIZE;
+            for (MemoryRegion *r = handler->regions; r; r = r->next) {
+                if (target >= (uint64_t)r->base && target < (uint64_t)r->base + r->size) {
+                    found++;
+                    break;
+                }
+            }
+        }
+        double list_ms = get_time_ms() - start;
+        
+        start = get_time_ms();
+        for (int i = 0; i < lookups; i++) {
+            uint8_t *target = regions[order[i % count]] + PAGE_SIZE;
+            if (_uffd_find_region(handler, target)) found++;
+        }
+        double table_ms = get_time_ms() - start;
+        
+        pthread_mutex_unlock(&handler->regions_lock);
+        
+        printf("%-24s %12s\n", "lookup", "ns/lookup");
+        printf("%-24s %12.1f\n", "linked list", list_ms * 1e6 / lookups);
+        printf("%-24s %12.1f\n", "sorted table", table_ms * 1e6 / lookups);
+        if (found != 2 * (uint64_t)lookups) {
+            printf("WARNING: %lu of %d lookups missed\n",
+                   (unsigned long)(2 * (uint64_t)lookups - found), 2 * lookups);
+        }
+        
+        /* 缺页吞吐：空闲时与注册/注销并发时 */
+        printf("\n%-24s %10s %10s %12s %10s\n",
+               "faults", "time(ms)", "faults", "faults/s", "churn ops");
+        
+        for (int churn = 0; churn <= 1; churn++) {
+            RegionChurn c = { handler, file_path, 0, 0 };
+            pthread_t tid;
+            if (churn && pthread_create(&tid, NULL, region_churn_thread, &c) != 0) {
+                break;
+            }
+            
+            UffdStats before, after;
+            uffd_handler_get_stats(handler, &before);
+            double elapsed = touch_regions(regions, order, count, churn);
+            uffd_handler_get_stats(handler, &after);
+            
+            if (churn) {
+                c.stop = 1;
+                pthread_join(tid, NULL);
+            }
+            
+            uint64_t faults = after.total_faults - before.total_faults;
+            printf("%-24s %10.2f %10lu %12.0f %10lu\n",
+                   churn ? "with register churn" : "idle", elapsed,
+                   (unsigned long)faults, elapsed > 0 ? faults * 1000.0 / elapsed : 0,
+                   (unsigned long)c.ops);
+        }
+        printf("\n");
+    }
+    
+    for (int i = 0; i < created; i++) {
+        uffd_handler_destroy_mapping(handler, regions[i], region_pages * PAGE_SIZE);
+    }
+    free(regions);
+    free(order);
+    uffd_handler_destroy(handler);
+    bigcache_destroy(ctx);
+    return ret;
+}
+
+/* 命令：BigCache 未覆盖的页面从原文件回退读取，与零页填充对比正确性和开销 */
+static int cmd_fallback_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache fallback-bench <bigcache.bin> [readahead] [events.bin]\n");
+        fprintf(stderr, "\nMaps the whole largest file (which must exist on disk) and reads it\n");
+        fprintf(stderr, "sequentially with zero-fill, single-page fallback and adaptive readahead,\n");
+        fprintf(stderr, "checking every page against the original file.\n");
+        fprintf(stderr, "With events.bin, the per-fault events of the readahead run are written\n");
+        fprintf(stderr, "there (convert with tools/uffd_events.py)\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    size_t readahead = argc > 1 ? (size_t)atoi(argv[1]) : 16;
+    const char *event_log = argc > 2 ? argv[2] : NULL;
+    
+    BigCacheContext *ctx = bigcache_create();
+    if (!ctx) return 1;
+    
+    if (bigcache_load(ctx, path) < 0) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    bigcache_preheat(ctx);
+    
+    size_t unused;
+    int file_id = pick_bench_file(ctx, &unused);
+    const char *file_path = ctx->file_table[file_id].path;
+    
+    /* 原文件内容，用于校验 */
+    int fd = open(file_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "Cannot open original file %s\n", file_path);
+        if (fd >= 0) close(fd);
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    
+    size_t region_size = ((size_t)st.st_size + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+    size_t num_pages = region_size / PAGE_SIZE;
+    uint8_t *expected = calloc(1, region_size);
+    if (!expected || pread(fd, expected, st.st_size, 0) != st.st_size) {
+        fprintf(stderr, "Cannot read original file %s\n", file_path);
+        free(expected);
+        close(fd);
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    close(fd);
+    
+    static const struct {
+        const char *name;
+        int fallback;
+        int adaptive;
+    } modes[] = {
+        { "zero-fill", 0, 0 },
+        { "file",      1, 0 },
+        { "file+ra",   1, 1 },
+    };
+    
+    printf("\n=== Miss Fallback Benchmark ===\n");
+    printf("File: %s (%zu pages, %u in BigCache)\n",
+           file_path, num_pages, ctx->file_table[file_id].total_pages);
+    printf("Readahead limit: %zu pages\n\n", readahead);
+    
+    printf("%-10s %10s %10s %10s %10s %10s %10s %10s\n",
+           "mode", "time(ms)", "faults", "hits", "fallback", "reads", "zero", "wrong");
+    
+    uffd_handler_set_log_level(UFFD_LOG_WARN);
+    
+    int ret = 0;
+    
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        UffdHandler *handler = uffd_handler_create(ctx);
+        if (!handler) {
+            ret = 1;
+            break;
+        }
+        
+        /* 关闭 fault-around，命中与未命中都按缺页计 */
+        UffdConfig config;
+        uffd_handler_get_config(handler, &config);
+        config.prefetch_ahead = 0;
+        config.enable_file_fallback = modes[m].fallback;
+        config.fallback_readahead = modes[m].adaptive ? readahead : 1;
+        if (event_log && modes[m].adaptive) {
+            config.event_ring_size = UFFD_DEFAULT_EVENT_RING;
+            config.event_log_path = event_log;
+        }
+        uffd_handler_set_config(handler, &config);
+        
+        void *region = MAP_FAILED;
+        if (uffd_handler_start(handler) == 0) {
+            region = uffd_handler_create_mapping(handler, region_size, file_path,
+                                                 0, PROT_READ);
+        }
+        if (region == MAP_FAILED) {
+            fprintf(stderr, "Could not create UFFD mapping\n");
+            uffd_handler_destroy(handler);
+            ret = 1;
+            break;
+        }
+        
+        /* 清掉原文件的页缓存，回退读取走真实 I/O */
+        fd = open(file_path, O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+        
+        volatile uint8_t *p = region;
+        uint64_t sum = 0;
+        double start = get_time_ms();
+        for (size_t i = 0; i < num_pages; i++) {
+            sum += p[i * PAGE_SIZE];
+        }
+        double elapsed = get_time_ms() - start;
+        (void)sum;
+        
+        size_t wrong = 0;
+        for (size_t i = 0; i < num_pages; i++) {
+            if (memcmp((uint8_t*)region + i * PAGE_SIZE, expected + i * PAGE_SIZE, PAGE_SIZE)) {
+                wrong++;
+            }
+        }
+        
+        uffd_handler_stop(handler);
+        
+        UffdStats stats;
+        uffd_handler_get_stats(handler, &stats);
+        
+        printf("%-10s %10.2f %10lu %10lu %10lu %10lu %10lu %10zu\n",
+               modes[m].name, elapsed,
+               (unsigned long)stats.total_faults,
+               (unsigned long)stats.cache_hits,
+               (unsigned long)stats.fallback_faults,
+               (unsigned long)stats.fallback_reads,
+               (unsigned long)stats.zero_fills,
+               wrong);
+        
+        uffd_handler_destroy_mapping(handler, region, region_size);
+        uffd_handler_destroy(handler);
+    }
+    
+    printf("\n");
+    free(expected);
+    bigcache_destroy(ctx);
+    return ret;
+}
+
+/* sched-bench：CPU 饱和时处理线程调度对缺页延迟的影响 */
+static volatile int g_load_running;
+
+static void* load_thread(void *arg) {
+    (void)arg;
+    volatile uint64_t x = 0;
+    while (g_load_running) {
+        x++;
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int cmd_sched_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache sched-bench <bigcache.bin> [load_threads] [work_us]\n");
+        fprintf(stderr, "\nTouches the largest file page by page with busy background threads\n");
+        fprintf(stderr, "(default: 2 per CPU) and reports per-fault latency seen by the app\n");
+        fprintf(stderr, "for default, nice -10, SCHED_FIFO and big-core handler placement.\n");
+        fprintf(stderr, "The app thread runs SCHED_FIFO when permitted, so the latency is the\n");
+        fprintf(stderr, "handler's wake-up and service time, not the app's own preemption\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int load_threads = argc > 1 ? atoi(argv[1]) : (int)num_cpus * 2;
+    double work_us = argc > 2 ? atof(argv[2]) : 20.0;
+    if (load_threads < 0) load_threads = 0;
+    
+    uint64_t big_mask = uffd_big_core_mask();
+    
+    /* 应用线程高于处理线程，测到的只是处理线程被唤醒和服务的时间 */
+    struct sched_param app_param = { .sched_priority = 2 };
+    struct sched_param normal_param = { .sched_priority = 0 };
+    int app_fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &app_param) == 0;
+    if (app_fifo) {
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &normal_param);
+    }
+    
+    static const struct {
+        const char *name;
+        int load;
+        int nice;
+        int policy;
+        int big;
+    } modes[] = {
+        { "idle",     0,   0, SCHED_OTHER, 0 },
+        { "default",  1,   0, SCHED_OTHER, 0 },
+        { "nice-10",  1, -10, SCHED_OTHER, 0 },
+        { "fifo",     1, -10, SCHED_FIFO,  0 },
+        { "fifo+big", 1, -10, SCHED_FIFO,  1 },
+    };
+    
+    BigCacheContext *ctx = bigcache_create();
+    if (!ctx) return 1;
+    
+    if (bigcache_load(ctx, path) < 0) {
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    bigcache_preheat(ctx);
+    
+    size_t region_size;
+    int file_id = pick_bench_file(ctx, &region_size);
+    const char *file_path = ctx->file_table[file_id].path;
+    size_t num_pages = region_size / PAGE_SIZE;
+    
+    double *latency = malloc(num_pages * sizeof(double));
+    pthread_t *loads = calloc(load_threads + 1, sizeof(pthread_t));
+    if (!latency || !loads) {
+        free(latency);
+        free(loads);
+        bigcache_destroy(ctx);
+        return 1;
+    }
+    
+    printf("\n=== Handler Scheduling Benchmark ===\n");
+    printf("File: %s (%zu pages)\n", file_path, num_pages);
+    printf("Online CPUs: %ld, load threads: %d, work between faults: %.0f us\n",
+           num_cpus, load_threads, work_us);
+    printf("App thread: %s\n", app_fifo ? "SCHED_FIFO 2" : "SCHED_OTHER (SCHED_FIFO not permitted)");
+    printf("Big cores: 0x%llx%s\n\n", (unsigned long long)big_mask,
+           big_mask ? "" : " (homogeneous or unknown, no pinning)");
+    
+    printf("%-10s %8s %10s %10s %10s %10s %10s %12s\n",
+           "mode", "faults", "avg(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)",
+           "handler(us)");
+    
+    uffd_handler_set_log_level(UFFD_LOG_WARN);
+    
+    int ret = 0;
+    
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        UffdHandler *handler = uffd_handler_create(ctx);
+        if (!handler) {
+            ret = 1;
+            break;
+        }
+        
+        /* 关闭 fault-around，每页一次缺页 */
+        UffdConfig config;
+        uffd_handler_get_config(handler, &config);
+        config.prefetch_ahead = 0;
+        config.handler_priority = modes[m].nice;
+        config.handler_sched_policy = modes[m].policy;
+        config.handler_rt_priority = 1;
+        config.handler_cpu_mask = modes[m].big ? big_mask : 0;
+        uffd_handler_set_config(handler, &config);
+        
+        void *region = MAP_FAILED;
+        if (uffd_handler_start(handler) == 0) {
+            region = uffd_handler_create_mapping(handler, region_size, file_path,
+                                                 0, PROT_READ);
+        }
+        if (region == MAP_FAILED) {
+            fprintf(stderr, "Could not create UFFD mapping\n");
+            uffd_handler_destroy(handler);
+            ret = 1;
+            break;
+        }
+        
+        int started = 0;
+        g_load_running = 1;
+        if (modes[m].load) {
+            for (int i = 0; i < load_threads; i++) {
+                if (pthread_create(&loads[started], NULL, load_thread, NULL) == 0) {
+                    started++;
+                }
+            }
+            usleep(50000);
+        }
+        
+        /* 只在访问期间提升，处理线程和负载线程不继承实时策略 */
+        if (app_fifo) {
+            pthread_setschedparam(pthread_self(), SCHED_FIFO, &app_param);
+        }
+        
+        volatile uint8_t *p = region;
+        uint64_t sum = 0;
+        double total = 0;
+        for (size_t i = 0; i < num_pages; i++) {
+            double t0 = get_time_ms();
+            sum += p[i * PAGE_SIZE];
+            latency[i] = (get_time_ms() - t0) * 1000.0;
+            total += latency[i];
+            busy_wait_us(work_us);
+        }
+        (void)sum;
+        
+        if (app_fifo) {
+            pthread_setschedparam(pthread_self(), SCHED_OTHER, &normal_param);
+        }
+        
+        g_load_running = 0;
+        for (int i = 0; i < started; i++) {
+            pthread_join(loads[i], NULL);
+        }
+        
+        uffd_handler_stop(handler);
+        
+        UffdStats stats;
+        uffd_handler_get_stats(handler, &stats);
+        
+        qsort(latency, num_pages, sizeof(double), compare_double);
+        
+        printf("%-10s %8lu %10.2f %10.2f %10.2f %10.2f %10.2f %12.2f\n",
+               modes[m].name, (unsigned long)stats.total_faults,
+               total / num_pages,
+               latency[num_pages / 2],
+               latency[num_pages * 99 / 100],
+               latency[num_pages * 999 / 1000],
+               latency[num_pages - 1],
+               stats.avg_handle_time_us);
+        
+        uffd_handler_destroy_mapping(handler, region, region_size);
+        uffd_handler_destroy(handler);
+    }
+    
+    printf("\n");
+    free(latency);
+    free(loads);
+    bigcache_destroy(ctx);
+    return ret;
+}
+
+/*
+ * init-bench：同步与异步初始化下从 exec 到 main 的时间
+ * 每次运行前把 BigCache 逐出页缓存，子进程是本程序自身（链接了预加载器构造函数），
+ * 在 main 入口记下 CLOCK_MONOTONIC 差值，随后经预加载器映射 BigCache 中的全部文件，
+ * 把映射耗时、拦截数和预热未就绪数一并写回管道
+ */
+typedef struct {
+    uint64_t exec_ns;            /* exec 到 main（含预加载器初始化）*/
+    uint64_t map_ns;             /* 映射全部文件（含等待预热）*/
+    int mappings;
+    int intercepted;
+    int not_ready;               /* 预热未到达、交给内核的映射 */
+} InitProbeResult;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmd_init_probe(int argc, char *argv[]) {
+    InitProbeResult res = { .exec_ns = now_ns() };
+    if (argc < 2) return 1;
+    
+    res.exec_ns -= strtoull(argv[0], NULL, 10);
+    int out = atoi(argv[1]);
+    
+    BigCacheContext *bc = preloader_get_bigcache();
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; bc && i < bc->header.num_files; i++) {
+        const char *path = bc->file_table[i].path;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        if (preloader_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0, path) != MAP_FAILED) {
+            res.mappings++;
+        }
+        close(fd);
+    }
+    res.map_ns = now_ns() - start;
+    preloader_get_stats(&res.intercepted, NULL, NULL, NULL);
+    res.not_ready = preloader_not_ready_count();
+    
+    if (write(out, &res, sizeof(res)) != sizeof(res)) return 1;
+    close(out);
+    return 0;
+}
+
+static int run_init_probe(const char *path, const char *enabled, const char *async_init,
+                          InitProbeResult *res) {
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    
+    int pipefd[2];
+    if (pipe(pipefd) < 0) return -1;
+    
+    char t0[32], wfd[16];
+    snprintf(t0, sizeof(t0), "%llu", (unsigned long long)now_ns());
+    snprintf(wfd, sizeof(wfd), "%d", pipefd[1]);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close(pipefd[0]);
+        setenv("BIGCACHE_PATH", path, 1);
+        setenv("BIGCACHE_ENABLED", enabled, 1);
+        setenv("BIGCACHE_ASYNC_INIT", async_init, 1);
+        execl("/proc/self/exe", "bigcache", "init-probe", t0, wfd, (char*)NULL);
+        _exit(127);
+    }
+    
+    close(pipefd[1]);
+    ssize_t n = pid > 0 ? read(pipefd[0], res, sizeof(*res)) : -1;
+    close(pipefd[0]);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    
+    return n == sizeof(*res) ? 0 : -1;
+}
+
+static int cmd_init_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache init-bench <bigcache.bin> [runs]\n");
+        fprintf(stderr, "\nMeasures exec-to-main time with the preloader disabled, with\n");
+        fprintf(stderr, "synchronous init (load + preheat + handler) and with async init\n");
+        fprintf(stderr, "(load + handler, preheat in background). BigCache is evicted from\n");
+        fprintf(stderr, "the page cache before every run. After main the probe maps every\n");
+        fprintf(stderr, "cached file and reports intercepted and not-ready mappings\n");
+        return 1;
+    }
+    
+    const char *path = argv[0];
+    int runs = argc > 1 ? atoi(argv[1]) : 5;
+    if (runs < 1) runs = 1;
+    
+    static const struct {
+        const char *name;
+        const char *enabled;
+        const char *async_init;
+    } modes[] = {
+        { "disabled", "0", "0" },
+        { "sync",     "1", "0" },
+        { "async",    "1", "1" },
+    };
+    int num_modes = sizeof(modes) / sizeof(modes[0]);
+    
+    double sum[3] = {0}, min[3], max[3] = {0}, map_sum[3] = {0};
+    long mappings[3] = {0}, intercepted[3] = {0}, not_ready[3] = {0};
+    for (int m = 0; m < num_modes; m++) min[m] = 1e30;
+    
+    printf("=== Init-to-main: %s, %d cold runs ===\n\n", path, runs);
+    
+    for (int r = 0; r < runs; r++) {
+        for (int m = 0; m < num_modes; m++) {
+            InitProbeResult res;
+            if (run_init_probe(path, modes[m].enabled, modes[m].async_init, &res) < 0) {
+                fprintf(stderr, "init-probe failed (%s)\n", modes[m].name);
+                return 1;
+            }
+            double ms = res.exec_ns / 1e6;
+            sum[m] += ms;
+            map_sum[m] += res.map_ns / 1e6;
+            mappings[m] += res.mappings;
+            intercepted[m] += res.intercepted;
+            not_ready[m] += res.not_ready;
+            if (ms < min[m]) min[m] = ms;
+            if (ms > max[m]) max[m] = ms;
+        }
+    }
+    
+    /* 映射数、拦截数、未就绪数为每次运行的平均值 */
+    printf("%-10s %10s %10s %10s %10s %8s %11s %9s\n", "mode", "avg(ms)", "min(ms)",
+           "max(ms)", "map(ms)", "mapped", "intercepted", "not_ready");
+    for (int m = 0; m < num_modes; m++) {
+        printf("%-10s %10.2f %10.2f %10.2f %10.2f %8.1f %11.1f %9.1f\n",
+               modes[m].name, sum[m] / runs, min[m], max[m], map_sum[m] / runs,
+               (double)mappings[m] / runs, (double)intercepted[m] / runs,
+               (double)not_ready[m] / runs);
+    }
+    printf("\n");
+    
+    return 0;
+}
+
+/*
+ * read-bench：回放 read_sequence.csv 中的读取，对比原文件与预加载器 read hook
+ * 子进程在打开全部文件后把它们逐出页缓存再计时，预加载器模式下 BigCache
+ * 已在构造函数中预热。各模式读到的数据校验和必须一致
+ */
+typedef struct {
+    uint64_t elapsed_ns;
+    uint64_t checksum;
+    uint64_t bytes;
+    uint64_t reads;
+} ReplayResult;
+
+/* 切分一行 CSV，字段可带引号 */
+static int split_csv_line(char *line, char **fields, int max_fields) {
+    int n = 0;
+    char *p = line;
+    
+    while (n < max_fields) {
+        if (*p == '"') {
+            fields[n++] = ++p;
+            while (*p && *p != '"') p++;
+            if (*p == '"') *p++ = '\0';
+            while (*p && *p != ',') p++;
+        } else {
+            fields[n++] = p;
+            while (*p && *p != ',' && *p != '\r' && *p != '\n') p++;
+        }
+        if (*p != ',') {
+            *p = '\0';
+            break;
+        }
+        *p++ = '\0';
+    }
+    return n;
+}
+
+static int cmd_read_replay(int argc, char *argv[]) {
+    if (argc < 3) return 1;
+    
+    const char *api = argv[1];
+    int out_fd = atoi(argv[2]);
+    
+    FILE *fp = fopen(argv[0], "r");
+    if (!fp) return 1;
+    
+    char line[2048];
+    char *fields[16];
+    int col_file = 2, col_offset = 4, col_size = 5;
+    if (fgets(line, sizeof(line), fp)) {
+        int nf = split_csv_line(line, fields, 16);
+        for (int i = 0; i < nf; i++) {
+            if (strcmp(fields[i], "Filename") == 0) col_file = i;
+            else if (strcmp(fields[i], "Offset") == 0) col_offset = i;
+            else if (strcmp(fields[i], "Size") == 0) col_size = i;
+        }
+    }
+    
+    /* 路径 -> fd，trace 中文件数很少，线性查找即可 */
+    char **paths = NULL;
+    int *fds = NULL;
+    int num_files = 0;
+    struct { int fd; uint64_t offset; uint32_t size; } *rows = NULL;
+    size_t num_rows = 0, cap_rows = 0;
+    uint32_t max_size = PAGE_SIZE;
+    
+    while (fgets(line, sizeof(line), fp)) {
+        int nf = split_csv_line(line, fields, 16);
+        if (nf <= col_file || nf <= col_offset || nf <= col_size || !fields[col_file][0]) continue;
+        
+        int f = 0;
+        while (f < num_files && strcmp(paths[f], fields[col_file]) != 0) f++;
+        if (f == num_files) {
+            paths = realloc(paths, (num_files + 1) * sizeof(char*));
+            fds = realloc(fds, (num_files + 1) * sizeof(int));
+            paths[f] = strdup(fields[col_file]);
+            fds[f] = open(paths[f], O_RDONLY);
+            num_files++;
+        }
+        if (fds[f] < 0) continue;
+        
+        if (num_rows == cap_rows) {
+            cap_rows = cap_rows ? cap_rows * 2 : 4096;
+            rows = realloc(rows, cap_rows * sizeof(*rows));
+        }
+        rows[num_rows].fd = fds[f];
+        rows[num_rows].offset = strtoull(fields[col_offset], NULL, 10);
+        rows[num_rows].size = (uint32_t)strtoul(fields[col_size], NULL, 10);
+        if (rows[num_rows].size > max_size) max_size = rows[num_rows].size;
+        num_rows++;
+    }
+    fclose(fp);
+    
+    for (int f = 0; f < num_files; f++) {
+        if (fds[f] >= 0) posix_fadvise(fds[f], 0, 0, POSIX_FADV_DONTNEED);
+    }
+    
+    uint8_t *buf = malloc(max_size);
+    ReplayResult res = { .checksum = 0xcbf29ce484222325ULL };
+    uint64_t t0 = now_ns();
+    
+    for (size_t i = 0; i < num_rows; i++) {
+        ssize_t n;
+        if (strcmp(api, "read") == 0) {
+            lseek(rows[i].fd, rows[i].offset, SEEK_SET);
+            n = read(rows[i].fd, buf, rows[i].size);
+        } else if (strcmp(api, "preadv") == 0) {
+            struct iovec iov[2] = {
+                { buf, rows[i].size / 2 },
+                { buf + rows[i].size / 2, rows[i].size - rows[i].size / 2 },
+            };
+            n = preadv(rows[i].fd, iov, 2, rows[i].offset);
+        } else {
+            n = pread(rows[i].fd, buf, rows[i].size, rows[i].offset);
+        }
+        
+        for (ssize_t j = 0; j < n; j++) {
+            res.checksum = (res.checksum ^ buf[j]) * 0x100000001b3ULL;
+        }
+        if (n > 0) res.bytes += n;
+        res.reads++;
+    }
+    
+    res.elapsed_ns = now_ns() - t0;
+    int ok = write(out_fd, &res, sizeof(res)) == sizeof(res);
+    
+    for (int f = 0; f < num_files; f++) {
+        if (fds[f] >= 0) close(fds[f]);
+        free(paths[f]);
+    }
+    free(paths);
+    free(fds);
+    free(rows);
+    free(buf);
+    return ok ? 0 : 1;
+}
+
+static int run_read_replay(const char *bc_path, const char *trace, const char *api,
+                           const char *preload, ReplayResult *res) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) return -1;
+    
+    char wfd[16];
+    snprintf(wfd, sizeof(wfd), "%d", pipefd[1]);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close(pipefd[0]);
+        setenv("BIGCACHE_PATH", bc_path, 1);
+        setenv("BIGCACHE_ENABLED", preload ? "1" : "0", 1);
+        if (preload) {
+            setenv("LD_PRELOAD", preload, 1);
+        } else {
+            unsetenv("LD_PRELOAD");
+        }
+        execl("/proc/self/exe", "bigcache", "read-replay", trace, api, wfd, (char*)NULL);
+        _exit(127);
+    }
+    
+    close(pipefd[1]);
+    ssize_t n = pid > 0 ? read(pipefd[0], res, sizeof(*res)) : -1;
+    close(pipefd[0]);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    
+    return n == sizeof(*res) ? 0 : -1;
+}
+
+static int cmd_read_bench(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: bigcache read-bench <bigcache.bin> <read_sequence.csv> "
+                "[libpreloader.so] [runs]\n");
+        fprintf(stderr, "\nReplays the trace with pread, lseek+read and preadv, with the\n");
+        fprintf(stderr, "source files evicted from the page cache, once against the original\n");
+        fprintf(stderr, "files and once under LD_PRELOAD (default: build/libpreloader.so)\n");
+        return 1;
+    }
+    
+    const char *bc_path = argv[0];
+    const char *trace = argv[1];
+    const char *lib = argc > 2 ? argv[2] : "build/libpreloader.so";
+    int runs = argc > 3 ? atoi(argv[3]) : 3;
+    if (runs < 1) runs = 1;
+    
+    char preload[1024];
+    if (!realpath(lib, preload)) {
+        fprintf(stderr, "Cannot find %s: %s\n", lib, strerror(errno));
+        return 1;
+    }
+    
+    static const char *apis[] = { "pread", "read", "preadv" };
+    
+    printf("=== Read replay: %s, %d cold runs ===\n\n", trace, runs);
+    printf("%-8s %8s %10s %14s %14s %9s  %s\n",
+           "api", "reads", "MB", "original(ms)", "preloader(ms)", "speedup", "data");
+    
+    int ret = 0;
+    for (size_t a = 0; a < sizeof(apis) / sizeof(apis[0]); a++) {
+        double t_orig = 0, t_pre = 0;
+        ReplayResult orig = {0}, pre = {0};
+        int same = 1;
+        
+        for (int r = 0; r < runs; r++) {
+            if (run_read_replay(bc_path, trace, apis[a], NULL, &orig) < 0 ||
+                run_read_replay(bc_path, trace, apis[a], preload, &pre) < 0) {
+                fprintf(stderr, "read-replay failed (%s)\n", apis[a]);
+                return 1;
+            }
+            t_orig += orig.elapsed_ns / 1e6;
+            t_pre += pre.elapsed_ns / 1e6;
+            same &= orig.checksum == pre.checksum && orig.bytes == pre.bytes;
+        }
+        
+        printf("%-8s %8lu %10.2f %14.2f %14.2f %8.2fx  %s\n",
+               apis[a], (unsigned long)orig.reads, orig.bytes / (1024.0 * 1024.0),
+               t_orig / runs, t_pre / runs, t_orig / t_pre, same ? "match" : "MISMATCH");
+        if (!same) ret = 1;
+    }
+    printf("\n");
+    
+    return ret;
+}
+
+/*
+ * dlopen-bench：冷页缓存下逐个 dlopen 库的耗时，对比不加载预加载器、
+ * 预加载器关闭 dlopen 预取与开启预取三种情况
+ */
+#define DLOPEN_BENCH_MAX_LIBS 32
+
+static int cmd_dlopen_probe(int argc, char *argv[]) {
+    if (argc < 2) return 1;
+    
+    int wfd = atoi(argv[0]);
+    int num_libs = argc - 1 < DLOPEN_BENCH_MAX_LIBS ? argc - 1 : DLOPEN_BENCH_MAX_LIBS;
+    double times[DLOPEN_BENCH_MAX_LIBS];
+    
+    /* 逐出库文件的页缓存（BigCache 已在构造函数中预热）*/
+    for (int i = 0; i < num_libs; i++) {
+        int fd = open(argv[1 + i], O_RDONLY);
+        if (fd < 0) continue;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+    
+    for (int i = 0; i < num_libs; i++) {
+        double start = get_time_ms();
+        void *handle = dlopen(argv[1 + i], RTLD_NOW | RTLD_LOCAL);
+        times[i] = handle ? get_time_ms() - start : -1;
+    }
+    
+    ssize_t n = write(wfd, times, num_libs * sizeof(double));
+    return n == (ssize_t)(num_libs * sizeof(double)) ? 0 : 1;
+}
+
+static int run_dlopen_probe(const char *bc_path, const char *preload, const char *prefetch,
+                            char **libs, int num_libs, double *times) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) return -1;
+    
+    char wfd[16];
+    snprintf(wfd, sizeof(wfd), "%d", pipefd[1]);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close(pipefd[0]);
+        
+        char *args[DLOPEN_BENCH_MAX_LIBS + 4];
+        int n = 0;
+        args[n++] = "bigcache";
+        args[n++] = "dlopen-probe";
+        args[n++] = wfd;
+        for (int i = 0; i < num_libs; i++) args[n++] = libs[i];
+        args[n] = NULL;
+        
+        setenv("BIGCACHE_PATH", bc_path, 1);
+        setenv("BIGCACHE_ENABLED", preload ? "1" : "0", 1);
+        setenv("BIGCACHE_DLOPEN_PREFETCH", prefetch, 1);
+        if (preload) {
+            setenv("LD_PRELOAD", preload, 1);
+        } else {
+            unsetenv("LD_PRELOAD");
+        }
+        execv("/proc/self/exe", args);
+        _exit(127);
+    }
+    
+    close(pipefd[1]);
+    ssize_t want = num_libs * sizeof(double);
+    ssize_t n = pid > 0 ? read(pipefd[0], times, want) : -1;
+    close(pipefd[0]);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    
+    return n == want ? 0 : -1;
+}
+
+static int cmd_dlopen_bench(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: bigcache dlopen-bench <bigcache.bin> <libpreloader_dlopen.so> "
+                "<lib.so>...\n");
+        fprintf(stderr, "\nTimes dlopen(RTLD_NOW) of each library with its page cache\n");
+        fprintf(stderr, "evicted: without the preloader, and under LD_PRELOAD with\n");
+        fprintf(stderr, "BIGCACHE_DLOPEN_PREFETCH=0 and =1 (3 runs each).\n");
+        fprintf(stderr, "The preloader must be built with make preloader-dlopen\n");
+        return 1;
+    }
+    
+    const char *bc_path = argv[0];
+    char preload[1024];
+    if (!realpath(argv[1], preload)) {
+        fprintf(stderr, "Cannot find %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    
+    int num_libs = argc - 2 < DLOPEN_BENCH_MAX_LIBS ? argc - 2 : DLOPEN_BENCH_MAX_LIBS;
+    char **libs = argv + 2;
+    const int runs = 3;
+    
+    static const struct {
+        const char *name;
+        int preload;
+        const char *prefetch;
+    } modes[] = {
+        { "original", 0, "0" },
+        { "no-prefetch", 1, "0" },
+        { "prefetch", 1, "1" },
+    };
+    double sum[3][DLOPEN_BENCH_MAX_LIBS] = {{0}};
+    
+    for (int r = 0; r < runs; r++) {
+        for (int m = 0; m < 3; m++) {
+            double times[DLOPEN_BENCH_MAX_LIBS];
+            if (run_dlopen_probe(bc_path, modes[m].preload ? preload : NULL, modes[m].prefetch,
+                                 libs, num_libs, times) < 0) {
+                fprintf(stderr, "dlopen-probe failed (%s)\n", modes[m].name);
+                return 1;
+            }
+            for (int i = 0; i < num_libs; i++) {
+                if (times[i] < 0) {
+                    fprintf(stderr, "dlopen %s failed (%s)\n", libs[i], modes[m].name);
+                    return 1;
+                }
+                sum[m][i] += times[i];
+            }
+        }
+    }
+    
+    printf("=== dlopen with cold page cache, %d runs ===\n\n", runs);
+    printf("%-32s %13s %16s %13s %9s\n",
+           "library", "original(ms)", "no-prefetch(ms)", "prefetch(ms)", "speedup");
+    double total[3] = {0};
+    for (int i = 0; i < num_libs; i++) {
+        const char *slash = strrchr(libs[i], '/');
+        for (int m = 0; m < 3; m++) total[m] += sum[m][i] / runs;
+        printf("%-32s %13.2f %16.2f %13.2f %8.2fx\n", slash ? slash + 1 : libs[i],
+               sum[0][i] / runs, sum[1][i] / runs, sum[2][i] / runs, sum[1][i] / sum[2][i]);
+    }
+    printf("%-32s %13.2f %16.2f %13.2f %8.2fx\n\n", "total",
+           total[0], total[1], total[2], total[1] / total[2]);
+    
+    return 0;
+}
+
+/*
+ * broker：常驻代理进程，把 BigCache 读入密封 memfd 后分发给预加载器
+ */
+static volatile sig_atomic_t g_broker_stop;
+
+static void broker_signal(int sig) {
+    (void)sig;
+    g_broker_stop = 1;
+}
+
+static int cmd_broker(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: bigcache broker <bigcache.bin> <socket>\n");
+        fprintf(stderr, "\nLoads BigCache into a sealed, locked memfd and hands it to\n");
+        fprintf(stderr, "preloaders started with BIGCACHE_BROKER=<socket>. A socket name\n");
+        fprintf(stderr, "starting with '@' is in the abstract namespace. Only clients\n");
+        fprintf(stderr, "running as the broker's uid, root or system receive the memfd\n");
+        return 1;
+    }
+    
+    BigCacheBroker broker;
+    int ret = broker_load(&broker, argv[0]);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to load %s: %d\n", argv[0], ret);
+        return 1;
+    }
+    printf("[Broker] Loaded %s in %.2f ms\n", argv[0], broker.load_ms);
+    
+    struct sigaction sa = { .sa_handler = broker_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    ret = broker_serve(&broker, argv[1], &g_broker_stop);
+    broker_unload(&broker);
+    return ret < 0 ? 1 : 0;
+}
+
+/*
+ * broker-bench：同时存活的 N 个进程各自加载 BigCache 与从代理取 memfd 的对比，
+ * 测每个进程 exec 到 main 的时间、读遍 BigCache 的时间，以及全部进程
+ * （代理模式含代理进程）的 RSS 与 PSS 之和。每种模式开始前把 BigCache 逐出页缓存
+ */
+typedef struct {
+    uint64_t exec_ns;            /* exec 到 main */
+    uint64_t touch_ns;           /* 读遍 BigCache 映射 */
+} BrokerProbeResult;
+
+static int cmd_broker_probe(int argc, char *argv[]) {
+    BrokerProbeResult res = { .exec_ns = now_ns() };
+    if (argc < 2) return 1;
+    
+    res.exec_ns -= strtoull(argv[0], NULL, 10);
+    int fd = atoi(argv[1]);
+    
+    /* 模拟启动期读取缓存内容，两种模式下都让整个映射进入页表 */
+    BigCacheContext *bc = preloader_get_bigcache();
+    uint64_t start = now_ns();
+    if (bc && bc->mapped_data != MAP_FAILED) {
+        volatile uint8_t sum = 0;
+        for (size_t off = 0; off < bc->mapped_size; off += PAGE_SIZE) {
+            sum += ((const uint8_t*)bc->mapped_data)[off];
+        }
+        (void)sum;
+    }
+    res.touch_ns = now_ns() - start;
+    
+    if (write(fd, &res, sizeof(res)) != sizeof(res)) return 1;
+    close(fd);
+    
+    /* 保持存活，由父进程统计内存后杀掉 */
+    for (;;) pause();
+}
+
+/* 从 smaps_rollup 读取进程的 Rss 与 Pss（KB）*/
+static int read_rss_pss(pid_t pid, long *rss_kb, long *pss_kb) {
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -errno;
+    
+    *rss_kb = *pss_kb = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        sscanf(line, "Rss: %ld kB", rss_kb);
+        sscanf(line, "Pss: %ld kB", pss_kb);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static pid_t spawn_broker_probe(const char *bc_path, const char *socket_path,
+                                BrokerProbeResult *res) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) return -1;
+    
+    char t0[32], wfd[16];
+    snprintf(t0, sizeof(t0), "%llu", (unsigned long long)now_ns());
+    snprintf(wfd, sizeof(wfd), "%d", pipefd[1]);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close(pipefd[0]);
+        setenv("BIGCACHE_PATH", bc_path, 1);
+        setenv("BIGCACHE_ENABLED", "1", 1);
+        setenv("BIGCACHE_ASYNC_INIT", "0", 1);
+        if (socket_path) {
+            setenv("BIGCACHE_BROKER", socket_path, 1);
+        } else {
+            unsetenv("BIGCACHE_BROKER");
+        }
+        execl("/proc/self/exe", "bigcache", "broker-probe", t0, wfd, (char*)NULL);
+        _exit(127);
+    }
+    
+    close(pipefd[1]);
+    ssize_t n = pid > 0 ? read(pipefd[0], res, sizeof(*res)) : -1;
+    close(pipefd[0]);
+    if (pid > 0 && n != sizeof(*res)) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    return pid;
+}
+
+#define BROKER_BENCH_MAX_PROCS 16
+
+static int cmd_broker_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache broker-bench <bigcache.bin> [procs]\n");
+        fprintf(stderr, "\nStarts N concurrent processes that each load and preheat\n");
+        fprintf(stderr, "BigCache privately, then N processes that map the broker's\n");
+        fprintf(stderr, "memfd, and reports start-up time and total RSS/PSS\n");
+        return 1;
+    }
+    
+    const char *bc_path = argv[0];
+    int procs = argc > 1 ? atoi(argv[1]) : 4;
+    if (procs < 1) procs = 1;
+    if (procs > BROKER_BENCH_MAX_PROCS) procs = BROKER_BENCH_MAX_PROCS;
+    
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "@bigcache-bench-%d", (int)getpid());
+    
+    printf("=== Broker: %s, %d concurrent processes ===\n\n", bc_path, procs);
+    printf("%-8s %14s %14s %14s %14s %14s\n",
+           "mode", "exec(ms)", "first(ms)", "touch(ms)", "RSS(MB)", "PSS(MB)");
+    
+    for (int mode = 0; mode < 2; mode++) {
+        int use_broker = mode == 1;
+        pid_t broker_pid = -1;
+        
+        int fd = open(bc_path, O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+        
+        if (use_broker) {
+            broker_pid = fork();
+            if (broker_pid == 0) {
+                int devnull = open("/dev/null", O_WRONLY);
+                if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+                BigCacheBroker broker;
+                if (broker_load(&broker, bc_path) < 0) _exit(1);
+                struct sigaction sa = { .sa_handler = broker_signal };
+                sigaction(SIGTERM, &sa, NULL);
+                broker_serve(&broker, socket_path, &g_broker_stop);
+                broker_unload(&broker);
+                _exit(0);
+            }
+            
+            /* 等代理开始监听（加载整份 BigCache 后才 bind）*/
+            int fetched = -1;
+            for (int i = 0; i < 1000 && fetched < 0; i++) {
+                fetched = broker_fetch(socket_path, 100, NULL);
+                if (fetched < 0) usleep(10000);
+            }
+            if (fetched < 0) {
+                fprintf(stderr, "Broker did not come up\n");
+                kill(broker_pid, SIGKILL);
+                waitpid(broker_pid, NULL, 0);
+                return 1;
+            }
+            close(fetched);
+        }
+        
+        pid_t pids[BROKER_BENCH_MAX_PROCS];
+        double exec_ms = 0, first_ms = 0, touch_ms = 0;
+        int started = 0;
+        for (int i = 0; i < procs; i++) {
+            BrokerProbeResult res;
+            pids[i] = spawn_broker_probe(bc_path, use_broker ? socket_path : NULL, &res);
+            if (pids[i] < 0) break;
+            if (i == 0) first_ms = res.exec_ns / 1e6;
+            exec_ms += res.exec_ns / 1e6;
+            touch_ms += res.touch_ns / 1e6;
+            started++;
+        }
+        
+        long rss_total = 0, pss_total = 0;
+        for (int i = 0; i < started; i++) {
+            long rss, pss;
+            if (read_rss_pss(pids[i], &rss, &pss) == 0) {
+                rss_total += rss;
+                pss_total += pss;
+            }
+        }
+        if (use_broker) {
+            long rss, pss;
+            if (read_rss_pss(broker_pid, &rss, &pss) == 0) {
+                rss_total += rss;
+                pss_total += pss;
+            }
+        }
+        
+        for (int i = 0; i < started; i++) {
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+        }
+        if (use_broker) {
+            kill(broker_pid, SIGTERM);
+            waitpid(broker_pid, NULL, 0);
+        }
+        
+        if (started < procs) {
+            fprintf(stderr, "broker-probe failed (%s)\n", use_broker ? "broker" : "private");
+            return 1;
+        }
+        
+        printf("%-8s %14.2f %14.2f %14.2f %14.2f %14.2f\n",
+               use_broker ? "broker" : "private", exec_ms / procs, first_ms,
+               touch_ms / procs, rss_total / 1024.0, pss_total / 1024.0);
+    }
+    printf("\nexec: mean exec-to-main per process, first: the first process\n");
+    printf("RSS/PSS: sum over all probes (and the broker)\n\n");
+    
+    return 0;
+}
+
+/*
+ * daemon：缺页服务进程，持有唯一一份 BigCache，为 BIGCACHE_DAEMON 指向它的
+ * 预加载器服务缺页
+ */
+static int cmd_daemon(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: bigcache daemon <bigcache.bin> <socket> [workers] "
+                        "[max_clients] [client_mb]\n");
+        fprintf(stderr, "\nServes page faults for preloaders started with\n");
+        fprintf(stderr, "BIGCACHE_DAEMON=<socket> from one BigCache and one handler pool.\n");
+        fprintf(stderr, "Clients beyond max_clients fall back to their own handler;\n");
+        fprintf(stderr, "mappings beyond client_mb per client stay file-backed\n");
+        return 1;
+    }
+    
+    FaultDaemonConfig config = {
+        .num_workers = argc > 2 ? atoi(argv[2]) : 4,
+        .max_clients = argc > 3 ? atoi(argv[3]) : FAULT_DAEMON_MAX_CLIENTS,
+        .max_client_bytes = argc > 4 ? (size_t)atol(argv[4]) * 1024 * 1024 : 0,
+        .batch_quota = 32,
+        .fault_around = 8
+    };
+    
+    BigCacheContext *bc = bigcache_create();
+    if (!bc || bigcache_load(bc, argv[0]) < 0) {
+        fprintf(stderr, "Failed to load %s\n", argv[0]);
+        bigcache_destroy(bc);
+        return 1;
+    }
+    double start = get_time_ms();
+    bigcache_preheat(bc);
+    printf("[Daemon] Loaded %s, preheated in %.2f ms\n", argv[0], get_time_ms() - start);
+    
+    FaultDaemon *daemon = fault_daemon_create(bc, &config);
+    if (!daemon) {
+        bigcache_destroy(bc);
+        return 1;
+    }
+    
+    struct sigaction sa = { .sa_handler = broker_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    int ret = fault_daemon_run(daemon, argv[1], &g_broker_stop);
+    fault_daemon_print_stats(daemon);
+    fault_daemon_destroy(daemon);
+    bigcache_destroy(bc);
+    return ret < 0 ? 1 : 0;
+}
+
+/*
+ * daemon-bench：N 个进程同时启动，经预加载器映射 BigCache 中的全部文件并读遍、
+ * 与原文件逐页比对。对比每个进程自带处理器与交给服务进程两种方式下的
+ * 启动时间、读遍时间、每进程线程数以及全部进程（含服务进程）的 RSS 与 PSS
+ */
+typedef struct {
+    uint64_t exec_ns;            /* exec 到 main（含预加载器初始化）*/
+    uint64_t touch_ns;           /* 映射并读遍全部文件 */
+    uint64_t pages;
+    uint64_t bad;                /* 与原文件不一致的页 */
+    int threads;
+} DaemonProbeResult;
+
+static int read_thread_count(void) {
+    char line[256];
+    int threads = 0;
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp) return 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "Threads: %d", &threads) == 1) break;
+    }
+    fclose(fp);
+    return threads;
+}
+
+static int cmd_daemon_probe(int argc, char *argv[]) {
+    DaemonProbeResult res = { .exec_ns = now_ns() };
+    if (argc < 2) return 1;
+    
+    res.exec_ns -= strtoull(argv[0], NULL, 10);
+    int out = atoi(argv[1]);
+    int touch_pct = argc > 2 ? atoi(argv[2]) : 100;
+    
+    BigCacheContext *bc = preloader_get_bigcache();
+    uint8_t *expect = malloc(PAGE_SIZE);
+    uint64_t start = now_ns();
+    
+    for (uint32_t i = 0; bc && expect && i < bc->header.num_files; i++) {
+        const char *path = bc->file_table[i].path;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        
+        const uint8_t *map = preloader_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                            fd, 0, path);
+        if (map == MAP_FAILED) {
+            close(fd);
+            continue;
+        }
+        /* 只读前 touch_pct% 的页，其余页留给驻留管理器按未服务处理 */
+        off_t touch_end = (off_t)((double)st.st_size * touch_pct / 100);
+        for (off_t off = 0; off < touch_end; off += PAGE_SIZE) {
+            size_t len = st.st_size - off < PAGE_SIZE ? st.st_size - off : PAGE_SIZE;
+            if (pread(fd, expect, len, off) != (ssize_t)len || memcmp(map + off, expect, len)) {
+                res.bad++;
+            }
+            res.pages++;
+        }
+        /* 映射保留到退出：本程序没有 munmap hook，解除映射不会注销 UFFD 区域 */
+        close(fd);
+    }
+    res.touch_ns = now_ns() - start;
+    res.threads = read_thread_count();
+    free(expect);
+    
+    if (write(out, &res, sizeof(res)) != sizeof(res)) return 1;
+    close(out);
+    
+    /* 保持存活，由父进程统计内存后杀掉 */
+    for (;;) pause();
+}
+
+static pid_t spawn_daemon_probe(const char *bc_path, const char *socket_path,
+                                int touch_pct, int *read_fd) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) return -1;
+    
+    char t0[32], wfd[16], pct[16];
+    snprintf(t0, sizeof(t0), "%llu", (unsigned long long)now_ns());
+    snprintf(wfd, sizeof(wfd), "%d", pipefd[1]);
+    snprintf(pct, sizeof(pct), "%d", touch_pct);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close(pipefd[0]);
+        setenv("BIGCACHE_PATH", bc_path, 1);
+        setenv("BIGCACHE_ENABLED", "1", 1);
+        setenv("BIGCACHE_ASYNC_INIT", "0", 1);
+        unsetenv("BIGCACHE_BROKER");
+        if (socket_path) {
+            setenv("BIGCACHE_DAEMON", socket_path, 1);
+        } else {
+            unsetenv("BIGCACHE_DAEMON");
+        }
+        execl("/proc/self/exe", "bigcache", "daemon-probe", t0, wfd, pct, (char*)NULL);
+        _exit(127);
+    }
+    
+    close(pipefd[1]);
+    if (pid < 0) {
+        close(pipefd[0]);
+        return -1;
+    }
+    *read_fd = pipefd[0];
+    return pid;
+}
+
+/* 启动测试用服务进程并等它开始监听，返回 pid，失败返回 -1 */
+static pid_t start_bench_daemon(const char *bc_path, const char *socket_path, int workers,
+                                BigCacheContext *bc) {
+    pid_t daemon_pid = fork();
+    if (daemon_pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        FaultDaemonConfig config = {
+            .num_workers = workers,
+            .max_clients = FAULT_DAEMON_MAX_CLIENTS,
+            .batch_quota = 32,
+            .fault_around = 8
+        };
+        BigCacheContext *own = bigcache_create();
+        if (!own || bigcache_load(own, bc_path) < 0) _exit(1);
+        bigcache_preheat(own);
+        FaultDaemon *daemon = fault_daemon_create(own, &config);
+        if (!daemon) _exit(1);
+        struct sigaction sa = { .sa_handler = broker_signal };
+        sigaction(SIGTERM, &sa, NULL);
+        fault_daemon_run(daemon, socket_path, &g_broker_stop);
+        fault_daemon_destroy(daemon);
+        _exit(0);
+    }
+    if (daemon_pid < 0) return -1;
+    
+    /* 等服务进程开始监听 */
+    FaultDaemonClient probe;
+    int ret = -1;
+    for (int i = 0; i < 1000 && ret < 0; i++) {
+        ret = fault_daemon_connect(&probe, socket_path, bc, 100);
+        if (ret < 0) usleep(10000);
+    }
+    if (ret < 0) {
+        kill(daemon_pid, SIGKILL);
+        waitpid(daemon_pid, NULL, 0);
+        return -1;
+    }
+    fault_daemon_disconnect(&probe);
+    return daemon_pid;
+}
+
+static int cmd_daemon_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache daemon-bench <bigcache.bin> [procs] [workers]\n");
+        fprintf(stderr, "\nStarts N processes at once that map and read every file in\n");
+        fprintf(stderr, "BigCache through the preloader, first with their own UFFD\n");
+        fprintf(stderr, "handler and then served by one fault daemon\n");
+        return 1;
+    }
+    
+    const char *bc_path = argv[0];
+    int procs = argc > 1 ? atoi(argv[1]) : 4;
+    int workers = argc > 2 ? atoi(argv[2]) : 4;
+    if (procs < 1) procs = 1;
+    if (procs > BROKER_BENCH_MAX_PROCS) procs = BROKER_BENCH_MAX_PROCS;
+    
+    BigCacheContext *bc = bigcache_create();
+    if (!bc || bigcache_load(bc, bc_path) < 0) {
+        fprintf(stderr, "Failed to load %s\n", bc_path);
+        bigcache_destroy(bc);
+        return 1;
+    }
+    
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "@bigcache-daemon-bench-%d", (int)getpid());
+    
+    printf("=== Fault daemon: %s, %d concurrent processes, %d workers ===\n\n",
+           bc_path, procs, workers);
+    printf("%-8s %11s %11s %9s %9s %11s %11s\n",
+           "mode", "exec(ms)", "touch(ms)", "threads", "bad", "RSS(MB)", "PSS(MB)");
+    
+    int failed = 0;
+    for (int mode = 0; mode < 2 && !failed; mode++) {
+        int use_daemon = mode == 1;
+        pid_t daemon_pid = -1;
+        
+        int fd = open(bc_path, O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+        
+        if (use_daemon) {
+            daemon_pid = start_bench_daemon(bc_path, socket_path, workers, bc);
+            if (daemon_pid < 0) {
+                fprintf(stderr, "Fault daemon did not come up\n");
+                failed = 1;
+                break;
+            }
+        }
+        
+        /* 全部进程先启动，再依次收结果，缺页在服务进程中并发到达 */
+        pid_t pids[BROKER_BENCH_MAX_PROCS];
+        int pipes[BROKER_BENCH_MAX_PROCS];
+        int started = 0;
+        for (int i = 0; i < procs; i++) {
+            pids[i] = spawn_daemon_probe(bc_path, use_daemon ? socket_path : NULL, 100,
+                                         &pipes[i]);
+            if (pids[i] < 0) break;
+            started++;
+        }
+        
+        double exec_ms = 0, touch_ms = 0;
+        uint64_t bad = 0;
+        int threads = 0, reported = 0;
+        for (int i = 0; i < started; i++) {
+            DaemonProbeResult res;
+            if (read(pipes[i], &res, sizeof(res)) == sizeof(res)) {
+                exec_ms += res.exec_ns / 1e6;
+                touch_ms += res.touch_ns / 1e6;
+                bad += res.bad;
+                threads += res.threads;
+                reported++;
+            }
+            close(pipes[i]);
+        }
+        
+        long rss_total = 0, pss_total = 0;
+        for (int i = 0; i < started; i++) {
+            long rss, pss;
+            if (read_rss_pss(pids[i], &rss, &pss) == 0) {
+                rss_total += rss;
+                pss_total += pss;
+            }
+        }
+        if (use_daemon) {
+            long rss, pss;
+            if (read_rss_pss(daemon_pid, &rss, &pss) == 0) {
+                rss_total += rss;
+                pss_total += pss;
+            }
+        }
+        
+        for (int i = 0; i < started; i++) {
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+        }
+        if (use_daemon) {
+            kill(daemon_pid, SIGTERM);
+            waitpid(daemon_pid, NULL, 0);
+        }
+        
+        if (reported < procs) {
+            fprintf(stderr, "daemon-probe failed (%s)\n", use_daemon ? "daemon" : "in-proc");
+            failed = 1;
+            break;
+        }
+        
+        printf("%-8s %11.2f %11.2f %9.1f %9lu %11.2f %11.2f\n",
+               use_daemon ? "daemon" : "in-proc", exec_ms / procs, touch_ms / procs,
+               (double)threads / procs, (unsigned long)bad,
+               rss_total / 1024.0, pss_total / 1024.0);
+    }
+    if (!failed) {
+        printf("\nexec, touch, threads: mean per process; bad: pages differing from the file\n");
+        printf("RSS/PSS: sum over all probes (and the daemon)\n\n");
+    }
+    
+    bigcache_destroy(bc);
+    return failed;
+}
+
+/*
+ * residency-bench：驻留管理的两项测量
+ * 1. RSS 随时间变化：一个进程读遍一半缓存页后保持存活，父进程写合成 PSI 文件，
+ *    依次经历启动、启动结束、some 压力、full 压力，定时采样 BigCache 映射的
+ *    Rss/Locked 与进程总 Rss
+ * 2. 内存 cgroup 限制下的启动时间：常驻的 BigCache 进程 A 与随后启动的进程 B
+ *    放进同一个受限 cgroup，B 分配匿名内存并读源文件，比较 A 保持锁定与
+ *    启动结束后释放两种情况下 B 的启动耗时，B 或 A 被 OOM 杀掉时如实报告
+ */
+
+/* 同一文件的各个 VMA 累加：按段解锁后一个映射会被拆成多个 VMA */
+static int read_mapping_rss(pid_t pid, const char *file, long *rss_kb, long *locked_kb) {
+    char path[64], line[512];
+    snprintf(path, sizeof(path), "/proc/%d/smaps", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -errno;
+    
+    *rss_kb = *locked_kb = 0;
+    int in_file = 0;
+    size_t file_len = strlen(file);
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long start, end;
+        long kb;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            size_t len = strcspn(line, "\n");
+            line[len] = '\0';
+            in_file = len >= file_len && strcmp(line + len - file_len, file) == 0;
+        } else if (in_file && sscanf(line, "Rss: %ld kB", &kb) == 1) {
+            *rss_kb += kb;
+        } else if (in_file && sscanf(line, "Locked: %ld kB", &kb) == 1) {
+            *locked_kb += kb;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static void write_psi(const char *path, double some, double full) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return;
+    fprintf(fp, "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\n", some);
+    fprintf(fp, "full avg10=%.2f avg60=0.00 avg300=0.00 total=0\n", full);
+    fclose(fp);
+    /* 整体替换，读取方不会读到写了一半的文件 */
+    rename(tmp, path);
+}
+
+/* 丢弃文件的页缓存：页缓存记在首次读入它的 cgroup 上，每轮都从磁盘重新读 */
+static void drop_file_cache(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static void drop_bigcache_cache(const char *bc_path, BigCacheContext *bc) {
+    drop_file_cache(bc_path);
+    for (uint32_t i = 0; i < bc->header.num_files; i++) {
+        drop_file_cache(bc->file_table[i].path);
+    }
+}
+
+static int write_cgroup(const char *dir, const char *name, const char *value) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -errno;
+    ssize_t n = write(fd, value, strlen(value));
+    int err = n < 0 ? errno : 0;
+    close(fd);
+    return n < 0 ? -err : 0;
+}
+
+/* 在子进程中 exec 前调用，把自己放进 cgroup */
+static void join_cgroup(const char *dir) {
+    char pid[16];
+    snprintf(pid, sizeof(pid), "%d", (int)getpid());
+    if (write_cgroup(dir, "cgroup.procs", pid) < 0) _exit(126);
+}
+
+/*
+ * residency-launch <t0> <wfd> <anon_mb> <bigcache.bin>：后启动的普通进程，
+ * 分配并写满 anon_mb 的匿名内存、读遍 BigCache 收录的源文件，写回 exec 到完成的耗时
+ */
+static int cmd_residency_launch(int argc, char *argv[]) {
+    if (argc < 4) return 1;
+    
+    uint64_t t0 = strtoull(argv[0], NULL, 10);
+    int out = atoi(argv[1]);
+    size_t anon = (size_t)atoi(argv[2]) * 1024 * 1024;
+    
+    uint8_t *mem = mmap(NULL, anon, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return 1;
+    for (size_t off = 0; off < anon; off += PAGE_SIZE) mem[off] = (uint8_t)off;
+    
+    BigCacheContext *bc = bigcache_create();
+    if (!bc || bigcache_load(bc, argv[3]) < 0) return 1;
+    uint8_t *buf = malloc(1 << 20);
+    for (uint32_t i = 0; buf && i < bc->header.num_files; i++) {
+        int fd = open(bc->file_table[i].path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        while (read(fd, buf, 1 << 20) > 0) {
+        }
+        close(fd);
+    }
+    
+    uint64_t elapsed = now_ns() - t0;
+    if (write(out, &elapsed, sizeof(elapsed)) != sizeof(elapsed)) return 1;
+    return 0;
+}
+
+/* 返回 B 的耗时（ms），B 被杀返回 -1，A 被杀返回 -2 */
+static double run_residency_launch(const char *bc_path, BigCacheContext *bc,
+                                   const char *cgroup, int residency, int launch_mb,
+                                   long *a_locked_kb) {
+    drop_bigcache_cache(bc_path, bc);
+    setenv("BIGCACHE_RESIDENCY", residency ? "1" : "0", 1);
+    setenv("BIGCACHE_STARTUP_MS", "500", 1);
+    setenv("BIGCACHE_PSI_PATH", RESIDENCY_DEFAULT_PSI_PATH, 1);
+    unsetenv("BIGCACHE_POPULATE");
+    
+    /* A：daemon-probe 读遍全部缓存页后常驻 */
+    int a_pipe[2];
+    if (pipe(a_pipe) < 0) return -2;
+    char a_t0[32], a_wfd[16];
+    snprintf(a_t0, sizeof(a_t0), "%llu", (unsigned long long)now_ns());
+    snprintf(a_wfd, sizeof(a_wfd), "%d", a_pipe[1]);
+    
+    pid_t a = fork();
+    if (a == 0) {
+        join_cgroup(cgroup);
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close(a_pipe[0]);
+        setenv("BIGCACHE_PATH", bc_path, 1);
+        setenv("BIGCACHE_ENABLED", "1", 1);
+        execl("/proc/self/exe", "bigcache", "daemon-probe", a_t0, a_wfd, "100", (char*)NULL);
+        _exit(127);
+    }
+    close(a_pipe[1]);
+    DaemonProbeResult res;
+    ssize_t got = a > 0 ? read(a_pipe[0], &res, sizeof(res)) : -1;
+    close(a_pipe[0]);
+    if (a < 0) return -2;
+    if (got != sizeof(res)) {
+        kill(a, SIGKILL);
+        waitpid(a, NULL, 0);
+        return -2;
+    }
+    
+    /* 等 A 经过 startup 阶段 */
+    usleep(1500 * 1000);
+    int status;
+    if (waitpid(a, &status, WNOHANG) == a) return -2;
+    long a_rss;
+    read_mapping_rss(a, bc_path, &a_rss, a_locked_kb);
+    
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        kill(a, SIGKILL);
+        waitpid(a, NULL, 0);
+        return -2;
+    }
+    char t0[32], wfd[16], mb[16];
+    snprintf(t0, sizeof(t0), "%llu", (unsigned long long)now_ns());
+    snprintf(wfd, sizeof(wfd), "%d", pipefd[1]);
+    snprintf(mb, sizeof(mb), "%d", launch_mb);
+    
+    pid_t b = fork();
+    if (b == 0) {
+        join_cgroup(cgroup);
+        close(pipefd[0]);
+        setenv("BIGCACHE_ENABLED", "0", 1);
+        execl("/proc/self/exe", "bigcache", "residency-launch", t0, wfd, mb, bc_path,
+              (char*)NULL);
+        _exit(127);
+    }
+    close(pipefd[1]);
+    
+    uint64_t elapsed = 0;
+    ssize_t n = b > 0 ? read(pipefd[0], &elapsed, sizeof(elapsed)) : -1;
+    close(pipefd[0]);
+    if (b > 0) waitpid(b, NULL, 0);
+    
+    int a_dead = waitpid(a, &status, WNOHANG) == a;
+    if (!a_dead) {
+        kill(a, SIGKILL);
+        waitpid(a, NULL, 0);
+    }
+    if (n != sizeof(elapsed)) return -1;
+    if (a_dead) return -2;
+    return elapsed / 1e6;
+}
+
+static int cmd_residency_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache residency-bench <bigcache.bin> [cgroup_dir] "
+                        "[limit_mb] [launch_mb]\n");
+        fprintf(stderr, "\nRSS of the BigCache mapping over time under a synthetic PSI\n");
+        fprintf(stderr, "timeline, then launch time of a second process sharing a\n");
+        fprintf(stderr, "memory-limited cgroup with a BigCache process\n");
+        return 1;
+    }
+    
+    const char *bc_path = argv[0];
+    char real_bc[PATH_MAX];
+    if (!realpath(bc_path, real_bc)) {
+        perror("realpath");
+        return 1;
+    }
+    
+    BigCacheContext *bc = bigcache_create();
+    if (!bc || bigcache_load(bc, real_bc) < 0) {
+        fprintf(stderr, "Failed to load %s\n", real_bc);
+        bigcache_destroy(bc);
+        return 1;
+    }
+    int cache_mb = (int)(bc->mapped_size >> 20);
+    
+    /* 1. 合成 PSI 时间线 */
+    char psi_path[64];
+    snprintf(psi_path, sizeof(psi_path), "/tmp/bigcache-psi-%d", (int)getpid());
+    write_psi(psi_path, 0, 0);
+    setenv("BIGCACHE_RESIDENCY", "1", 1);
+    setenv("BIGCACHE_PSI_PATH", psi_path, 1);
+    setenv("BIGCACHE_STARTUP_MS", "1000", 1);
+    setenv("BIGCACHE_RESIDENCY_POLL_MS", "100", 1);
+    setenv("BIGCACHE_POPULATE", "0", 1);
+    drop_bigcache_cache(real_bc, bc);
+    
+    printf("=== Residency: %s (%d MB, %u pages) ===\n\n", real_bc, cache_mb,
+           bc->header.num_pages);
+    printf("RSS over time (probe reads the first half of every cached file):\n");
+    printf("%8s %-10s %14s %14s %14s\n", "t(ms)", "phase", "cache RSS(MB)",
+           "locked(MB)", "total RSS(MB)");
+    
+    int read_fd;
+    pid_t pid = spawn_daemon_probe(real_bc, NULL, 50, &read_fd);
+    DaemonProbeResult res;
+    if (pid < 0 || read(read_fd, &res, sizeof(res)) != sizeof(res)) {
+        fprintf(stderr, "daemon-probe failed\n");
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        }
+        unlink(psi_path);
+        bigcache_destroy(bc);
+        return 1;
+    }
+    close(read_fd);
+    
+    /* 启动结束 1000 ms；2000 ms some=25；3000 ms full=15 */
+    double start = get_time_ms() - res.exec_ns / 1e6;
+    const char *phase = "startup";
+    for (int step = 0; step <= 16; step++) {
+        double t = step * 250.0;
+        double wait = start + t - get_time_ms();
+        if (wait > 0) usleep((useconds_t)(wait * 1000));
+        
+        if (t >= 3000) {
+            write_psi(psi_path, 40, 15);
+            phase = "full=15";
+        } else if (t >= 2000) {
+            write_psi(psi_path, 25, 0);
+            phase = "some=25";
+        } else if (t >= 1000) {
+            phase = "settled";
+        }
+        
+        long rss, locked, total_rss, pss;
+        if (read_mapping_rss(pid, real_bc, &rss, &locked) < 0 ||
+            read_rss_pss(pid, &total_rss, &pss) < 0) {
+            break;
+        }
+        printf("%8.0f %-10s %14.2f %14.2f %14.2f\n", get_time_ms() - start, phase,
+               rss / 1024.0, locked / 1024.0, total_rss / 1024.0);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    unlink(psi_path);
+    unsetenv("BIGCACHE_RESIDENCY_POLL_MS");
+    printf("\nPhases: startup until 1000 ms, then PSI some avg10=25 at 2000 ms and\n");
+    printf("full avg10=15 at 3000 ms (thresholds 10/5), sampled every 250 ms\n\n");
+    
+    /* 2. cgroup 内存限制下的启动时间 */
+    char cgroup[PATH_MAX];
+    int v1 = access("/sys/fs/cgroup/memory", W_OK) == 0;
+    if (argc > 1) {
+        snprintf(cgroup, sizeof(cgroup), "%s", argv[1]);
+    } else {
+        snprintf(cgroup, sizeof(cgroup), "%s/bigcache-residency-%d",
+                 v1 ? "/sys/fs/cgroup/memory" : "/sys/fs/cgroup", (int)getpid());
+    }
+    int launch_mb = argc > 3 ? atoi(argv[3]) : cache_mb;
+    int limit_mb = argc > 2 ? atoi(argv[2]) : cache_mb * 5 / 2 + 16;
+    
+    char limit_file[PATH_MAX];
+    if (snprintf(limit_file, sizeof(limit_file), "%s/memory.limit_in_bytes",
+                 cgroup) >= (int)sizeof(limit_file)) {
+        fprintf(stderr, "cgroup path too long: %s\n", cgroup);
+        bigcache_destroy(bc);
+        return 1;
+    }
+    int created = mkdir(cgroup, 0755) == 0;
+    const char *limit_name = access(limit_file, F_OK) == 0 ?
+                             "memory.limit_in_bytes" : "memory.max";
+    char limit[32];
+    snprintf(limit, sizeof(limit), "%lld", (long long)limit_mb << 20);
+    
+    printf("Launch in a memory cgroup (%s):\n", cgroup);
+    printf("A reads every cached page and stays alive; 2 s later B allocates %d MB\n",
+           launch_mb);
+    printf("and reads every source file\n");
+    printf("%-10s %10s %14s %14s\n", "A", "limit(MB)", "A locked(MB)", "B launch(ms)");
+    
+    /* 先不限制测基准，再在限制下比较保持锁定与释放 */
+    for (int run = 0; run < 3; run++) {
+        int limited = run > 0;
+        int residency = run == 2;
+        int ret = write_cgroup(cgroup, limit_name, limited ? limit :
+                               (strcmp(limit_name, "memory.max") == 0 ? "max" : "-1"));
+        if (ret < 0) {
+            fprintf(stderr, "Cannot set %s in %s: %d, skipping launch test\n",
+                    limit_name, cgroup, ret);
+            break;
+        }
+        
+        long locked = 0;
+        double ms = run_residency_launch(real_bc, bc, cgroup, residency, launch_mb, &locked);
+        char limit_col[16], result[32];
+        if (limited) {
+            snprintf(limit_col, sizeof(limit_col), "%d", limit_mb);
+        } else {
+            snprintf(limit_col, sizeof(limit_col), "none");
+        }
+        if (ms == -1) {
+            snprintf(result, sizeof(result), "B OOM-killed");
+        } else if (ms == -2) {
+            snprintf(result, sizeof(result), "A OOM-killed");
+        } else {
+            snprintf(result, sizeof(result), "%.2f", ms);
+        }
+        printf("%-10s %10s %14.2f %14s\n", residency ? "released" : "locked", limit_col,
+               locked / 1024.0, result);
+    }
+    printf("\nreleased: residency manager on, startup phase 500 ms, real PSI\n\n");
+    
+    if (created) rmdir(cgroup);
+    drop_bigcache_cache(real_bc, bc);
+    bigcache_destroy(bc);
+    return 0;
+}
+
+/* 使用说明 */
+/*
+ * handback-bench：N 个进程经预加载器映射并读遍全部文件（启动阶段），
+ * 之后调用 preloader_handback 把拦截的映射换回原文件，比较换回前后
+ * 全部进程（含服务进程）的稳态 RSS、PSS 与匿名内存，换回后再逐页比对一次。
+ * 换回前每个进程的文件内容都是私有匿名副本；换回后是共享的页缓存，PSS 按进程数分摊
+ */
+typedef struct {
+    uint64_t pages;
+    uint64_t bad;                /* 与原文件不一致的页 */
+    int regions;                 /* 换回的区域数（第一次结果为 0）*/
+    double handback_ms;
+} HandbackProbeResult;
+
+#define HANDBACK_PROBE_MAX_FILES 256
+
+/* 映射逐页与原文件比对 */
+static void verify_probe_maps(BigCacheContext *bc, const uint8_t **maps, const off_t *sizes,
+                              uint8_t *expect, HandbackProbeResult *res) {
+    for (uint32_t i = 0; i < bc->header.num_files && i < HANDBACK_PROBE_MAX_FILES; i++) {
+        if (!maps[i]) continue;
+        int fd = open(bc->file_table[i].path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            res->bad++;
+            continue;
+        }
+        for (off_t off = 0; off < sizes[i]; off += PAGE_SIZE) {
+            size_t len = sizes[i] - off < PAGE_SIZE ? sizes[i] - off : PAGE_SIZE;
+            if (pread(fd, expect, len, off) != (ssize_t)len || memcmp(maps[i] + off, expect, len)) {
+                res->bad++;
+            }
+            res->pages++;
+        }
+        close(fd);
+    }
+}
+
+static int cmd_handback_probe(int argc, char *argv[]) {
+    if (argc < 2) return 1;
+    int out = atoi(argv[0]);
+    int go = atoi(argv[1]);
+    
+    BigCacheContext *bc = preloader_get_bigcache();
+    const uint8_t *maps[HANDBACK_PROBE_MAX_FILES] = { 0 };
+    off_t sizes[HANDBACK_PROBE_MAX_FILES] = { 0 };
+    uint8_t *expect = malloc(PAGE_SIZE);
+    if (!bc || !expect) return 1;
+    
+    for (uint32_t i = 0; i < bc->header.num_files && i < HANDBACK_PROBE_MAX_FILES; i++) {
+        const char *path = bc->file_table[i].path;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+            if (fd >= 0) close(fd);
+            continue;
+        }
+        const uint8_t *map = preloader_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                            fd, 0, path);
+        close(fd);
+        if (map == MAP_FAILED) continue;
+        maps[i] = map;
+        sizes[i] = st.st_size;
+    }
+    
+    HandbackProbeResult res = { 0 };
+    verify_probe_maps(bc, maps, sizes, expect, &res);
+    if (write(out, &res, sizeof(res)) != sizeof(res)) return 1;
+    
+    /* 父进程统计完换回前的内存后写入一个字节 */
+    char cmd;
+    if (read(go, &cmd, 1) != 1) return 1;
+    
+    memset(&res, 0, sizeof(res));
+    double start = get_time_ms();
+    res.regions = preloader_handback();
+    res.handback_ms = get_time_ms() - start;
+    verify_probe_maps(bc, maps, sizes, expect, &res);
+    free(expect);
+    
+    if (write(out, &res, sizeof(res)) != sizeof(res)) return 1;
+    close(out);
+    
+    for (;;) pause();
+}
+
+static pid_t spawn_handback_probe(const char *bc_path, const char *socket_path,
+                                  int *read_fd, int *go_fd) {
+    int res_pipe[2], go_pipe[2];
+    if (pipe(res_pipe) < 0) return -1;
+    if (pipe(go_pipe) < 0) {
+        close(res_pipe[0]);
+        close(res_pipe[1]);
+        return -1;
+    }
+    
+    char wfd[16], rfd[16];
+    snprintf(wfd, sizeof(wfd), "%d", res_pipe[1]);
+    snprintf(rfd, sizeof(rfd), "%d", go_pipe[0]);
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        close(res_pipe[0]);
+        close(go_pipe[1]);
+        setenv("BIGCACHE_PATH", bc_path, 1);
+        setenv("BIGCACHE_ENABLED", "1", 1);
+        setenv("BIGCACHE_ASYNC_INIT", "0", 1);
+        /* 启动结束只由换回触发 */
+        setenv("BIGCACHE_STARTUP_MS", "0", 1);
+        unsetenv("BIGCACHE_HANDBACK_MS");
+        unsetenv("BIGCACHE_BROKER");
+        if (socket_path) {
+            setenv("BIGCACHE_DAEMON", socket_path, 1);
+        } else {
+            unsetenv("BIGCACHE_DAEMON");
+        }
+        execl("/proc/self/exe", "bigcache", "handback-probe", wfd, rfd, (char*)NULL);
+        _exit(127);
+    }
+    
+    close(res_pipe[1]);
+    close(go_pipe[0]);
+    if (pid < 0) {
+        close(res_pipe[0]);
+        close(go_pipe[1]);
+        return -1;
+    }
+    *read_fd = res_pipe[0];
+    *go_fd = go_pipe[1];
+    return pid;
+}
+
+/* 从 smaps_rollup 读取 Anonymous（KB）*/
+static long read_anon_rollup_kb(pid_t pid) {
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+    
+    long kb = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "Anonymous: %ld kB", &kb) == 1) break;
+    }
+    fclose(fp);
+    return kb;
+}
+
+static void sum_handback_memory(const pid_t *pids, int count, pid_t daemon_pid,
+                                long *rss_total, long *pss_total, long *anon_total) {
+    *rss_total = *pss_total = *anon_total = 0;
+    for (int i = 0; i <= count; i++) {
+        pid_t pid = i < count ? pids[i] : daemon_pid;
+        long rss, pss;
+        if (pid <= 0 || read_rss_pss(pid, &rss, &pss) < 0) continue;
+        *rss_total += rss;
+        *pss_total += pss;
+        *anon_total += read_anon_rollup_kb(pid);
+    }
+}
+
+static int cmd_handback_bench(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: bigcache handback-bench <bigcache.bin> [procs] [workers]\n");
+        fprintf(stderr, "\nStarts N processes that map and read every file in BigCache\n");
+        fprintf(stderr, "through the preloader, then hands the intercepted mappings back\n");
+        fprintf(stderr, "to the files and compares steady-state RSS/PSS before and after,\n");
+        fprintf(stderr, "with in-process handlers and with one fault daemon\n");
+        return 1;
+    }
+    
+    const char *bc_path = argv[0];
+    int procs = argc > 1 ? atoi(argv[1]) : 4;
+    int workers = argc > 2 ? atoi(argv[2]) : 4;
+    if (procs < 1) procs = 1;
+    if (procs > BROKER_BENCH_MAX_PROCS) procs = BROKER_BENCH_MAX_PROCS;
+    
+    BigCacheContext *bc = bigcache_create();
+    if (!bc || bigcache_load(bc, bc_path) < 0) {
+        fprintf(stderr, "Failed to load %s\n", bc_path);
+        bigcache_destroy(bc);
+        return 1;
+    }
+    
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "@bigcache-handback-bench-%d", (int)getpid());
+    
+    printf("=== Handback: %s, %d processes ===\n\n", bc_path, procs);
+    printf("%-8s %-7s %10s %10s %10s %12s %9s %7s\n",
+           "mode", "phase", "RSS(MB)", "PSS(MB)", "Anon(MB)", "handback(ms)", "regions", "bad");
+    
+    int failed = 0;
+    for (int mode = 0; mode < 2 && !failed; mode++) {
+        int use_daemon = mode == 1;
+        const char *mode_name = use_daemon ? "daemon" : "in-proc";
+        pid_t daemon_pid = -1;
+        
+        if (use_daemon) {
+            daemon_pid = start_bench_daemon(bc_path, socket_path, workers, bc);
+            if (daemon_pid < 0) {
+                fprintf(stderr, "Fault daemon did not come up\n");
+                failed = 1;
+                break;
+            }
+        }
+        
+        pid_t pids[BROKER_BENCH_MAX_PROCS];
+        int pipes[BROKER_BENCH_MAX_PROCS], gos[BROKER_BENCH_MAX_PROCS];
+        int started = 0;
+        for (int i = 0; i < procs; i++) {
+            pids[i] = spawn_handback_probe(bc_path, use_daemon ? socket_path : NULL,
+                                           &pipes[i], &gos[i]);
+            if (pids[i] < 0) break;
+            started++;
+        }
+        
+        HandbackProbeResult before = { 0 }, after = { 0 };
+        int reported = 0;
+        for (int i = 0; i < started; i++) {
+            HandbackProbeResult res;
+            if (read(pipes[i], &res, sizeof(res)) == sizeof(res)) {
+                before.bad += res.bad;
+                reported++;
+            }
+        }
+        
+        long rss[2], pss[2], anon[2];
+        sum_handback_memory(pids, started, daemon_pid, &rss[0], &pss[0], &anon[0]);
+        
+        for (int i = 0; i < started; i++) {
+            if (write(gos[i], "h", 1) != 1) reported--;
+        }
+        for (int i = 0; i < started; i++) {
+            HandbackProbeResult res;
+            if (read(pipes[i], &res, sizeof(res)) == sizeof(res)) {
+                after.bad += res.bad;
+                after.regions += res.regions;
+                after.handback_ms += res.handback_ms;
+                reported++;
+            }
+            close(pipes[i]);
+            close(gos[i]);
+        }
+        
+        sum_handback_memory(pids, started, daemon_pid, &rss[1], &pss[1], &anon[1]);
+        
+        for (int i = 0; i < started; i++) {
+            kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+        }
+        if (use_daemon) {
+            kill(daemon_pid, SIGTERM);
+            waitpid(daemon_pid, NULL, 0);
+        }
+        
+        if (reported < 2 * procs) {
+            fprintf(stderr, "handback-probe failed (%s)\n", mode_name);
+            failed = 1;
+            break;
+        }
+        
+        printf("%-8s %-7s %10.2f %10.2f %10.2f %12s %9s %7lu\n",
+               mode_name, "before", rss[0] / 1024.0, pss[0] / 1024.0, anon[0] / 1024.0,
+               "-", "-", (unsigned long)before.bad);
+        printf("%-8s %-7s %10.2f %10.2f %10.2f %12.2f %9.1f %7lu\n",
+               mode_name, "after", rss[1] / 1024.0, pss[1] / 1024.0, anon[1] / 1024.0,
+               after.handback_ms / procs, (double)after.regions / procs,
+               (unsigned long)after.bad);
+    }
+    if (!failed) {
+        printf("\nRSS/PSS/Anon: sum over all probes (and the daemon)\n");
+        printf("handback, regions: mean per process; bad: pages differing from the file\n\n");
+    }
+    
+    bigcache_destroy(bc);
+    return failed;
+}
+
 static void usage(const char *prog) {
     printf("BigCache - Userspace Demand Paging for Cold Start Optimization\n\n");
     printf("Usage: %s <command> [options]\n\n", prog);
     printf("Commands:\n");
-    printf("  pack <layout.csv> <output.bin>    Pack pages into BigCache\n");
+    printf("  pack <layout.csv> <output.bin> [--budget-mb N] [--device NAME]\n");
+    printf("                                    Pack pages into BigCache\n");
+    printf("  layout <in.csv> <out.csv> [strategy] [window]\n");
+    printf("                                    Reorder layout and score it\n");
+    printf("  consensus <out.csv> <k%%> <trace.csv>...\n");
+    printf("                                    Consensus layout from N traces\n");
     printf("  verify <bigcache.bin>             Verify BigCache integrity\n");
     printf("  info <bigcache.bin>               Show BigCache information\n");
     printf("  benchmark <bigcache.bin> [iter]   Run performance benchmark\n");
     printf("  simulate <bigcache.bin> <layout>  Simulate cold start\n");
+    printf("  fault-bench <bigcache.bin> [max_handlers] [app_threads]\n");
+    printf("                                    Fault throughput vs handler threads\n");
+    printf("  around-bench <bigcache.bin> [behind]\n");
+    printf("                                    Fault count vs prefetch_ahead\n");
+    printf("  populate-bench <bigcache.bin> [work_us]\n");
+    printf("                                    Faults avoided by the populator\n");
+    printf("  minor-bench <bigcache.bin> [ahead]\n");
+    printf("                                    UFFDIO_COPY vs UFFDIO_CONTINUE serving\n");
+    printf("  region-bench <bigcache.bin> [num_regions]\n");
+    printf("                                    Region lookup with many mappings\n");
+    printf("  fallback-bench <bigcache.bin> [readahead] [events.bin]\n");
+    printf("                                    Serve misses from the original file\n");
+    printf("  sched-bench <bigcache.bin> [load_threads] [work_us]\n");
+    printf("                                    Fault latency vs handler scheduling\n");
+    printf("  init-bench <bigcache.bin> [runs]  Exec-to-main time, sync vs async init\n");
+    printf("  read-bench <bigcache.bin> <read_sequence.csv> [libpreloader.so] [runs]\n");
+    printf("                                    Replay reads through the read hooks\n");
+    printf("  broker <bigcache.bin> <socket>    Share BigCache with preloaders via memfd\n");
+    printf("  broker-bench <bigcache.bin> [procs]\n");
+    printf("                                    Private load vs broker memfd, N processes\n");
+    printf("  daemon <bigcache.bin> <socket> [workers] [max_clients] [client_mb]\n");
+    printf("                                    Serve page faults for many processes\n");
+    printf("  daemon-bench <bigcache.bin> [procs] [workers]\n");
+    printf("                                    In-process handlers vs one fault daemon\n");
+    printf("  residency-bench <bigcache.bin> [cgroup_dir] [limit_mb] [launch_mb]\n");
+    printf("                                    Cache RSS vs PSI, launch under a memory cgroup\n");
+    printf("  handback-bench <bigcache.bin> [procs] [workers]\n");
+    printf("                                    Steady-state PSS before/after file handback\n");
+    printf("  dlopen-bench <bigcache.bin> <libpreloader_dlopen.so> <lib.so>...\n");
+    printf("                                    Cold dlopen time with library prefetch\n");
     printf("  help                              Show this help\n");
     printf("\nEnvironment variables:\n");
     printf("  BIGCACHE_PATH     Path to BigCache file (for preloader)\n");
     printf("  BIGCACHE_ENABLED  Enable/disable preloader (0/1)\n");
     printf("  BIGCACHE_VERBOSE  Verbose logging level (0-5)\n");
+    printf("  BIGCACHE_HANDLER_THREADS  UFFD handler threads (default: min(4, CPUs))\n");
+    printf("  BIGCACHE_POPULATE  Populate mapped regions in access order (0/1)\n");
+    printf("  BIGCACHE_SERVE_MODE  copy (UFFDIO_COPY) or minor (shmem + UFFDIO_CONTINUE)\n");
+    printf("  BIGCACHE_SHADOW_HUGETLB  Back minor-mode shadow with hugetlb (0/1)\n");
+    printf("  BIGCACHE_FILE_FALLBACK  Serve BigCache misses from the original file (0/1)\n");
+    printf("  BIGCACHE_EVENT_LOG  Write per-fault events to this file on exit\n");
+    printf("  BIGCACHE_EVENT_RING  Fault events kept per handler thread (default: 65536)\n");
+    printf("  BIGCACHE_HANDLER_NICE  Handler thread nice value (default: -10)\n");
+    printf("  BIGCACHE_HANDLER_SCHED  other, fifo or rr (real-time needs CAP_SYS_NICE)\n");
+    printf("  BIGCACHE_HANDLER_RT_PRIO  Real-time priority for fifo/rr (default: 1)\n");
+    printf("  BIGCACHE_HANDLER_CPUS  big, all, 0xMASK or a list like 4-7 (default: big)\n");
+    printf("  BIGCACHE_COVERAGE_FULL  Cached fraction to intercept a whole mapping (default: 0.5)\n");
+    printf("  BIGCACHE_COVERAGE_PARTIAL  Cached fraction to overlay cached ranges (default: 0.05)\n");
+    printf("  BIGCACHE_HYBRID  Keep mappings file-backed, overlay only hot ranges (default: 1)\n");
+    printf("  BIGCACHE_OVERLAY_GAP  Uncached pages bridged inside one overlay window (default: 8)\n");
+    printf("  BIGCACHE_ASYNC_INIT  Preheat in the background instead of before main (0/1)\n");
+    printf("  BIGCACHE_READY_WAIT_US  Max wait for a file's pages to be preheated (default: 2000)\n");
+    printf("  BIGCACHE_BROKER  Broker socket to get a shared BigCache memfd from\n");
+    printf("  BIGCACHE_BROKER_TIMEOUT_MS  Wait for the broker before loading privately (default: 100)\n");
+    printf("  BIGCACHE_DAEMON  Fault daemon socket to hand this process's userfaultfd to\n");
+    printf("  BIGCACHE_RESIDENCY  Release locked cache pages after startup or under pressure (default: 1)\n");
+    printf("  BIGCACHE_STARTUP_MS  Startup phase after preheat, 0 waits for preloader_startup_complete (default: 10000)\n");
+    printf("  BIGCACHE_PSI_PATH  Memory PSI file, or a file in the same format (default: /proc/pressure/memory)\n");
+    printf("  BIGCACHE_PSI_SOME  some avg10 %% that pages out served pages (default: 10)\n");
+    printf("  BIGCACHE_PSI_FULL  full avg10 %% that also pages out unserved pages (default: 5)\n");
+    printf("  BIGCACHE_RESIDENCY_POLL_MS  PSI sampling interval (default: 500)\n");
+    printf("  BIGCACHE_HANDBACK_MS  Hand intercepted mappings back to their files after this, 0 only via preloader_handback (default: 0)\n");
+    printf("  BIGCACHE_DLOPEN_PREFETCH  Prefetch cached pages of a library before dlopen, libpreloader_dlopen.so only (default: 1)\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -411,6 +3453,10 @@ int main(int argc, char *argv[]) {
     
     if (strcmp(cmd, "pack") == 0) {
         return cmd_pack(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "layout") == 0) {
+        return cmd_layout(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "consensus") == 0) {
+        return cmd_consensus(cmd_argc, cmd_argv);
     } else if (strcmp(cmd, "verify") == 0) {
         return cmd_verify(cmd_argc, cmd_argv);
     } else if (strcmp(cmd, "info") == 0) {
@@ -419,6 +3465,52 @@ int main(int argc, char *argv[]) {
         return cmd_benchmark(cmd_argc, cmd_argv);
     } else if (strcmp(cmd, "simulate") == 0) {
         return cmd_simulate(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "fault-bench") == 0) {
+        return cmd_fault_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "around-bench") == 0) {
+        return cmd_around_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "populate-bench") == 0) {
+        return cmd_populate_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "minor-bench") == 0) {
+        return cmd_minor_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "region-bench") == 0) {
+        return cmd_region_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "fallback-bench") == 0) {
+        return cmd_fallback_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "init-probe") == 0) {
+        return cmd_init_probe(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "read-replay") == 0) {
+        return cmd_read_replay(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "read-bench") == 0) {
+        return cmd_read_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "broker") == 0) {
+        return cmd_broker(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "broker-probe") == 0) {
+        return cmd_broker_probe(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "broker-bench") == 0) {
+        return cmd_broker_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "daemon") == 0) {
+        return cmd_daemon(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "daemon-probe") == 0) {
+        return cmd_daemon_probe(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "daemon-bench") == 0) {
+        return cmd_daemon_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "residency-launch") == 0) {
+        return cmd_residency_launch(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "residency-bench") == 0) {
+        return cmd_residency_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "handback-probe") == 0) {
+        return cmd_handback_probe(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "handback-bench") == 0) {
+        return cmd_handback_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "dlopen-probe") == 0) {
+        return cmd_dlopen_probe(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "dlopen-bench") == 0) {
+        return cmd_dlopen_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "init-bench") == 0) {
+        return cmd_init_bench(cmd_argc, cmd_argv);
+    } else if (strcmp(cmd, "sched-bench") == 0) {
+        return cmd_sched_bench(cmd_argc, cmd_argv);
     } else if (strcmp(cmd, "help") == 0 || strcmp(cmd, "-h") == 0 ||
                strcmp(cmd, "--help") == 0) {
         usage(argv[0]);
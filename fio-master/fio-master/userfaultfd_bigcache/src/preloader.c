@@ -14,18 +14,60 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <stdarg.h>
 #include <dlfcn.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
 #include <time.h>
 #include "bigcache.h"
 #include "uffd_handler.h"
+#include "bigcache_broker.h"
+#include "fault_daemon.h"
+#include "bigcache_residency.h"
+
+/* 记录的 dlopen 次数上限 */
+#define MAX_DLOPEN_STATS 128
+
+typedef struct {
+    char name[128];
+    double ms;                   /* 原 dlopen 耗时 */
+    size_t prefetched_pages;     /* 本次 dlopen 前发起预取的页数 */
+    double prefetch_ms;          /* 提交预取的耗时 */
+} DlopenStat;
 
 /* 预加载器全局状态 */
 typedef struct {
     BigCacheContext *bigcache;
     UffdHandler *uffd_handler;
     
+    /* 缺页交给服务进程时不创建 uffd_handler，映射经 fault_daemon 注册 */
+    FaultDaemonClient fault_daemon;
+    int use_daemon;
+    
+    /*
+     * 驻留管理：启动结束或内存压力升高时释放预热锁定的页。
+     * 代理的 memfd 由代理锁定、服务进程模式下本地不预热，两者都不创建
+     */
+    ResidencyManager *residency;
+    
+    /*
+     * Handback：启动结束后（BIGCACHE_HANDBACK_MS 计时或调用 preloader_handback）
+     * 把拦截的映射换回原文件映射、释放匿名副本，之后的映射直接交给内核
+     */
+    int handback_ms;
+    int handed_back;
+    UffdHandbackStats handback_stats;
+    pthread_t handback_thread;
+    int handback_running;
+    int handback_stop;
+    pthread_mutex_t handback_lock;
+    pthread_cond_t handback_cond;
+    
     /* 原始函数指针（用于 hook）*/
     void* (*original_mmap)(void*, size_t, int, int, int, off_t);
     int (*original_munmap)(void*, size_t);
@@ -33,13 +75,70 @@ typedef struct {
     
     /* 配置 */
     char bigcache_path[512];
+    int from_broker;             /* BigCache 映射自代理进程的 memfd，已常驻，跳过预热 */
     int enabled;
     int verbose;
     
+    /*
+     * 按覆盖率决定是否拦截：映射范围内在 BigCache 中的页占比
+     * >= coverage_full 整体替换为 UFFD 映射，>= coverage_partial 只覆盖有缓存的区间，
+     * 否则交给内核按原文件映射
+     */
+    double coverage_full;
+    double coverage_partial;
+    
+    /*
+     * 混合映射：先按原文件映射，只把有缓存的热区间覆盖为 UFFD 窗口，
+     * 冷页保留文件页（预读、共享、可回收）。开启时不再整体替换映射。
+     * 热区间之间不超过 overlay_gap 页的空洞并入同一窗口，由原文件回退读取
+     */
+    int hybrid;
+    int overlay_gap;
+    
+    /*
+     * 异步初始化：构造函数只加载索引、启动处理器，预热在后台线程按数据区顺序分段进行。
+     * preheat_slots 为已预热的数据区页数，文件的全部页都已预热后才拦截其映射，
+     * 否则最多等待 ready_wait_us 后交给内核
+     */
+    int async_init;
+    int ready_wait_us;
+    pthread_t preheat_thread;
+    int preheat_running;         /* 后台预热线程已创建，清理时 join */
+    int preheat_stop;
+    uint32_t preheat_slots;
+    pthread_mutex_t ready_lock;
+    pthread_cond_t ready_cond;
+    
+    /*
+     * dlopen 预取：库在 BigCache 中时，调用原 dlopen 前对原文件的缓存区间发起
+     * WILLNEED 异步读入，每个库只预取一次。dlopen_stats 记录每次 dlopen 的耗时
+     */
+    int dlopen_prefetch;
+    uint8_t *dlopen_prefetched;  /* 每个 file_id 是否已预取 */
+    DlopenStat dlopen_stats[MAX_DLOPEN_STATS];
+    int num_dlopen_stats;
+    pthread_mutex_t dlopen_lock;
+    
+    /* 文件路径 -> BigCache file_id 的开放寻址哈希（-1 为空槽），初始化完成后只读 */
+    int32_t *file_hash;
+    uint32_t file_hash_mask;
+    
+    /* 每个 file_id 是否已被本进程写过，置位后 mmap 和 read hook 都不再由 BigCache 服务 */
+    uint8_t *file_written;
+    
     /* 统计 */
     int intercepted_count;
     int bypassed_count;
     size_t total_intercepted_size;
+    int fd_table_hits;           /* mmap 由 fd 表直接判定的次数 */
+    int fd_proc_lookups;         /* readlink(/proc/self/fd) 次数：open 时路径未命中或 mmap 时 fd 表未知 */
+    int partial_count;           /* 部分覆盖的映射数 */
+    int overlay_windows;         /* 覆盖的 UFFD 窗口数 */
+    int not_ready_count;         /* 预热未到达、整体或部分窗口交给内核的映射数 */
+    int reads_served;            /* 由 BigCache 服务的 read 类调用 */
+    int reads_passed;            /* 文件在 BigCache 中但范围未全部缓存、交给原函数的调用 */
+    size_t read_bytes_served;
+    int coverage_left_count;     /* 覆盖率不足、未拦截的映射数 */
     
     /* 启动时间 */
     double init_time_ms;
@@ -52,6 +151,11 @@ typedef struct {
 
 static PreloaderState g_preloader = {
     .lock = PTHREAD_MUTEX_INITIALIZER,
+    .ready_lock = PTHREAD_MUTEX_INITIALIZER,
+    .ready_cond = PTHREAD_COND_INITIALIZER,
+    .dlopen_lock = PTHREAD_MUTEX_INITIALIZER,
+    .handback_lock = PTHREAD_MUTEX_INITIALIZER,
+    .handback_cond = PTHREAD_COND_INITIALIZER,
     .initialized = 0
 };
 
@@ -79,6 +183,249 @@ static int should_intercept(const char *path) {
     return 0;
 }
 
+/*
+ * fd 表
+ *
+ * open/openat/dup/close hook 维护每个 fd 对应的 BigCache file_id，
+ * mmap hook 据此 O(1) 判定，不再对每次映射 readlink(/proc/self/fd/N) 和匹配扩展名。
+ * 未经 hook 打开的 fd（初始化前打开、相对路径、libc 内部打开）记为未知，
+ * mmap 时回退到 readlink。libc 内部 close 不经过 hook，fd 号可能被复用，
+ * 所以每个表项都记录 dev/ino，查询时用 fstat 校验。
+ * 文件的大小、mtime 或 inode 与打包时不同（被替换或原地改写）即视为不在 BigCache 中
+ */
+#define PRELOADER_MAX_FDS 4096
+
+/* 查询结果（非负为 file_id）*/
+#define FD_NOT_CACHED  (-1)      /* 文件不在 BigCache 中 */
+#define FD_UNKNOWN     (-2)      /* 未记录或已失效，回退 readlink */
+
+typedef struct {
+    int32_t file;                /* 0 未记录，-1 不在 BigCache 中，否则为 file_id + 1 */
+    int read_only;               /* O_RDONLY 打开，read hook 只服务这类 fd */
+    dev_t dev;
+    ino_t ino;
+} FdEntry;
+
+static FdEntry g_fd_table[PRELOADER_MAX_FDS];
+
+static uint32_t hash_path(const char *path) {
+    uint32_t hash = 2166136261u;  /* FNV-1a */
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* 建立文件路径哈希（调用者持有 lock）*/
+static int build_file_hash(BigCacheContext *bc) {
+    uint32_t size = 16;
+    while (size < bc->header.num_files * 2) size <<= 1;
+    
+    int32_t *table = malloc(size * sizeof(int32_t));
+    if (!table) return -ENOMEM;
+    memset(table, 0xff, size * sizeof(int32_t));
+    
+    for (uint32_t i = 0; i < bc->header.num_files; i++) {
+        uint32_t slot = hash_path(bc->file_table[i].path) & (size - 1);
+        while (table[slot] >= 0) slot = (slot + 1) & (size - 1);
+        table[slot] = (int32_t)i;
+    }
+    
+    g_preloader.file_hash_mask = size - 1;
+    __atomic_store_n(&g_preloader.file_hash, table, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * 源文件是否仍是打包时的那个文件：本进程没有写过，大小、mtime、inode 与打包时一致。
+ * 原地改写（如 SQLite）不改变大小，只能靠 mtime 发现；旧 BigCache 未记录的项不校验
+ */
+static int file_unchanged(int file_id, const struct stat *st) {
+    BigCacheContext *bc = g_preloader.bigcache;
+    uint8_t *written = __atomic_load_n(&g_preloader.file_written, __ATOMIC_ACQUIRE);
+    if (written && __atomic_load_n(&written[file_id], __ATOMIC_RELAXED)) return 0;
+    
+    uint64_t original_size = bc->file_table[file_id].original_size;
+    if (original_size != 0 && (uint64_t)st->st_size != original_size) return 0;
+    
+    if (bc->file_stats && bc->file_stats[file_id].mtime_ns != 0) {
+        uint64_t mtime_ns = (uint64_t)st->st_mtim.tv_sec * 1000000000ull +
+                            (uint64_t)st->st_mtim.tv_nsec;
+        if (mtime_ns != bc->file_stats[file_id].mtime_ns ||
+            (uint64_t)st->st_ino != bc->file_stats[file_id].ino) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* 后台预热每段的页数：每段完成后推进 preheat_slots 并唤醒等待的 hook */
+#define PREHEAT_CHUNK_PAGES 256
+
+static void* preheat_thread_main(void *arg) {
+    BigCacheContext *bc = arg;
+    double start = get_time_ms();
+    uint32_t total = bc->header.num_pages;
+    
+    if (madvise(bc->mapped_data, bc->mapped_size, MADV_SEQUENTIAL) < 0) {
+        perror("preheat: madvise SEQUENTIAL");
+    }
+    
+    for (uint32_t slot = 0; slot < total; ) {
+        if (__atomic_load_n(&g_preloader.preheat_stop, __ATOMIC_ACQUIRE)) return NULL;
+        
+        uint32_t end = slot + PREHEAT_CHUNK_PAGES < total ? slot + PREHEAT_CHUNK_PAGES : total;
+        bigcache_preheat_range(bc, slot, end);
+        slot = end;
+        
+        pthread_mutex_lock(&g_preloader.ready_lock);
+        __atomic_store_n(&g_preloader.preheat_slots, slot, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&g_preloader.ready_cond);
+        pthread_mutex_unlock(&g_preloader.ready_lock);
+    }
+    
+    bigcache_preheat_finish(bc);
+    g_preloader.preheat_time_ms = get_time_ms() - start;
+    
+    if (g_preloader.verbose) {
+        printf("[Preloader] Background preheat done in %.2f ms\n", g_preloader.preheat_time_ms);
+    }
+    return NULL;
+}
+
+/*
+ * 等待 [offset, offset + length) 内的缓存页预热完成，同步初始化时总是就绪；超时返回 0。
+ * 只看范围内的页：交错布局中各文件的最后一页都落在数据区末尾附近。
+ * deadline 全零时从现在起算 ready_wait_us，同一次 mmap 的多个窗口共用它，总等待不超过一次
+ */
+static int wait_range_ready(int file_id, off_t offset, size_t length,
+                            struct timespec *deadline) {
+    if (!g_preloader.async_init) return 1;
+    
+    uint32_t need = bigcache_range_end_slot(g_preloader.bigcache, file_id, offset, length);
+    if (__atomic_load_n(&g_preloader.preheat_slots, __ATOMIC_ACQUIRE) >= need) return 1;
+    if (g_preloader.ready_wait_us <= 0) return 0;
+    
+    if (deadline->tv_sec == 0 && deadline->tv_nsec == 0) {
+        clock_gettime(CLOCK_REALTIME, deadline);
+        deadline->tv_nsec += (long)g_preloader.ready_wait_us * 1000;
+        deadline->tv_sec += deadline->tv_nsec / 1000000000;
+        deadline->tv_nsec %= 1000000000;
+    }
+    
+    pthread_mutex_lock(&g_preloader.ready_lock);
+    while (__atomic_load_n(&g_preloader.preheat_slots, __ATOMIC_ACQUIRE) < need) {
+        if (pthread_cond_timedwait(&g_preloader.ready_cond, &g_preloader.ready_lock,
+                                   deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_preloader.ready_lock);
+    
+    return __atomic_load_n(&g_preloader.preheat_slots, __ATOMIC_ACQUIRE) >= need;
+}
+
+/* 创建、配置并启动进程内 UFFD 处理器，失败时不留下处理器 */
+static int start_uffd_handler(void) {
+    g_preloader.uffd_handler = uffd_handler_create(g_preloader.bigcache);
+    if (!g_preloader.uffd_handler) {
+        fprintf(stderr, "Failed to create UFFD handler\n");
+        return -ENOMEM;
+    }
+    
+    /* 配置 UFFD 处理器 */
+    /* 启动期主线程、RenderThread 和类加载线程会同时缺页，默认使用多个处理线程 */
+    const char *threads = getenv("BIGCACHE_HANDLER_THREADS");
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = threads ? atoi(threads) : (num_cpus < 4 ? (int)num_cpus : 4);
+    const char *populate = getenv("BIGCACHE_POPULATE");
+    const char *serve_mode = getenv("BIGCACHE_SERVE_MODE");
+    const char *hugetlb = getenv("BIGCACHE_SHADOW_HUGETLB");
+    const char *fallback = getenv("BIGCACHE_FILE_FALLBACK");
+    const char *event_log = getenv("BIGCACHE_EVENT_LOG");
+    const char *event_ring = getenv("BIGCACHE_EVENT_RING");
+    
+    /* 处理线程调度：默认 nice -10、只在大核上运行，可选实时策略 */
+    const char *nice_env = getenv("BIGCACHE_HANDLER_NICE");
+    const char *sched_env = getenv("BIGCACHE_HANDLER_SCHED");
+    const char *rt_prio = getenv("BIGCACHE_HANDLER_RT_PRIO");
+    const char *cpus = getenv("BIGCACHE_HANDLER_CPUS");
+    int policy = SCHED_OTHER;
+    if (sched_env && strcmp(sched_env, "fifo") == 0) policy = SCHED_FIFO;
+    if (sched_env && strcmp(sched_env, "rr") == 0) policy = SCHED_RR;
+    uint64_t cpu_mask = 0;
+    if (uffd_parse_cpu_mask(cpus ? cpus : "big", &cpu_mask) < 0) {
+        fprintf(stderr, "Ignoring invalid BIGCACHE_HANDLER_CPUS=%s\n", cpus);
+        cpu_mask = 0;
+    }
+    
+    UffdConfig config = {
+        .enable_zero_fill = 1,
+        .enable_stats = 1,
+        .enable_logging = g_preloader.verbose,
+        .handler_priority = nice_env ? atoi(nice_env) : -10,  /* 高优先级 */
+        .handler_sched_policy = policy,
+        .handler_rt_priority = rt_prio ? atoi(rt_prio) : 1,
+        .handler_cpu_mask = cpu_mask,
+        .prefetch_ahead = 8,
+        .num_handler_threads = num_threads,
+        .msg_batch_size = UFFD_DEFAULT_MSG_BATCH,
+        .enable_populator = populate ? atoi(populate) : 1,
+        .populate_chunk_pages = 16,
+        .serve_mode = (serve_mode && strcmp(serve_mode, "minor") == 0) ?
+                      UFFD_SERVE_MINOR : UFFD_SERVE_COPY,
+        .shadow_hugetlb = hugetlb ? atoi(hugetlb) : 0,
+        .batch_wake = 1,
+        .enable_file_fallback = fallback ? atoi(fallback) : 1,
+        .fallback_readahead = 16,
+        .event_ring_size = event_log ? (event_ring ? (size_t)atol(event_ring) :
+                                        UFFD_DEFAULT_EVENT_RING) : 0,
+        .event_log_path = event_log
+    };
+    uffd_handler_set_config(g_preloader.uffd_handler, &config);
+    
+    /* 没有原文件回退时空洞页会被零填充，窗口不能跨过未缓存页 */
+    if (!config.enable_file_fallback) {
+        g_preloader.overlay_gap = 0;
+    }
+    
+    /* 启动 UFFD 处理器 */
+    int ret = uffd_handler_start(g_preloader.uffd_handler);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to start UFFD handler: %d\n", ret);
+        uffd_handler_destroy(g_preloader.uffd_handler);
+        g_preloader.uffd_handler = NULL;
+    }
+    return ret;
+}
+
+/* 定义在后面，计时线程到时调用 */
+int preloader_handback(void);
+
+/* BIGCACHE_HANDBACK_MS 计时线程：到时换回，清理时提前唤醒退出 */
+static void* handback_thread_main(void *arg) {
+    (void)arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += g_preloader.handback_ms / 1000;
+    deadline.tv_nsec += (long)(g_preloader.handback_ms % 1000) * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    
+    pthread_mutex_lock(&g_preloader.handback_lock);
+    int ret = 0;
+    while (!g_preloader.handback_stop && ret != ETIMEDOUT) {
+        ret = pthread_cond_timedwait(&g_preloader.handback_cond, &g_preloader.handback_lock,
+                                     &deadline);
+    }
+    int stop = g_preloader.handback_stop;
+    pthread_mutex_unlock(&g_preloader.handback_lock);
+    
+    if (!stop) preloader_handback();
+    return NULL;
+}
+
 /* 初始化预加载器 */
 int preloader_init(const char *bigcache_path) {
     pthread_mutex_lock(&g_preloader.lock);
@@ -104,6 +451,22 @@ int preloader_init(const char *bigcache_path) {
     const char *verbose = getenv("BIGCACHE_VERBOSE");
     g_preloader.verbose = verbose ? atoi(verbose) : 0;
     
+    const char *coverage_full = getenv("BIGCACHE_COVERAGE_FULL");
+    const char *coverage_partial = getenv("BIGCACHE_COVERAGE_PARTIAL");
+    g_preloader.coverage_full = coverage_full ? atof(coverage_full) : 0.5;
+    g_preloader.coverage_partial = coverage_partial ? atof(coverage_partial) : 0.05;
+    const char *hybrid = getenv("BIGCACHE_HYBRID");
+    const char *overlay_gap = getenv("BIGCACHE_OVERLAY_GAP");
+    g_preloader.hybrid = hybrid ? atoi(hybrid) : 1;
+    g_preloader.overlay_gap = overlay_gap ? atoi(overlay_gap) : 8;
+    const char *async_init = getenv("BIGCACHE_ASYNC_INIT");
+    const char *ready_wait = getenv("BIGCACHE_READY_WAIT_US");
+    g_preloader.async_init = async_init ? atoi(async_init) : 0;
+    g_preloader.ready_wait_us = ready_wait ? atoi(ready_wait) : 2000;
+    /* dlopen_prefetched 分配之后才打开开关，hook 不会看到开关已开而数组为空 */
+    const char *dlopen_prefetch = getenv("BIGCACHE_DLOPEN_PREFETCH");
+    int want_dlopen_prefetch = dlopen_prefetch ? atoi(dlopen_prefetch) : 1;
+    
     const char *enabled = getenv("BIGCACHE_ENABLED");
     g_preloader.enabled = enabled ? atoi(enabled) : 1;
     
@@ -122,8 +485,33 @@ int preloader_init(const char *bigcache_path) {
         return -ENOMEM;
     }
     
+    /*
+     * 设置了 BIGCACHE_BROKER 时先向代理取 memfd，多个进程共享同一份常驻页；
+     * 代理不可用时退回各自加载 BigCache 文件
+     */
+    int ret = -ENOENT;
+    const char *broker = getenv("BIGCACHE_BROKER");
+    if (broker) {
+        const char *timeout = getenv("BIGCACHE_BROKER_TIMEOUT_MS");
+        int fd = broker_fetch(broker, timeout ? atoi(timeout) : 100, NULL);
+        if (fd >= 0) {
+            ret = bigcache_load_fd(g_preloader.bigcache, fd);
+        }
+        if (fd >= 0 && ret == 0) {
+            g_preloader.from_broker = 1;
+        } else {
+            fprintf(stderr, "BigCache broker %s unavailable (%d), loading %s\n",
+                    broker, fd < 0 ? fd : ret, g_preloader.bigcache_path);
+            bigcache_destroy(g_preloader.bigcache);
+            g_preloader.bigcache = bigcache_create();
+            ret = g_preloader.bigcache ? -ENOENT : -ENOMEM;
+        }
+    }
+    
     /* 加载 BigCache 文件 */
-    int ret = bigcache_load(g_preloader.bigcache, g_preloader.bigcache_path);
+    if (!g_preloader.from_broker && g_preloader.bigcache) {
+        ret = bigcache_load(g_preloader.bigcache, g_preloader.bigcache_path);
+    }
     if (ret < 0) {
         fprintf(stderr, "Failed to load BigCache from %s: %d\n",
                 g_preloader.bigcache_path, ret);
@@ -137,48 +525,65 @@ int preloader_init(const char *bigcache_path) {
     
     g_preloader.init_time_ms = get_time_ms() - start_time;
     
-    /* 预热 BigCache */
-    double preheat_start = get_time_ms();
-    ret = bigcache_preheat(g_preloader.bigcache);
-    if (ret < 0) {
-        fprintf(stderr, "Failed to preheat BigCache: %d\n", ret);
+    /*
+     * 设置了 BIGCACHE_DAEMON 时把 uffd 交给缺页服务进程，本进程不启动处理线程，
+     * 缓存页由服务进程的 BigCache 提供，本地只需页索引，不必预热。
+     * 服务进程不可用或拒绝（客户端已满、BigCache 不一致）时退回进程内处理器
+     */
+    const char *daemon = getenv("BIGCACHE_DAEMON");
+    if (daemon) {
+        const char *timeout = getenv("BIGCACHE_BROKER_TIMEOUT_MS");
+        ret = fault_daemon_connect(&g_preloader.fault_daemon, daemon, g_preloader.bigcache,
+                                   timeout ? atoi(timeout) : 100);
+        if (ret == 0) {
+            g_preloader.use_daemon = 1;
+        } else {
+            fprintf(stderr, "Fault daemon %s unavailable (%d), using in-process handler\n",
+                    daemon, ret);
+        }
     }
-    g_preloader.preheat_time_ms = get_time_ms() - preheat_start;
     
-    /* 创建 UFFD 处理器 */
-    g_preloader.uffd_handler = uffd_handler_create(g_preloader.bigcache);
-    if (!g_preloader.uffd_handler) {
-        fprintf(stderr, "Failed to create UFFD handler\n");
-        bigcache_destroy(g_preloader.bigcache);
-        g_preloader.bigcache = NULL;
-        g_preloader.enabled = 0;
-        g_preloader.initialized = 1;
-        pthread_mutex_unlock(&g_preloader.lock);
-        return -ENOMEM;
+    /* 预热 BigCache（异步初始化时在最后交给后台线程）*/
+    if (g_preloader.from_broker || g_preloader.use_daemon) {
+        /* 代理已读入并锁定全部页，或由服务进程提供页，映射只需按需建立页表 */
+        g_preloader.bigcache->is_preheated = 1;
+        g_preloader.preheat_slots = g_preloader.bigcache->header.num_pages;
+    } else if (!g_preloader.async_init) {
+        double preheat_start = get_time_ms();
+        ret = bigcache_preheat(g_preloader.bigcache);
+        if (ret < 0) {
+            fprintf(stderr, "Failed to preheat BigCache: %d\n", ret);
+        }
+        g_preloader.preheat_time_ms = get_time_ms() - preheat_start;
     }
     
-    /* 配置 UFFD 处理器 */
-    UffdConfig config = {
-        .enable_zero_fill = 1,
-        .enable_stats = 1,
-        .enable_logging = g_preloader.verbose,
-        .handler_priority = -10,  /* 高优先级 */
-        .prefetch_ahead = 8
-    };
-    uffd_handler_set_config(g_preloader.uffd_handler, &config);
+    /* 创建并启动进程内 UFFD 处理器 */
+    if (!g_preloader.use_daemon) {
+        ret = start_uffd_handler();
+        if (ret < 0) {
+            bigcache_destroy(g_preloader.bigcache);
+            g_preloader.bigcache = NULL;
+            g_preloader.enabled = 0;
+            g_preloader.initialized = 1;
+            pthread_mutex_unlock(&g_preloader.lock);
+            return ret;
+        }
+    }
     
-    /* 启动 UFFD 处理器 */
-    ret = uffd_handler_start(g_preloader.uffd_handler);
-    if (ret < 0) {
-        fprintf(stderr, "Failed to start UFFD handler: %d\n", ret);
-        uffd_handler_destroy(g_preloader.uffd_handler);
-        bigcache_destroy(g_preloader.bigcache);
-        g_preloader.uffd_handler = NULL;
-        g_preloader.bigcache = NULL;
-        g_preloader.enabled = 0;
-        g_preloader.initialized = 1;
-        pthread_mutex_unlock(&g_preloader.lock);
-        return ret;
+    /* fd 表按路径判定是否在 BigCache 中，失败时所有 fd 都回退 readlink */
+    if (build_file_hash(g_preloader.bigcache) < 0) {
+        fprintf(stderr, "Failed to build file hash, mmap falls back to /proc lookups\n");
+    }
+    
+    __atomic_store_n(&g_preloader.file_written,
+                     calloc(g_preloader.bigcache->header.num_files, 1), __ATOMIC_RELEASE);
+    
+    if (want_dlopen_prefetch) {
+        uint8_t *prefetched = calloc(g_preloader.bigcache->header.num_files, 1);
+        pthread_mutex_lock(&g_preloader.dlopen_lock);
+        g_preloader.dlopen_prefetched = prefetched;
+        g_preloader.dlopen_prefetch = prefetched != NULL;
+        pthread_mutex_unlock(&g_preloader.dlopen_lock);
     }
     
     /* 保存原始函数指针 */
@@ -186,12 +591,79 @@ int preloader_init(const char *bigcache_path) {
     g_preloader.original_munmap = dlsym(RTLD_NEXT, "munmap");
     g_preloader.original_dlopen = dlsym(RTLD_NEXT, "dlopen");
     
+    if (g_preloader.async_init && !g_preloader.from_broker && !g_preloader.use_daemon) {
+        ret = pthread_create(&g_preloader.preheat_thread, NULL, preheat_thread_main,
+                             g_preloader.bigcache);
+        if (ret == 0) {
+            g_preloader.preheat_running = 1;
+        } else {
+            /* 没有后台线程时所有映射都不会就绪，退回同步预热 */
+            fprintf(stderr, "Failed to start preheat thread: %d, preheating now\n", ret);
+            bigcache_preheat(g_preloader.bigcache);
+            g_preloader.preheat_slots = g_preloader.bigcache->header.num_pages;
+        }
+    }
+    
+    const char *residency = getenv("BIGCACHE_RESIDENCY");
+    if ((!residency || atoi(residency)) && !g_preloader.from_broker && !g_preloader.use_daemon) {
+        ResidencyConfig config;
+        residency_default_config(&config);
+        const char *psi_path = getenv("BIGCACHE_PSI_PATH");
+        const char *startup_ms = getenv("BIGCACHE_STARTUP_MS");
+        const char *psi_some = getenv("BIGCACHE_PSI_SOME");
+        const char *psi_full = getenv("BIGCACHE_PSI_FULL");
+        const char *poll_ms = getenv("BIGCACHE_RESIDENCY_POLL_MS");
+        if (psi_path) snprintf(config.psi_path, sizeof(config.psi_path), "%s", psi_path);
+        if (startup_ms) config.startup_ms = atoi(startup_ms);
+        if (psi_some) config.some_threshold = atof(psi_some);
+        if (psi_full) config.full_threshold = atof(psi_full);
+        if (poll_ms) config.poll_ms = atoi(poll_ms);
+        
+        g_preloader.residency = residency_create(g_preloader.bigcache, &config);
+        if (g_preloader.residency && residency_start(g_preloader.residency) < 0) {
+            fprintf(stderr, "Failed to start residency manager, cache stays locked\n");
+            residency_destroy(g_preloader.residency);
+            g_preloader.residency = NULL;
+        }
+    }
+    
+    const char *handback_ms = getenv("BIGCACHE_HANDBACK_MS");
+    g_preloader.handback_ms = handback_ms ? atoi(handback_ms) : 0;
+    if (g_preloader.handback_ms > 0) {
+        g_preloader.handback_stop = 0;
+        if (pthread_create(&g_preloader.handback_thread, NULL, handback_thread_main, NULL) == 0) {
+            g_preloader.handback_running = 1;
+        } else {
+            fprintf(stderr, "Failed to start handback timer, mappings stay on UFFD\n");
+        }
+    }
+    
     double total_time = get_time_ms() - start_time;
     
     printf("\n=== Preloader Initialized ===\n");
-    printf("BigCache: %s\n", g_preloader.bigcache_path);
+    if (g_preloader.from_broker) {
+        printf("BigCache: shared memfd from broker %s\n", getenv("BIGCACHE_BROKER"));
+    } else {
+        printf("BigCache: %s\n", g_preloader.bigcache_path);
+    }
+    if (g_preloader.use_daemon) {
+        printf("Faults: served by daemon %s\n", getenv("BIGCACHE_DAEMON"));
+    }
     printf("Init time: %.2f ms\n", g_preloader.init_time_ms);
-    printf("Preheat time: %.2f ms\n", g_preloader.preheat_time_ms);
+    if (g_preloader.preheat_running) {
+        printf("Preheat time: in background\n");
+    } else {
+        printf("Preheat time: %.2f ms\n", g_preloader.preheat_time_ms);
+    }
+    if (g_preloader.residency) {
+        printf("Residency: startup %d ms, PSI %s (some >= %.1f, full >= %.1f)\n",
+               g_preloader.residency->config.startup_ms, g_preloader.residency->config.psi_path,
+               g_preloader.residency->config.some_threshold,
+               g_preloader.residency->config.full_threshold);
+    }
+    if (g_preloader.handback_running) {
+        printf("Handback: after %d ms\n", g_preloader.handback_ms);
+    }
     printf("Total time: %.2f ms\n", total_time);
     printf("=============================\n\n");
     
@@ -212,19 +684,94 @@ void preloader_cleanup(void) {
     
     printf("\n=== Preloader Cleanup ===\n");
     
+    if (g_preloader.preheat_running) {
+        __atomic_store_n(&g_preloader.preheat_stop, 1, __ATOMIC_RELEASE);
+        pthread_join(g_preloader.preheat_thread, NULL);
+        g_preloader.preheat_running = 0;
+        printf("Background preheat: %u/%u pages, %d mappings not ready\n",
+               g_preloader.preheat_slots, g_preloader.bigcache->header.num_pages,
+               g_preloader.not_ready_count);
+    }
+    
+    /* 计时线程可能正在换回，等它结束后处理器和服务进程连接才能销毁 */
+    if (g_preloader.handback_running) {
+        pthread_mutex_lock(&g_preloader.handback_lock);
+        g_preloader.handback_stop = 1;
+        pthread_cond_signal(&g_preloader.handback_cond);
+        pthread_mutex_unlock(&g_preloader.handback_lock);
+        pthread_join(g_preloader.handback_thread, NULL);
+        g_preloader.handback_running = 0;
+    }
+    if (g_preloader.handed_back) {
+        UffdHandbackStats *hb = &g_preloader.handback_stats;
+        printf("Handback: %llu regions (%.2f MB) back on files, %.2f MB anonymous freed, "
+               "%llu kept, %llu failed in %.2f ms\n",
+               (unsigned long long)hb->regions,
+               (double)hb->pages * PAGE_SIZE / (1024 * 1024),
+               (double)hb->anon_pages * PAGE_SIZE / (1024 * 1024),
+               (unsigned long long)hb->kept, (unsigned long long)hb->failed, hb->ms);
+    }
+    
+    /* 驻留管理线程会访问 BigCache 映射，先于 BigCache 销毁停止 */
+    if (g_preloader.residency) {
+        residency_stop(g_preloader.residency);
+        residency_print_stats(g_preloader.residency);
+        residency_destroy(g_preloader.residency);
+        g_preloader.residency = NULL;
+    }
+    
     /* 打印统计 */
     printf("Intercepted: %d calls, %.2f MB\n",
            g_preloader.intercepted_count,
            (double)g_preloader.total_intercepted_size / (1024*1024));
     printf("Bypassed: %d calls\n", g_preloader.bypassed_count);
+    printf("Coverage: %d full, %d overlay (%d windows), %d left to kernel\n",
+           g_preloader.intercepted_count - g_preloader.partial_count,
+           g_preloader.partial_count, g_preloader.overlay_windows,
+           g_preloader.coverage_left_count);
+    printf("fd table: %d hits, %d /proc lookups\n",
+           g_preloader.fd_table_hits, g_preloader.fd_proc_lookups);
+    printf("read hooks: %d served (%.2f MB), %d passed through\n",
+           g_preloader.reads_served,
+           (double)g_preloader.read_bytes_served / (1024 * 1024),
+           g_preloader.reads_passed);
+    
+    pthread_mutex_lock(&g_preloader.dlopen_lock);
+    if (g_preloader.num_dlopen_stats > 0) {
+        printf("dlopen (prefetch %s):\n", g_preloader.dlopen_prefetch ? "on" : "off");
+        for (int i = 0; i < g_preloader.num_dlopen_stats; i++) {
+            DlopenStat *d = &g_preloader.dlopen_stats[i];
+            printf("  %-40s %8.2f ms  %zu pages prefetched in %.2f ms\n",
+                   d->name, d->ms, d->prefetched_pages, d->prefetch_ms);
+        }
+    }
+    g_preloader.dlopen_prefetch = 0;
+    free(g_preloader.dlopen_prefetched);
+    g_preloader.dlopen_prefetched = NULL;
+    pthread_mutex_unlock(&g_preloader.dlopen_lock);
     
     if (g_preloader.uffd_handler) {
-        uffd_handler_print_stats(g_preloader.uffd_handler);
-        uffd_handler_stop(g_preloader.uffd_handler);
-        uffd_handler_destroy(g_preloader.uffd_handler);
+        /* 先摘下处理器，销毁过程中的 munmap 不再经 hook 访问它 */
+        UffdHandler *handler = g_preloader.uffd_handler;
         g_preloader.uffd_handler = NULL;
+        uffd_handler_print_stats(handler);
+        uffd_handler_stop(handler);
+        uffd_handler_destroy(handler);
     }
     
+    if (g_preloader.use_daemon) {
+        g_preloader.use_daemon = 0;
+        printf("Fault daemon: %d regions registered, %d refused\n",
+               g_preloader.fault_daemon.regions.count, g_preloader.fault_daemon.refused);
+        fault_daemon_disconnect(&g_preloader.fault_daemon);
+    }
+    
+    /* 先撤下哈希，之后的 open 不再查 BigCache 文件表 */
+    int32_t *file_hash = __atomic_exchange_n(&g_preloader.file_hash, NULL, __ATOMIC_ACQ_REL);
+    free(file_hash);
+    memset(g_fd_table, 0, sizeof(g_fd_table));
+    free(__atomic_exchange_n(&g_preloader.file_written, NULL, __ATOMIC_ACQ_REL));
+    
     if (g_preloader.bigcache) {
         bigcache_print_stats(g_preloader.bigcache);
         bigcache_destroy(g_preloader.bigcache);
@@ -243,11 +790,40 @@ void preloader_cleanup(void) {
  * 拦截文件映射，对于在 BigCache 中的文件，
  * 创建 UFFD 保护的匿名映射替代
  */
+static void* map_cached(void *addr, size_t length, int prot, int flags,
+                        int fd, off_t offset, const char *pathname, int file_id);
+
+/* 缺页由进程内处理器或服务进程提供 */
+static int uffd_ready(void) {
+    /* 换回之后启动已结束，新的映射不再拦截 */
+    if (__atomic_load_n(&g_preloader.handed_back, __ATOMIC_ACQUIRE)) return 0;
+    return g_preloader.uffd_handler || g_preloader.use_daemon;
+}
+
+static void* overlay_region(void *addr, size_t size, const char *pathname, int file_id,
+                            off_t offset, int prot) {
+    if (g_preloader.use_daemon) {
+        return fault_daemon_map(&g_preloader.fault_daemon, addr, size, pathname,
+                                file_id, offset, prot);
+    }
+    return uffd_handler_overlay_mapping(g_preloader.uffd_handler, addr, size,
+                                        pathname, offset, prot);
+}
+
+static void* create_region(size_t size, const char *pathname, int file_id,
+                           off_t offset, int prot) {
+    if (g_preloader.use_daemon) {
+        return fault_daemon_map(&g_preloader.fault_daemon, NULL, size, pathname,
+                                file_id, offset, prot);
+    }
+    return uffd_handler_create_mapping(g_preloader.uffd_handler, size, pathname, offset, prot);
+}
+
 void* preloader_mmap(void *addr, size_t length, int prot, int flags,
                      int fd, off_t offset, const char *pathname) {
     /* 检查是否应该拦截 */
     if (!g_preloader.enabled || 
-        !g_preloader.uffd_handler ||
+        !uffd_ready() ||
         !(flags & MAP_PRIVATE) ||
         !pathname ||
         !should_intercept(pathname)) {
@@ -260,23 +836,138 @@ void* preloader_mmap(void *addr, size_t length, int prot, int flags,
         return g_preloader.original_mmap(addr, length, prot, flags, fd, offset);
     }
     
-    /* 检查页面是否在 BigCache 中 */
-    uint64_t bc_offset;
-    int found = bigcache_lookup_offset(g_preloader.bigcache, 
-                                       pathname, offset, &bc_offset);
-    if (found < 0) {
-        /* BigCache 中没有这个页面，使用原始 mmap */
+    return map_cached(addr, length, prot, flags, fd, offset, pathname, -1);
+}
+
+/*
+ * 覆盖映射：按原文件映射，再把有缓存的热区间逐段以 MAP_FIXED 覆盖为 UFFD 窗口，
+ * 窗口外的冷页仍由内核从文件读取。单个窗口失败时该段保持文件映射
+ */
+static void* map_overlay(void *addr, size_t length, int prot, int flags,
+                         int fd, off_t offset, const char *pathname, int file_id) {
+    void *result = g_preloader.original_mmap(addr, length, prot, flags, fd, offset);
+    if (result == MAP_FAILED) return result;
+    
+    uint64_t npages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t page = 0;
+    int windows = 0;
+    int not_ready = 0;
+    size_t hot_size = 0;
+    struct timespec deadline = {0};
+    
+    while (page < npages) {
+        /* 找下一个热区间，合并不超过 overlay_gap 页的空洞 */
+        while (page < npages &&
+               !bigcache_page_cached(g_preloader.bigcache, file_id, offset + page * PAGE_SIZE)) {
+            page++;
+        }
+        if (page == npages) break;
+        
+        uint64_t first = page, last = page;
+        while (page < npages && page - last <= (uint64_t)g_preloader.overlay_gap) {
+            if (bigcache_page_cached(g_preloader.bigcache, file_id, offset + page * PAGE_SIZE)) {
+                last = page;
+            }
+            page++;
+        }
+        page = last + 1;
+        
+        /* 后台预热还没到这个窗口，该段先保持文件映射 */
+        if (!wait_range_ready(file_id, offset + first * PAGE_SIZE,
+                              (last + 1 - first) * PAGE_SIZE, &deadline)) {
+            not_ready++;
+            continue;
+        }
+        
+        void *window = overlay_region((char *)result + first * PAGE_SIZE,
+                                      (last + 1 - first) * PAGE_SIZE, pathname, file_id,
+                                      offset + first * PAGE_SIZE, prot);
+        if (window == MAP_FAILED) {
+            if (g_preloader.verbose) {
+                printf("[Preloader] UFFD overlay failed, file-backed: %s pages %lu-%lu\n",
+                       pathname, (unsigned long)first, (unsigned long)last);
+            }
+            continue;
+        }
+        
+        windows++;
+        hot_size += (last + 1 - first) * PAGE_SIZE;
+    }
+    
+    if (not_ready) {
+        if (g_preloader.verbose > 1) {
+            printf("[Preloader] Not ready: %s offset=%ld, %d windows left file-backed\n",
+                   pathname, (long)offset, not_ready);
+        }
+        g_preloader.not_ready_count++;
+    }
+    
+    if (windows == 0) {
+        g_preloader.bypassed_count++;
+        return result;
+    }
+    
+    if (g_preloader.verbose) {
+        printf("[Preloader] Overlay: %s, len=%zu, offset=%ld, %d windows, %zu hot KB -> 0x%lx\n",
+               pathname, length, (long)offset, windows, hot_size / 1024,
+               (unsigned long)result);
+    }
+    
+    g_preloader.intercepted_count++;
+    g_preloader.partial_count++;
+    g_preloader.overlay_windows += windows;
+    g_preloader.total_intercepted_size += hot_size;
+    
+    return result;
+}
+
+/* 文件已确定需要拦截：按映射范围的缓存覆盖率选择整体拦截、覆盖热区间或不拦截 */
+static void* map_cached(void *addr, size_t length, int prot, int flags,
+                        int fd, off_t offset, const char *pathname, int file_id) {
+    if (file_id < 0) {
+        file_id = bigcache_find_file(g_preloader.bigcache, pathname);
+        
+        struct stat st;
+        if (file_id >= 0 && (fstat(fd, &st) < 0 || !file_unchanged(file_id, &st))) {
+            file_id = -1;
+        }
+    }
+    
+    size_t cached = file_id >= 0 ?
+                    bigcache_count_cached(g_preloader.bigcache, file_id, offset, length) : 0;
+    double coverage = (double)cached * PAGE_SIZE / length;
+    
+    if (cached == 0 || coverage < g_preloader.coverage_partial) {
+        /* 缓存页太少，拦截得不偿失，使用原始 mmap */
+        if (g_preloader.verbose > 1) {
+            printf("[Preloader] Low coverage %.2f: %s offset=%ld\n",
+                   coverage, pathname, (long)offset);
+        }
+        g_preloader.bypassed_count++;
+        g_preloader.coverage_left_count++;
+        return g_preloader.original_mmap(addr, length, prot, flags, fd, offset);
+    }
+    
+    /* 覆盖映射按窗口判定预热是否就绪 */
+    if (g_preloader.hybrid || coverage < g_preloader.coverage_full) {
+        return map_overlay(addr, length, prot, flags, fd, offset, pathname, file_id);
+    }
+    
+    struct timespec deadline = {0};
+    if (!wait_range_ready(file_id, offset, length, &deadline)) {
+        /* 后台预热还没到这段映射，先按原文件映射 */
         if (g_preloader.verbose > 1) {
-            printf("[Preloader] Miss BigCache: %s offset=%ld\n", 
-                   pathname, (long)offset);
+            printf("[Preloader] Not ready: %s offset=%ld\n", pathname, (long)offset);
         }
         g_preloader.bypassed_count++;
+        g_preloader.not_ready_count++;
         return g_preloader.original_mmap(addr, length, prot, flags, fd, offset);
     }
     
-    /* 创建 UFFD 保护的映射 */
-    void *result = uffd_handler_create_mapping(g_preloader.uffd_handler,
-                                               length, pathname, offset, prot);
+    /* 创建 UFFD 保护的映射，MAP_FIXED 时必须落在调用者指定的地址 */
+    void *result = (flags & MAP_FIXED) ?
+                   overlay_region(addr, length, pathname, file_id, offset, prot) :
+                   create_region(length, pathname, file_id, offset, prot);
     
     if (result == MAP_FAILED) {
         /* 失败，回退到原始 mmap */
@@ -289,8 +980,8 @@ void* preloader_mmap(void *addr, size_t length, int prot, int flags,
     
     /* 成功 */
     if (g_preloader.verbose) {
-        printf("[Preloader] Intercepted: %s, len=%zu, offset=%ld -> 0x%lx\n",
-               pathname, length, (long)offset, (unsigned long)result);
+        printf("[Preloader] Intercepted: %s, len=%zu, offset=%ld, coverage=%.2f -> 0x%lx\n",
+               pathname, length, (long)offset, coverage, (unsigned long)result);
     }
     
     g_preloader.intercepted_count++;
@@ -310,6 +1001,11 @@ void preloader_get_stats(int *intercepted, int *bypassed,
     if (init_time) *init_time = g_preloader.init_time_ms + g_preloader.preheat_time_ms;
 }
 
+/* 异步初始化时因预热未到达而交给内核的映射数 */
+int preloader_not_ready_count(void) {
+    return g_preloader.not_ready_count;
+}
+
 /*
  * 检查预加载器是否启用
  */
@@ -324,6 +1020,42 @@ BigCacheContext* preloader_get_bigcache(void) {
     return g_preloader.bigcache;
 }
 
+/*
+ * 应用通知启动完成：驻留管理器不再等待 BIGCACHE_STARTUP_MS，立即释放已服务的页
+ */
+void preloader_startup_complete(void) {
+    residency_startup_done(g_preloader.residency);
+}
+
+/*
+ * 把拦截的映射换回原文件映射并释放匿名副本，只执行一次，返回换回的区域数。
+ * 换回意味着启动已结束，同时通知驻留管理器
+ */
+int preloader_handback(void) {
+    pthread_mutex_lock(&g_preloader.handback_lock);
+    if (g_preloader.handed_back || !g_preloader.enabled) {
+        pthread_mutex_unlock(&g_preloader.handback_lock);
+        return 0;
+    }
+    __atomic_store_n(&g_preloader.handed_back, 1, __ATOMIC_RELEASE);
+    
+    int ret = 0;
+    if (g_preloader.use_daemon) {
+        ret = fault_daemon_handback(&g_preloader.fault_daemon, &g_preloader.handback_stats);
+    } else if (g_preloader.uffd_handler) {
+        ret = uffd_handler_handback(g_preloader.uffd_handler, &g_preloader.handback_stats);
+    }
+    pthread_mutex_unlock(&g_preloader.handback_lock);
+    
+    residency_startup_done(g_preloader.residency);
+    
+    if (g_preloader.verbose) {
+        printf("[Preloader] Handed back %d regions in %.2f ms\n", ret,
+               g_preloader.handback_stats.ms);
+    }
+    return ret;
+}
+
 /*
  * 获取 UFFD 处理器
  */
@@ -355,8 +1087,170 @@ static void preloader_destructor(void) {
  */
 
 #ifdef ENABLE_MMAP_HOOK
+/* 按路径查 file_id，不在 BigCache 中返回 FD_NOT_CACHED，哈希尚未建立返回 FD_UNKNOWN */
+static int find_cached_file(const char *path) {
+    int32_t *table = __atomic_load_n(&g_preloader.file_hash, __ATOMIC_ACQUIRE);
+    if (!table) return FD_UNKNOWN;
+    
+    uint32_t slot = hash_path(path) & g_preloader.file_hash_mask;
+    while (table[slot] >= 0) {
+        if (strcmp(g_preloader.bigcache->file_table[table[slot]].path, path) == 0) {
+            return table[slot];
+        }
+        slot = (slot + 1) & g_preloader.file_hash_mask;
+    }
+    return FD_NOT_CACHED;
+}
+
+/* open 成功后记录 fd */
+static void fd_table_open(int fd, const char *path, int flags) {
+    if (fd < 0 || fd >= PRELOADER_MAX_FDS) return;
+    
+    FdEntry *e = &g_fd_table[fd];
+    int file_id = path && path[0] == '/' ? find_cached_file(path) : FD_UNKNOWN;
+    
+    /*
+     * 打开路径可能经过符号链接（/lib -> usr/lib、/data/user/0 -> /data/data），
+     * 未命中时取内核解析后的规范路径再查一次，结果才能记为 FD_NOT_CACHED
+     */
+    if (file_id == FD_NOT_CACHED) {
+        char proc_path[64];
+        char real_path[512];
+        snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+        ssize_t len = readlink(proc_path, real_path, sizeof(real_path) - 1);
+        __atomic_fetch_add(&g_preloader.fd_proc_lookups, 1, __ATOMIC_RELAXED);
+        if (len <= 0 || len == (ssize_t)sizeof(real_path) - 1) {
+            file_id = FD_UNKNOWN;
+        } else {
+            real_path[len] = '\0';
+            if (strcmp(real_path, path) != 0) file_id = find_cached_file(real_path);
+        }
+    }
+    
+    /* 不可读的 fd 不能由 BigCache 服务 read，mmap 也会失败 */
+    if (file_id >= 0 && ((flags & O_ACCMODE) == O_WRONLY || (flags & O_PATH))) {
+        file_id = FD_NOT_CACHED;
+    }
+    
+    struct stat st;
+    if (file_id != FD_UNKNOWN && fstat(fd, &st) < 0) {
+        file_id = FD_UNKNOWN;
+    }
+    if (file_id >= 0 && !file_unchanged(file_id, &st)) {
+        file_id = FD_NOT_CACHED;
+    }
+    
+    e->read_only = (flags & O_ACCMODE) == O_RDONLY;
+    if (file_id == FD_UNKNOWN) {
+        __atomic_store_n(&e->file, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    __atomic_store_n(&e->file, file_id >= 0 ? file_id + 1 : -1, __ATOMIC_RELEASE);
+}
+
+static void fd_table_close(int fd) {
+    if (fd >= 0 && fd < PRELOADER_MAX_FDS) {
+        __atomic_store_n(&g_fd_table[fd].file, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static void fd_table_dup(int oldfd, int newfd) {
+    if (newfd < 0 || newfd >= PRELOADER_MAX_FDS) return;
+    
+    if (oldfd < 0 || oldfd >= PRELOADER_MAX_FDS) {
+        fd_table_close(newfd);
+        return;
+    }
+    
+    FdEntry *src = &g_fd_table[oldfd];
+    FdEntry *dst = &g_fd_table[newfd];
+    dst->read_only = src->read_only;
+    dst->dev = src->dev;
+    dst->ino = src->ino;
+    __atomic_store_n(&dst->file, __atomic_load_n(&src->file, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+}
+
+/* mmap 时查询：返回 file_id、FD_NOT_CACHED 或 FD_UNKNOWN */
+static int fd_table_lookup_stat(int fd, struct stat *st) {
+    if (fd < 0 || fd >= PRELOADER_MAX_FDS) return FD_UNKNOWN;
+    
+    FdEntry *e = &g_fd_table[fd];
+    int file = __atomic_load_n(&e->file, __ATOMIC_ACQUIRE);
+    if (file == 0) return FD_UNKNOWN;
+    
+    /* 不在 BigCache 中的表项同样可能因 fd 号被复用而过期，一并校验 */
+    if (fstat(fd, st) < 0 || st->st_dev != e->dev || st->st_ino != e->ino) {
+        return FD_UNKNOWN;
+    }
+    if (file < 0) return FD_NOT_CACHED;
+    if (!file_unchanged(file - 1, st)) {
+        /* 打开之后文件被改写，之后不再服务 */
+        __atomic_store_n(&e->file, -1, __ATOMIC_RELEASE);
+        return FD_NOT_CACHED;
+    }
+    return file - 1;
+}
+
+/*
+ * 写类调用之前：fd 指向 BigCache 中的文件时，该文件所有 fd 都不再由 BigCache 服务。
+ * 其他进程的写入由 file_unchanged 的 mtime 比较发现
+ */
+static void fd_table_write(int fd) {
+    if (fd < 0 || fd >= PRELOADER_MAX_FDS) return;
+    
+    FdEntry *e = &g_fd_table[fd];
+    int file = __atomic_load_n(&e->file, __ATOMIC_ACQUIRE);
+    if (file <= 0) return;
+    
+    uint8_t *written = __atomic_load_n(&g_preloader.file_written, __ATOMIC_ACQUIRE);
+    if (written) __atomic_store_n(&written[file - 1], 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->file, -1, __ATOMIC_RELEASE);
+}
+
+static int fd_table_lookup(int fd) {
+    struct stat st;
+    return fd_table_lookup_stat(fd, &st);
+}
+
+/* munmap、MAP_FIXED 覆盖前移除范围内的 UFFD 区域 */
+static void unregister_range(void *addr, size_t length) {
+    if (g_preloader.use_daemon) {
+        fault_daemon_unmap_range(&g_preloader.fault_daemon, addr, length);
+    } else if (g_preloader.uffd_handler) {
+        uffd_handler_unregister_range(g_preloader.uffd_handler, addr, length);
+    }
+}
+
 /* 这个版本用于 LD_PRELOAD */
 void* mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    /* 初始化过程中（加载 BigCache 等）就会调用到这里 */
+    if (!g_preloader.original_mmap) {
+        g_preloader.original_mmap = dlsym(RTLD_NEXT, "mmap");
+    }
+    
+    /* MAP_FIXED 会替换原有映射，先移除其中的 UFFD 区域 */
+    if (flags & MAP_FIXED) {
+        unregister_range(addr, length);
+    }
+    
+    /* fd 表已知时直接判定 */
+    if (fd >= 0 && g_preloader.enabled && uffd_ready()) {
+        int file_id = fd_table_lookup(fd);
+        if (file_id != FD_UNKNOWN) {
+            __atomic_fetch_add(&g_preloader.fd_table_hits, 1, __ATOMIC_RELAXED);
+            if (file_id == FD_NOT_CACHED || !(flags & MAP_PRIVATE)) {
+                g_preloader.bypassed_count++;
+                return g_preloader.original_mmap(addr, length, prot, flags, fd, offset);
+            }
+            return map_cached(addr, length, prot, flags, fd, offset,
+                              g_preloader.bigcache->file_table[file_id].path, file_id);
+        }
+    }
+    
     /* 获取文件路径 */
     char path[512] = "";
     if (fd >= 0) {
@@ -364,17 +1258,406 @@ void* mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
         snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
         ssize_t len = readlink(proc_path, path, sizeof(path) - 1);
         if (len > 0) path[len] = '\0';
+        __atomic_fetch_add(&g_preloader.fd_proc_lookups, 1, __ATOMIC_RELAXED);
     }
     
     return preloader_mmap(addr, length, prot, flags, fd, offset, 
                           path[0] ? path : NULL);
 }
 
+/*
+ * fd 表维护
+ * 原始函数按需解析：这些 hook 可能在预加载器初始化之前就被调用
+ */
+static void* resolve_next(void **slot, const char *name) {
+    void *fn = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (!fn) {
+        fn = dlsym(RTLD_NEXT, name);
+        __atomic_store_n(slot, fn, __ATOMIC_RELEASE);
+    }
+    return fn;
+}
+
+static void *g_next_open, *g_next_open64, *g_next_openat, *g_next_openat64;
+static void *g_next_close, *g_next_dup, *g_next_dup2, *g_next_dup3;
+static void *g_next_read, *g_next_pread, *g_next_pread64;
+static void *g_next_readv, *g_next_preadv, *g_next_preadv64;
+static void *g_next_write, *g_next_pwrite, *g_next_pwrite64;
+static void *g_next_writev, *g_next_pwritev, *g_next_pwritev64;
+static void *g_next_ftruncate, *g_next_ftruncate64;
+
+/* O_CREAT / O_TMPFILE 时才有 mode 参数 */
+static int open_has_mode(int flags) {
+#ifdef O_TMPFILE
+    if ((flags & O_TMPFILE) == O_TMPFILE) return 1;
+#endif
+    return (flags & O_CREAT) != 0;
+}
+
+#define OPEN_MODE_ARG(flags, mode) do { \
+    if (open_has_mode(flags)) { \
+        va_list ap; \
+        va_start(ap, flags); \
+        mode = (mode_t)va_arg(ap, int); \
+        va_end(ap); \
+    } \
+} while (0)
+
+int open(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    OPEN_MODE_ARG(flags, mode);
+    int (*next)(const char*, int, ...) = resolve_next(&g_next_open, "open");
+    int fd = next(path, flags, mode);
+    fd_table_open(fd, path, flags);
+    return fd;
+}
+
+int open64(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    OPEN_MODE_ARG(flags, mode);
+    int (*next)(const char*, int, ...) = resolve_next(&g_next_open64, "open64");
+    int fd = next(path, flags, mode);
+    fd_table_open(fd, path, flags);
+    return fd;
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+    mode_t mode = 0;
+    OPEN_MODE_ARG(flags, mode);
+    int (*next)(int, const char*, int, ...) = resolve_next(&g_next_openat, "openat");
+    int fd = next(dirfd, path, flags, mode);
+    fd_table_open(fd, path, flags);
+    return fd;
+}
+
+int openat64(int dirfd, const char *path, int flags, ...) {
+    mode_t mode = 0;
+    OPEN_MODE_ARG(flags, mode);
+    int (*next)(int, const char*, int, ...) = resolve_next(&g_next_openat64, "openat64");
+    int fd = next(dirfd, path, flags, mode);
+    fd_table_open(fd, path, flags);
+    return fd;
+}
+
+int close(int fd) {
+    int (*next)(int) = resolve_next(&g_next_close, "close");
+    fd_table_close(fd);
+    return next(fd);
+}
+
+int dup(int oldfd) {
+    int (*next)(int) = resolve_next(&g_next_dup, "dup");
+    int fd = next(oldfd);
+    if (fd >= 0) fd_table_dup(oldfd, fd);
+    return fd;
+}
+
+int dup2(int oldfd, int newfd) {
+    int (*next)(int, int) = resolve_next(&g_next_dup2, "dup2");
+    int fd = next(oldfd, newfd);
+    if (fd >= 0 && fd != oldfd) fd_table_dup(oldfd, fd);
+    return fd;
+}
+
+int dup3(int oldfd, int newfd, int flags) {
+    int (*next)(int, int, int) = resolve_next(&g_next_dup3, "dup3");
+    int fd = next(oldfd, newfd, flags);
+    if (fd >= 0) fd_table_dup(oldfd, fd);
+    return fd;
+}
+
+/*
+ * read 类 hook
+ *
+ * fd 表命中 BigCache 的文件，请求范围内的页全部在 BigCache 中时直接从 BigCache
+ * 映射复制，否则交给原函数。只整段服务不返回短读（SQLite 等把短读当作文件截断）。
+ * 只服务 O_RDONLY 打开的 fd；文件与打包时不同或被写过时 fd_table_lookup_stat 不再返回 file_id
+ */
+#define READ_PASS (-2)
+
+static ssize_t serve_cached_read(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    BigCacheContext *bc = g_preloader.bigcache;
+    if (!g_preloader.enabled || !bc || offset < 0 || iovcnt < 0) return READ_PASS;
+    
+    struct stat st;
+    int file_id = fd_table_lookup_stat(fd, &st);
+    if (file_id < 0) return READ_PASS;
+    
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+    
+    if (offset >= st.st_size) return 0;
+    if (total > (uint64_t)(st.st_size - offset)) total = st.st_size - offset;
+    if (total == 0) return 0;
+    
+    /* 先确认所有页都在 BigCache 中 */
+    for (uint64_t page = offset & ~(uint64_t)(PAGE_SIZE - 1); page < offset + total;
+         page += PAGE_SIZE) {
+        if (!bigcache_file_page(bc, file_id, page)) {
+            __atomic_fetch_add(&g_preloader.reads_passed, 1, __ATOMIC_RELAXED);
+            return READ_PASS;
+        }
+    }
+    
+    uint64_t pos = offset;
+    size_t left = total;
+    for (int i = 0; i < iovcnt && left > 0; i++) {
+        uint8_t *dst = iov[i].iov_base;
+        size_t len = iov[i].iov_len < left ? iov[i].iov_len : left;
+        
+        while (len > 0) {
+            size_t in_page = PAGE_SIZE - pos % PAGE_SIZE;
+            size_t n = len < in_page ? len : in_page;
+            memcpy(dst, (const uint8_t*)bigcache_file_page(bc, file_id, pos) + pos % PAGE_SIZE, n);
+            dst += n;
+            pos += n;
+            len -= n;
+            left -= n;
+        }
+    }
+    
+    __atomic_fetch_add(&g_preloader.reads_served, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_preloader.read_bytes_served, total, __ATOMIC_RELAXED);
+    return total;
+}
+
+/*
+ * read/readv 从当前位置服务后推进文件位置。两次 lseek 不是原子的，
+ * 多线程在同一个 fd 上并发 read 时位置可能交错（pread 类不受影响）
+ */
+static ssize_t serve_cached_at_pos(int fd, const struct iovec *iov, int iovcnt) {
+    if (fd < 0 || fd >= PRELOADER_MAX_FDS || !g_fd_table[fd].read_only ||
+        __atomic_load_n(&g_fd_table[fd].file, __ATOMIC_ACQUIRE) <= 0) {
+        return READ_PASS;
+    }
+    
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0) return READ_PASS;
+    
+    ssize_t n = serve_cached_read(fd, iov, iovcnt, pos);
+    if (n > 0) lseek(fd, pos + n, SEEK_SET);
+    return n;
+}
+
+static ssize_t serve_cached_pread(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    if (fd < 0 || fd >= PRELOADER_MAX_FDS || !g_fd_table[fd].read_only ||
+        __atomic_load_n(&g_fd_table[fd].file, __ATOMIC_ACQUIRE) <= 0) {
+        return READ_PASS;
+    }
+    return serve_cached_read(fd, iov, iovcnt, offset);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    ssize_t (*next)(int, void*, size_t) = resolve_next(&g_next_read, "read");
+    struct iovec iov = { buf, count };
+    ssize_t n = serve_cached_at_pos(fd, &iov, 1);
+    return n != READ_PASS ? n : next(fd, buf, count);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    ssize_t (*next)(int, void*, size_t, off_t) = resolve_next(&g_next_pread, "pread");
+    struct iovec iov = { buf, count };
+    ssize_t n = serve_cached_pread(fd, &iov, 1, offset);
+    return n != READ_PASS ? n : next(fd, buf, count, offset);
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset) {
+    ssize_t (*next)(int, void*, size_t, off64_t) = resolve_next(&g_next_pread64, "pread64");
+    struct iovec iov = { buf, count };
+    ssize_t n = serve_cached_pread(fd, &iov, 1, offset);
+    return n != READ_PASS ? n : next(fd, buf, count, offset);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    ssize_t (*next)(int, const struct iovec*, int) = resolve_next(&g_next_readv, "readv");
+    ssize_t n = serve_cached_at_pos(fd, iov, iovcnt);
+    return n != READ_PASS ? n : next(fd, iov, iovcnt);
+}
+
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    ssize_t (*next)(int, const struct iovec*, int, off_t) = resolve_next(&g_next_preadv, "preadv");
+    ssize_t n = serve_cached_pread(fd, iov, iovcnt, offset);
+    return n != READ_PASS ? n : next(fd, iov, iovcnt, offset);
+}
+
+ssize_t preadv64(int fd, const struct iovec *iov, int iovcnt, off64_t offset) {
+    ssize_t (*next)(int, const struct iovec*, int, off64_t) =
+        resolve_next(&g_next_preadv64, "preadv64");
+    ssize_t n = serve_cached_pread(fd, iov, iovcnt, offset);
+    return n != READ_PASS ? n : next(fd, iov, iovcnt, offset);
+}
+
+/* 写类 hook：只登记文件已被改写，调用原样转发 */
+ssize_t write(int fd, const void *buf, size_t count) {
+    ssize_t (*next)(int, const void*, size_t) = resolve_next(&g_next_write, "write");
+    fd_table_write(fd);
+    return next(fd, buf, count);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    ssize_t (*next)(int, const void*, size_t, off_t) = resolve_next(&g_next_pwrite, "pwrite");
+    fd_table_write(fd);
+    return next(fd, buf, count, offset);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset) {
+    ssize_t (*next)(int, const void*, size_t, off64_t) =
+        resolve_next(&g_next_pwrite64, "pwrite64");
+    fd_table_write(fd);
+    return next(fd, buf, count, offset);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    ssize_t (*next)(int, const struct iovec*, int) = resolve_next(&g_next_writev, "writev");
+    fd_table_write(fd);
+    return next(fd, iov, iovcnt);
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    ssize_t (*next)(int, const struct iovec*, int, off_t) =
+        resolve_next(&g_next_pwritev, "pwritev");
+    fd_table_write(fd);
+    return next(fd, iov, iovcnt, offset);
+}
+
+ssize_t pwritev64(int fd, const struct iovec *iov, int iovcnt, off64_t offset) {
+    ssize_t (*next)(int, const struct iovec*, int, off64_t) =
+        resolve_next(&g_next_pwritev64, "pwritev64");
+    fd_table_write(fd);
+    return next(fd, iov, iovcnt, offset);
+}
+
+int ftruncate(int fd, off_t length) {
+    int (*next)(int, off_t) = resolve_next(&g_next_ftruncate, "ftruncate");
+    fd_table_write(fd);
+    return next(fd, length);
+}
+
+int ftruncate64(int fd, off64_t length) {
+    int (*next)(int, off64_t) = resolve_next(&g_next_ftruncate64, "ftruncate64");
+    fd_table_write(fd);
+    return next(fd, length);
+}
+
+#ifdef ENABLE_DLOPEN_HOOK
+/*
+ * dlopen hook（只在 make preloader-dlopen 构建的库中导出）
+ *
+ * 动态链接器内部的 open/mmap 不经过 hook，dlopen 的库总是由内核按原文件映射。
+ * 库在 BigCache 中时，先对原文件中有缓存的页区间发起 WILLNEED（只提交读请求，不等待），
+ * 链接器随后的缺页落在已读入或正在读入的页上，热页按一批大 I/O 读入而不是逐页缺页。
+ * 经 hook 转发后 glibc 以本库为调用者，调用者的 RUNPATH/$ORIGIN 不再参与搜索，
+ * Android 上也会落入本库所在的链接器命名空间，因此默认构建不拦截 dlopen
+ */
+#define DLOPEN_PREFETCH_GAP 16   /* 缓存区间之间不超过该页数的空洞并入同一次预取 */
+
+/* dlopen 参数 -> file_id：含 '/' 按真实路径查找，否则按文件名匹配文件表 */
+static int find_library(const char *name) {
+    BigCacheContext *bc = g_preloader.bigcache;
+    
+    if (strchr(name, '/')) {
+        char path[PATH_MAX];
+        if (!realpath(name, path)) return -1;
+        int file_id = find_cached_file(path);
+        return file_id >= 0 ? file_id : -1;
+    }
+    
+    for (uint32_t i = 0; i < bc->header.num_files; i++) {
+        const char *slash = strrchr(bc->file_table[i].path, '/');
+        if (strcmp(slash ? slash + 1 : bc->file_table[i].path, name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+/* 对原文件中有缓存的页区间发起 WILLNEED，返回覆盖的页数 */
+static size_t prefetch_library(int file_id) {
+    BigCacheContext *bc = g_preloader.bigcache;
+    const uint8_t *bitmap = bc->page_bitmaps[file_id];
+    uint32_t pages = bc->bitmap_pages[file_id];
+    size_t total = 0;
+    
+    int fd = open(bc->file_table[file_id].path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    
+    uint32_t page = 0;
+    while (page < pages) {
+        if (!((bitmap[page / 8] >> (page % 8)) & 1)) {
+            page++;
+            continue;
+        }
+        
+        /* 向后延伸区间，跨过不超过 DLOPEN_PREFETCH_GAP 页的空洞 */
+        uint32_t start = page, end = page + 1;
+        for (uint32_t p = end; p < pages && p <= end + DLOPEN_PREFETCH_GAP; p++) {
+            if ((bitmap[p / 8] >> (p % 8)) & 1) end = p + 1;
+        }
+        
+        posix_fadvise(fd, (off_t)start << PAGE_SHIFT, (off_t)(end - start) << PAGE_SHIFT,
+                      POSIX_FADV_WILLNEED);
+        total += end - start;
+        page = end;
+    }
+    
+    close(fd);
+    return total;
+}
+
+void* dlopen(const char *name, int flags) {
+    void* (*next)(const char*, int) =
+        resolve_next((void**)&g_preloader.original_dlopen, "dlopen");
+    size_t prefetched = 0;
+    double prefetch_ms = 0;
+    
+    if (!name || !g_preloader.enabled || !g_preloader.bigcache) return next(name, flags);
+    
+    /* 清理时在 dlopen_lock 下释放 dlopen_prefetched，查找和标记都在锁内完成 */
+    int file_id = -1;
+    pthread_mutex_lock(&g_preloader.dlopen_lock);
+    if (g_preloader.dlopen_prefetch && g_preloader.dlopen_prefetched) {
+        file_id = find_library(name);
+        if (file_id >= 0) {
+            if (g_preloader.dlopen_prefetched[file_id]) {
+                file_id = -1;
+            } else {
+                g_preloader.dlopen_prefetched[file_id] = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_preloader.dlopen_lock);
+    
+    if (file_id >= 0) {
+        double prefetch_start = get_time_ms();
+        prefetched = prefetch_library(file_id);
+        prefetch_ms = get_time_ms() - prefetch_start;
+    }
+    
+    double start = get_time_ms();
+    void *handle = next(name, flags);
+    double elapsed = get_time_ms() - start;
+    
+    pthread_mutex_lock(&g_preloader.dlopen_lock);
+    if (g_preloader.num_dlopen_stats < MAX_DLOPEN_STATS) {
+        DlopenStat *d = &g_preloader.dlopen_stats[g_preloader.num_dlopen_stats++];
+        snprintf(d->name, sizeof(d->name), "%s", name);
+        d->ms = elapsed;
+        d->prefetched_pages = prefetched;
+        d->prefetch_ms = prefetch_ms;
+    }
+    pthread_mutex_unlock(&g_preloader.dlopen_lock);
+    
+    if (g_preloader.verbose) {
+        printf("[Preloader] dlopen %s: %.2f ms, %zu pages prefetched\n", name, elapsed, prefetched);
+    }
+    return handle;
+}
+#endif /* ENABLE_DLOPEN_HOOK */
+
 int munmap(void *addr, size_t length) {
-    if (g_preloader.uffd_handler) {
-        /* 尝试从 UFFD 处理器移除 */
-        uffd_handler_unregister_region(g_preloader.uffd_handler, addr);
+    if (!g_preloader.original_munmap) {
+        g_preloader.original_munmap = dlsym(RTLD_NEXT, "munmap");
     }
+    /* 移除范围内的 UFFD 区域（部分覆盖的映射区域起点不在 addr）*/
+    unregister_range(addr, length);
     return g_preloader.original_munmap(addr, length);
 }
 #endif
@@ -17,8 +17,11 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/syscall.h>
 #include <linux/userfaultfd.h>
 #include <time.h>
@@ -52,6 +55,13 @@ static double get_time_us(void) {
     return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
 }
 
+/* 获取当前时间（纳秒）*/
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 /* 设置日志级别 */
 void uffd_handler_set_log_level(int level) {
     g_log_level = level;
@@ -66,8 +76,31 @@ void uffd_set_active_handler(UffdHandler *handler) {
     g_active_handler = handler;
 }
 
-/* 创建 userfaultfd */
-static int create_userfaultfd(void) {
+/*
+ * 探测内核支持的 UFFD 特性
+ * UFFDIO_API 在同一个 fd 上只能调用一次，用临时 fd 查询
+ */
+static uint64_t probe_uffd_features(void) {
+    int uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (uffd < 0) return 0;
+    
+    struct uffdio_api uffdio_api = { .api = UFFD_API, .features = 0 };
+    uint64_t features = 0;
+    if (ioctl(uffd, UFFDIO_API, &uffdio_api) == 0) {
+        features = uffdio_api.features;
+    }
+    
+    close(uffd);
+    return features;
+}
+
+/* 创建 userfaultfd，out_features 返回启用的特性 */
+static int create_userfaultfd(uint64_t *out_features) {
+    /* MINOR 模式需要的特性和缺页线程 ID，内核支持时才启用 */
+    uint64_t wanted = probe_uffd_features() &
+                      (UFFD_FEATURE_MINOR_SHMEM | UFFD_FEATURE_MINOR_HUGETLBFS |
+                       UFFD_FEATURE_THREAD_ID);
+    
     /* 使用 syscall 创建 userfaultfd */
     int uffd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
     if (uffd < 0) {
@@ -78,7 +111,7 @@ static int create_userfaultfd(void) {
     /* 初始化 UFFD API */
     struct uffdio_api uffdio_api;
     uffdio_api.api = UFFD_API;
-    uffdio_api.features = 0;  /* 可以启用 UFFD_FEATURE_* */
+    uffdio_api.features = wanted;
     
     if (ioctl(uffd, UFFDIO_API, &uffdio_api) < 0) {
         LOG_ERROR("ioctl(UFFDIO_API) failed: %s", strerror(errno));
@@ -91,13 +124,601 @@ static int create_userfaultfd(void) {
              (unsigned long long)uffdio_api.api,
              (unsigned long long)uffdio_api.features);
     
+    *out_features = wanted;
     return uffd;
 }
 
-/* 处理单个缺页 */
-int _uffd_handle_pagefault(UffdHandler *handler, 
-                           uint64_t fault_addr,
-                           uint64_t fault_flags) {
+/* 当前线程所属的处理线程（非处理线程为 NULL）*/
+static __thread UffdWorker *t_worker = NULL;
+
+/*
+ * 取得统计结构：处理线程使用私有统计，其他调用者（测试等）加锁使用全局统计
+ */
+static UffdStats* stats_acquire(UffdHandler *handler) {
+    if (t_worker && t_worker->handler == handler) {
+        return &t_worker->stats;
+    }
+    pthread_mutex_lock(&handler->stats_lock);
+    return &handler->stats;
+}
+
+static void stats_release(UffdHandler *handler, UffdStats *stats) {
+    if (stats == &handler->stats) {
+        pthread_mutex_unlock(&handler->stats_lock);
+    }
+}
+
+/* 累加统计 */
+static void stats_merge(UffdStats *dst, const UffdStats *src) {
+    dst->total_faults += src->total_faults;
+    dst->cache_hits += src->cache_hits;
+    dst->cache_misses += src->cache_misses;
+    dst->zero_fills += src->zero_fills;
+    dst->copy_errors += src->copy_errors;
+    dst->coalesced_faults += src->coalesced_faults;
+    dst->poll_calls += src->poll_calls;
+    dst->read_calls += src->read_calls;
+    dst->copy_ioctls += src->copy_ioctls;
+    dst->prefetched_pages += src->prefetched_pages;
+    dst->populated_pages += src->populated_pages;
+    dst->populate_copies += src->populate_copies;
+    dst->populate_races += src->populate_races;
+    dst->populate_yields += src->populate_yields;
+    dst->minor_faults += src->minor_faults;
+    dst->wake_ioctls += src->wake_ioctls;
+    dst->fallback_faults += src->fallback_faults;
+    dst->fallback_pages += src->fallback_pages;
+    dst->fallback_reads += src->fallback_reads;
+    dst->fallback_errors += src->fallback_errors;
+    if (src->max_batch > dst->max_batch) {
+        dst->max_batch = src->max_batch;
+    }
+    dst->total_handle_time_us += src->total_handle_time_us;
+    if (src->max_handle_time_us > dst->max_handle_time_us) {
+        dst->max_handle_time_us = src->max_handle_time_us;
+    }
+    dst->avg_handle_time_us = dst->total_faults > 0 ?
+        dst->total_handle_time_us / dst->total_faults : 0;
+}
+
+/*
+ * 在途缺页登记
+ * 返回槽位（>= 0）表示由本线程负责填充；
+ * -EBUSY 表示同一页正由其他线程填充，可直接合并；
+ * -1 表示槽位被其他页占用，不做合并照常处理
+ */
+static int inflight_acquire(UffdHandler *handler, uint64_t page_addr) {
+    if (handler->num_workers <= 1) return -1;
+    
+    uint32_t idx = (uint32_t)((page_addr / PAGE_SIZE) * 2654435761u) &
+                   (UFFD_INFLIGHT_SLOTS - 1);
+    uint64_t expected = 0;
+    
+    if (__atomic_compare_exchange_n(&handler->inflight[idx], &expected, page_addr,
+                                    0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return (int)idx;
+    }
+    
+    return expected == page_addr ? -EBUSY : -1;
+}
+
+static void inflight_release(UffdHandler *handler, int slot) {
+    if (slot >= 0) {
+        __atomic_store_n(&handler->inflight[slot], 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* 唤醒阻塞在 [start, start + len) 上的线程，未安装的页由它们重新触发缺页 */
+static int wake_range(UffdHandler *handler, uint64_t start, uint64_t len) {
+    struct uffdio_range range = { .start = start, .len = len };
+    if (ioctl(handler->uffd, UFFDIO_WAKE, &range) < 0) {
+        int err = errno;
+        LOG_ERROR("ioctl(UFFDIO_WAKE) failed: %s", strerror(err));
+        return -err;
+    }
+    return 0;
+}
+
+/*
+ * 失败后能否唤醒等待者重新缺页：区域已注销、映射已变化或暂时缺内存时，
+ * 重新缺页会走新的路径；其余错误重试仍会失败，唤醒只会让应用线程反复缺页
+ */
+static int fault_error_transient(long err) {
+    return err == -ENOENT || err == -EAGAIN || err == -ENOMEM || err == -ESRCH;
+}
+
+/*
+ * 记录一条缺页事件（只在处理线程内记录）
+ * 每个环只有所属线程写入，写完记录后再以 release 发布 event_head，
+ * 运行中导出时读者据此判断哪些记录可能已被覆盖
+ */
+static void event_record(UffdHandler *handler, uint64_t start_ns, uint64_t addr,
+                         MemoryRegion *region, int kind, uint64_t pages, uint32_t tid) {
+    UffdWorker *w = t_worker;
+    if (!w || w->handler != handler || !w->events) return;
+    
+    uint64_t service = get_time_ns() - start_ns;
+    uint64_t head = w->event_head;
+    UffdFaultEvent *e = &w->events[head & w->event_mask];
+    
+    e->timestamp_ns = start_ns;
+    e->address = addr;
+    e->file_offset = region ? region->file_offset_base + (addr - (uint64_t)region->base) : 0;
+    e->service_ns = service > UINT32_MAX ? UINT32_MAX : (uint32_t)service;
+    e->file = region ? region->event_file : -1;
+    e->tid = tid;
+    e->pages = pages > UINT16_MAX ? UINT16_MAX : (uint16_t)pages;
+    e->kind = (uint8_t)kind;
+    e->worker = (uint8_t)w->index;
+    
+    __atomic_store_n(&w->event_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* 事件文件表中的序号，不存在时追加（调用者持有 regions_lock）*/
+static int event_file_intern(UffdHandler *handler, const char *file_path, int file_id) {
+    for (int i = 0; i < handler->num_event_files; i++) {
+        if (strcmp(handler->event_files[i].file_path, file_path) == 0) {
+            return i;
+        }
+    }
+    
+    UffdEventFile *grown = realloc(handler->event_files,
+                                   (handler->num_event_files + 1) * sizeof(UffdEventFile));
+    if (!grown) return -1;
+    handler->event_files = grown;
+    
+    UffdEventFile *f = &handler->event_files[handler->num_event_files];
+    f->file_path = strdup(file_path);
+    if (!f->file_path) return -1;
+    f->file_id = file_id;
+    return handler->num_event_files++;
+}
+
+/* 读侧临界区嵌套深度（批量路径内会再进入单页路径）*/
+static __thread int t_read_depth = 0;
+
+/* 当前线程若是填充线程，指向所属处理器 */
+static __thread UffdHandler *t_populator = NULL;
+
+/* 当前线程的读侧序号槽位，没有时返回 NULL */
+static uint64_t* region_read_seq(UffdHandler *handler) {
+    if (t_worker && t_worker->handler == handler) return &t_worker->read_seq;
+    if (t_populator == handler) return &handler->populator_read_seq;
+    return NULL;
+}
+
+/*
+ * 区域读侧临界区
+ * 处理线程和填充线程只把自己的读侧序号加一（变为奇数），不与注册/注销竞争锁；
+ * 其他调用者（测试等）没有序号槽位，退回持有 regions_lock
+ */
+static void region_read_lock(UffdHandler *handler) {
+    if (t_read_depth++ > 0) return;
+    
+    uint64_t *seq = region_read_seq(handler);
+    if (seq) {
+        __atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+    } else {
+        pthread_mutex_lock(&handler->regions_lock);
+    }
+}
+
+static void region_read_unlock(UffdHandler *handler) {
+    if (--t_read_depth > 0) return;
+    
+    uint64_t *seq = region_read_seq(handler);
+    if (seq) {
+        __atomic_add_fetch(seq, 1, __ATOMIC_RELEASE);
+    } else {
+        pthread_mutex_unlock(&handler->regions_lock);
+    }
+}
+
+/* 等待发布新表之前已进入读侧临界区的处理线程和填充线程全部离开 */
+static void region_synchronize(UffdHandler *handler) {
+    /* stats_lock 保证 workers 数组在遍历期间不被释放 */
+    pthread_mutex_lock(&handler->stats_lock);
+    
+    for (int i = 0; i < handler->num_workers; i++) {
+        UffdWorker *w = &handler->workers[i];
+        if (w == t_worker) continue;
+        
+        uint64_t seq = __atomic_load_n(&w->read_seq, __ATOMIC_SEQ_CST);
+        if (!(seq & 1)) continue;
+        
+        while (__atomic_load_n(&w->read_seq, __ATOMIC_ACQUIRE) == seq) {
+            sched_yield();
+        }
+    }
+    
+    if (t_populator != handler) {
+        uint64_t seq = __atomic_load_n(&handler->populator_read_seq, __ATOMIC_SEQ_CST);
+        if (seq & 1) {
+            while (__atomic_load_n(&handler->populator_read_seq, __ATOMIC_ACQUIRE) == seq) {
+                sched_yield();
+            }
+        }
+    }
+    
+    pthread_mutex_unlock(&handler->stats_lock);
+}
+
+/* by_file 的排序：先 file_id，再文件偏移 */
+static int region_file_before(const MemoryRegion *a, const MemoryRegion *b) {
+    if (a->file_id != b->file_id) return a->file_id < b->file_id;
+    return a->file_offset_base < b->file_offset_base;
+}
+
+/*
+ * 以旧表为基础加入 add、去掉 remove，发布新的区域表（调用者持有 regions_lock）
+ * 返回后旧表已释放，remove 不再被任何读者引用，可以安全释放
+ */
+static int region_table_publish(UffdHandler *handler, MemoryRegion *add,
+                                MemoryRegion *remove) {
+    RegionTable *old = handler->region_table;
+    int old_count = old ? old->count : 0;
+    
+    RegionTable *table = malloc(sizeof(RegionTable) +
+                                (size_t)(old_count + 1) * 2 * sizeof(MemoryRegion*));
+    if (!table) return -ENOMEM;
+    table->by_file = table->entries + old_count + 1;
+    
+    int n = 0, nf = 0;
+    for (int i = 0; i < old_count; i++) {
+        if (old->entries[i] != remove) {
+            table->entries[n++] = old->entries[i];
+        }
+        if (old->by_file[i] != remove) {
+            table->by_file[nf++] = old->by_file[i];
+        }
+    }
+    
+    if (add) {
+        int pos = n;
+        while (pos > 0 && (uint64_t)table->entries[pos - 1]->base > (uint64_t)add->base) {
+            table->entries[pos] = table->entries[pos - 1];
+            pos--;
+        }
+        table->entries[pos] = add;
+        n++;
+        
+        pos = nf;
+        while (pos > 0 && region_file_before(add, table->by_file[pos - 1])) {
+            table->by_file[pos] = table->by_file[pos - 1];
+            pos--;
+        }
+        table->by_file[pos] = add;
+    }
+    table->count = n;
+    
+    __atomic_store_n(&handler->region_table, table, __ATOMIC_SEQ_CST);
+    region_synchronize(handler);
+    free(old);
+    
+    return 0;
+}
+
+/*
+ * 安装一段连续页面
+ * 中途遇到已存在的页时，UFFDIO_COPY 以 EAGAIN 返回并在 copy 中给出已完成字节数，
+ * 或在首页即存在时返回 EEXIST；跳过已存在的页（显式唤醒其等待者）后继续。
+ * dontwake 时不唤醒等待者，由调用者在整批安装完成后统一 UFFDIO_WAKE。
+ * 返回新安装的页数，或负错误码
+ */
+static long copy_pages(UffdHandler *handler, uint64_t dst, uint64_t src,
+                       uint64_t len, int dontwake, UffdStats *st) {
+    uint64_t done = 0;
+    long installed = 0;
+    
+    while (done < len) {
+        struct uffdio_copy uffdio_copy;
+        uffdio_copy.dst = dst + done;
+        uffdio_copy.src = src + done;
+        uffdio_copy.len = len - done;
+        uffdio_copy.mode = dontwake ? UFFDIO_COPY_MODE_DONTWAKE : 0;
+        uffdio_copy.copy = 0;
+        
+        if (st) st->copy_ioctls++;
+        
+        if (ioctl(handler->uffd, UFFDIO_COPY, &uffdio_copy) == 0) {
+            installed += (len - done) / PAGE_SIZE;
+            break;
+        }
+        
+        int err = errno;
+        if (uffdio_copy.copy > 0) {
+            done += uffdio_copy.copy;
+            installed += uffdio_copy.copy / PAGE_SIZE;
+        }
+        
+        if (err == EAGAIN) {
+            continue;
+        } else if (err == EEXIST) {
+            /* 失败的 COPY 不会唤醒等待者，显式唤醒本页 */
+            if (!dontwake) {
+                struct uffdio_range range = { .start = dst + done, .len = PAGE_SIZE };
+                ioctl(handler->uffd, UFFDIO_WAKE, &range);
+                if (st) st->wake_ioctls++;
+            }
+            done += PAGE_SIZE;
+        } else {
+            LOG_ERROR("ioctl(UFFDIO_COPY) failed: %s", strerror(err));
+            return -err;
+        }
+    }
+    
+    return installed;
+}
+
+/*
+ * MINOR 模式安装一段页面：数据已在 shadow memfd 的页缓存中，
+ * UFFDIO_CONTINUE 只建立页表项，不拷贝。部分完成和已存在页的处理同 copy_pages，
+ * step 为区域的安装粒度（hugetlb 为大页）
+ */
+static long continue_pages(UffdHandler *handler, uint64_t dst, uint64_t len,
+                           uint64_t step, int dontwake, UffdStats *st) {
+    uint64_t done = 0;
+    long installed = 0;
+    
+    while (done < len) {
+        struct uffdio_continue uffdio_continue;
+        uffdio_continue.range.start = dst + done;
+        uffdio_continue.range.len = len - done;
+        uffdio_continue.mode = dontwake ? UFFDIO_CONTINUE_MODE_DONTWAKE : 0;
+        uffdio_continue.mapped = 0;
+        
+        if (st) st->copy_ioctls++;
+        
+        if (ioctl(handler->uffd, UFFDIO_CONTINUE, &uffdio_continue) == 0) {
+            installed += (len - done) / PAGE_SIZE;
+            break;
+        }
+        
+        int err = errno;
+        if (uffdio_continue.mapped > 0) {
+            done += uffdio_continue.mapped;
+            installed += uffdio_continue.mapped / PAGE_SIZE;
+        }
+        
+        if (err == EAGAIN) {
+            continue;
+        } else if (err == EEXIST) {
+            if (!dontwake) {
+                struct uffdio_range range = { .start = dst + done, .len = step };
+                ioctl(handler->uffd, UFFDIO_WAKE, &range);
+                if (st) st->wake_ioctls++;
+            }
+            done += step;
+        } else {
+            LOG_ERROR("ioctl(UFFDIO_CONTINUE) failed: %s", strerror(err));
+            return -err;
+        }
+    }
+    
+    return installed;
+}
+
+/* 释放区域结构（区域已不在区域表中）*/
+static void region_free(MemoryRegion *region) {
+    if (region->source_fd >= 0) {
+        close(region->source_fd);
+    }
+    free(region->file_path);
+    free(region->populated);
+    free(region);
+}
+
+/*
+ * 累加已注销区域的未命中统计（调用者持有 regions_lock）
+ * 同一文件通常会被映射多次（多个段、多次加载），按路径汇总
+ */
+static void file_miss_add(UffdHandler *handler, const char *file_path,
+                          uint64_t faults, uint64_t pages) {
+    for (int i = 0; i < handler->num_file_misses; i++) {
+        if (strcmp(handler->file_misses[i].file_path, file_path) == 0) {
+            handler->file_misses[i].faults += faults;
+            handler->file_misses[i].pages += pages;
+            return;
+        }
+    }
+    
+    UffdFileMiss *grown = realloc(handler->file_misses,
+                                  (handler->num_file_misses + 1) * sizeof(UffdFileMiss));
+    if (!grown) return;
+    handler->file_misses = grown;
+    
+    UffdFileMiss *m = &handler->file_misses[handler->num_file_misses];
+    m->file_path = strdup(file_path);
+    if (!m->file_path) return;
+    m->faults = faults;
+    m->pages = pages;
+    handler->num_file_misses++;
+}
+
+/* 区域内页面是否已安装 */
+static int region_page_populated(MemoryRegion *region, uint64_t addr) {
+    size_t idx = (addr - (uint64_t)region->base) / PAGE_SIZE;
+    return (__atomic_load_n(&region->populated[idx / 8], __ATOMIC_RELAXED) >> (idx % 8)) & 1;
+}
+
+/* 标记区间内页面已安装 */
+static void region_mark_populated(MemoryRegion *region, uint64_t addr, uint64_t len) {
+    size_t first = (addr - (uint64_t)region->base) / PAGE_SIZE;
+    size_t last = first + len / PAGE_SIZE;
+    
+    for (size_t idx = first; idx < last; idx++) {
+        __atomic_fetch_or(&region->populated[idx / 8], (uint8_t)(1 << (idx % 8)),
+                          __ATOMIC_RELAXED);
+    }
+}
+
+/* 从 BigCache 数据区拷贝出去的页记为已服务，驻留管理器据此释放 */
+static void mark_served_copy(UffdHandler *handler, uint64_t src, uint64_t len) {
+    BigCacheContext *bc = handler->bigcache;
+    uint64_t data_base = (uint64_t)bc->mapped_data + bc->header.data_offset;
+    uint64_t data_end = data_base + (uint64_t)bc->header.num_pages * PAGE_SIZE;
+    if (src < data_base || src + len > data_end) return;
+    bigcache_mark_served(bc, (uint32_t)((src - data_base) / PAGE_SIZE),
+                         (uint32_t)(len / PAGE_SIZE));
+}
+
+/*
+ * Fault-around：把 [*dst, *dst + *len) 向后最多扩展 prefetch_ahead 页、
+ * 向前最多扩展 prefetch_behind 页。只纳入区域内仍缺失、且在 BigCache 中
+ * 与当前段首尾相接的页面，保证整段仍是一次 UFFDIO_COPY。
+ * MINOR 区域从 shadow memfd 安装，只要求页面被 BigCache 收录。
+ * 返回扩展的页数
+ */
+static uint64_t fault_around(UffdHandler *handler, MemoryRegion *region,
+                             uint64_t *dst, uint64_t *src, uint64_t *len) {
+    uint64_t base = (uint64_t)region->base;
+    uint64_t end = base + region->size;
+    uint64_t added = 0;
+    
+    for (size_t k = 0; k < handler->config.prefetch_ahead; k++) {
+        uint64_t next = *dst + *len;
+        if (next >= end || region_page_populated(region, next)) break;
+        
+        void *data = bigcache_peek(handler->bigcache, region->file_path,
+                                   region->file_offset_base + (next - base));
+        if (region->minor ? !data : (uint64_t)data != *src + *len) break;
+        
+        *len += PAGE_SIZE;
+        added++;
+    }
+    
+    for (size_t k = 0; k < handler->config.prefetch_behind; k++) {
+        if (*dst <= base) break;
+        
+        uint64_t prev = *dst - PAGE_SIZE;
+        if (region_page_populated(region, prev)) break;
+        
+        void *data = bigcache_peek(handler->bigcache, region->file_path,
+                                   region->file_offset_base + (prev - base));
+        if (!data || (!region->minor && (uint64_t)data != *src - PAGE_SIZE)) break;
+        
+        *dst = prev;
+        *src -= PAGE_SIZE;
+        *len += PAGE_SIZE;
+        added++;
+    }
+    
+    return added;
+}
+
+/* 回退读取的中转缓冲区：处理线程使用自己的缓冲区，其他调用者临时分配 */
+static uint8_t* bounce_get(UffdHandler *handler) {
+    if (t_worker && t_worker->handler == handler && t_worker->bounce) {
+        return t_worker->bounce;
+    }
+    return malloc(UFFD_MAX_FALLBACK_PAGES * PAGE_SIZE);
+}
+
+static void bounce_put(UffdHandler *handler, uint8_t *buf) {
+    if (!buf) return;
+    if (t_worker && t_worker->handler == handler && buf == t_worker->bounce) return;
+    free(buf);
+}
+
+static size_t fallback_max_pages(UffdHandler *handler) {
+    size_t max = handler->config.fallback_readahead;
+    if (max < 1) max = 1;
+    if (max > UFFD_MAX_FALLBACK_PAGES) max = UFFD_MAX_FALLBACK_PAGES;
+    return max;
+}
+
+/*
+ * 自适应回退窗口：未命中恰好接在上一次回退读取之后时窗口翻倍（不超过
+ * fallback_readahead），否则回到一页；窗口不越过区域末尾、已安装的页和
+ * BigCache 收录的页（这些页不需要 I/O）。
+ * 多个处理线程可能同时更新窗口状态，它只是启发式，不要求精确
+ */
+static size_t fallback_window(UffdHandler *handler, MemoryRegion *region,
+                              uint64_t page_addr) {
+    size_t max = fallback_max_pages(handler);
+    size_t want = 1;
+    
+    if (max > 1 && page_addr == region->ra_next) {
+        want = region->ra_pages * 2;
+        if (want < 2) want = 2;
+        if (want > max) want = max;
+    }
+    
+    uint64_t base = (uint64_t)region->base;
+    uint64_t end = base + region->size;
+    size_t n = 1;
+    while (n < want) {
+        uint64_t next = page_addr + n * PAGE_SIZE;
+        if (next >= end || region_page_populated(region, next) ||
+            bigcache_peek(handler->bigcache, region->file_path,
+                          region->file_offset_base + (next - base))) {
+            break;
+        }
+        n++;
+    }
+    
+    region->ra_pages = want;
+    region->ra_next = page_addr + n * PAGE_SIZE;
+    return n;
+}
+
+/*
+ * 未命中回退：从原文件读取 page_addr 起的一段到中转缓冲区（*out_buf，用完 bounce_put）
+ * 返回读入长度（按页向上取整，文件尾部补零）；未启用、无源文件或已到文件末尾返回 0，
+ * 读取失败返回负错误码
+ */
+static long read_fallback(UffdHandler *handler, MemoryRegion *region,
+                          uint64_t page_addr, uint8_t **out_buf) {
+    *out_buf = NULL;
+    if (!handler->config.enable_file_fallback || region->source_fd < 0) {
+        return 0;
+    }
+    
+    size_t pages = fallback_window(handler, region, page_addr);
+    uint8_t *buf = bounce_get(handler);
+    if (!buf) return -ENOMEM;
+    
+    uint64_t file_offset = region->file_offset_base + (page_addr - (uint64_t)region->base);
+    size_t want = pages * PAGE_SIZE;
+    size_t got = 0;
+    
+    while (got < want) {
+        ssize_t n = pread(region->source_fd, buf + got, want - got, file_offset + got);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            LOG_WARN("Fallback read of %s at %lu failed: %s",
+                     region->file_path, (unsigned long)file_offset, strerror(err));
+            bounce_put(handler, buf);
+            return -err;
+        }
+        if (n == 0) break;
+        got += n;
+    }
+    
+    if (got == 0) {
+        bounce_put(handler, buf);
+        return 0;
+    }
+    
+    size_t len = (got + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+    memset(buf + got, 0, len - got);
+    
+    /* 窗口已到上限，说明在顺序读：让内核异步预读下一个窗口 */
+    if (pages > 1 && pages == fallback_max_pages(handler)) {
+        posix_fadvise(region->source_fd, file_offset + len, len, POSIX_FADV_WILLNEED);
+    }
+    
+    *out_buf = buf;
+    return (long)len;
+}
+
+/* 处理单个缺页，tid 为缺页的应用线程（未知为 0），只用于事件记录 */
+static int handle_pagefault(UffdHandler *handler,
+                            uint64_t fault_addr,
+                            uint64_t fault_flags,
+                            uint32_t tid) {
+    uint64_t start_ns = get_time_ns();
     double start_time = 0;
     if (handler->config.enable_stats) {
         start_time = get_time_us();
@@ -111,14 +732,34 @@ int _uffd_handle_pagefault(UffdHandler *handler,
               (unsigned long)page_addr,
               (unsigned long)fault_flags);
     
-    /* 查找对应的内存区域 */
-    pthread_mutex_lock(&handler->regions_lock);
+    /*
+     * 多个线程同时访问同一缺页时，内核为每个等待者各投递一条消息。
+     * 若该页正由其他处理线程填充，其 UFFDIO_COPY 完成后会唤醒所有等待者，
+     * 这里直接合并，省去查找和注定 EEXIST 的拷贝
+     */
+    int slot = inflight_acquire(handler, page_addr);
+    if (slot == -EBUSY) {
+        if (handler->config.enable_stats) {
+            UffdStats *st = stats_acquire(handler);
+            st->coalesced_faults++;
+            stats_release(handler, st);
+        }
+        event_record(handler, start_ns, page_addr, NULL, UFFD_FAULT_COALESCED, 0, tid);
+        LOG_TRACE("Coalesced fault at 0x%lx", (unsigned long)page_addr);
+        return 0;
+    }
+    
+    int ret = 0;
+    
+    /* 查找对应的内存区域，区域在处理完成前不会被释放 */
+    region_read_lock(handler);
     MemoryRegion *region = _uffd_find_region(handler, (void*)page_addr);
-    pthread_mutex_unlock(&handler->regions_lock);
     
     if (!region) {
         LOG_ERROR("No region registered for address 0x%lx", (unsigned long)page_addr);
-        return -ENOENT;
+        event_record(handler, start_ns, page_addr, NULL, UFFD_FAULT_ERROR, 0, tid);
+        ret = -ENOENT;
+        goto out;
     }
     
     /* 计算在源文件中的偏移 */
@@ -137,103 +778,633 @@ int _uffd_handle_pagefault(UffdHandler *handler,
     
     int cache_hit = (source_data != NULL);
     
-    /* 准备复制数据 */
-    struct uffdio_copy uffdio_copy;
-    uffdio_copy.dst = page_addr;
-    uffdio_copy.len = PAGE_SIZE;
-    uffdio_copy.mode = 0;
+    /*
+     * MINOR 区域的命中页在 shadow memfd 中，用 UFFDIO_CONTINUE 安装；
+     * hugetlb shadow 已分配全部大页，区域内任何缺页都按大页 CONTINUE
+     */
+    int minor_hit = region->minor && (source_data || region->fault_size > PAGE_SIZE);
     
-    if (source_data) {
+    /* 准备复制数据 */
+    uint64_t dst = page_addr;
+    uint64_t src = 0;
+    uint64_t len = PAGE_SIZE;
+    uint64_t prefetched = 0;
+    uint8_t *fb_buf = NULL;
+    long fb_len = 0;
+    int hard_miss = 0;
+    
+    if (minor_hit) {
+        dst = page_addr & ~((uint64_t)region->fault_size - 1);
+        len = region->fault_size;
+        if (len == PAGE_SIZE) {
+            prefetched = fault_around(handler, region, &dst, &src, &len);
+        }
+        LOG_TRACE("Cache HIT: continuing %lu pages from shadow",
+                  (unsigned long)(len / PAGE_SIZE));
+    } else if (source_data) {
         /* 命中：从 BigCache 复制 */
-        uffdio_copy.src = (uint64_t)source_data;
-        LOG_TRACE("Cache HIT: copying from BigCache");
+        src = (uint64_t)source_data;
+        prefetched = fault_around(handler, region, &dst, &src, &len);
+        LOG_TRACE("Cache HIT: copying %lu pages from BigCache",
+                  (unsigned long)(len / PAGE_SIZE));
+    } else if ((fb_len = read_fallback(handler, region, page_addr, &fb_buf)) > 0) {
+        /* 未命中：从原文件读取 */
+        src = (uint64_t)fb_buf;
+        len = fb_len;
+        LOG_DEBUG("Cache MISS: read %lu pages from %s",
+                  (unsigned long)(len / PAGE_SIZE), region->file_path);
     } else {
-        /* 未命中：填充零页或报错 */
+        /*
+         * 未命中且无法回退：填充零页。关闭 zero-fill 时同样安装零页并报错，
+         * 不安装的话应用线程被唤醒后立即重新缺页，不唤醒则永久阻塞
+         */
+        src = (uint64_t)handler->zero_page;
         if (handler->config.enable_zero_fill) {
-            uffdio_copy.src = (uint64_t)handler->zero_page;
             LOG_DEBUG("Cache MISS: zero-filling page at 0x%lx", (unsigned long)page_addr);
         } else {
-            LOG_ERROR("Cache MISS and zero-fill disabled for 0x%lx", 
+            LOG_ERROR("Cache MISS and zero-fill disabled for 0x%lx, installing zero page",
                       (unsigned long)page_addr);
-            return -ENODATA;
+            hard_miss = 1;
         }
     }
     
-    /* 执行复制 */
-    if (ioctl(handler->uffd, UFFDIO_COPY, &uffdio_copy) < 0) {
-        if (errno != EEXIST) {  /* EEXIST 表示页面已存在，不是错误 */
-            LOG_ERROR("ioctl(UFFDIO_COPY) failed: %s", strerror(errno));
-            if (handler->config.enable_stats) {
-                pthread_mutex_lock(&handler->stats_lock);
-                handler->stats.copy_errors++;
-                pthread_mutex_unlock(&handler->stats_lock);
+    /* 执行复制（EEXIST 表示页面已存在，不是错误）*/
+    UffdStats *st = handler->config.enable_stats ? stats_acquire(handler) : NULL;
+    long copied = minor_hit ?
+        continue_pages(handler, dst, len, region->fault_size, 0, st) :
+        copy_pages(handler, dst, src, len, 0, st);
+    bounce_put(handler, fb_buf);
+    if (copied < 0) {
+        ret = (int)copied;
+        if (st) st->copy_errors++;
+    } else {
+        region_mark_populated(region, dst, len);
+        if (cache_hit && !minor_hit) mark_served_copy(handler, src, len);
+        if (fb_len > 0) {
+            __atomic_fetch_add(&region->miss_faults, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&region->miss_pages, len / PAGE_SIZE, __ATOMIC_RELAXED);
+        }
+        if (st) {
+            st->prefetched_pages += prefetched;
+            if (minor_hit) st->minor_faults++;
+            if (fb_len > 0) {
+                st->fallback_reads++;
+                st->fallback_pages += len / PAGE_SIZE;
             }
-            return -errno;
         }
     }
+    if (st && fb_len < 0) st->fallback_errors++;
+    if (st) stats_release(handler, st);
+    
+    int kind = ret < 0 || hard_miss ? UFFD_FAULT_ERROR :
+               minor_hit ? UFFD_FAULT_MINOR :
+               cache_hit ? UFFD_FAULT_HIT :
+               fb_len > 0 ? UFFD_FAULT_FALLBACK : UFFD_FAULT_ZERO;
+    event_record(handler, start_ns, page_addr, region, kind,
+                 ret < 0 ? 0 : len / PAGE_SIZE, tid);
+    if (ret < 0) goto out;
     
     /* 更新统计 */
     if (handler->config.enable_stats) {
         double elapsed = get_time_us() - start_time;
         
-        pthread_mutex_lock(&handler->stats_lock);
-        handler->stats.total_faults++;
+        UffdStats *st = stats_acquire(handler);
+        st->total_faults++;
         
         if (cache_hit) {
-            handler->stats.cache_hits++;
+            st->cache_hits++;
+        } else if (fb_len > 0) {
+            st->fallback_faults++;
         } else {
             if (handler->config.enable_zero_fill) {
-                handler->stats.zero_fills++;
+                st->zero_fills++;
             } else {
-                handler->stats.cache_misses++;
+                st->cache_misses++;
             }
         }
         
-        handler->stats.total_handle_time_us += elapsed;
-        if (elapsed > handler->stats.max_handle_time_us) {
-            handler->stats.max_handle_time_us = elapsed;
+        st->total_handle_time_us += elapsed;
+        if (elapsed > st->max_handle_time_us) {
+            st->max_handle_time_us = elapsed;
         }
-        handler->stats.avg_handle_time_us = 
-            handler->stats.total_handle_time_us / handler->stats.total_faults;
+        st->avg_handle_time_us = st->total_handle_time_us / st->total_faults;
         
-        pthread_mutex_unlock(&handler->stats_lock);
+        stats_release(handler, st);
     }
     
-    return 0;
+out:
+    region_read_unlock(handler);
+    /*
+     * 失败时页没有安装，缺页线程和合并到本页的等待者不会被 COPY 唤醒；
+     * 可重试的失败在释放槽位前唤醒它们重新缺页
+     */
+    if (ret < 0 && fault_error_transient(ret)) wake_range(handler, page_addr, PAGE_SIZE);
+    inflight_release(handler, slot);
+    return ret;
 }
 
-/* 查找地址对应的区域 */
+int _uffd_handle_pagefault(UffdHandler *handler, 
+                           uint64_t fault_addr,
+                           uint64_t fault_flags) {
+    return handle_pagefault(handler, fault_addr, fault_flags, 0);
+}
+
+/* 查找地址对应的区域：在区域表快照中二分查找最后一个基址不大于 addr 的区域 */
 MemoryRegion* _uffd_find_region(UffdHandler *handler, void *addr) {
-    MemoryRegion *region = handler->regions;
+    RegionTable *table = __atomic_load_n(&handler->region_table, __ATOMIC_SEQ_CST);
+    if (!table) return NULL;
+    
     uint64_t target = (uint64_t)addr;
+    int lo = 0;
+    int hi = table->count;
     
-    while (region) {
-        uint64_t start = (uint64_t)region->base;
-        uint64_t end = start + region->size;
-        
-        if (target >= start && target < end) {
-            return region;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if ((uint64_t)table->entries[mid]->base <= target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-        
-        region = region->next;
+    }
+    
+    if (lo == 0) return NULL;
+    
+    MemoryRegion *region = table->entries[lo - 1];
+    if (target < (uint64_t)region->base + region->size) {
+        return region;
     }
     
     return NULL;
 }
 
-/* 处理器线程主函数 */
-static void* handler_thread_func(void *arg) {
-    UffdHandler *handler = (UffdHandler*)arg;
+/* 缺页页地址及其应用线程，排序时保持对应关系 */
+typedef struct {
+    uint64_t page;
+    uint32_t tid;
+} FaultRef;
+
+static int compare_fault_ref(const void *a, const void *b) {
+    uint64_t x = ((const FaultRef*)a)->page;
+    uint64_t y = ((const FaultRef*)b)->page;
+    return (x > y) - (x < y);
+}
+
+/*
+ * 批量处理一次 read 读出的缺页
+ *
+ * 按地址排序后同一区域的缺页相邻：区域只查找一次，重复的页直接合并；
+ * 地址连续且在 BigCache 中也连续的命中页合并为一次多页 UFFDIO_COPY
+ * （MINOR 区域只要求地址连续，合并为一次 UFFDIO_CONTINUE）。
+ * hugetlb 区域按大页粒度逐个处理。
+ * batch_wake 时各段以 DONTWAKE 安装，整批完成后按合并后的连续段各做一次 UFFDIO_WAKE，
+ * 相邻段上的等待者一次唤醒；段之间的空隙可能属于其他线程正在处理的页，不在唤醒范围内
+ */
+
+/* 记录待唤醒的段，与上一段重叠或相接时合并 */
+static void wake_list_add(uint64_t *starts, uint64_t *ends, int *count,
+                          uint64_t start, uint64_t end) {
+    if (*count > 0 && start <= ends[*count - 1] && end >= starts[*count - 1]) {
+        if (start < starts[*count - 1]) starts[*count - 1] = start;
+        if (end > ends[*count - 1]) ends[*count - 1] = end;
+        return;
+    }
+    starts[*count] = start;
+    ends[*count] = end;
+    (*count)++;
+}
+
+static void handle_fault_batch(UffdHandler *handler, FaultRef *refs, int n) {
+    if (n == 1) {
+        handle_pagefault(handler, refs[0].page, 0, refs[0].tid);
+        return;
+    }
     
-    LOG_INFO("Handler thread started");
+    uint64_t start_ns = get_time_ns();
+    double start_time = get_time_us();
     
-    struct pollfd pollfds[2];
-    pollfds[0].fd = handler->uffd;
-    pollfds[0].events = POLLIN;
-    pollfds[1].fd = handler->shutdown_pipe[0];
+    uint64_t pages[UFFD_MAX_MSG_BATCH];
+    MemoryRegion *regions[UFFD_MAX_MSG_BATCH];
+    uint8_t *srcs[UFFD_MAX_MSG_BATCH];
+    int slots[UFFD_MAX_MSG_BATCH];
+    uint64_t coalesced = 0;
+    
+    qsort(refs, n, sizeof(FaultRef), compare_fault_ref);
+    for (int i = 0; i < n; i++) {
+        pages[i] = refs[i].page;
+    }
+    
+    region_read_lock(handler);
+    
+    /* 第一遍：去重、登记在途、查找区域和 BigCache 数据 */
+    MemoryRegion *region = NULL;
+    for (int i = 0; i < n; i++) {
+        regions[i] = NULL;
+        srcs[i] = NULL;
+        slots[i] = -1;
+        
+        if (i > 0 && pages[i] == pages[i - 1]) {
+            coalesced++;
+            event_record(handler, start_ns, pages[i], NULL, UFFD_FAULT_COALESCED,
+                         0, refs[i].tid);
+            continue;
+        }
+        
+        slots[i] = inflight_acquire(handler, pages[i]);
+        if (slots[i] == -EBUSY) {
+            slots[i] = -1;
+            coalesced++;
+            event_record(handler, start_ns, pages[i], NULL, UFFD_FAULT_COALESCED,
+                         0, refs[i].tid);
+            continue;
+        }
+        
+        if (!region || pages[i] < (uint64_t)region->base ||
+            pages[i] >= (uint64_t)region->base + region->size) {
+            region = _uffd_find_region(handler, (void*)pages[i]);
+        }
+        
+        if (!region) {
+            LOG_ERROR("No region registered for address 0x%lx", (unsigned long)pages[i]);
+            event_record(handler, start_ns, pages[i], NULL, UFFD_FAULT_ERROR,
+                         0, refs[i].tid);
+            continue;
+        }
+        
+        if (region->fault_size > PAGE_SIZE) {
+            inflight_release(handler, slots[i]);
+            slots[i] = -1;
+            handle_pagefault(handler, pages[i], 0, refs[i].tid);
+            continue;
+        }
+        
+        regions[i] = region;
+        srcs[i] = bigcache_lookup(handler->bigcache, region->file_path,
+                                  region->file_offset_base +
+                                  (pages[i] - (uint64_t)region->base));
+    }
+    
+    /* 第二遍：按连续段安装 */
+    UffdStats *st = handler->config.enable_stats ? stats_acquire(handler) : NULL;
+    int dontwake = handler->config.batch_wake;
+    uint64_t wake_starts[UFFD_MAX_MSG_BATCH];
+    uint64_t wake_ends[UFFD_MAX_MSG_BATCH];
+    int wake_count = 0;
+    
+    int i = 0;
+    while (i < n) {
+        if (!regions[i]) {
+            /* 没有区域的页不会安装，本线程负责的页要唤醒合并过来的等待者 */
+            if (slots[i] >= 0) {
+                wake_list_add(wake_starts, wake_ends, &wake_count, pages[i], pages[i] + PAGE_SIZE);
+            }
+            i++;
+            continue;
+        }
+        
+        MemoryRegion *run_region = regions[i];
+        uint64_t dst = pages[i];
+        uint64_t len = PAGE_SIZE;
+        uint64_t faults = 1;
+        uint64_t prefetched = 0;
+        int hit = (srcs[i] != NULL);
+        int j = i + 1;
+        
+        if (hit) {
+            while (j < n) {
+                if (!regions[j]) {
+                    /* 重复或合并掉的页不打断连续段 */
+                    if (pages[j] == dst + len - PAGE_SIZE) {
+                        j++;
+                        continue;
+                    }
+                    break;
+                }
+                if (regions[j] != run_region || pages[j] != dst + len || !srcs[j] ||
+                    (!run_region->minor && srcs[j] != srcs[i] + len)) {
+                    break;
+                }
+                len += PAGE_SIZE;
+                faults++;
+                j++;
+            }
+        }
+        
+        uint64_t src;
+        uint8_t *fb_buf = NULL;
+        long fb_len = 0;
+        int hard_miss = 0;
+        if (hit) {
+            src = (uint64_t)srcs[i];
+            prefetched = fault_around(handler, run_region, &dst, &src, &len);
+            
+            /* 扩展段覆盖到的后续缺页一并满足 */
+            while (j < n && pages[j] < dst + len) {
+                if (regions[j]) {
+                    faults++;
+                    prefetched--;
+                }
+                j++;
+            }
+        } else if ((fb_len = read_fallback(handler, run_region, dst, &fb_buf)) > 0) {
+            /* 未命中：从原文件读取，读入窗口覆盖到的后续缺页一并满足 */
+            src = (uint64_t)fb_buf;
+            len = fb_len;
+            while (j < n && pages[j] < dst + len) {
+                if (regions[j]) faults++;
+                j++;
+            }
+        } else {
+            /* 同单页路径：关闭 zero-fill 时也安装零页并报错，避免反复缺页 */
+            src = (uint64_t)handler->zero_page;
+            if (!handler->config.enable_zero_fill) {
+                LOG_ERROR("Cache MISS and zero-fill disabled for 0x%lx, installing zero page",
+                          (unsigned long)dst);
+                hard_miss = 1;
+            }
+        }
+        
+        int minor_hit = hit && run_region->minor;
+        long copied = minor_hit ?
+            continue_pages(handler, dst, len, PAGE_SIZE, dontwake, st) :
+            copy_pages(handler, dst, src, len, dontwake, st);
+        bounce_put(handler, fb_buf);
+        if (copied >= 0) {
+            region_mark_populated(run_region, dst, len);
+            if (hit && !minor_hit) mark_served_copy(handler, src, len);
+            if (fb_len > 0) {
+                __atomic_fetch_add(&run_region->miss_faults, faults, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&run_region->miss_pages, len / PAGE_SIZE, __ATOMIC_RELAXED);
+            }
+        }
+        
+        /* 段内第一个缺页记安装的页数，随段满足的其余缺页记 0 */
+        int kind = copied < 0 || hard_miss ? UFFD_FAULT_ERROR :
+                   minor_hit ? UFFD_FAULT_MINOR :
+                   hit ? UFFD_FAULT_HIT :
+                   fb_len > 0 ? UFFD_FAULT_FALLBACK : UFFD_FAULT_ZERO;
+        uint64_t run_pages = copied < 0 ? 0 : len / PAGE_SIZE;
+        for (int k = i; k < j; k++) {
+            if (regions[k]) {
+                event_record(handler, start_ns, pages[k], run_region, kind,
+                             run_pages, refs[k].tid);
+                run_pages = 0;
+            }
+        }
+        
+        /* 可重试的失败即使没有 DONTWAKE 也要唤醒：未安装的页上有等待者 */
+        if (copied < 0 ? fault_error_transient(copied) : dontwake) {
+            wake_list_add(wake_starts, wake_ends, &wake_count, dst, dst + len);
+        }
+        
+        if (st) {
+            if (fb_len < 0) st->fallback_errors++;
+            if (copied < 0) {
+                st->copy_errors++;
+            } else {
+                /* 同批次中排在后面的缺页还要等待前面的段，按批次起点计时 */
+                double elapsed = get_time_us() - start_time;
+                st->total_faults += faults;
+                if (hit) {
+                    st->cache_hits += faults;
+                } else if (fb_len > 0) {
+                    st->fallback_faults += faults;
+                    st->fallback_reads++;
+                    st->fallback_pages += len / PAGE_SIZE;
+                } else if (hard_miss) {
+                    st->cache_misses += faults;
+                } else {
+                    st->zero_fills += faults;
+                }
+                st->prefetched_pages += prefetched;
+                if (minor_hit) st->minor_faults += faults;
+                st->total_handle_time_us += elapsed * faults;
+                if (elapsed > st->max_handle_time_us) {
+                    st->max_handle_time_us = elapsed;
+                }
+            }
+        }
+        
+        i = j;
+    }
+    
+    /* 统一唤醒：必须在释放在途槽位前完成，合并到本线程的等待者靠这次唤醒 */
+    for (int k = 0; k < wake_count; k++) {
+        wake_range(handler, wake_starts[k], wake_ends[k] - wake_starts[k]);
+        if (st) st->wake_ioctls++;
+    }
+    
+    if (st) {
+        st->coalesced_faults += coalesced;
+        if (st->total_faults > 0) {
+            st->avg_handle_time_us = st->total_handle_time_us / st->total_faults;
+        }
+        stats_release(handler, st);
+    }
+    
+    region_read_unlock(handler);
+    
+    for (int k = 0; k < n; k++) {
+        inflight_release(handler, slots[k]);
+    }
+}
+
+/* 读取 sysfs 中 CPU 的一个数值属性，不存在返回 0 */
+static uint64_t read_cpu_attr(int cpu, const char *attr) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, attr);
+    
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+    
+    unsigned long long value = 0;
+    if (fscanf(fp, "%llu", &value) != 1) value = 0;
+    fclose(fp);
+    return value;
+}
+
+uint64_t uffd_big_core_mask(void) {
+    static const char *attrs[] = { "cpu_capacity", "cpufreq/cpuinfo_max_freq" };
+    long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (num_cpus > 64) num_cpus = 64;
+    
+    for (size_t a = 0; a < sizeof(attrs) / sizeof(attrs[0]); a++) {
+        uint64_t values[64];
+        uint64_t best = 0;
+        uint64_t lowest = UINT64_MAX;
+        
+        for (int cpu = 0; cpu < num_cpus; cpu++) {
+            values[cpu] = read_cpu_attr(cpu, attrs[a]);
+            if (values[cpu] > best) best = values[cpu];
+            if (values[cpu] && values[cpu] < lowest) lowest = values[cpu];
+        }
+        if (best == 0) continue;
+        
+        /*
+         * 去掉最低一档（与最低值相差 10% 以内的核心都算同一档），其余都选：
+         * 三簇 SoC 上中核和超大核都可用，同簇核心频率略有差异时也不会只剩一个核
+         */
+        uint64_t tier = lowest + lowest / 10;
+        uint64_t mask = 0;
+        for (int cpu = 0; cpu < num_cpus; cpu++) {
+            if (values[cpu] > tier) mask |= 1ULL << cpu;
+        }
+        return mask;
+    }
+    
+    return 0;
+}
+
+int uffd_parse_cpu_mask(const char *spec, uint64_t *mask) {
+    if (!spec || !mask) return -EINVAL;
+    
+    if (strcmp(spec, "big") == 0) {
+        *mask = uffd_big_core_mask();
+        return 0;
+    }
+    if (strcmp(spec, "all") == 0 || spec[0] == '\0') {
+        *mask = 0;
+        return 0;
+    }
+    if (strncmp(spec, "0x", 2) == 0) {
+        char *end;
+        *mask = strtoull(spec + 2, &end, 16);
+        return *end == '\0' ? 0 : -EINVAL;
+    }
+    
+    /* CPU 列表：4-7,2 */
+    uint64_t result = 0;
+    const char *p = spec;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) return -EINVAL;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) return -EINVAL;
+        }
+        if (first < 0 || last > 63 || first > last) return -EINVAL;
+        for (long cpu = first; cpu <= last; cpu++) {
+            result |= 1ULL << cpu;
+        }
+        if (*end == ',') end++;
+        else if (*end != '\0') return -EINVAL;
+        p = end;
+    }
+    
+    *mask = result;
+    return 0;
+}
+
+/*
+ * 设置处理线程的调度参数
+ * 缺页处理线程阻塞着应用线程，与应用自身的忙线程按同等优先级竞争时，
+ * 唤醒延迟直接叠加到缺页延迟上；big.LITTLE 上落到小核也会拉长服务时间。
+ * 各项设置失败只告警，不影响处理线程运行
+ */
+static void apply_worker_sched(UffdWorker *worker) {
+    UffdConfig *config = &worker->handler->config;
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    
+    if (config->handler_cpu_mask) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (config->handler_cpu_mask & (1ULL << cpu)) CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) < 0) {
+            LOG_WARN("Handler thread %d: sched_setaffinity(0x%llx) failed: %s",
+                     worker->index, (unsigned long long)config->handler_cpu_mask,
+                     strerror(errno));
+        }
+    }
+    
+    if (config->handler_priority != 0 &&
+        setpriority(PRIO_PROCESS, (id_t)tid, config->handler_priority) < 0) {
+        LOG_WARN("Handler thread %d: setpriority(%d) failed: %s",
+                 worker->index, config->handler_priority, strerror(errno));
+    }
+    
+    int policy = config->handler_sched_policy;
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        struct sched_param param = { .sched_priority = config->handler_rt_priority };
+        int min = sched_get_priority_min(policy);
+        int max = sched_get_priority_max(policy);
+        if (param.sched_priority < min) param.sched_priority = min;
+        if (param.sched_priority > max) param.sched_priority = max;
+        
+        int ret = pthread_setschedparam(pthread_self(), policy, &param);
+        if (ret != 0) {
+            LOG_WARN("Handler thread %d: %s not permitted (%s), using nice %d",
+                     worker->index, policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR",
+                     strerror(ret), config->handler_priority);
+        }
+    }
+}
+
+/* 处理非缺页事件 */
+static void handle_event(UffdHandler *handler, const struct uffd_msg *msg) {
+    (void)handler;
+    
+    switch (msg->event) {
+        case UFFD_EVENT_FORK:
+            LOG_DEBUG("UFFD_EVENT_FORK received");
+            break;
+            
+        case UFFD_EVENT_REMAP:
+            LOG_DEBUG("UFFD_EVENT_REMAP received");
+            break;
+            
+        case UFFD_EVENT_REMOVE:
+            LOG_DEBUG("UFFD_EVENT_REMOVE received");
+            break;
+            
+        case UFFD_EVENT_UNMAP:
+            LOG_DEBUG("UFFD_EVENT_UNMAP received");
+            break;
+            
+        default:
+            LOG_WARN("Unknown UFFD event: %u", msg->event);
+            break;
+    }
+}
+
+/*
+ * 处理器线程主函数
+ * 所有处理线程共享同一个非阻塞 userfaultfd，每条消息只会被一个线程读到。
+ * 每次唤醒后用多消息缓冲区反复 read 直到读空，缺页批量处理
+ */
+static void* handler_thread_func(void *arg) {
+    UffdWorker *worker = (UffdWorker*)arg;
+    UffdHandler *handler = worker->handler;
+    
+    t_worker = worker;
+    
+    apply_worker_sched(worker);
+    
+    if (handler->config.enable_file_fallback) {
+        worker->bounce = malloc(UFFD_MAX_FALLBACK_PAGES * PAGE_SIZE);
+    }
+    
+    LOG_INFO("Handler thread %d started", worker->index);
+    
+    int batch = handler->config.msg_batch_size;
+    if (batch < 1) batch = 1;
+    if (batch > UFFD_MAX_MSG_BATCH) batch = UFFD_MAX_MSG_BATCH;
+    
+    struct uffd_msg msgs[UFFD_MAX_MSG_BATCH];
+    FaultRef refs[UFFD_MAX_MSG_BATCH];
+    
+    struct pollfd pollfds[2];
+    pollfds[0].fd = handler->uffd;
+    pollfds[0].events = POLLIN;
+    pollfds[1].fd = handler->shutdown_pipe[0];
     pollfds[1].events = POLLIN;
     
-    while (handler->running) {
+    int fatal = 0;
+    
+    while (handler->running && !fatal) {
         int ret = poll(pollfds, 2, 1000);  /* 1秒超时 */
         
         if (ret < 0) {
@@ -247,60 +1418,271 @@ static void* handler_thread_func(void *arg) {
             continue;
         }
         
+        worker->stats.poll_calls++;
+        
         /* 检查关闭信号 */
         if (pollfds[1].revents & POLLIN) {
             LOG_INFO("Shutdown signal received");
             break;
         }
         
-        /* 处理 UFFD 事件 */
-        if (pollfds[0].revents & POLLIN) {
-            struct uffd_msg msg;
+        if (!(pollfds[0].revents & POLLIN)) {
+            continue;
+        }
+        
+        /* 读空 UFFD 消息队列，期间后台填充器让路 */
+        __atomic_fetch_add(&handler->demand_active, 1, __ATOMIC_RELAXED);
+        
+        for (;;) {
+            ssize_t n = read(handler->uffd, msgs, batch * sizeof(struct uffd_msg));
+            worker->stats.read_calls++;
             
-            ssize_t n = read(handler->uffd, &msg, sizeof(msg));
             if (n < 0) {
-                if (errno == EAGAIN) continue;
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) break;
                 LOG_ERROR("read(uffd) failed: %s", strerror(errno));
+                fatal = 1;
+                break;
+            }
+            
+            if (n % sizeof(struct uffd_msg) != 0) {
+                LOG_ERROR("read(uffd) returned %zd, not a multiple of %zu",
+                          n, sizeof(struct uffd_msg));
                 break;
             }
             
-            if (n != sizeof(msg)) {
-                LOG_ERROR("read(uffd) returned %zd, expected %zu", n, sizeof(msg));
+            int count = n / sizeof(struct uffd_msg);
+            int num_faults = 0;
+            
+            for (int i = 0; i < count; i++) {
+                if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+                    LOG_DEBUG("Page fault at 0x%lx, flags=0x%lx",
+                              (unsigned long)msgs[i].arg.pagefault.address,
+                              (unsigned long)msgs[i].arg.pagefault.flags);
+                    refs[num_faults].page = msgs[i].arg.pagefault.address & ~(PAGE_SIZE - 1);
+                    refs[num_faults].tid = (handler->uffd_features & UFFD_FEATURE_THREAD_ID) ?
+                                           msgs[i].arg.pagefault.feat.ptid : 0;
+                    num_faults++;
+                } else {
+                    handle_event(handler, &msgs[i]);
+                }
+            }
+            
+            if (num_faults > 0) {
+                if ((uint64_t)num_faults > worker->stats.max_batch) {
+                    worker->stats.max_batch = num_faults;
+                }
+                handle_fault_batch(handler, refs, num_faults);
+            }
+            
+            /* 未读满说明已经读空，省掉一次返回 EAGAIN 的 read */
+            if (count < batch) break;
+        }
+        
+        __atomic_fetch_sub(&handler->demand_active, 1, __ATOMIC_RELAXED);
+    }
+    
+    LOG_INFO("Handler thread %d exiting", worker->index);
+    free(worker->bounce);
+    worker->bounce = NULL;
+    t_worker = NULL;
+    return NULL;
+}
+
+/*
+ * 后台填充器
+ *
+ * 按 access_order 遍历 BigCache 索引，把源文件已被注册区域映射的页面
+ * 提前 UFFDIO_COPY 进去，应用访问时就不再缺页。尚未映射的页面保留，
+ * 有新区域注册时再扫描。缺页处理线程工作时让路，并以较低优先级运行
+ */
+typedef struct {
+    uint32_t order;              /* access_order */
+    uint32_t index;              /* BigCache 页索引 */
+} PopulateItem;
+
+static int compare_populate_item(const void *a, const void *b) {
+    const PopulateItem *x = (const PopulateItem*)a;
+    const PopulateItem *y = (const PopulateItem*)b;
+    if (x->order != y->order) return x->order < y->order ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/*
+ * 在已发布的区域表中查找映射了文件指定偏移的区域（调用者处于读侧临界区）
+ * 在 by_file 中二分找到最后一个起点不大于该偏移的区域，再向前检查同文件区域：
+ * 同一文件范围被多次映射时，包含该偏移的可能是起点更靠前的区域
+ */
+static MemoryRegion* find_file_region(UffdHandler *handler, int file_id,
+                                      uint64_t file_offset) {
+    RegionTable *table = __atomic_load_n(&handler->region_table, __ATOMIC_SEQ_CST);
+    if (!table) return NULL;
+    
+    int lo = 0;
+    int hi = table->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        MemoryRegion *r = table->by_file[mid];
+        if (r->file_id < file_id ||
+            (r->file_id == file_id && r->file_offset_base <= file_offset)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    for (int i = lo - 1; i >= 0 && table->by_file[i]->file_id == file_id; i--) {
+        MemoryRegion *region = table->by_file[i];
+        if (file_offset < region->file_offset_base + region->size) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+static void* populator_thread_func(void *arg) {
+    UffdHandler *handler = (UffdHandler*)arg;
+    BigCacheContext *bc = handler->bigcache;
+    uint32_t num_pages = bc->header.num_pages;
+    
+    size_t chunk = handler->config.populate_chunk_pages;
+    if (chunk < 1) chunk = 1;
+    
+    PopulateItem *items = malloc((size_t)num_pages * sizeof(PopulateItem));
+    if (!items) {
+        LOG_ERROR("Populator: out of memory");
+        return NULL;
+    }
+    
+    for (uint32_t i = 0; i < num_pages; i++) {
+        items[i].order = bc->page_index[i].access_order;
+        items[i].index = i;
+    }
+    qsort(items, num_pages, sizeof(PopulateItem), compare_populate_item);
+    
+    t_populator = handler;
+    
+    /* 让缺页处理线程和应用线程优先 */
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+    
+    LOG_INFO("Populator started (%u pages)", num_pages);
+    
+    uint8_t *data_base = (uint8_t*)bc->mapped_data + bc->header.data_offset;
+    size_t remaining = num_pages;
+    uint32_t seen_gen = __atomic_load_n(&handler->region_gen, __ATOMIC_ACQUIRE) - 1;
+    
+    while (handler->populator_running && remaining > 0) {
+        /* 等待新区域注册：注册路径增加 region_gen 后立即唤醒，启动期映射不必等轮询 */
+        pthread_mutex_lock(&handler->populator_lock);
+        while (handler->populator_running &&
+               __atomic_load_n(&handler->region_gen, __ATOMIC_ACQUIRE) == seen_gen) {
+            pthread_cond_wait(&handler->populator_cond, &handler->populator_lock);
+        }
+        seen_gen = __atomic_load_n(&handler->region_gen, __ATOMIC_ACQUIRE);
+        pthread_mutex_unlock(&handler->populator_lock);
+        if (!handler->populator_running) break;
+        
+        size_t kept = 0;
+        size_t k = 0;
+        
+        while (k < remaining && handler->populator_running) {
+            /* 每次让路只计一次，自旋期间不碰 stats_lock */
+            if (__atomic_load_n(&handler->demand_active, __ATOMIC_RELAXED) > 0) {
+                __atomic_fetch_add(&handler->stats.populate_yields, 1, __ATOMIC_RELAXED);
+                while (__atomic_load_n(&handler->demand_active, __ATOMIC_RELAXED) > 0 &&
+                       handler->populator_running) {
+                    sched_yield();
+                }
+            }
+            
+            uint32_t idx = items[k].index;
+            BigCachePageIndex *pi = &bc->page_index[idx];
+            
+            /* 文件尚未映射：保留到下一轮 */
+            if (__atomic_load_n(&handler->file_region_count[pi->file_id],
+                                __ATOMIC_RELAXED) == 0) {
+                items[kept++] = items[k++];
                 continue;
             }
             
-            /* 处理消息 */
-            switch (msg.event) {
-                case UFFD_EVENT_PAGEFAULT:
-                    _uffd_handle_pagefault(handler,
-                                           msg.arg.pagefault.address,
-                                           msg.arg.pagefault.flags);
-                    break;
-                    
-                case UFFD_EVENT_FORK:
-                    LOG_DEBUG("UFFD_EVENT_FORK received");
-                    break;
-                    
-                case UFFD_EVENT_REMAP:
-                    LOG_DEBUG("UFFD_EVENT_REMAP received");
-                    break;
-                    
-                case UFFD_EVENT_REMOVE:
-                    LOG_DEBUG("UFFD_EVENT_REMOVE received");
-                    break;
-                    
-                case UFFD_EVENT_UNMAP:
-                    LOG_DEBUG("UFFD_EVENT_UNMAP received");
-                    break;
-                    
-                default:
-                    LOG_WARN("Unknown UFFD event: %u", msg.event);
+            /* 读侧临界区内完成拷贝：区域在离开前不会被释放，注销也不必等待拷贝 */
+            region_read_lock(handler);
+            
+            MemoryRegion *region = find_file_region(handler, pi->file_id, pi->source_offset);
+            if (!region) {
+                region_read_unlock(handler);
+                items[kept++] = items[k++];
+                continue;
+            }
+            
+            uint64_t base = (uint64_t)region->base;
+            uint64_t dst = base + (pi->source_offset - region->file_offset_base);
+            if (region_page_populated(region, dst)) {
+                region_read_unlock(handler);
+                k++;
+                continue;
+            }
+            
+            /*
+             * 访问顺序上相邻、在文件和 BigCache 中也相邻的页合并为一次拷贝；
+             * MINOR 区域不经过 BigCache 拷贝，只要求文件内相邻
+             */
+            uint64_t len = PAGE_SIZE;
+            size_t next = k + 1;
+            if (region->fault_size > PAGE_SIZE) {
+                /* hugetlb shadow 按大页安装 */
+                dst &= ~((uint64_t)region->fault_size - 1);
+                len = region->fault_size;
+            }
+            while (region->fault_size == PAGE_SIZE &&
+                   next < remaining && len / PAGE_SIZE < chunk) {
+                uint32_t nidx = items[next].index;
+                BigCachePageIndex *npi = &bc->page_index[nidx];
+                
+                if ((!region->minor && nidx != idx + len / PAGE_SIZE) ||
+                    (int)npi->file_id != (int)pi->file_id ||
+                    npi->source_offset != pi->source_offset + len ||
+                    dst + len >= base + region->size ||
+                    region_page_populated(region, dst + len)) {
                     break;
+                }
+                len += PAGE_SIZE;
+                next++;
+            }
+            
+            long copied = region->minor ?
+                continue_pages(handler, dst, len, region->fault_size, 0, NULL) :
+                copy_pages(handler, dst, (uint64_t)(data_base + (uint64_t)idx * PAGE_SIZE),
+                           len, 0, NULL);
+            if (copied >= 0) {
+                region_mark_populated(region, dst, len);
+                if (!region->minor) bigcache_mark_served(bc, idx, (uint32_t)(len / PAGE_SIZE));
             }
+            
+            region_read_unlock(handler);
+            
+            pthread_mutex_lock(&handler->stats_lock);
+            handler->stats.populate_copies++;
+            if (copied >= 0) {
+                handler->stats.populated_pages += copied;
+                handler->stats.populate_races += len / PAGE_SIZE - copied;
+            } else {
+                handler->stats.copy_errors++;
+            }
+            pthread_mutex_unlock(&handler->stats_lock);
+            
+            k = next;
+        }
+        
+        /* 被中断时未扫描的部分也要保留 */
+        while (k < remaining) {
+            items[kept++] = items[k++];
         }
+        remaining = kept;
     }
     
-    LOG_INFO("Handler thread exiting");
+    LOG_INFO("Populator exiting (%zu pages not mapped)", remaining);
+    free(items);
     return NULL;
 }
 
@@ -320,9 +1702,12 @@ UffdHandler* uffd_handler_create(BigCacheContext *bigcache) {
     /* 初始化锁 */
     pthread_mutex_init(&handler->regions_lock, NULL);
     pthread_mutex_init(&handler->stats_lock, NULL);
+    pthread_mutex_init(&handler->shadow_lock, NULL);
+    pthread_mutex_init(&handler->populator_lock, NULL);
+    pthread_cond_init(&handler->populator_cond, NULL);
     
     /* 创建 userfaultfd */
-    handler->uffd = create_userfaultfd();
+    handler->uffd = create_userfaultfd(&handler->uffd_features);
     if (handler->uffd < 0) {
         uffd_handler_destroy(handler);
         return NULL;
@@ -352,7 +1737,31 @@ UffdHandler* uffd_handler_create(BigCacheContext *bigcache) {
     handler->config.enable_stats = 1;
     handler->config.enable_logging = 1;
     handler->config.handler_priority = 0;
+    handler->config.handler_sched_policy = SCHED_OTHER;
+    handler->config.handler_rt_priority = 1;
+    handler->config.handler_cpu_mask = 0;
     handler->config.prefetch_ahead = 4;
+    handler->config.prefetch_behind = 0;
+    handler->config.num_handler_threads = 1;
+    handler->config.msg_batch_size = UFFD_DEFAULT_MSG_BATCH;
+    handler->config.enable_populator = 0;
+    handler->config.populate_chunk_pages = 16;
+    handler->config.serve_mode = UFFD_SERVE_COPY;
+    handler->config.shadow_hugetlb = 0;
+    handler->config.batch_wake = 1;
+    handler->config.enable_file_fallback = 1;
+    handler->config.fallback_readahead = 16;
+    
+    /* 每个 BigCache 文件的区域计数，供填充器快速跳过未映射的文件 */
+    handler->file_region_count = calloc(bigcache->header.num_files + 1, sizeof(uint32_t));
+    handler->shadows = calloc(bigcache->header.num_files + 1, sizeof(UffdShadow));
+    if (!handler->file_region_count || !handler->shadows) {
+        uffd_handler_destroy(handler);
+        return NULL;
+    }
+    for (uint32_t i = 0; i <= bigcache->header.num_files; i++) {
+        handler->shadows[i].fd = -1;
+    }
     
     LOG_INFO("UFFD handler created");
     return handler;
@@ -369,10 +1778,11 @@ void uffd_handler_destroy(UffdHandler *handler) {
     MemoryRegion *region = handler->regions;
     while (region) {
         MemoryRegion *next = region->next;
-        free(region->file_path);
-        free(region);
+        region_free(region);
         region = next;
     }
+    handler->regions = NULL;
+    handler->num_regions = 0;
     
     /* 关闭文件描述符 */
     if (handler->uffd >= 0) {
@@ -391,9 +1801,35 @@ void uffd_handler_destroy(UffdHandler *handler) {
         munmap(handler->zero_page, PAGE_SIZE);
     }
     
+    free(handler->region_table);
+    free(handler->file_region_count);
+    
+    for (int i = 0; i < handler->num_file_misses; i++) {
+        free(handler->file_misses[i].file_path);
+    }
+    free(handler->file_misses);
+    
+    for (int i = 0; i < handler->num_event_files; i++) {
+        free(handler->event_files[i].file_path);
+    }
+    free(handler->event_files);
+    
+    /* 关闭 shadow memfd（已建立的映射仍持有各自的引用）*/
+    if (handler->shadows) {
+        for (uint32_t i = 0; i <= handler->bigcache->header.num_files; i++) {
+            if (handler->shadows[i].fd >= 0) {
+                close(handler->shadows[i].fd);
+            }
+        }
+        free(handler->shadows);
+    }
+    
     /* 销毁锁 */
     pthread_mutex_destroy(&handler->regions_lock);
     pthread_mutex_destroy(&handler->stats_lock);
+    pthread_mutex_destroy(&handler->shadow_lock);
+    pthread_mutex_destroy(&handler->populator_lock);
+    pthread_cond_destroy(&handler->populator_cond);
     
     /* 清理全局引用 */
     if (g_active_handler == handler) {
@@ -417,6 +1853,45 @@ int uffd_handler_get_config(UffdHandler *handler, UffdConfig *config) {
     return 0;
 }
 
+/* 通知并等待所有处理线程退出 */
+static void join_workers(UffdHandler *handler, int count) {
+    /* 关闭管道保持可读，所有线程都能看到关闭信号 */
+    char c = 1;
+    if (write(handler->shutdown_pipe[1], &c, 1) < 0) {
+        LOG_WARN("write(shutdown_pipe) failed: %s", strerror(errno));
+    }
+    
+    for (int i = 0; i < count; i++) {
+        pthread_join(handler->workers[i].thread, NULL);
+    }
+    
+    /* 取走关闭信号，允许再次启动 */
+    if (read(handler->shutdown_pipe[0], &c, 1) < 0) {
+        LOG_WARN("read(shutdown_pipe) failed: %s", strerror(errno));
+    }
+    
+    if (handler->config.event_log_path) {
+        long n = uffd_handler_dump_events(handler, handler->config.event_log_path);
+        if (n >= 0) {
+            LOG_INFO("Wrote %ld fault events to %s", n, handler->config.event_log_path);
+        } else {
+            LOG_WARN("Cannot write fault events to %s: %s",
+                     handler->config.event_log_path, strerror((int)-n));
+        }
+    }
+    
+    /* 线程私有统计并入全局统计 */
+    pthread_mutex_lock(&handler->stats_lock);
+    for (int i = 0; i < count; i++) {
+        stats_merge(&handler->stats, &handler->workers[i].stats);
+        free(handler->workers[i].events);
+    }
+    handler->num_workers = 0;
+    free(handler->workers);
+    handler->workers = NULL;
+    pthread_mutex_unlock(&handler->stats_lock);
+}
+
 /* 启动处理器 */
 int uffd_handler_start(UffdHandler *handler) {
     if (!handler) return -EINVAL;
@@ -426,20 +1901,61 @@ int uffd_handler_start(UffdHandler *handler) {
         return 0;
     }
     
+    int count = handler->config.num_handler_threads;
+    if (count < 1) count = 1;
+    if (count > UFFD_MAX_HANDLER_THREADS) count = UFFD_MAX_HANDLER_THREADS;
+    
+    UffdWorker *workers = calloc(count, sizeof(UffdWorker));
+    if (!workers) return -ENOMEM;
+    
+    memset(handler->inflight, 0, sizeof(handler->inflight));
+    
+    /* 缺页事件环，分配失败时该线程不记录 */
+    if (handler->config.event_ring_size > 0) {
+        uint64_t cap = 1;
+        while (cap < handler->config.event_ring_size) cap <<= 1;
+        for (int i = 0; i < count; i++) {
+            workers[i].events = calloc(cap, sizeof(UffdFaultEvent));
+            workers[i].event_mask = cap - 1;
+        }
+    }
+    
+    pthread_mutex_lock(&handler->stats_lock);
+    handler->workers = workers;
+    handler->num_workers = count;
+    pthread_mutex_unlock(&handler->stats_lock);
+    
     handler->running = 1;
     
-    int ret = pthread_create(&handler->handler_thread, NULL,
-                             handler_thread_func, handler);
-    if (ret != 0) {
-        LOG_ERROR("pthread_create failed: %s", strerror(ret));
-        handler->running = 0;
-        return -ret;
+    for (int i = 0; i < count; i++) {
+        workers[i].handler = handler;
+        workers[i].index = i;
+        
+        int ret = pthread_create(&workers[i].thread, NULL,
+                                 handler_thread_func, &workers[i]);
+        if (ret != 0) {
+            LOG_ERROR("pthread_create failed: %s", strerror(ret));
+            handler->running = 0;
+            join_workers(handler, i);
+            return -ret;
+        }
+    }
+    
+    /* 后台填充器 */
+    if (handler->config.enable_populator) {
+        handler->populator_running = 1;
+        int ret = pthread_create(&handler->populator_thread, NULL,
+                                 populator_thread_func, handler);
+        if (ret != 0) {
+            LOG_WARN("Populator not started: %s", strerror(ret));
+            handler->populator_running = 0;
+        }
     }
     
     /* 设置为活跃处理器 */
     g_active_handler = handler;
     
-    LOG_INFO("UFFD handler started");
+    LOG_INFO("UFFD handler started (%d threads)", count);
     return 0;
 }
 
@@ -453,14 +1969,16 @@ int uffd_handler_stop(UffdHandler *handler) {
     
     handler->running = 0;
     
-    /* 发送关闭信号 */
-    char c = 1;
-    if (write(handler->shutdown_pipe[1], &c, 1) < 0) {
-        LOG_WARN("write(shutdown_pipe) failed: %s", strerror(errno));
+    if (handler->populator_running) {
+        pthread_mutex_lock(&handler->populator_lock);
+        handler->populator_running = 0;
+        pthread_cond_signal(&handler->populator_cond);
+        pthread_mutex_unlock(&handler->populator_lock);
+        pthread_join(handler->populator_thread, NULL);
     }
     
-    /* 等待线程结束 */
-    pthread_join(handler->handler_thread, NULL);
+    /* 发送关闭信号并等待线程结束 */
+    join_workers(handler, handler->num_workers);
     
     LOG_INFO("UFFD handler stopped");
     return 0;
@@ -470,12 +1988,18 @@ int uffd_handler_is_running(UffdHandler *handler) {
     return handler ? handler->running : 0;
 }
 
-/* 注册内存区域 */
-int uffd_handler_register_region(UffdHandler *handler,
-                                  void *addr,
-                                  size_t size,
-                                  const char *file_path,
-                                  uint64_t file_offset_base) {
+/*
+ * 注册内存区域，minor 区域同时以 MINOR 模式注册。
+ * prot 为应用请求的原权限，换回文件映射时使用；未知时为 0，该区域不换回
+ */
+static int register_region(UffdHandler *handler,
+                           void *addr,
+                           size_t size,
+                           const char *file_path,
+                           uint64_t file_offset_base,
+                           int minor,
+                           size_t fault_size,
+                           int prot) {
     if (!handler || !addr || size == 0 || !file_path) {
         return -EINVAL;
     }
@@ -499,39 +2023,116 @@ int uffd_handler_register_region(UffdHandler *handler,
     region->size = size;
     region->file_path = strdup(file_path);
     region->file_offset_base = file_offset_base;
-    
-    if (!region->file_path) {
-        free(region);
+    region->populated = calloc((size / PAGE_SIZE + 7) / 8, 1);
+    region->file_id = bigcache_find_file(handler->bigcache, file_path);
+    region->minor = minor;
+    region->fault_size = fault_size;
+    region->prot = prot;
+    region->source_fd = -1;
+    region->event_file = -1;
+    
+    if (!region->file_path || !region->populated) {
+        region_free(region);
         return -ENOMEM;
     }
     
+    /* 未命中回退用的原文件，打不开时退回零页填充 */
+    if (handler->config.enable_file_fallback) {
+        region->source_fd = open(file_path, O_RDONLY | O_CLOEXEC);
+        if (region->source_fd < 0) {
+            LOG_DEBUG("No fallback source for %s: %s", file_path, strerror(errno));
+        }
+    }
+    
+    pthread_mutex_lock(&handler->regions_lock);
+    
+    if (handler->config.event_ring_size > 0) {
+        region->event_file = event_file_intern(handler, file_path, region->file_id);
+    }
+    
+    /* 先发布到区域表，注册后立即到来的缺页就能找到区域 */
+    int ret = region_table_publish(handler, region, NULL);
+    if (ret < 0) {
+        pthread_mutex_unlock(&handler->regions_lock);
+        region_free(region);
+        return ret;
+    }
+    
     /* 向 UFFD 注册区域 */
     struct uffdio_register uffdio_register;
     uffdio_register.range.start = (uint64_t)addr;
     uffdio_register.range.len = size;
     uffdio_register.mode = UFFDIO_REGISTER_MODE_MISSING;
+    if (minor) {
+        uffdio_register.mode |= UFFDIO_REGISTER_MODE_MINOR;
+    }
     
     if (ioctl(handler->uffd, UFFDIO_REGISTER, &uffdio_register) < 0) {
-        LOG_ERROR("ioctl(UFFDIO_REGISTER) failed: %s", strerror(errno));
-        free(region->file_path);
-        free(region);
-        return -errno;
+        ret = -errno;
+        LOG_ERROR("ioctl(UFFDIO_REGISTER) failed: %s", strerror(-ret));
+        if (region_table_publish(handler, NULL, region) < 0) {
+            /* 仍在表中，不能释放 */
+            pthread_mutex_unlock(&handler->regions_lock);
+            return ret;
+        }
+        pthread_mutex_unlock(&handler->regions_lock);
+        region_free(region);
+        return ret;
     }
     
     /* 添加到链表 */
-    pthread_mutex_lock(&handler->regions_lock);
     region->next = handler->regions;
     handler->regions = region;
     handler->num_regions++;
+    if (region->file_id >= 0) {
+        __atomic_fetch_add(&handler->file_region_count[region->file_id], 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock(&handler->populator_lock);
+        __atomic_fetch_add(&handler->region_gen, 1, __ATOMIC_RELEASE);
+        pthread_cond_signal(&handler->populator_cond);
+        pthread_mutex_unlock(&handler->populator_lock);
+    }
     pthread_mutex_unlock(&handler->regions_lock);
     
-    LOG_INFO("Registered region: base=0x%lx, size=%zu, file=%s, offset=%lu",
-             (unsigned long)addr, size, file_path, (unsigned long)file_offset_base);
+    LOG_INFO("Registered region: base=0x%lx, size=%zu, file=%s, offset=%lu%s",
+             (unsigned long)addr, size, file_path, (unsigned long)file_offset_base,
+             minor ? " (minor)" : "");
     
     return 0;
 }
 
+int uffd_handler_register_region(UffdHandler *handler,
+                                  void *addr,
+                                  size_t size,
+                                  const char *file_path,
+                                  uint64_t file_offset_base) {
+    return register_region(handler, addr, size, file_path, file_offset_base,
+                           0, PAGE_SIZE, 0);
+}
+
 /* 取消注册内存区域 */
+/*
+ * 从链表和区域表摘下 *prev（调用者持有 regions_lock），
+ * 区域表发布后处理线程不再引用它，调用者解锁后释放
+ */
+static int region_detach(UffdHandler *handler, MemoryRegion **prev) {
+    MemoryRegion *region = *prev;
+    
+    *prev = region->next;
+    handler->num_regions--;
+    if (region->file_id >= 0) {
+        __atomic_fetch_sub(&handler->file_region_count[region->file_id], 1,
+                           __ATOMIC_RELAXED);
+    }
+    
+    if (region->miss_faults > 0) {
+        file_miss_add(handler, region->file_path,
+                      region->miss_faults, region->miss_pages);
+    }
+    
+    /* 从区域表移除，等待处理线程不再引用后才能释放 */
+    return region_table_publish(handler, NULL, region);
+}
+
 int uffd_handler_unregister_region(UffdHandler *handler, void *addr) {
     if (!handler || !addr) return -EINVAL;
     
@@ -551,14 +2152,16 @@ int uffd_handler_unregister_region(UffdHandler *handler, void *addr) {
                 LOG_WARN("ioctl(UFFDIO_UNREGISTER) failed: %s", strerror(errno));
             }
             
-            /* 从链表移除 */
-            *prev = region->next;
-            handler->num_regions--;
+            if (region_detach(handler, prev) < 0) {
+                pthread_mutex_unlock(&handler->regions_lock);
+                LOG_ERROR("Out of memory unpublishing region 0x%lx, leaking it",
+                          (unsigned long)addr);
+                return -ENOMEM;
+            }
             
             pthread_mutex_unlock(&handler->regions_lock);
             
-            free(region->file_path);
-            free(region);
+            region_free(region);
             
             LOG_INFO("Unregistered region: base=0x%lx", (unsigned long)addr);
             return 0;
@@ -572,12 +2175,176 @@ int uffd_handler_unregister_region(UffdHandler *handler, void *addr) {
     return -ENOENT;
 }
 
-/* 创建受 UFFD 保护的映射 */
-void* uffd_handler_create_mapping(UffdHandler *handler,
-                                   size_t size,
-                                   const char *file_path,
-                                   uint64_t file_offset_base,
-                                   int prot) {
+/* 普通 shmem shadow：按源文件偏移稀疏写入 */
+static int shadow_fill_shmem(BigCacheContext *bc, int fd, int file_id, uint64_t size) {
+    if (ftruncate(fd, size) < 0) return -errno;
+    
+    uint8_t *data_base = (uint8_t*)bc->mapped_data + bc->header.data_offset;
+    for (uint32_t i = 0; i < bc->header.num_pages; i++) {
+        BigCachePageIndex *pi = &bc->page_index[i];
+        if ((int)pi->file_id != file_id) continue;
+        
+        if (pwrite(fd, data_base + (uint64_t)i * PAGE_SIZE, PAGE_SIZE,
+                   pi->source_offset) != PAGE_SIZE) {
+            return errno ? -errno : -EIO;
+        }
+        bigcache_mark_served(bc, i, 1);
+    }
+    return 0;
+}
+
+/* hugetlb shadow：预先分配全部大页（大页不足时在这里失败，而不是缺页时 SIGBUS）*/
+static int shadow_fill_hugetlb(BigCacheContext *bc, int fd, int file_id, uint64_t size) {
+    if (ftruncate(fd, size) < 0) return -errno;
+    if (fallocate(fd, 0, 0, size) < 0) return -errno;
+    
+    uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return -errno;
+    
+    uint8_t *data_base = (uint8_t*)bc->mapped_data + bc->header.data_offset;
+    for (uint32_t i = 0; i < bc->header.num_pages; i++) {
+        BigCachePageIndex *pi = &bc->page_index[i];
+        if ((int)pi->file_id == file_id) {
+            memcpy(map + pi->source_offset, data_base + (uint64_t)i * PAGE_SIZE, PAGE_SIZE);
+            bigcache_mark_served(bc, i, 1);
+        }
+    }
+    
+    munmap(map, size);
+    return 0;
+}
+
+/*
+ * 取得文件的 shadow memfd，首次使用时创建并装入该文件在 BigCache 中的全部页面
+ * shmem shadow 中未收录的页保持空洞，缺页时走 MISSING 零填充；
+ * 需要的大小超出 hugetlb shadow 时返回 NULL
+ */
+static UffdShadow* get_shadow(UffdHandler *handler, int file_id, uint64_t need_size) {
+    BigCacheContext *bc = handler->bigcache;
+    UffdShadow *sh = &handler->shadows[file_id];
+    
+    pthread_mutex_lock(&handler->shadow_lock);
+    
+    if (sh->fd < 0) {
+        uint64_t size = need_size;
+        for (uint32_t i = 0; i < bc->header.num_pages; i++) {
+            BigCachePageIndex *pi = &bc->page_index[i];
+            if ((int)pi->file_id == file_id && pi->source_offset + PAGE_SIZE > size) {
+                size = pi->source_offset + PAGE_SIZE;
+            }
+        }
+        
+        if (handler->config.shadow_hugetlb) {
+            uint64_t hsize = (size + UFFD_HUGE_PAGE_SIZE - 1) & ~(UFFD_HUGE_PAGE_SIZE - 1);
+            int fd = memfd_create("bigcache-shadow", MFD_CLOEXEC | MFD_HUGETLB);
+            int ret = fd < 0 ? -errno : shadow_fill_hugetlb(bc, fd, file_id, hsize);
+            if (ret == 0) {
+                sh->fd = fd;
+                sh->size = hsize;
+                sh->page_size = UFFD_HUGE_PAGE_SIZE;
+            } else {
+                if (fd >= 0) close(fd);
+                LOG_WARN("hugetlb shadow unavailable (%s), using shmem", strerror(-ret));
+            }
+        }
+        
+        if (sh->fd < 0) {
+            int fd = memfd_create("bigcache-shadow", MFD_CLOEXEC);
+            int ret = fd < 0 ? -errno : shadow_fill_shmem(bc, fd, file_id, size);
+            if (ret == 0) {
+                sh->fd = fd;
+                sh->size = size;
+                sh->page_size = PAGE_SIZE;
+            } else {
+                if (fd >= 0) close(fd);
+                LOG_WARN("shadow memfd for file %d failed: %s", file_id, strerror(-ret));
+            }
+        }
+        
+        if (sh->fd >= 0) {
+            LOG_INFO("Shadow memfd for %s: %lu bytes, page size %zu",
+                     bc->file_table[file_id].path, (unsigned long)sh->size, sh->page_size);
+        }
+    }
+    
+    /* shmem shadow 可以按需扩展 */
+    if (sh->fd >= 0 && need_size > sh->size && sh->page_size == PAGE_SIZE &&
+        ftruncate(sh->fd, need_size) == 0) {
+        sh->size = need_size;
+    }
+    
+    UffdShadow *ret = (sh->fd >= 0 && need_size <= sh->size) ? sh : NULL;
+    pthread_mutex_unlock(&handler->shadow_lock);
+    return ret;
+}
+
+/*
+ * MINOR 模式映射：MAP_PRIVATE 映射文件的 shadow memfd，以 MISSING|MINOR 注册。
+ * 内核不支持、文件不在 BigCache 中或 hugetlb 偏移未按大页对齐时返回 MAP_FAILED，
+ * 由调用者退回 COPY 模式。fixed 非 NULL 时覆盖到该地址（hugetlb 会越界，不支持）
+ */
+static void* create_minor_mapping(UffdHandler *handler,
+                                  void *fixed,
+                                  size_t size,
+                                  const char *file_path,
+                                  uint64_t file_offset_base,
+                                  int prot) {
+    if (!(handler->uffd_features & UFFD_FEATURE_MINOR_SHMEM)) {
+        return MAP_FAILED;
+    }
+    
+    int file_id = bigcache_find_file(handler->bigcache, file_path);
+    if (file_id < 0) return MAP_FAILED;
+    
+    UffdShadow *sh = get_shadow(handler, file_id, file_offset_base + size);
+    if (!sh) return MAP_FAILED;
+    
+    if (sh->page_size > PAGE_SIZE) {
+        if (fixed || !(handler->uffd_features & UFFD_FEATURE_MINOR_HUGETLBFS) ||
+            file_offset_base % sh->page_size != 0) {
+            return MAP_FAILED;
+        }
+        size = (size + sh->page_size - 1) & ~(sh->page_size - 1);
+    }
+    
+    void *addr = mmap(fixed, size, prot, MAP_PRIVATE | (fixed ? MAP_FIXED : 0),
+                      sh->fd, file_offset_base);
+    if (addr == MAP_FAILED) {
+        LOG_WARN("mmap(shadow) failed: %s", strerror(errno));
+        return MAP_FAILED;
+    }
+    
+    if (register_region(handler, addr, size, file_path, file_offset_base,
+                        1, sh->page_size, prot) < 0) {
+        if (!fixed) munmap(addr, size);
+        return MAP_FAILED;
+    }
+    
+    return addr;
+}
+
+/* 覆盖映射失败后按原文件恢复该范围 */
+static void restore_file_mapping(void *addr, size_t size, const char *file_path,
+                                 uint64_t file_offset_base, int prot) {
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    void *p = MAP_FAILED;
+    if (fd >= 0) {
+        p = mmap(addr, size, prot, MAP_PRIVATE | MAP_FIXED, fd, file_offset_base);
+        close(fd);
+    }
+    if (p == MAP_FAILED) {
+        LOG_ERROR("Cannot restore file mapping of %s at 0x%lx: %s",
+                  file_path, (unsigned long)addr, strerror(errno));
+    }
+}
+
+/* 创建映射：fixed 为 NULL 时新建，否则以 MAP_FIXED 覆盖已有映射的该范围 */
+static void* create_mapping(UffdHandler *handler,
+                            void *fixed,
+                            size_t size,
+                            const char *file_path,
+                            uint64_t file_offset_base,
+                            int prot) {
     if (!handler || size == 0 || !file_path) {
         return MAP_FAILED;
     }
@@ -585,42 +2352,442 @@ void* uffd_handler_create_mapping(UffdHandler *handler,
     /* 对齐大小 */
     size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     
+    if (handler->config.serve_mode == UFFD_SERVE_MINOR) {
+        void *addr = create_minor_mapping(handler, fixed, size, file_path,
+                                          file_offset_base, prot);
+        if (addr != MAP_FAILED) return addr;
+        LOG_DEBUG("Minor mapping unavailable for %s, using copy mode", file_path);
+    }
+    
     /* 创建匿名映射 */
-    void *addr = mmap(NULL, size,
+    void *addr = mmap(fixed, size,
                       prot | PROT_WRITE,  /* 需要写权限来填充数据 */
-                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      MAP_PRIVATE | MAP_ANONYMOUS | (fixed ? MAP_FIXED : 0),
                       -1, 0);
     
     if (addr == MAP_FAILED) {
         LOG_ERROR("mmap failed: %s", strerror(errno));
+        if (fixed) restore_file_mapping(fixed, size, file_path, file_offset_base, prot);
         return MAP_FAILED;
     }
     
     /* 注册到 UFFD */
-    int ret = uffd_handler_register_region(handler, addr, size,
-                                           file_path, file_offset_base);
+    int ret = register_region(handler, addr, size, file_path, file_offset_base,
+                              0, PAGE_SIZE, prot);
     if (ret < 0) {
-        munmap(addr, size);
+        if (fixed) {
+            restore_file_mapping(fixed, size, file_path, file_offset_base, prot);
+        } else {
+            munmap(addr, size);
+        }
         return MAP_FAILED;
     }
     
     return addr;
 }
 
+/* 创建受 UFFD 保护的映射 */
+void* uffd_handler_create_mapping(UffdHandler *handler,
+                                   size_t size,
+                                   const char *file_path,
+                                   uint64_t file_offset_base,
+                                   int prot) {
+    return create_mapping(handler, NULL, size, file_path, file_offset_base, prot);
+}
+
+void* uffd_handler_overlay_mapping(UffdHandler *handler,
+                                    void *addr,
+                                    size_t size,
+                                    const char *file_path,
+                                    uint64_t file_offset_base,
+                                    int prot) {
+    if (!addr || (uint64_t)addr % PAGE_SIZE != 0) return MAP_FAILED;
+    return create_mapping(handler, addr, size, file_path, file_offset_base, prot);
+}
+
+/*
+ * 复制区域的 [from, to) 部分（调用者持有 regions_lock）
+ * 已安装位图随之平移，未命中计数留在原区域由调用者汇总
+ */
+static MemoryRegion* region_split(MemoryRegion *region, uint64_t from, uint64_t to) {
+    MemoryRegion *part = calloc(1, sizeof(MemoryRegion));
+    if (!part) return NULL;
+    
+    size_t shift = (from - (uint64_t)region->base) / PAGE_SIZE;
+    size_t npages = (to - from) / PAGE_SIZE;
+    
+    part->base = (void*)from;
+    part->size = to - from;
+    part->file_path = strdup(region->file_path);
+    part->file_offset_base = region->file_offset_base + (from - (uint64_t)region->base);
+    part->prot = region->prot;
+    part->populated = calloc((npages + 7) / 8, 1);
+    part->file_id = region->file_id;
+    part->minor = region->minor;
+    part->fault_size = region->fault_size;
+    part->source_fd = region->source_fd >= 0 ?
+                      fcntl(region->source_fd, F_DUPFD_CLOEXEC, 0) : -1;
+    part->event_file = region->event_file;
+    
+    if (!part->file_path || !part->populated) {
+        region_free(part);
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < npages; i++) {
+        if (region_page_populated(region, (uint64_t)region->base + (shift + i) * PAGE_SIZE)) {
+            part->populated[i / 8] |= (uint8_t)(1 << (i % 8));
+        }
+    }
+    
+    return part;
+}
+
+/*
+ * 把部分落在 [start, end) 内的区域裁成两侧剩余部分（调用者持有 regions_lock）
+ * 先发布尾部再用头部替换原区域，过程中任一时刻尾部地址都能查到区域
+ */
+static int region_trim(UffdHandler *handler, MemoryRegion **prev,
+                       uint64_t start, uint64_t end) {
+    MemoryRegion *region = *prev;
+    uint64_t rs = (uint64_t)region->base;
+    uint64_t re = rs + region->size;
+    
+    MemoryRegion *head = rs < start ? region_split(region, rs, start) : NULL;
+    MemoryRegion *tail = re > end ? region_split(region, end, re) : NULL;
+    if ((rs < start && !head) || (re > end && !tail) ||
+        (tail && region_table_publish(handler, tail, NULL) < 0)) {
+        if (head) region_free(head);
+        if (tail) region_free(tail);
+        return -ENOMEM;
+    }
+    
+    if (region_table_publish(handler, head, region) < 0) {
+        /* 原区域仍在表中，尾部与其重叠但内容一致，保留两者 */
+        if (head) region_free(head);
+        if (tail) {
+            tail->next = region->next;
+            region->next = tail;
+            handler->num_regions++;
+            if (tail->file_id >= 0) {
+                __atomic_fetch_add(&handler->file_region_count[tail->file_id], 1,
+                                   __ATOMIC_RELAXED);
+            }
+        }
+        return -ENOMEM;
+    }
+    
+    struct uffdio_range range;
+    range.start = start > rs ? start : rs;
+    range.len = (end < re ? end : re) - range.start;
+    if (ioctl(handler->uffd, UFFDIO_UNREGISTER, &range) < 0) {
+        LOG_WARN("ioctl(UFFDIO_UNREGISTER) failed: %s", strerror(errno));
+    }
+    
+    MemoryRegion *next = region->next;
+    if (tail) {
+        tail->next = next;
+        next = tail;
+    }
+    if (head) {
+        head->next = next;
+        next = head;
+    }
+    *prev = next;
+    
+    int parts = (head != NULL) + (tail != NULL);
+    handler->num_regions += parts - 1;
+    if (region->file_id >= 0) {
+        __atomic_fetch_add(&handler->file_region_count[region->file_id], parts - 1,
+                           __ATOMIC_RELAXED);
+    }
+    if (region->miss_faults > 0) {
+        file_miss_add(handler, region->file_path, region->miss_faults, region->miss_pages);
+    }
+    region_free(region);
+    
+    return parts;
+}
+
+/*
+ * 取消注册与 [addr, addr + len) 重叠的区域
+ * 完全落在范围内的整体取消；部分重叠的（动态链接器先映射整个文件再以 MAP_FIXED
+ * 覆盖各段、或只 munmap 一部分）裁掉重叠部分，两侧仍由原文件偏移提供服务。
+ * hugetlb shadow 区域不能按 4K 裁剪，保持不变。返回取消或裁剪的区域数
+ */
+int uffd_handler_unregister_range(UffdHandler *handler, void *addr, size_t len) {
+    if (!handler || !addr) return -EINVAL;
+    
+    uint64_t start = (uint64_t)addr & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t end = ((uint64_t)addr + len + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    int count = 0;
+    
+    for (;;) {
+        void *base = NULL;
+        
+        pthread_mutex_lock(&handler->regions_lock);
+        for (MemoryRegion *r = handler->regions; r; r = r->next) {
+            if ((uint64_t)r->base >= start && (uint64_t)r->base + r->size <= end) {
+                base = r->base;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&handler->regions_lock);
+        
+        if (!base || uffd_handler_unregister_region(handler, base) < 0) break;
+        count++;
+    }
+    
+    pthread_mutex_lock(&handler->regions_lock);
+    MemoryRegion **prev = &handler->regions;
+    while (*prev) {
+        MemoryRegion *r = *prev;
+        uint64_t rs = (uint64_t)r->base;
+        if (rs >= end || rs + r->size <= start || r->fault_size != PAGE_SIZE) {
+            prev = &r->next;
+            continue;
+        }
+        
+        int parts = region_trim(handler, prev, start, end);
+        if (parts < 0) {
+            LOG_ERROR("Out of memory trimming region 0x%lx, keeping it",
+                      (unsigned long)rs);
+            prev = &(*prev)->next;
+            continue;
+        }
+        count++;
+        
+        /* 跳过刚插入的剩余部分 */
+        while (parts-- > 0) prev = &(*prev)->next;
+    }
+    pthread_mutex_unlock(&handler->regions_lock);
+    
+    return count;
+}
+
 /* 销毁映射 */
 int uffd_handler_destroy_mapping(UffdHandler *handler, void *addr, size_t size) {
     if (!handler || !addr) return -EINVAL;
     
+    /* hugetlb 区域按大页向上取整过，按注册大小解除映射 */
+    pthread_mutex_lock(&handler->regions_lock);
+    MemoryRegion *region = _uffd_find_region(handler, addr);
+    if (region && region->base == addr && region->size > size) {
+        size = region->size;
+    }
+    pthread_mutex_unlock(&handler->regions_lock);
+    
     uffd_handler_unregister_region(handler, addr);
     return munmap(addr, size);
 }
 
+int uffd_vma_snapshot(UffdVmaSnapshot *snap) {
+    snap->entries = NULL;
+    snap->count = 0;
+    
+    FILE *fp = fopen("/proc/self/maps", "re");
+    if (!fp) return -errno;
+    
+    char line[512];
+    int cap = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long vs, ve, inode;
+        char perms[8];
+        if (sscanf(line, "%lx-%lx %7s %*s %*s %lu", &vs, &ve, perms, &inode) != 4) continue;
+        
+        if (snap->count == cap) {
+            int new_cap = cap ? cap * 2 : 256;
+            UffdVma *grown = realloc(snap->entries, new_cap * sizeof(UffdVma));
+            if (!grown) {
+                fclose(fp);
+                uffd_vma_snapshot_free(snap);
+                return -ENOMEM;
+            }
+            snap->entries = grown;
+            cap = new_cap;
+        }
+        UffdVma *v = &snap->entries[snap->count++];
+        v->start = vs;
+        v->end = ve;
+        v->prot = (perms[0] == 'r' ? PROT_READ : 0) |
+                  (perms[1] == 'w' ? PROT_WRITE : 0) |
+                  (perms[2] == 'x' ? PROT_EXEC : 0);
+        v->anon = inode == 0;
+    }
+    fclose(fp);
+    return 0;
+}
+
+void uffd_vma_snapshot_free(UffdVmaSnapshot *snap) {
+    free(snap->entries);
+    snap->entries = NULL;
+    snap->count = 0;
+}
+
+/*
+ * 检查 [start, end) 是否整段由本模块创建、之后未被改过权限的匿名映射覆盖：
+ * 映射时加了 PROT_WRITE 供 UFFDIO_COPY 填充，MINOR 区域保持原权限，两者都算
+ */
+static int handback_vmas_ok(const UffdVmaSnapshot *vmas, uint64_t start, uint64_t end,
+                            int prot) {
+    /* 二分找到第一个 end > start 的 VMA */
+    int lo = 0, hi = vmas->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (vmas->entries[mid].end <= start) lo = mid + 1;
+        else hi = mid;
+    }
+    
+    uint64_t covered = start;
+    for (int i = lo; i < vmas->count && covered < end; i++) {
+        const UffdVma *v = &vmas->entries[i];
+        if (v->start > covered) return 0;
+        if (!v->anon || (v->prot != prot && v->prot != (prot | PROT_WRITE))) return 0;
+        covered = v->end;
+    }
+    return covered >= end;
+}
+
+int uffd_handback_range(int uffd, uint64_t start, uint64_t end, const char *file_path,
+                        uint64_t file_offset, int prot, const UffdVmaSnapshot *vmas,
+                        UffdHandbackStats *stats) {
+    size_t len = end - start;
+    size_t pages = len / PAGE_SIZE;
+    
+    if ((prot & PROT_WRITE) || !(prot & PROT_READ) || !handback_vmas_ok(vmas, start, end, prot)) {
+        if (stats) stats->kept++;
+        return -EBUSY;
+    }
+    
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        int err = errno;
+        if (fd >= 0) close(fd);
+        if (stats) stats->failed++;
+        return -err;
+    }
+    
+    /* 直接走系统调用：预加载器的 mmap hook 会把 BigCache 中的文件再次拦截 */
+    uint8_t *file_map = (uint8_t*)syscall(SYS_mmap, NULL, len, prot, MAP_PRIVATE, fd,
+                                          file_offset);
+    int err = errno;
+    close(fd);
+    if (file_map == MAP_FAILED) {
+        if (stats) stats->failed++;
+        return -err;
+    }
+    
+    /* 只比对已驻留（已安装）的页；文件末尾之后的页在原文件映射中会 SIGBUS */
+    unsigned char *vec = malloc(pages);
+    int ret = vec && mincore((void*)start, len, vec) == 0 ? 0 : -ENOMEM;
+    uint64_t resident = 0;
+    uint64_t file_pages = st.st_size > (off_t)file_offset ?
+        ((uint64_t)st.st_size - file_offset + PAGE_SIZE - 1) / PAGE_SIZE : 0;
+    for (size_t i = 0; ret == 0 && i < pages; i++) {
+        if (!(vec[i] & 1)) continue;
+        if (i >= file_pages ||
+            memcmp((void*)(start + i * PAGE_SIZE), file_map + i * PAGE_SIZE, PAGE_SIZE)) {
+            ret = -EBUSY;
+        }
+        resident++;
+    }
+    free(vec);
+    
+    if (ret == 0 && syscall(SYS_mremap, file_map, len, len, MREMAP_MAYMOVE | MREMAP_FIXED,
+                            start) == (long)MAP_FAILED) {
+        ret = -errno;
+    }
+    if (ret < 0) {
+        syscall(SYS_munmap, file_map, len);
+        if (stats) {
+            if (ret == -EBUSY) stats->kept++;
+            else stats->failed++;
+        }
+        return ret;
+    }
+    
+    struct uffdio_range range = { .start = start, .len = len };
+    ioctl(uffd, UFFDIO_WAKE, &range);
+    
+    if (stats) {
+        stats->regions++;
+        stats->pages += pages;
+        stats->anon_pages += resident;
+    }
+    return 0;
+}
+
+/*
+ * 持有 regions_lock 完成整轮换回：munmap / MAP_FIXED hook 的 unregister_range
+ * 会等到换回结束，不会出现 hook 已解除映射、这里又把文件映射放回去的情况
+ */
+int uffd_handler_handback(UffdHandler *handler, UffdHandbackStats *stats) {
+    if (!handler) return -EINVAL;
+    
+    double start = get_time_us();
+    MemoryRegion *freed = NULL;
+    int count = 0;
+    
+    pthread_mutex_lock(&handler->regions_lock);
+    UffdVmaSnapshot vmas;
+    if (uffd_vma_snapshot(&vmas) < 0) {
+        pthread_mutex_unlock(&handler->regions_lock);
+        return -ENOMEM;
+    }
+    
+    MemoryRegion **prev = &handler->regions;
+    while (*prev) {
+        MemoryRegion *r = *prev;
+        
+        /* MINOR 区域映射的是共享的 shadow 页，hugetlb 区域大小按大页取整，都保留 */
+        if (r->minor || r->fault_size != PAGE_SIZE) {
+            if (stats) stats->kept++;
+            prev = &r->next;
+            continue;
+        }
+        
+        if (uffd_handback_range(handler->uffd, (uint64_t)r->base,
+                                (uint64_t)r->base + r->size, r->file_path,
+                                r->file_offset_base, r->prot, &vmas, stats) < 0) {
+            prev = &r->next;
+            continue;
+        }
+        
+        /* 旧映射已被替换，UFFD 注册随之消失，不再 UFFDIO_UNREGISTER */
+        if (region_detach(handler, prev) < 0) {
+            LOG_ERROR("Out of memory unpublishing region 0x%lx, leaking it",
+                      (unsigned long)r->base);
+        } else {
+            r->next = freed;
+            freed = r;
+        }
+        count++;
+    }
+    pthread_mutex_unlock(&handler->regions_lock);
+    uffd_vma_snapshot_free(&vmas);
+    
+    while (freed) {
+        MemoryRegion *next = freed->next;
+        region_free(freed);
+        freed = next;
+    }
+    
+    if (stats) stats->ms += (get_time_us() - start) / 1000.0;
+    LOG_INFO("Handed back %d regions", count);
+    return count;
+}
+
 /* 统计信息 */
 void uffd_handler_get_stats(UffdHandler *handler, UffdStats *stats) {
     if (!handler || !stats) return;
     
     pthread_mutex_lock(&handler->stats_lock);
     memcpy(stats, &handler->stats, sizeof(UffdStats));
+    /* 运行中的线程私有统计为近似快照 */
+    for (int i = 0; i < handler->num_workers; i++) {
+        stats_merge(stats, &handler->workers[i].stats);
+    }
     pthread_mutex_unlock(&handler->stats_lock);
 }
 
@@ -629,6 +2796,9 @@ void uffd_handler_reset_stats(UffdHandler *handler) {
     
     pthread_mutex_lock(&handler->stats_lock);
     memset(&handler->stats, 0, sizeof(UffdStats));
+    for (int i = 0; i < handler->num_workers; i++) {
+        memset(&handler->workers[i].stats, 0, sizeof(UffdStats));
+    }
     pthread_mutex_unlock(&handler->stats_lock);
 }
 
@@ -644,6 +2814,36 @@ void uffd_handler_print_stats(UffdHandler *handler) {
     printf("Cache misses: %lu\n", (unsigned long)stats.cache_misses);
     printf("Zero fills: %lu\n", (unsigned long)stats.zero_fills);
     printf("Copy errors: %lu\n", (unsigned long)stats.copy_errors);
+    printf("Coalesced faults: %lu\n", (unsigned long)stats.coalesced_faults);
+    printf("Fault-around pages: %lu\n", (unsigned long)stats.prefetched_pages);
+    if (stats.minor_faults > 0) {
+        printf("Minor faults (UFFDIO_CONTINUE): %lu\n", (unsigned long)stats.minor_faults);
+    }
+    if (stats.populate_copies > 0) {
+        printf("Populated ahead: %lu pages in %lu copies (%lu raced, %lu yields)\n",
+               (unsigned long)stats.populated_pages,
+               (unsigned long)stats.populate_copies,
+               (unsigned long)stats.populate_races,
+               (unsigned long)stats.populate_yields);
+    }
+    
+    uint64_t served = stats.total_faults + stats.coalesced_faults;
+    if (served > 0) {
+        printf("Syscalls per fault: %.2f (poll %lu, read %lu, copy %lu, wake %lu, max batch %lu)\n",
+               (double)(stats.poll_calls + stats.read_calls + stats.copy_ioctls +
+                        stats.wake_ioctls) / served,
+               (unsigned long)stats.poll_calls, (unsigned long)stats.read_calls,
+               (unsigned long)stats.copy_ioctls, (unsigned long)stats.wake_ioctls,
+               (unsigned long)stats.max_batch);
+    }
+    
+    if (stats.fallback_faults > 0 || stats.fallback_errors > 0) {
+        printf("File fallback: %lu faults, %lu pages in %lu reads (%lu errors)\n",
+               (unsigned long)stats.fallback_faults,
+               (unsigned long)stats.fallback_pages,
+               (unsigned long)stats.fallback_reads,
+               (unsigned long)stats.fallback_errors);
+    }
     
     if (stats.total_faults > 0) {
         printf("Hit rate: %.2f%%\n", 
@@ -654,6 +2854,170 @@ void uffd_handler_print_stats(UffdHandler *handler) {
     printf("Max handle time: %.2f us\n", stats.max_handle_time_us);
     printf("Total handle time: %.2f ms\n", stats.total_handle_time_us / 1000);
     printf("===============================\n\n");
+    
+    if (stats.fallback_faults > 0) {
+        uffd_handler_print_file_misses(handler, 10);
+    }
+}
+
+static int compare_file_miss(const void *a, const void *b) {
+    const UffdFileMiss *x = (const UffdFileMiss*)a;
+    const UffdFileMiss *y = (const UffdFileMiss*)b;
+    return (x->faults < y->faults) - (x->faults > y->faults);
+}
+
+void uffd_handler_print_file_misses(UffdHandler *handler, int limit) {
+    if (!handler) return;
+    
+    pthread_mutex_lock(&handler->regions_lock);
+    
+    /* 已注销区域的累计值加上仍在注册的区域 */
+    int capacity = handler->num_file_misses + handler->num_regions;
+    UffdFileMiss *all = calloc(capacity > 0 ? capacity : 1, sizeof(UffdFileMiss));
+    if (!all) {
+        pthread_mutex_unlock(&handler->regions_lock);
+        return;
+    }
+    
+    int count = handler->num_file_misses;
+    if (count > 0) {
+        memcpy(all, handler->file_misses, count * sizeof(UffdFileMiss));
+    }
+    
+    for (MemoryRegion *region = handler->regions; region; region = region->next) {
+        uint64_t faults = __atomic_load_n(&region->miss_faults, __ATOMIC_RELAXED);
+        if (faults == 0) continue;
+        
+        int i = 0;
+        while (i < count && strcmp(all[i].file_path, region->file_path) != 0) i++;
+        if (i == count) {
+            all[count].file_path = region->file_path;
+            count++;
+        }
+        all[i].faults += faults;
+        all[i].pages += __atomic_load_n(&region->miss_pages, __ATOMIC_RELAXED);
+    }
+    
+    qsort(all, count, sizeof(UffdFileMiss), compare_file_miss);
+    
+    printf("=== Misses By File (served from original file) ===\n");
+    printf("%10s %10s  %s\n", "faults", "pages", "file");
+    for (int i = 0; i < count && (limit <= 0 || i < limit); i++) {
+        printf("%10lu %10lu  %s\n", (unsigned long)all[i].faults,
+               (unsigned long)all[i].pages, all[i].file_path);
+    }
+    if (limit > 0 && count > limit) {
+        printf("... %d more files\n", count - limit);
+    }
+    printf("\n");
+    
+    pthread_mutex_unlock(&handler->regions_lock);
+    free(all);
+}
+
+static int compare_event(const void *a, const void *b) {
+    const UffdFaultEvent *x = a;
+    const UffdFaultEvent *y = b;
+    if (x->timestamp_ns != y->timestamp_ns) {
+        return (x->timestamp_ns > y->timestamp_ns) - (x->timestamp_ns < y->timestamp_ns);
+    }
+    return (int)x->worker - (int)y->worker;
+}
+
+/*
+ * 导出缺页事件
+ * 运行中也可调用：先读 event_head 再拷贝环，拷贝后再读一次 event_head，
+ * 期间可能已被写者覆盖的最旧记录丢弃
+ */
+long uffd_handler_dump_events(UffdHandler *handler, const char *path) {
+    if (!handler || !path) return -EINVAL;
+    
+    UffdEventLogHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = UFFD_EVENT_MAGIC;
+    header.version = UFFD_EVENT_VERSION;
+    header.record_size = sizeof(UffdFaultEvent);
+    
+    pthread_mutex_lock(&handler->stats_lock);
+    
+    size_t total = 0;
+    for (int i = 0; i < handler->num_workers; i++) {
+        if (handler->workers[i].events) {
+            total += handler->workers[i].event_mask + 1;
+        }
+    }
+    
+    UffdFaultEvent *events = total ? malloc(total * sizeof(UffdFaultEvent)) : NULL;
+    if (total && !events) {
+        pthread_mutex_unlock(&handler->stats_lock);
+        return -ENOMEM;
+    }
+    
+    /* 写者正在写的槽位是 head 对应的位置，运行中多留一个余量 */
+    uint64_t guard = handler->running ? 1 : 0;
+    size_t count = 0;
+    
+    for (int i = 0; i < handler->num_workers; i++) {
+        UffdWorker *w = &handler->workers[i];
+        if (!w->events) continue;
+        
+        uint64_t cap = w->event_mask + 1;
+        uint64_t head = __atomic_load_n(&w->event_head, __ATOMIC_ACQUIRE);
+        uint64_t first = head > cap ? head - cap : 0;
+        
+        UffdFaultEvent *out = events + count;
+        for (uint64_t k = first; k < head; k++) {
+            out[k - first] = w->events[k & w->event_mask];
+        }
+        
+        uint64_t now = __atomic_load_n(&w->event_head, __ATOMIC_ACQUIRE);
+        uint64_t valid = now + guard > cap ? now + guard - cap : 0;
+        if (valid < first) valid = first;
+        if (valid > head) valid = head;
+        
+        memmove(out, out + (valid - first), (head - valid) * sizeof(UffdFaultEvent));
+        count += head - valid;
+        header.dropped_events += valid;
+        header.num_threads++;
+    }
+    
+    pthread_mutex_unlock(&handler->stats_lock);
+    
+    qsort(events, count, sizeof(UffdFaultEvent), compare_event);
+    header.num_events = count;
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header.realtime_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    header.monotonic_ns = get_time_ns();
+    
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        int err = errno;
+        free(events);
+        return -err;
+    }
+    
+    /* 文件表只增不减，事件引用的序号都在表内 */
+    pthread_mutex_lock(&handler->regions_lock);
+    header.num_files = handler->num_event_files;
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (int i = 0; ok && i < handler->num_event_files; i++) {
+        int32_t file_id = handler->event_files[i].file_id;
+        uint32_t path_len = strlen(handler->event_files[i].file_path);
+        ok = fwrite(&file_id, sizeof(file_id), 1, fp) == 1 &&
+             fwrite(&path_len, sizeof(path_len), 1, fp) == 1 &&
+             fwrite(handler->event_files[i].file_path, 1, path_len, fp) == path_len;
+    }
+    pthread_mutex_unlock(&handler->regions_lock);
+    
+    if (ok && count > 0) {
+        ok = fwrite(events, sizeof(UffdFaultEvent), count, fp) == count;
+    }
+    if (fclose(fp) != 0) ok = 0;
+    free(events);
+    
+    return ok ? (long)count : -EIO;
 }
 
 /* 调试：打印所有注册的区域 */
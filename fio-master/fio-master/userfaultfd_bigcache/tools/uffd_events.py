@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+缺页事件日志转换工具
+
+读取 UFFD 处理器停止时写出的缺页事件文件（BIGCACHE_EVENT_LOG），
+打印按服务方式/文件的延迟汇总，并可转换为：
+  - CSV：每个缺页一行，包含全部字段
+  - read_sequence.csv：visit_io 脚本使用的读取序列格式
+    （Order, Type, Filename, 空列, Offset, Size, Timestamp, Process）
+
+文件格式见 include/uffd_handler.h 中的 UffdEventLogHeader / UffdFaultEvent。
+"""
+
+import csv
+import struct
+import sys
+from collections import defaultdict
+
+PAGE_SIZE = 4096
+UFFD_EVENT_MAGIC = 0x56454655  # "UFEV"
+UFFD_EVENT_VERSION = 1
+
+# UffdEventLogHeader / UffdFaultEvent（packed，小端）
+HEADER_FORMAT = '<IHHIIQQQQ'
+EVENT_FORMAT = '<QQQIiIHBB'
+
+KIND_NAMES = ['hit', 'minor', 'fallback', 'zero', 'coalesced', 'error']
+
+
+def load_events(path):
+    """读取事件文件，返回 (header, files, events)"""
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    (magic, version, record_size, num_files, num_threads,
+     num_events, dropped, monotonic_ns, realtime_ns) = struct.unpack_from(HEADER_FORMAT, data, 0)
+
+    if magic != UFFD_EVENT_MAGIC:
+        raise ValueError(f"{path}: bad magic 0x{magic:08x}")
+    if version != UFFD_EVENT_VERSION or record_size != struct.calcsize(EVENT_FORMAT):
+        raise ValueError(f"{path}: unsupported version {version} / record size {record_size}")
+
+    header = {
+        'num_threads': num_threads,
+        'num_events': num_events,
+        'dropped': dropped,
+        'monotonic_ns': monotonic_ns,
+        'realtime_ns': realtime_ns,
+    }
+
+    # 文件表
+    pos = header_size
+    files = []
+    for _ in range(num_files):
+        file_id, path_len = struct.unpack_from('<iI', data, pos)
+        pos += 8
+        files.append((data[pos:pos + path_len].decode('utf-8', 'replace'), file_id))
+        pos += path_len
+
+    events = []
+    for rec in struct.iter_unpack(EVENT_FORMAT, data[pos:pos + num_events * record_size]):
+        ts, addr, offset, service_ns, file_idx, tid, pages, kind, worker = rec
+        events.append({
+            'timestamp_ns': ts,
+            'address': addr,
+            'file_offset': offset,
+            'service_ns': service_ns,
+            'file': files[file_idx][0] if 0 <= file_idx < len(files) else '',
+            'tid': tid,
+            'pages': pages,
+            'kind': KIND_NAMES[kind] if kind < len(KIND_NAMES) else str(kind),
+            'worker': worker,
+        })
+
+    return header, files, events
+
+
+def percentile(sorted_values, p):
+    """已排序列表的百分位数"""
+    if not sorted_values:
+        return 0
+    idx = min(len(sorted_values) - 1, int(len(sorted_values) * p / 100))
+    return sorted_values[idx]
+
+
+def print_summary(header, files, events, top):
+    """打印按服务方式和按文件的延迟汇总"""
+    print(f"Events: {len(events)} ({header['dropped']} dropped), "
+          f"{header['num_threads']} handler threads, {len(files)} files")
+    if not events:
+        return
+
+    span_ms = (events[-1]['timestamp_ns'] - events[0]['timestamp_ns']) / 1e6
+    print(f"Time span: {span_ms:.2f} ms\n")
+
+    by_kind = defaultdict(list)
+    for e in events:
+        by_kind[e['kind']].append(e['service_ns'] / 1000.0)
+
+    print(f"{'kind':<10} {'faults':>8} {'p50(us)':>10} {'p99(us)':>10} {'max(us)':>10}")
+    for kind in KIND_NAMES:
+        values = sorted(by_kind.get(kind, []))
+        if not values:
+            continue
+        print(f"{kind:<10} {len(values):>8} {percentile(values, 50):>10.1f} "
+              f"{percentile(values, 99):>10.1f} {values[-1]:>10.1f}")
+
+    by_file = defaultdict(lambda: [0, 0, 0.0])
+    for e in events:
+        stat = by_file[e['file'] or '(unknown)']
+        stat[0] += 1
+        if e['kind'] == 'fallback':
+            stat[1] += 1
+        stat[2] += e['service_ns'] / 1000.0
+
+    print(f"\nTop {top} files by total service time:")
+    print(f"{'faults':>8} {'fallback':>8} {'total(ms)':>10}  file")
+    ranked = sorted(by_file.items(), key=lambda kv: kv[1][2], reverse=True)
+    for path, (faults, fallback, total_us) in ranked[:top]:
+        print(f"{faults:>8} {fallback:>8} {total_us / 1000.0:>10.2f}  {path}")
+
+    print(f"\nTop {top} slowest faults:")
+    for e in sorted(events, key=lambda e: e['service_ns'], reverse=True)[:top]:
+        t_ms = (e['timestamp_ns'] - events[0]['timestamp_ns']) / 1e6
+        print(f"  +{t_ms:9.3f} ms  {e['service_ns'] / 1000.0:9.1f} us  {e['kind']:<9} "
+              f"{e['file']}+0x{e['file_offset']:x} (tid {e['tid']})")
+
+
+def write_csv(events, output_path):
+    """每个缺页一行"""
+    start = events[0]['timestamp_ns'] if events else 0
+    fields = ['timestamp_ns', 'time_ms', 'kind', 'file', 'file_offset', 'address',
+              'pages', 'service_ns', 'tid', 'worker']
+
+    with open(output_path, 'w', encoding='utf-8', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        for e in events:
+            row = dict(e)
+            row['time_ms'] = f"{(e['timestamp_ns'] - start) / 1e6:.6f}"
+            row['address'] = f"0x{e['address']:x}"
+            writer.writerow(row)
+
+    print(f"CSV written: {output_path} ({len(events)} rows)")
+
+
+def write_read_sequence(events, output_path):
+    """
+    转换为 read_sequence.csv
+    只保留实际安装了页面的缺页（合并掉的和随段满足的缺页不产生读取），
+    Size 为本次安装的字节数，Timestamp 为 CLOCK_MONOTONIC 秒，与 ftrace 时间戳同一时钟
+    """
+    count = 0
+    with open(output_path, 'w', encoding='utf-8', newline='') as f:
+        writer = csv.writer(f, quoting=csv.QUOTE_ALL)
+        writer.writerow(['Order', 'Type', 'Filename', '', 'Offset', 'Size', 'Timestamp', 'Process'])
+        for e in events:
+            if e['pages'] == 0 or not e['file']:
+                continue
+            count += 1
+            writer.writerow([count, f"uffd_{e['kind']}", e['file'], '',
+                             e['file_offset'], e['pages'] * PAGE_SIZE,
+                             f"{e['timestamp_ns'] / 1e9:.6f}", f"app-{e['tid']}"])
+
+    print(f"read_sequence written: {output_path} ({count} reads)")
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(
+        description='Summarize and convert UFFD fault event logs'
+    )
+    parser.add_argument('input', help='Fault event file (BIGCACHE_EVENT_LOG)')
+    parser.add_argument('--csv', help='Write all events as CSV')
+    parser.add_argument('--read-sequence',
+                       help='Write installs in visit_io read_sequence.csv format')
+    parser.add_argument('--top', type=int, default=10,
+                       help='Rows in the per-file and slowest-fault tables')
+
+    args = parser.parse_args()
+
+    try:
+        header, files, events = load_events(args.input)
+    except (OSError, ValueError, struct.error) as e:
+        print(f"Error: {e}")
+        return 1
+
+    print_summary(header, files, events, args.top)
+
+    if args.csv:
+        write_csv(events, args.csv)
+    if args.read_sequence:
+        write_read_sequence(events, args.read_sequence)
+
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())